@@ -0,0 +1,319 @@
+// dump1090, a Mode S messages decoder for RTLSDR devices.
+//
+// Copyright (C) 2012 by Salvatore Sanfilippo <antirez@gmail.com>
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//  *  Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//  *  Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include "dump1090.h"
+#ifndef _WIN32
+    #include <sys/mman.h>
+#endif
+//
+// ============================= Frame archive ==============================
+//
+// With --archive, every frame useModesMessage() passes on is also appended
+// to the current segment in Modes.archive_dir (see archive.h for the
+// format). Segments are created at their full size and mapped, so adding a
+// frame costs a 40 byte copy and a few bit sets, done with Modes.data_mutex
+// held like the rest of useModesMessage(). The space is reserved up front,
+// so a full disk shows up when a segment is started rather than as a SIGBUS
+// part way through one.
+//
+// Each run starts a new segment, and a segment is shrunk to the records in
+// it when it is finished, so nothing is ever rewritten. A segment left open
+// by a crash is still readable: its header is kept up to date as it goes.
+//
+// The archive needs mmap(), so it isn't available in the Windows build.
+//
+#ifndef _WIN32
+//
+// Create, size and map a new segment. Returns 0, or -1 if it couldn't be.
+//
+static int archiveStartSegment(void) {
+    struct archiveHeader *hdr;
+    char path[1024];
+    size_t size = (size_t) Modes.archive_segment_mb * 1024 * 1024;
+    uint64_t now = mstime();
+    void *map;
+    int fd, err;
+
+    snprintf(path, sizeof(path), "%s/frames-%013llu.seg", Modes.archive_dir, (unsigned long long) now);
+    if ((fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0644)) < 0) {
+        fprintf(stderr, "Archive: can't create %s: %s\n", path, strerror(errno));
+        return (-1);
+    }
+    if ((err = posix_fallocate(fd, 0, size)) != 0) {
+        fprintf(stderr, "Archive: can't make room for %s: %s\n", path, strerror(err));
+        close(fd);
+        unlink(path);
+        return (-1);
+    }
+    if ((map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        fprintf(stderr, "Archive: can't map %s: %s\n", path, strerror(errno));
+        close(fd);
+        unlink(path);
+        return (-1);
+    }
+
+    hdr = (struct archiveHeader *) map;
+    memcpy(hdr->magic, ARCHIVE_MAGIC, sizeof(hdr->magic));
+    hdr->version     = ARCHIVE_VERSION;
+    hdr->header_size = ARCHIVE_HEADER_SIZE;
+    hdr->record_size = sizeof(struct archiveRecord);
+    hdr->max_records = (size - ARCHIVE_HEADER_SIZE) / sizeof(struct archiveRecord);
+    hdr->index_every = (uint32_t) ((hdr->max_records + ARCHIVE_INDEX_SLOTS - 1) / ARCHIVE_INDEX_SLOTS);
+
+    Modes.archive_fd      = fd;
+    Modes.archive_hdr     = hdr;
+    Modes.archive_records = (struct archiveRecord *) ((char *) map + ARCHIVE_HEADER_SIZE);
+    Modes.archive_size    = size;
+    Modes.stat_archive_segments++;
+    return (0);
+}
+//
+//=========================================================================
+//
+// Mark the current segment finished, and give back the space it didn't use
+//
+static void archiveFinishSegment(void) {
+    struct archiveHeader *hdr = Modes.archive_hdr;
+    off_t used;
+
+    if (hdr == NULL) {return;}
+
+    hdr->closed = 1;
+    used = ARCHIVE_HEADER_SIZE + (off_t) (hdr->nrecords * sizeof(struct archiveRecord));
+    munmap((void *) hdr, Modes.archive_size);
+    if (ftruncate(Modes.archive_fd, used) < 0) {
+        fprintf(stderr, "Archive: can't truncate segment: %s\n", strerror(errno));
+    }
+    close(Modes.archive_fd);
+
+    Modes.archive_hdr     = NULL;
+    Modes.archive_records = NULL;
+}
+//
+//=========================================================================
+//
+void archiveInit(void) {
+    if (Modes.archive_dir == NULL) {return;}
+
+    if ((mkdir(Modes.archive_dir, 0755) < 0) && (errno != EEXIST)) {
+        fprintf(stderr, "Archive: can't create %s: %s\n", Modes.archive_dir, strerror(errno));
+        exit(1);
+    }
+    if (archiveStartSegment() < 0) {
+        exit(1);
+    }
+}
+//
+//=========================================================================
+//
+void archiveExit(void) {
+    archiveFinishSegment();
+}
+//
+//=========================================================================
+//
+// Append mm to the archive. Called with Modes.data_mutex held. If a new
+// segment can't be started the archive is turned off, rather than stopping
+// the receiver.
+//
+void archiveMessage(struct modesMessage *mm) {
+    struct archiveHeader *hdr = Modes.archive_hdr;
+    struct archiveRecord *r;
+    uint64_t now, n;
+    int k;
+
+    if (hdr == NULL) {return;}
+
+    if (hdr->nrecords == hdr->max_records) {
+        archiveFinishSegment();
+        if (archiveStartSegment() < 0) {
+            fprintf(stderr, "Archive: stopped\n");
+            Modes.archive_dir = NULL;
+            return;
+        }
+        hdr = Modes.archive_hdr;
+    }
+
+    // Keep the times in order, even if the clock is stepped back
+    now = mstime();
+    if (now < Modes.archive_last_time) {now = Modes.archive_last_time;}
+    Modes.archive_last_time = now;
+
+    n = hdr->nrecords;
+    r = &Modes.archive_records[n];
+    r->time      = now;
+    r->timestamp = mm->timestampMsg;
+    r->addr      = mm->addr;
+    r->signal    = mm->signalLevel;
+    r->len       = (unsigned char) (mm->msgbits / 8);
+    r->flags     = (mm->crcok         ? ARCHIVE_CRCOK     : 0)
+                 | (mm->correctedbits ? ARCHIVE_CORRECTED : 0)
+                 | (mm->remote        ? ARCHIVE_REMOTE    : 0);
+    r->rx        = (unsigned char) mm->rx;
+    memcpy(r->msg, mm->msg, r->len);
+    memset(r->msg + r->len, 0, sizeof(r->msg) - r->len);
+    r->pad[0]    = r->pad[1] = 0;
+
+    if ((n % hdr->index_every) == 0) {
+        hdr->index[hdr->nindex++] = now;
+    }
+    for (k = 0; k < ARCHIVE_BLOOM_HASHES; k++) {
+        uint32_t bit = archiveBloomBit(mm->addr, k);
+        hdr->bloom[bit >> 3] |= (unsigned char) (1 << (bit & 7));
+    }
+    if (n == 0) {hdr->first_time = now;}
+    hdr->last_time = now;
+
+    // Only now let readers see the record
+    __sync_synchronize();
+    hdr->nrecords = n + 1;
+    Modes.stat_archived++;
+}
+//
+//=========================================================================
+//
+// Map the segment at path for reading. Returns 0, or -1 if it can't be read
+// or isn't a segment.
+//
+int archiveOpenSegment(struct archiveSegment *seg, const char *path) {
+    struct archiveHeader *hdr;
+    struct stat st;
+    uint64_t room;
+    void *map;
+    int fd;
+
+    memset(seg, 0, sizeof(*seg));
+    if ((fd = open(path, O_RDONLY)) < 0) {return (-1);}
+    if ((fstat(fd, &st) < 0) || (st.st_size < ARCHIVE_HEADER_SIZE)) {
+        close(fd);
+        return (-1);
+    }
+    map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {return (-1);}
+
+    hdr = (struct archiveHeader *) map;
+    if ( (memcmp(hdr->magic, ARCHIVE_MAGIC, sizeof(hdr->magic)))
+      || (hdr->version     != ARCHIVE_VERSION)
+      || (hdr->header_size != ARCHIVE_HEADER_SIZE)
+      || (hdr->record_size != sizeof(struct archiveRecord)) ) {
+        munmap(map, (size_t) st.st_size);
+        return (-1);
+    }
+
+    // A segment that's still being written is read as far as it had got
+    room = (st.st_size - ARCHIVE_HEADER_SIZE) / sizeof(struct archiveRecord);
+    seg->hdr      = hdr;
+    seg->records  = (struct archiveRecord *) ((char *) map + ARCHIVE_HEADER_SIZE);
+    seg->nrecords = (hdr->nrecords < room) ? hdr->nrecords : room;
+    seg->size     = (size_t) st.st_size;
+    madvise(map, seg->size, MADV_SEQUENTIAL);
+    return (0);
+}
+//
+//=========================================================================
+//
+void archiveCloseSegment(struct archiveSegment *seg) {
+    if (seg->hdr) {munmap((void *) seg->hdr, seg->size);}
+    memset(seg, 0, sizeof(*seg));
+}
+//
+//=========================================================================
+//
+// Return the first record a scan for records at or after time need look at:
+// the one at the last time index entry before time.
+//
+uint64_t archiveSeek(struct archiveSegment *seg, uint64_t time) {
+    struct archiveHeader *hdr = seg->hdr;
+    uint32_t lo = 0, hi = hdr->nindex;
+    uint64_t first;
+
+    if (hi > ARCHIVE_INDEX_SLOTS) {hi = ARCHIVE_INDEX_SLOTS;}
+
+    // Find the first entry at or after time. The one before it is before time.
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (hdr->index[mid] < time) {lo = mid + 1;}
+        else                        {hi = mid;}
+    }
+    first = (lo) ? ((uint64_t) (lo - 1) * hdr->index_every) : 0;
+    return ((first < seg->nrecords) ? first : seg->nrecords);
+}
+#else
+void archiveInit(void) {
+    if (Modes.archive_dir) {
+        fprintf(stderr, "The frame archive isn't available on Windows\n");
+        exit(1);
+    }
+}
+void archiveExit(void) {}
+void archiveMessage(struct modesMessage *mm) {MODES_NOTUSED(mm);}
+int  archiveOpenSegment(struct archiveSegment *seg, const char *path) {
+    MODES_NOTUSED(path);
+    memset(seg, 0, sizeof(*seg));
+    return (-1);
+}
+void archiveCloseSegment(struct archiveSegment *seg) {MODES_NOTUSED(seg);}
+uint64_t archiveSeek(struct archiveSegment *seg, uint64_t time) {
+    MODES_NOTUSED(seg); MODES_NOTUSED(time);
+    return (0);
+}
+#endif
+//
+//=========================================================================
+//
+// Bit k of the bloom filter for ICAO address addr. Shared by the writer and
+// the readers, so it mustn't change without changing ARCHIVE_VERSION.
+//
+uint32_t archiveBloomBit(uint32_t addr, int k) {
+    uint32_t h = (addr ^ (0x9E3779B9u * (uint32_t) (k + 1))) * 0x85EBCA6Bu;
+
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+    return (h & ((ARCHIVE_BLOOM_BYTES * 8) - 1));
+}
+//
+//=========================================================================
+//
+// Returns 0 if the segment has no frames from addr, 1 if it may have
+//
+int archiveBloomMayHave(const struct archiveHeader *hdr, uint32_t addr) {
+    int k;
+
+    for (k = 0; k < ARCHIVE_BLOOM_HASHES; k++) {
+        uint32_t bit = archiveBloomBit(addr, k);
+        if (!(hdr->bloom[bit >> 3] & (1 << (bit & 7)))) {return (0);}
+    }
+    return (1);
+}
+//
+// =============================== Archive end =============================
+//
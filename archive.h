@@ -0,0 +1,125 @@
+// dump1090, a Mode S messages decoder for RTLSDR devices.
+//
+// Copyright (C) 2012 by Salvatore Sanfilippo <antirez@gmail.com>
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//  *  Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//  *  Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#ifndef __ARCHIVE_H
+#define __ARCHIVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// The frame archive. dump1090 --archive <dir> appends every good frame it
+// decodes to a series of segment files in dir, which query1090 searches.
+//
+// A segment is one file, named frames-<wall clock ms it was started>.seg so
+// the names sort in time order. It starts with a struct archiveHeader, padded
+// to ARCHIVE_HEADER_SIZE, followed by fixed size struct archiveRecord's in
+// the order they were received. The writer maps the whole file, so a record
+// is a memcpy, and nrecords is only advanced once the record is in place:
+// a reader (or a restart after a crash) never sees a half written record.
+//
+// Two things let a query skip most of the data:
+//
+//  *  index[i] is the wall clock time of record i * index_every. The times
+//     never go backwards within a segment, so a binary search of the index
+//     finds where a time range starts, and the scan can stop at its end.
+//
+//  *  bloom is a bloom filter of the ICAO addresses in the segment, so a
+//     segment that can't hold the aircraft wanted isn't read at all.
+//
+// Everything is in the byte order of the machine that wrote it.
+//
+#define ARCHIVE_MAGIC         "MODESARC"
+#define ARCHIVE_VERSION       1
+#define ARCHIVE_HEADER_SIZE   65536      // Header plus padding, so records start page aligned
+#define ARCHIVE_INDEX_SLOTS   2048       // Time index entries in a segment
+#define ARCHIVE_BLOOM_BYTES   32768      // Size of the ICAO bloom filter (256K bits)
+#define ARCHIVE_BLOOM_HASHES  3          // Bits set per address
+
+#define ARCHIVE_SEGMENT_MB    64         // Default segment size
+#define ARCHIVE_SEGMENT_MB_MAX 1024
+
+#define ARCHIVE_CRCOK         1          // archiveRecord.flags
+#define ARCHIVE_CORRECTED     2          // Bits were corrected, msg[] is after correction
+#define ARCHIVE_REMOTE        4          // Came from the network rather than a receiver
+
+struct archiveRecord {
+    uint64_t      time;                  // Wall clock time received, ms since 1970
+    uint64_t      timestamp;             // 12MHz receiver clock, as in Beast output
+    uint32_t      addr;                  // ICAO address
+    unsigned char signal;                // Signal level
+    unsigned char len;                   // Bytes used in msg, 2 (Mode A/C), 7 or 14
+    unsigned char flags;                 // ARCHIVE_xxx
+    unsigned char rx;                    // Receiver that demodulated it
+    unsigned char msg[14];
+    unsigned char pad[2];
+};                                       // 40 bytes
+
+struct archiveHeader {
+    char          magic[8];              // ARCHIVE_MAGIC
+    uint32_t      version;               // ARCHIVE_VERSION
+    uint32_t      header_size;           // Offset of the first record
+    uint32_t      record_size;           // sizeof(struct archiveRecord)
+    uint32_t      index_every;           // Records per time index entry
+    uint64_t      max_records;           // Records the segment has room for
+    uint64_t      nrecords;              // Records written so far
+    uint64_t      first_time;            // Wall clock time of the first record, 0 if none
+    uint64_t      last_time;             // and of the last
+    uint32_t      nindex;                // Entries used in index[]
+    uint32_t      closed;                // Set once the writer has finished with it
+    uint64_t      index[ARCHIVE_INDEX_SLOTS];
+    unsigned char bloom[ARCHIVE_BLOOM_BYTES];
+};
+
+//
+// A segment mapped for reading, by archiveOpenSegment(). records holds
+// nrecords records, as many as were complete when it was opened.
+//
+struct archiveSegment {
+    struct archiveHeader *hdr;
+    struct archiveRecord *records;
+    uint64_t              nrecords;
+    size_t                size;      // Of the mapping
+};
+
+int      archiveOpenSegment (struct archiveSegment *seg, const char *path);
+void     archiveCloseSegment(struct archiveSegment *seg);
+uint64_t archiveSeek        (struct archiveSegment *seg, uint64_t time);
+uint32_t archiveBloomBit    (uint32_t addr, int k);
+int      archiveBloomMayHave(const struct archiveHeader *hdr, uint32_t addr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ARCHIVE_H
@@ -0,0 +1,319 @@
+// dump1090, a Mode S messages decoder for RTLSDR devices.
+//
+// Copyright (C) 2012 by Salvatore Sanfilippo <antirez@gmail.com>
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//  *  Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//  *  Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include "dump1090.h"
+//
+// =========================== Tracker checkpoint ============================
+//
+// With --checkpoint <file> the state the decoder builds up as it runs is
+// saved every Modes.checkpoint_interval seconds, and at exit, and loaded
+// again at startup. That is the tracked aircraft (with their last CPR
+// frames and positions, squawks and flight numbers), the cache of recently
+// seen ICAO addresses that address/parity replies are checked against, and
+// the DF11 interrogator codes heard. Without it a restarted dump1090 throws
+// away the replies of every aircraft until it hears it squitter again, and
+// shows no positions until it has a fresh even/odd pair for each aircraft.
+//
+// The state is copied into a buffer with Modes.data_mutex held, and written
+// after it's released, so the demodulators only wait for the copy. The file
+// is written under a temporary name and renamed over the old one, so a
+// crash while saving leaves the last checkpoint intact.
+//
+// Everything saved keeps the wall clock time it was last heard, so on loading
+// it ages just as it would have if dump1090 had kept running: aircraft not
+// heard for Modes.interactive_delete_ttl seconds are dropped, and cached
+// addresses expire after MODES_ICAO_CACHE_TTL. A position more than
+// MODES_CHECKPOINT_REL_TTL seconds old isn't used as the reference for
+// relative CPR decoding, as the aircraft may have gone too far from it.
+//
+#define CHECKPOINT_MAGIC   "MODESCKP"
+#define CHECKPOINT_VERSION 1
+
+struct checkpointHeader {
+    char     magic[8];                 // CHECKPOINT_MAGIC
+    uint32_t version;                  // CHECKPOINT_VERSION
+    uint32_t aircraft_size;            // sizeof(struct checkpointAircraft)
+    uint32_t naircraft;                // Aircraft that follow the header
+    uint32_t cache_len;                // MODES_ICAO_CACHE_LEN, then the cache
+    uint32_t iid_words;                // Size of df11_iid_seen[], then it
+    uint32_t checksum;                 // Of everything after the header
+    uint64_t saved;                    // Wall clock time saved, seconds
+};
+
+// The part of struct aircraft worth keeping. The registry details are looked
+// up again when it's loaded.
+struct checkpointAircraft {
+    uint32_t      addr;
+    int32_t       altitude;
+    int32_t       speed;
+    int32_t       track;
+    int32_t       vert_rate;
+    int32_t       modeA;
+    int32_t       modeC;
+    int32_t       bFlags;
+    int32_t       odd_cprlat;
+    int32_t       odd_cprlon;
+    int32_t       even_cprlat;
+    int32_t       even_cprlon;
+    uint64_t      odd_cprtime;         // Wall clock, ms
+    uint64_t      even_cprtime;
+    int64_t       seen;                // Wall clock, seconds
+    int64_t       seenLatLon;
+    double        lat, lon;
+    uint32_t      messages;
+    char          flight[16];
+    unsigned char signalLevel[8];
+    unsigned char pad[4];
+};
+//
+//=========================================================================
+//
+static uint32_t checkpointChecksum(const unsigned char *p, size_t len) {
+    uint32_t h = 2166136261u;
+
+    while (len--) {h = (h ^ *p++) * 16777619u;}
+    return (h);
+}
+//
+//=========================================================================
+//
+// Write the current state to Modes.checkpoint_file
+//
+void checkpointSave(void) {
+    struct checkpointHeader   *hdr;
+    struct checkpointAircraft *ca;
+    struct aircraft *a;
+    unsigned char *buf, *p;
+    char tmp[1024];
+    size_t size;
+    FILE *f;
+    int n = 0, ok;
+
+    if (Modes.checkpoint_file == NULL) {return;}
+
+    pthread_mutex_lock(&Modes.data_mutex);
+
+    for (a = Modes.aircrafts; a; a = a->next) {n++;}
+    size = sizeof(*hdr) + (n * sizeof(*ca))
+         + (sizeof(uint32_t) * MODES_ICAO_CACHE_LEN * 2) + sizeof(Modes.df11_iid_seen);
+    if ((buf = (unsigned char *) calloc(1, size)) == NULL) {
+        pthread_mutex_unlock(&Modes.data_mutex);
+        fprintf(stderr, "Out of memory saving checkpoint\n");
+        return;
+    }
+
+    // Mode A/C replies aren't worth keeping, they're matched up again in
+    // a moment
+    hdr = (struct checkpointHeader *) buf;
+    ca  = (struct checkpointAircraft *) (hdr + 1);
+    for (a = Modes.aircrafts; a; a = a->next) {
+        if (a->modeACflags & MODEAC_MSG_FLAG) continue;
+        ca->addr         = a->addr;
+        ca->altitude     = a->altitude;
+        ca->speed        = a->speed;
+        ca->track        = a->track;
+        ca->vert_rate    = a->vert_rate;
+        ca->modeA        = a->modeA;
+        ca->modeC        = a->modeC;
+        ca->bFlags       = a->bFlags;
+        ca->odd_cprlat   = a->odd_cprlat;
+        ca->odd_cprlon   = a->odd_cprlon;
+        ca->even_cprlat  = a->even_cprlat;
+        ca->even_cprlon  = a->even_cprlon;
+        ca->odd_cprtime  = a->odd_cprtime;
+        ca->even_cprtime = a->even_cprtime;
+        ca->seen         = a->seen;
+        ca->seenLatLon   = a->seenLatLon;
+        ca->lat          = a->lat;
+        ca->lon          = a->lon;
+        ca->messages     = (uint32_t) a->messages;
+        memcpy(ca->flight,      a->flight,      sizeof(ca->flight));
+        memcpy(ca->signalLevel, a->signalLevel, sizeof(ca->signalLevel));
+        ca++;
+        hdr->naircraft++;
+    }
+    p = (unsigned char *) ca;
+    memcpy(p, Modes.icao_cache, sizeof(uint32_t) * MODES_ICAO_CACHE_LEN * 2);
+    p += sizeof(uint32_t) * MODES_ICAO_CACHE_LEN * 2;
+    memcpy(p, Modes.df11_iid_seen, sizeof(Modes.df11_iid_seen));
+    p += sizeof(Modes.df11_iid_seen);
+
+    pthread_mutex_unlock(&Modes.data_mutex);
+
+    memcpy(hdr->magic, CHECKPOINT_MAGIC, sizeof(hdr->magic));
+    hdr->version       = CHECKPOINT_VERSION;
+    hdr->aircraft_size = sizeof(*ca);
+    hdr->cache_len     = MODES_ICAO_CACHE_LEN;
+    hdr->iid_words     = sizeof(Modes.df11_iid_seen) / sizeof(uint32_t);
+    hdr->saved         = (uint64_t) time(NULL);
+    size               = p - buf;
+    hdr->checksum      = checkpointChecksum((unsigned char *) (hdr + 1), size - sizeof(*hdr));
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", Modes.checkpoint_file);
+    if ((f = fopen(tmp, "wb")) == NULL) {
+        fprintf(stderr, "Can't write checkpoint %s: %s\n", tmp, strerror(errno));
+        free(buf);
+        return;
+    }
+    ok = (fwrite(buf, 1, size, f) == size) && (fflush(f) == 0);
+#ifndef _WIN32
+    ok = ok && (fsync(fileno(f)) == 0);
+#endif
+    ok = (fclose(f) == 0) && ok;
+    free(buf);
+
+#ifdef _WIN32
+    remove(Modes.checkpoint_file); // rename() won't replace a file on Windows
+#endif
+    if ((!ok) || (rename(tmp, Modes.checkpoint_file) < 0)) {
+        fprintf(stderr, "Can't write checkpoint %s: %s\n", Modes.checkpoint_file, strerror(errno));
+        remove(tmp);
+    }
+}
+//
+//=========================================================================
+//
+// Called from backgroundTasks(), to save the state every
+// Modes.checkpoint_interval seconds
+//
+void checkpointCheck(void) {
+    time_t now;
+
+    if ((Modes.checkpoint_file == NULL) || (Modes.checkpoint_interval <= 0)) return;
+
+    now = time(NULL);
+    if (now < Modes.checkpoint_next) return;
+    Modes.checkpoint_next = now + Modes.checkpoint_interval;
+
+    checkpointSave();
+}
+//
+//=========================================================================
+//
+// Load the state saved in Modes.checkpoint_file, if there's one. Called at
+// startup, after the registry is loaded and before any messages arrive. A
+// checkpoint that's missing, damaged or from another version is ignored.
+//
+void checkpointLoad(void) {
+    struct checkpointHeader   *hdr;
+    struct checkpointAircraft *ca;
+    struct aircraft *a, **tail = &Modes.aircrafts;
+    unsigned char *buf, *p;
+    time_t now = time(NULL);
+    size_t size, need;
+    long len;
+    FILE *f;
+    int j, loaded = 0;
+
+    if (Modes.checkpoint_file == NULL) {return;}
+    Modes.checkpoint_next = now + Modes.checkpoint_interval;
+
+    if ((f = fopen(Modes.checkpoint_file, "rb")) == NULL) {return;}
+    if ( (fseek(f, 0, SEEK_END) < 0) || ((len = ftell(f)) < (long) sizeof(*hdr))
+      || (fseek(f, 0, SEEK_SET) < 0) || ((buf = (unsigned char *) malloc(len)) == NULL) ) {
+        fclose(f);
+        return;
+    }
+    size = fread(buf, 1, len, f);
+    fclose(f);
+
+    hdr = (struct checkpointHeader *) buf;
+    need = sizeof(*hdr) + (hdr->naircraft * sizeof(*ca))
+         + (sizeof(uint32_t) * MODES_ICAO_CACHE_LEN * 2) + sizeof(Modes.df11_iid_seen);
+    if ( (size != (size_t) len) || (memcmp(hdr->magic, CHECKPOINT_MAGIC, sizeof(hdr->magic)))
+      || (hdr->version       != CHECKPOINT_VERSION)
+      || (hdr->aircraft_size != sizeof(*ca))
+      || (hdr->cache_len     != MODES_ICAO_CACHE_LEN)
+      || (hdr->iid_words     != (sizeof(Modes.df11_iid_seen) / sizeof(uint32_t)))
+      || (size != need)
+      || (hdr->checksum != checkpointChecksum((unsigned char *) (hdr + 1), size - sizeof(*hdr))) ) {
+        fprintf(stderr, "Ignoring checkpoint %s: it's damaged or from another version\n", Modes.checkpoint_file);
+        free(buf);
+        return;
+    }
+
+    while (*tail) {tail = &(*tail)->next;}
+    ca = (struct checkpointAircraft *) (hdr + 1);
+    for (j = 0; j < (int) hdr->naircraft; j++, ca++) {
+        if ((now - (time_t) ca->seen) > Modes.interactive_delete_ttl) continue;
+        if (interactiveFindAircraft(ca->addr)) continue;
+        if ((a = (struct aircraft *) calloc(1, sizeof(*a))) == NULL) break;
+
+        a->addr         = ca->addr;
+        a->altitude     = ca->altitude;
+        a->speed        = ca->speed;
+        a->track        = ca->track;
+        a->vert_rate    = ca->vert_rate;
+        a->modeA        = ca->modeA;
+        a->modeC        = ca->modeC;
+        a->bFlags       = ca->bFlags;
+        a->odd_cprlat   = ca->odd_cprlat;
+        a->odd_cprlon   = ca->odd_cprlon;
+        a->even_cprlat  = ca->even_cprlat;
+        a->even_cprlon  = ca->even_cprlon;
+        a->odd_cprtime  = ca->odd_cprtime;
+        a->even_cprtime = ca->even_cprtime;
+        a->seen         = (time_t) ca->seen;
+        a->seenLatLon   = (time_t) ca->seenLatLon;
+        a->lat          = ca->lat;
+        a->lon          = ca->lon;
+        a->messages     = ca->messages;
+        memcpy(a->flight,      ca->flight,      sizeof(a->flight));
+        memcpy(a->signalLevel, ca->signalLevel, sizeof(a->signalLevel));
+        a->flight[sizeof(a->flight)-1] = '\0';
+
+        if ((now - a->seenLatLon) > MODES_CHECKPOINT_REL_TTL) {
+            a->bFlags &= ~MODES_ACFLAGS_LATLON_REL_OK;
+        }
+        registryFillAircraft(a);
+
+        // Keep them in the order they were saved in
+        *tail = a;
+        tail  = &a->next;
+        a->hnext = Modes.aircraft_hash[MODES_AIRCRAFT_HASH(a->addr)];
+        Modes.aircraft_hash[MODES_AIRCRAFT_HASH(a->addr)] = a;
+        loaded++;
+    }
+
+    p = (unsigned char *) ((struct checkpointAircraft *) (hdr + 1) + hdr->naircraft);
+    memcpy(Modes.icao_cache, p, sizeof(uint32_t) * MODES_ICAO_CACHE_LEN * 2);
+    p += sizeof(uint32_t) * MODES_ICAO_CACHE_LEN * 2;
+    memcpy(Modes.df11_iid_seen, p, sizeof(Modes.df11_iid_seen));
+
+    Modes.tracker_epoch++;
+    interactivePublishSnapshot();
+
+    fprintf(stderr, "Restored %d aircraft from %s, saved %d seconds ago\n",
+            loaded, Modes.checkpoint_file, (int) (now - (time_t) hdr->saved));
+    free(buf);
+}
+//
+//=========================================================================
+//
@@ -38,6 +38,17 @@ void sigintHandler(int dummy) {
     signal(SIGINT, SIG_DFL);  // reset signal handler - bit extra safety
     Modes.exit = 1;           // Signal to threads that we are done
 }
+
+#ifdef SIGHUP
+// SIGHUP asks for the aircraft registry to be reloaded. The handler can't
+// take locks, so it just leaves a note for backgroundTasks()
+static volatile sig_atomic_t registryReloadSignalled;
+
+void sighupHandler(int dummy) {
+    MODES_NOTUSED(dummy);
+    registryReloadSignalled = 1;
+}
+#endif
 //
 // =============================== Terminal handling ========================
 //
@@ -49,15 +60,25 @@ int getTermRows() {
     return (w.ws_row); 
 } 
 
+// And the number of columns, or 0 if it isn't known
+int getTermCols() { 
+    struct winsize w; 
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &w) < 0) {return (0);}
+    return (w.ws_col); 
+} 
+
 // Handle resizing terminal
 void sigWinchCallback() {
     signal(SIGWINCH, SIG_IGN);
     Modes.interactive_rows = getTermRows();
-    interactiveShowData();
+    Modes.interactive_cols = getTermCols();
+    Modes.screen_repaint   = 1; // Redrawn from scratch at the next refresh, which is now
+    Modes.interactive_last_update = 0;
     signal(SIGWINCH, sigWinchCallback); 
 }
 #else 
 int getTermRows() { return MODES_INTERACTIVE_ROWS;}
+int getTermCols() { return 0;}
 #endif
 //
 // =============================== Initialization ===========================
@@ -70,35 +91,34 @@ void modesInitConfig(void) {
     Modes.gain                    = MODES_MAX_GAIN;
     Modes.freq                    = MODES_DEFAULT_FREQ;
     Modes.ppm_error               = MODES_DEFAULT_PPM;
+    Modes.sample_rate             = MODES_DEFAULT_RATE;
     Modes.check_crc               = 1;
     Modes.net_heartbeat_rate      = MODES_NET_HEARTBEAT_RATE;
     Modes.net_output_sbs_port     = MODES_NET_OUTPUT_SBS_PORT;
+    Modes.net_output_rec_port     = MODES_NET_OUTPUT_REC_PORT;
+    Modes.net_rec_format          = MODES_RECORD_JSON;
     Modes.net_output_raw_port     = MODES_NET_OUTPUT_RAW_PORT;
     Modes.net_input_raw_port      = MODES_NET_INPUT_RAW_PORT;
     Modes.net_output_beast_port   = MODES_NET_OUTPUT_BEAST_PORT;
     Modes.net_input_beast_port    = MODES_NET_INPUT_BEAST_PORT;
     Modes.net_http_port           = MODES_NET_HTTP_PORT;
     Modes.interactive_rows        = getTermRows();
+    Modes.interactive_cols        = getTermCols();
     Modes.interactive_delete_ttl  = MODES_INTERACTIVE_DELETE_TTL;
     Modes.interactive_display_ttl = MODES_INTERACTIVE_DISPLAY_TTL;
     Modes.fUserLat                = MODES_USER_LATITUDE_DFLT;
     Modes.fUserLon                = MODES_USER_LONGITUDE_DFLT;
+    Modes.db_check_interval       = MODES_DB_CHECK_INTERVAL;
+    Modes.archive_segment_mb      = ARCHIVE_SEGMENT_MB;
+    Modes.checkpoint_interval     = MODES_CHECKPOINT_INTERVAL;
 }
 //
 //=========================================================================
 //
 void modesInit(void) {
-    int i, q;
-
-    pthread_mutex_init(&Modes.pDF_mutex,NULL);
-    pthread_mutex_init(&Modes.data_mutex,NULL);
-    pthread_cond_init(&Modes.data_cond,NULL);
 
     // Allocate the various buffers used by Modes
-    if ( ((Modes.icao_cache = (uint32_t *) malloc(sizeof(uint32_t) * MODES_ICAO_CACHE_LEN * 2)                  ) == NULL) ||
-         ((Modes.pFileData  = (uint16_t *) malloc(MODES_ASYNC_BUF_SIZE)                                         ) == NULL) ||
-         ((Modes.magnitude  = (uint16_t *) malloc(MODES_ASYNC_BUF_SIZE+MODES_PREAMBLE_SIZE+MODES_LONG_MSG_SIZE) ) == NULL) ||
-         ((Modes.maglut     = (uint16_t *) malloc(sizeof(uint16_t) * 256 * 256)                                 ) == NULL) ||
+    if ( ((Modes.pFileData  = (uint16_t *) malloc(MODES_ASYNC_BUF_SIZE)                                         ) == NULL) ||
          ((Modes.beastOut   = (char     *) malloc(MODES_RAWOUT_BUF_SIZE)                                        ) == NULL) ||
          ((Modes.rawOut     = (char     *) malloc(MODES_RAWOUT_BUF_SIZE)                                        ) == NULL) ) 
     {
@@ -107,9 +127,20 @@ void modesInit(void) {
     }
 
     // Clear the buffers that have just been allocated, just in-case
-    memset(Modes.icao_cache, 0,   sizeof(uint32_t) * MODES_ICAO_CACHE_LEN * 2);
     memset(Modes.pFileData,127,   MODES_ASYNC_BUF_SIZE);
-    memset(Modes.magnitude,  0,   MODES_ASYNC_BUF_SIZE+MODES_PREAMBLE_SIZE+MODES_LONG_MSG_SIZE);
+
+    // Each receiver gets its own fifo and magnitude vector. If no device was
+    // selected on the command line, default to a single receiver on device 0.
+    // A file (or the network) is only ever one source.
+    if ((Modes.nreceivers == 0) || (Modes.filename) || (Modes.net_only)) {
+        Modes.nreceivers = 1;
+    }
+
+    // The demodulator, decoder and tracker state: caches, lookup tables, the
+    // per rate constants and the receivers buffers
+    if (modesInitContext(&Modes)) {
+        exit(1);
+    }
 
     // Validate the users Lat/Lon home location inputs
     if ( (Modes.fUserLat >   90.0)  // Latitude must be -90 to +90
@@ -138,64 +169,60 @@ void modesInit(void) {
     if (Modes.net_sndbuf_size > (MODES_NET_SNDBUF_MAX))
       {Modes.net_sndbuf_size = MODES_NET_SNDBUF_MAX;}
 
-    // Initialise the Block Timers to something half sensible
-    ftime(&Modes.stSystemTimeBlk);
-    for (i = 0; i < MODES_ASYNC_BUF_NUMBER; i++)
-      {Modes.stSystemTimeRTL[i] = Modes.stSystemTimeBlk;}
-
-    // Each I and Q value varies from 0 to 255, which represents a range from -1 to +1. To get from the 
-    // unsigned (0-255) range you therefore subtract 127 (or 128 or 127.5) from each I and Q, giving you 
-    // a range from -127 to +128 (or -128 to +127, or -127.5 to +127.5)..
-    //
-    // To decode the AM signal, you need the magnitude of the waveform, which is given by sqrt((I^2)+(Q^2))
-    // The most this could be is if I&Q are both 128 (or 127 or 127.5), so you could end up with a magnitude 
-    // of 181.019 (or 179.605, or 180.312)
-    //
-    // However, in reality the magnitude of the signal should never exceed the range -1 to +1, because the 
-    // values are I = rCos(w) and Q = rSin(w). Therefore the integer computed magnitude should (can?) never 
-    // exceed 128 (or 127, or 127.5 or whatever)
-    //
-    // If we scale up the results so that they range from 0 to 65535 (16 bits) then we need to multiply 
-    // by 511.99, (or 516.02 or 514). antirez's original code multiplies by 360, presumably because he's 
-    // assuming the maximim calculated amplitude is 181.019, and (181.019 * 360) = 65166.
-    //
-    // So lets see if we can improve things by subtracting 127.5, Well in integer arithmatic we can't
-    // subtract half, so, we'll double everything up and subtract one, and then compensate for the doubling 
-    // in the multiplier at the end.
-    //
-    // If we do this we can never have I or Q equal to 0 - they can only be as small as +/- 1.
-    // This gives us a minimum magnitude of root 2 (0.707), so the dynamic range becomes (1.414-255). This 
-    // also affects our scaling value, which is now 65535/(255 - 1.414), or 258.433254
-    //
-    // The sums then become mag = 258.433254 * (sqrt((I*2-255)^2 + (Q*2-255)^2) - 1.414)
-    //                   or mag = (258.433254 * sqrt((I*2-255)^2 + (Q*2-255)^2)) - 365.4798
-    //
-    // We also need to clip mag just incaes any rogue I/Q values somehow do have a magnitude greater than 255.
-    //
-
-    for (i = 0; i <= 255; i++) {
-        for (q = 0; q <= 255; q++) {
-            int mag, mag_i, mag_q;
-
-            mag_i = (i * 2) - 255;
-            mag_q = (q * 2) - 255;
-
-            mag = (int) round((sqrt((mag_i*mag_i)+(mag_q*mag_q)) * 258.433254) - 365.4798);
-
-            Modes.maglut[(i*256)+q] = (uint16_t) ((mag < 65535) ? mag : 65535);
-        }
-    }
+    // Load the aircraft registry, and keep it up to date
+    registryInit();
 
-    // Prepare error correction tables
-    modesInitErrorInfo();
+    // Start a new archive segment
+    archiveInit();
 
-	Modes.db = planedb_init();
+    // Pick up where the last run left off
+    checkpointLoad();
 }
 //
 // =============================== RTLSDR handling ==========================
 //
+// Open and configure the RTL device used by one receiver
+//
+void modesInitRTLSDRDevice(struct receiver *rx) {
+    int gain = Modes.gain;
+
+    if (rtlsdr_open(&rx->dev, rx->dev_index) < 0) {
+        fprintf(stderr, "Error opening the RTLSDR device %d: %s\n",
+            rx->dev_index, strerror(errno));
+        exit(1);
+    }
+
+    // Set gain, frequency, sample rate, and reset the device
+    rtlsdr_set_tuner_gain_mode(rx->dev,
+        (gain == MODES_AUTO_GAIN) ? 0 : 1);
+    if (gain != MODES_AUTO_GAIN) {
+        if (gain == MODES_MAX_GAIN) {
+            // Find the maximum gain available
+            int numgains;
+            int gains[100];
+
+            numgains = rtlsdr_get_tuner_gains(rx->dev, gains);
+            gain = gains[numgains-1];
+            fprintf(stderr, "Device %d max available gain is: %.2f\n", rx->dev_index, gain/10.0);
+        }
+        rtlsdr_set_tuner_gain(rx->dev, gain);
+        fprintf(stderr, "Device %d setting gain to: %.2f\n", rx->dev_index, gain/10.0);
+    } else {
+        fprintf(stderr, "Device %d using automatic gain control.\n", rx->dev_index);
+    }
+    rtlsdr_set_freq_correction(rx->dev, Modes.ppm_error);
+    if (Modes.enable_agc) rtlsdr_set_agc_mode(rx->dev, 1);
+    rtlsdr_set_center_freq(rx->dev, Modes.freq);
+    rtlsdr_set_sample_rate(rx->dev, Modes.sample_rate);
+    rtlsdr_reset_buffer(rx->dev);
+    fprintf(stderr, "Device %d gain reported by device: %.2f\n",
+        rx->dev_index, rtlsdr_get_tuner_gain(rx->dev)/10.0);
+}
+//
+//=========================================================================
+//
 void modesInitRTLSDR(void) {
-    int j;
+    int i, j;
     int device_count;
     char vendor[256], product[256], serial[256];
 
@@ -207,87 +234,63 @@ void modesInitRTLSDR(void) {
 
     fprintf(stderr, "Found %d device(s):\n", device_count);
     for (j = 0; j < device_count; j++) {
+        int selected = 0;
+        for (i = 0; i < Modes.nreceivers; i++) {
+            if (j == Modes.receivers[i].dev_index) {selected = 1;}
+        }
         rtlsdr_get_device_usb_strings(j, vendor, product, serial);
         fprintf(stderr, "%d: %s, %s, SN: %s %s\n", j, vendor, product, serial,
-            (j == Modes.dev_index) ? "(currently selected)" : "");
+            selected ? "(currently selected)" : "");
     }
 
-    if (rtlsdr_open(&Modes.dev, Modes.dev_index) < 0) {
-        fprintf(stderr, "Error opening the RTLSDR device: %s\n",
-            strerror(errno));
-        exit(1);
+    for (i = 0; i < Modes.nreceivers; i++) {
+        modesInitRTLSDRDevice(&Modes.receivers[i]);
     }
-
-    // Set gain, frequency, sample rate, and reset the device
-    rtlsdr_set_tuner_gain_mode(Modes.dev,
-        (Modes.gain == MODES_AUTO_GAIN) ? 0 : 1);
-    if (Modes.gain != MODES_AUTO_GAIN) {
-        if (Modes.gain == MODES_MAX_GAIN) {
-            // Find the maximum gain available
-            int numgains;
-            int gains[100];
-
-            numgains = rtlsdr_get_tuner_gains(Modes.dev, gains);
-            Modes.gain = gains[numgains-1];
-            fprintf(stderr, "Max available gain is: %.2f\n", Modes.gain/10.0);
-        }
-        rtlsdr_set_tuner_gain(Modes.dev, Modes.gain);
-        fprintf(stderr, "Setting gain to: %.2f\n", Modes.gain/10.0);
-    } else {
-        fprintf(stderr, "Using automatic gain control.\n");
-    }
-    rtlsdr_set_freq_correction(Modes.dev, Modes.ppm_error);
-    if (Modes.enable_agc) rtlsdr_set_agc_mode(Modes.dev, 1);
-    rtlsdr_set_center_freq(Modes.dev, Modes.freq);
-    rtlsdr_set_sample_rate(Modes.dev, MODES_DEFAULT_RATE);
-    rtlsdr_reset_buffer(Modes.dev);
-    fprintf(stderr, "Gain reported by device: %.2f\n",
-        rtlsdr_get_tuner_gain(Modes.dev)/10.0);
 }
 //
 //=========================================================================
 //
-// We use a thread reading data in background, while the main thread
-// handles decoding and visualization of data to the user.
+// We use a thread per receiver reading data in background, while the
+// demodulator (the main thread, or one thread per receiver if there is more
+// than one) handles decoding and visualization of data to the user.
 //
 // The reading thread calls the RTLSDR API to read data asynchronously, and
-// uses a callback to populate the data buffer.
+// uses a callback to populate the receivers data buffer.
 //
 // A Mutex is used to avoid races with the decoding thread.
 //
 void rtlsdrCallback(unsigned char *buf, uint32_t len, void *ctx) {
-
-    MODES_NOTUSED(ctx);
+    struct receiver *rx = (struct receiver *) ctx;
 
     // Lock the data buffer variables before accessing them
-    pthread_mutex_lock(&Modes.data_mutex);
+    pthread_mutex_lock(&rx->data_mutex);
 
-    Modes.iDataIn &= (MODES_ASYNC_BUF_NUMBER-1); // Just incase!!!
+    rx->iDataIn &= (MODES_ASYNC_BUF_NUMBER-1); // Just incase!!!
 
     // Get the system time for this block
-    ftime(&Modes.stSystemTimeRTL[Modes.iDataIn]);
+    ftime(&rx->stSystemTimeRTL[rx->iDataIn]);
 
     if (len > MODES_ASYNC_BUF_SIZE) {len = MODES_ASYNC_BUF_SIZE;}
 
     // Queue the new data
-    Modes.pData[Modes.iDataIn] = (uint16_t *) buf;
-    Modes.iDataIn    = (MODES_ASYNC_BUF_NUMBER-1) & (Modes.iDataIn + 1);
-    Modes.iDataReady = (MODES_ASYNC_BUF_NUMBER-1) & (Modes.iDataIn - Modes.iDataOut);   
+    rx->pData[rx->iDataIn] = (uint16_t *) buf;
+    rx->iDataIn    = (MODES_ASYNC_BUF_NUMBER-1) & (rx->iDataIn + 1);
+    rx->iDataReady = (MODES_ASYNC_BUF_NUMBER-1) & (rx->iDataIn - rx->iDataOut);   
 
-    if (Modes.iDataReady == 0) {
+    if (rx->iDataReady == 0) {
       // Ooooops. We've just received the MODES_ASYNC_BUF_NUMBER'th outstanding buffer
       // This means that RTLSDR is currently overwriting the MODES_ASYNC_BUF_NUMBER+1
       // buffer, but we havent yet processed it, so we're going to lose it. There
       // isn't much we can do to recover the lost data, but we can correct things to
       // avoid any additional problems.
-      Modes.iDataOut   = (MODES_ASYNC_BUF_NUMBER-1) & (Modes.iDataOut+1);
-      Modes.iDataReady = (MODES_ASYNC_BUF_NUMBER-1);   
-      Modes.iDataLost++;
+      rx->iDataOut   = (MODES_ASYNC_BUF_NUMBER-1) & (rx->iDataOut+1);
+      rx->iDataReady = (MODES_ASYNC_BUF_NUMBER-1);   
+      rx->iDataLost++;
     }
  
     // Signal to the other thread that new data is ready, and unlock
-    pthread_cond_signal(&Modes.data_cond);
-    pthread_mutex_unlock(&Modes.data_mutex);
+    pthread_cond_signal(&rx->data_cond);
+    pthread_mutex_unlock(&rx->data_mutex);
 }
 //
 //=========================================================================
@@ -295,23 +298,23 @@ void rtlsdrCallback(unsigned char *buf, uint32_t len, void *ctx) {
 // This is used when --ifile is specified in order to read data from file
 // instead of using an RTLSDR device
 //
-void readDataFromFile(void) {
-    pthread_mutex_lock(&Modes.data_mutex);
+void readDataFromFile(struct receiver *rx) {
+    pthread_mutex_lock(&rx->data_mutex);
     while(Modes.exit == 0) {
         ssize_t nread, toread;
         unsigned char *p;
 
-        if (Modes.iDataReady) {
-            pthread_cond_wait(&Modes.data_cond, &Modes.data_mutex);
+        if (rx->iDataReady) {
+            pthread_cond_wait(&rx->data_cond, &rx->data_mutex);
             continue;
         }
 
         if (Modes.interactive) {
             // When --ifile and --interactive are used together, slow down
             // playing at the natural rate of the RTLSDR received.
-            pthread_mutex_unlock(&Modes.data_mutex);
-            usleep(64000);
-            pthread_mutex_lock(&Modes.data_mutex);
+            pthread_mutex_unlock(&rx->data_mutex);
+            usleep((64000 * MODES_RATE_2000_SPS5) / Modes.sps5);
+            pthread_mutex_lock(&rx->data_mutex);
         }
 
         toread = MODES_ASYNC_BUF_SIZE;
@@ -330,18 +333,18 @@ void readDataFromFile(void) {
             memset(p,127,toread);
         }
 
-        Modes.iDataIn &= (MODES_ASYNC_BUF_NUMBER-1); // Just incase!!!
+        rx->iDataIn &= (MODES_ASYNC_BUF_NUMBER-1); // Just incase!!!
 
         // Get the system time for this block
-        ftime(&Modes.stSystemTimeRTL[Modes.iDataIn]);
+        ftime(&rx->stSystemTimeRTL[rx->iDataIn]);
 
         // Queue the new data
-        Modes.pData[Modes.iDataIn] = Modes.pFileData;
-        Modes.iDataIn    = (MODES_ASYNC_BUF_NUMBER-1) & (Modes.iDataIn + 1);
-        Modes.iDataReady = (MODES_ASYNC_BUF_NUMBER-1) & (Modes.iDataIn - Modes.iDataOut);   
+        rx->pData[rx->iDataIn] = Modes.pFileData;
+        rx->iDataIn    = (MODES_ASYNC_BUF_NUMBER-1) & (rx->iDataIn + 1);
+        rx->iDataReady = (MODES_ASYNC_BUF_NUMBER-1) & (rx->iDataIn - rx->iDataOut);   
 
         // Signal to the other thread that new data is ready
-        pthread_cond_signal(&Modes.data_cond);
+        pthread_cond_signal(&rx->data_cond);
     }
 }
 //
@@ -351,18 +354,157 @@ void readDataFromFile(void) {
 // without caring about data acquisition
 //
 void *readerThreadEntryPoint(void *arg) {
-    MODES_NOTUSED(arg);
+    struct receiver *rx = (struct receiver *) arg;
 
     if (Modes.filename == NULL) {
-        rtlsdr_read_async(Modes.dev, rtlsdrCallback, NULL,
+        rtlsdr_read_async(rx->dev, rtlsdrCallback, rx,
                               MODES_ASYNC_BUF_NUMBER,
                               MODES_ASYNC_BUF_SIZE);
     } else {
-        readDataFromFile();
+        readDataFromFile(rx);
     }
     // Signal to the other thread that new data is ready - dummy really so threads don't mutually lock
-    pthread_cond_signal(&Modes.data_cond);
+    pthread_cond_signal(&rx->data_cond);
+    pthread_mutex_unlock(&rx->data_mutex);
+#ifndef _WIN32
+    pthread_exit(NULL);
+#else
+    return NULL;
+#endif
+}
+//
+//=========================================================================
+//
+// The CPU budget controller. Called after every block with the number of
+// blocks still waiting in the receivers fifo, the number lost since the last
+// block, and how long the block took to demodulate.
+//
+// If the fifo is backing up, blocks are being lost, or demodulation is taking
+// more than Modes.cpu_budget percent of real time, the next lot of optional
+// work is shed (see MODES_SHED_xxx). Once there has been headroom for
+// MODES_SHED_DOWN_BLOCKS blocks in a row, the last level shed is restored.
+//
+static const char *shedNames[MODES_SHED_LEVELS] = {
+    "everything enabled", "phase enhancement", "two bit fixes", "Mode A/C", "stdout display"
+};
+
+static void modesCheckLoad(int backlog, int lost, uint64_t usecs) {
+    uint64_t blockUsecs = ((uint64_t) MODES_ASYNC_BUF_SAMPLES * 1000000) / Modes.sample_rate;
+    int      load       = (int) ((usecs * 100) / blockUsecs);
+    int      pressure, headroom;
+
+    pthread_mutex_lock(&Modes.data_mutex);
+
+    Modes.stat_shed_blocks[Modes.shed_level]++;
+    // Kept x16 so the integer division doesn't leave it stuck short of the load
+    Modes.load_avg16 += ((load * 16) - Modes.load_avg16) / 4;
+
+    pressure = (lost) || (backlog >= (MODES_ASYNC_BUF_NUMBER / 4)) 
+            || (Modes.load_avg16 > (Modes.cpu_budget * 16));
+    headroom = (!backlog) && (Modes.load_avg16 < (Modes.cpu_budget * 12));
+
+    if (Modes.shed_hold) {Modes.shed_hold--;}
+
+    if (pressure) {
+        Modes.shed_relief = 0;
+        if ((!Modes.shed_hold) && (Modes.shed_level < (MODES_SHED_LEVELS-1))) {
+            Modes.shed_level++;
+            Modes.shed_hold = MODES_SHED_UP_BLOCKS;
+            Modes.stat_shed_entered[Modes.shed_level]++;
+        }
+    } else if ((headroom) && (Modes.shed_level)) {
+        if (++Modes.shed_relief >= MODES_SHED_DOWN_BLOCKS) {
+            Modes.shed_level--;
+            Modes.shed_relief = 0;
+            Modes.shed_hold   = MODES_SHED_UP_BLOCKS;
+            Modes.stat_shed_restored++;
+        }
+    } else {
+        Modes.shed_relief = 0;
+    }
+
     pthread_mutex_unlock(&Modes.data_mutex);
+}
+//
+//=========================================================================
+//
+// Return the time now in microseconds, for timing blocks
+//
+static uint64_t usTime(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return ((uint64_t) tv.tv_sec * 1000000) + tv.tv_usec;
+}
+//
+//=========================================================================
+//
+// Demodulate the next block in a receivers fifo. Must be called with
+// rx->data_mutex locked and rx->iDataReady != 0. Returns with the
+// mutex unlocked.
+//
+void receiverProcessBlock(struct receiver *rx) {
+    uint64_t start;
+    int backlog, lost;
+
+    rx->iDataOut &= (MODES_ASYNC_BUF_NUMBER-1); // Just incase
+
+    // Translate the next lot of I/Q samples into rx->magnitude
+    computeMagnitudeVector(rx, rx->pData[rx->iDataOut]);
+
+    rx->stSystemTimeBlk = rx->stSystemTimeRTL[rx->iDataOut];
+
+    // Update the input buffer pointer queue
+    rx->iDataOut   = (MODES_ASYNC_BUF_NUMBER-1) & (rx->iDataOut + 1); 
+    rx->iDataReady = (MODES_ASYNC_BUF_NUMBER-1) & (rx->iDataIn - rx->iDataOut);   
+
+    backlog = rx->iDataReady;
+    lost    = rx->iDataLost;
+
+    // If we lost some blocks, correct the timestamp
+    if (rx->iDataLost) {
+        rx->timestampBlk += MODES_SAMPLES_TO_TICKS(MODES_ASYNC_BUF_SAMPLES, Modes.sps5) * rx->iDataLost;
+        rx->stat_blocks_dropped += rx->iDataLost;
+        rx->iDataLost = 0;
+    }
+
+    // It's safe to release the lock now
+    pthread_cond_signal (&rx->data_cond);
+    pthread_mutex_unlock(&rx->data_mutex);
+
+    // Process data after releasing the lock, so that the capturing
+    // thread can read data while we perform computationally expensive
+    // stuff at the same time.
+    start = usTime();
+    detectModeS(rx, rx->magnitude, MODES_ASYNC_BUF_SAMPLES);
+
+    if (Modes.cpu_budget) {
+        modesCheckLoad(backlog, lost, usTime() - start);
+    }
+
+    // Update the timestamp ready for the next block
+    rx->timestampBlk += MODES_SAMPLES_TO_TICKS(MODES_ASYNC_BUF_SAMPLES, Modes.sps5);
+    rx->stat_blocks_processed++;
+}
+//
+//=========================================================================
+//
+// With more than one receiver, each gets its own demodulator thread feeding
+// the shared tracker, and the main thread is left to run backgroundTasks()
+//
+void *demodThreadEntryPoint(void *arg) {
+    struct receiver *rx = (struct receiver *) arg;
+
+    pthread_mutex_lock(&rx->data_mutex);
+    while (Modes.exit == 0) {
+        if (rx->iDataReady == 0) {
+            pthread_cond_wait(&rx->data_cond, &rx->data_mutex);
+            continue;
+        }
+        receiverProcessBlock(rx);
+        pthread_mutex_lock(&rx->data_mutex);
+    }
+    pthread_mutex_unlock(&rx->data_mutex);
 #ifndef _WIN32
     pthread_exit(NULL);
 #else
@@ -398,10 +540,12 @@ void showHelp(void) {
 "-----------------------------------------------------------------------------\n"
 "|                        dump1090 ModeS Receiver         Ver : " MODES_DUMP1090_VERSION " |\n"
 "-----------------------------------------------------------------------------\n"
-"--device-index <index>   Select RTL device (default: 0)\n"
+"--device-index <index>   Select RTL device (default: 0). Repeat to use several\n"
+"                         devices, frames heard by more than one are used once\n"
 "--gain <db>              Set gain (default: max gain. Use -10 for auto-gain)\n"
 "--enable-agc             Enable the Automatic Gain Control (default: off)\n"
 "--freq <hz>              Set frequency (default: 1090 Mhz)\n"
+"--sample-rate <MS/s>     Set sample rate: 2.0, 2.4, 3.2 or 4.0 (default: 2.0)\n"
 "--ifile <filename>       Read data from file (use '-' for stdin)\n"
 "--interactive            Interactive mode refreshing data on screen\n"
 "--interactive-rows <num> Max number of rows in interactive mode (default: 15)\n"
@@ -419,6 +563,12 @@ void showHelp(void) {
 "--net-sbs-port <port>    TCP BaseStation output listen port (default: 30003)\n"
 "--net-bi-port <port>     TCP Beast input listen port  (default: 30004)\n"
 "--net-bo-port <port>     TCP Beast output listen port (default: 30005)\n"
+"--net-rec-port <port>    TCP record output listen port (default: 30006)\n"
+"--net-rec-format <fmt>   Records sent to it as json (default) or binary\n"
+"--net-ro-filter <terms>  Only send these messages to raw output clients, see README\n"
+"--net-bo-filter <terms>  The same for Beast output clients\n"
+"--net-sbs-filter <terms> The same for BaseStation output clients\n"
+"--net-rec-filter <terms> The same for record output clients\n"
 "--net-ro-size <size>     TCP raw output minimum size (default: 0)\n"
 "--net-ro-rate <rate>     TCP raw output memory flush rate (default: 0)\n"
 "--net-heartbeat <rate>   TCP heartbeat rate in seconds (default: 60 sec; 0 to disable)\n"
@@ -430,10 +580,27 @@ void showHelp(void) {
 "--no-crc-check           Disable messages with broken CRC (discouraged)\n"
 "--phase-enhance          Enable phase enhancement\n"
 "--aggressive             More CPU for more messages (two bits fixes, ...)\n"
+"--fix-soft               Also fix up to 3 weak bits using demodulator confidence\n"
+"--fix-df11               Fix single bit errors in DF11 replies from known aircraft\n"
+"--cpu-budget <percent>   Shed optional work if demodulating takes more than this\n"
+"                         percent of real time, or blocks back up (default: off)\n"
 "--mlat                   display raw messages in Beast ascii mode\n"
+"--db-source <kind:path>  Load the registry from faa:<directory> or csv:<file>.\n"
+"                         Repeat for more sources, highest priority first\n"
+"                         (default: faa:. , the FAA files in this directory)\n"
+"--db-check <seconds>     Reload the registry files when they change, checking\n"
+"                         every <seconds> seconds (default: 60; 0 to disable)\n"
+"--db-http-reload         Allow the registry to be reloaded with /reload-db.json\n"
+"--archive <directory>    Append every frame to segment files in <directory>,\n"
+"                         to be searched with query1090\n"
+"--archive-segment <MB>   Size of each archive segment (default: 64)\n"
+"--checkpoint <file>      Save the tracked aircraft to <file>, and restore them\n"
+"                         from it at startup\n"
+"--checkpoint-every <sec> Seconds between saves (default: 30; 0 for only at exit)\n"
 "--stats                  With --ifile print stats at exit. No other output\n"
 "--stats-every <seconds>  Show and reset stats every <seconds> seconds\n"
 "--onlyaddr               Show only ICAO addresses (testing purposes)\n"
+"--records <fmt>          Print each message as a json or binary record, see README\n"
 "--metric                 Use metric units (meters, km/h, ...)\n"
 "--snip <level>           Strip IQ file removing samples < level\n"
 "--debug <flags>          Debug mode (verbose), see README for details\n"
@@ -489,16 +656,32 @@ void showCopyright(void) {
 
 static void display_stats(void) {
     int j;
+    unsigned int blocks_processed = 0, blocks_dropped = 0;
     time_t now = time(NULL);
 
+    outputFlush(); // The messages so far go first
     printf("\n\n");
     if (Modes.interactive)
         interactiveShowData();
 
     printf("Statistics as at %s", ctime(&now));
 
-    printf("%d sample blocks processed\n",                    Modes.stat_blocks_processed);
-    printf("%d sample blocks dropped\n",                      Modes.stat_blocks_dropped);
+    for (j = 0; j < Modes.nreceivers; j++) {
+        blocks_processed += Modes.receivers[j].stat_blocks_processed;
+        blocks_dropped   += Modes.receivers[j].stat_blocks_dropped;
+    }
+    printf("%d sample blocks processed\n",                    blocks_processed);
+    printf("%d sample blocks dropped\n",                      blocks_dropped);
+
+    // With several receivers, show how much each one contributed
+    if (Modes.nreceivers > 1) {
+        for (j = 0; j < Modes.nreceivers; j++) {
+            struct receiver *rx = &Modes.receivers[j];
+            printf("   device %d: %d blocks processed, %d dropped, %d messages used, %d duplicates\n",
+                rx->dev_index, rx->stat_blocks_processed, rx->stat_blocks_dropped,
+                rx->stat_messages, rx->stat_duplicates);
+        }
+    }
 
     printf("%d ModeA/C detected\n",                           Modes.stat_ModeAC);
     printf("%d valid Mode-S preambles\n",                     Modes.stat_valid_preamble);
@@ -516,6 +699,29 @@ static void display_stats(void) {
         printf("   %d with %d bit %s\n", Modes.stat_bit_fix[j], j+1, (j==0)?"error":"errors");
     }
 
+    if (Modes.soft_fix) {
+        printf("%d soft decision errors corrected\n",             Modes.stat_soft_fixed);
+        printf("%d soft decision fixes rejected (unknown ICAO)\n", Modes.stat_soft_rejected);
+        printf("%d soft decision attempts skipped (over budget)\n", Modes.stat_soft_skipped);
+    }
+
+    if (Modes.df11_fix) {
+        printf("%d DF-11 errors corrected\n",                    Modes.stat_df11_fixed);
+        printf("%d DF-11 with more than one valid correction\n", Modes.stat_df11_ambiguous);
+        printf("%d DF-11 with no valid correction\n",            Modes.stat_df11_rejected);
+    }
+
+    if (Modes.cpu_budget) {
+        printf("CPU budget %d%%, load %d%%, now shedding %s\n", Modes.cpu_budget, (Modes.load_avg16 + 8) / 16,
+               (Modes.shed_level) ? shedNames[Modes.shed_level] : "nothing");
+        for (j = 1;  j < MODES_SHED_LEVELS;  j++) {
+            printf("   %d times shed %s, %d blocks at that level\n", 
+                   Modes.stat_shed_entered[j], shedNames[j], Modes.stat_shed_blocks[j]);
+        }
+        printf("   %d times restored a level, %d blocks with %s\n",
+               Modes.stat_shed_restored, Modes.stat_shed_blocks[0], shedNames[0]);
+    }
+
     if (Modes.phase_enhance) {
         printf("%d phase enhancement attempts\n",                 Modes.stat_out_of_phase);
         printf("%d phase enhanced demodulated with 0 errors\n",   Modes.stat_ph_demodulated0);
@@ -531,11 +737,24 @@ static void display_stats(void) {
         }
     }
 
+    if (Modes.stat_db_reloads || Modes.stat_db_reload_failures) {
+        printf("%d registry reloads, %d failed\n", Modes.stat_db_reloads, Modes.stat_db_reload_failures);
+    }
+
+    if ((Modes.archive_dir) || (Modes.stat_archive_segments)) {
+        printf("%d frames archived, %d segments started\n", Modes.stat_archived, Modes.stat_archive_segments);
+    }
+
     printf("%d total usable messages\n",                      Modes.stat_goodcrc + Modes.stat_ph_goodcrc + Modes.stat_fixed + Modes.stat_ph_fixed);
     fflush(stdout);
 
-    Modes.stat_blocks_processed =
-        Modes.stat_blocks_dropped = 0;
+    for (j = 0; j < Modes.nreceivers; j++) {
+        struct receiver *rx = &Modes.receivers[j];
+        rx->stat_blocks_processed =
+            rx->stat_blocks_dropped =
+            rx->stat_messages =
+            rx->stat_duplicates = 0;
+    }
 
     Modes.stat_ModeAC =
         Modes.stat_valid_preamble =
@@ -558,6 +777,26 @@ static void display_stats(void) {
         Modes.stat_ph_badcrc =
         Modes.stat_ph_fixed = 0;
 
+    Modes.stat_soft_fixed =
+        Modes.stat_soft_rejected =
+        Modes.stat_soft_skipped = 0;
+
+    Modes.stat_df11_fixed =
+        Modes.stat_df11_ambiguous =
+        Modes.stat_df11_rejected = 0;
+
+    Modes.stat_db_reloads =
+        Modes.stat_db_reload_failures = 0;
+
+    Modes.stat_archived =
+        Modes.stat_archive_segments = 0;
+
+    Modes.stat_shed_restored = 0;
+    for (j = 0;  j < MODES_SHED_LEVELS;  j++) {
+        Modes.stat_shed_entered[j] = 0;
+        Modes.stat_shed_blocks[j] = 0;
+    }
+
     for (j = 0;  j < MODES_MAX_BITERRORS;  j++) {
         Modes.stat_ph_bit_fix[j] = 0;
         Modes.stat_bit_fix[j] = 0;
@@ -575,6 +814,10 @@ static void display_stats(void) {
 void backgroundTasks(void) {
     static time_t next_stats;
 
+    // The demodulator threads update the aircraft list and network
+    // buffers, so hold them off while we work on them
+    pthread_mutex_lock(&Modes.data_mutex);
+
     if (Modes.net) {
         modesReadFromClients();
     }    
@@ -584,10 +827,8 @@ void backgroundTasks(void) {
         interactiveRemoveStaleAircrafts();
     }
 
-    // Refresh screen when in interactive mode
-    if (Modes.interactive) {
-        interactiveShowData();
-    }
+    // Let the readers see any changes to the aircraft
+    interactivePublishSnapshot();
 
     if (Modes.stats > 0) {
         time_t now = time(NULL);
@@ -597,6 +838,26 @@ void backgroundTasks(void) {
             next_stats = now + Modes.stats;
         }
     }
+
+    pthread_mutex_unlock(&Modes.data_mutex);
+
+    // Pick up new registry files. The reloader thread does the work.
+#ifdef SIGHUP
+    if (registryReloadSignalled) {
+        registryReloadSignalled = 0;
+        registryRequestReload();
+    }
+#endif
+    registryCheckFiles();
+
+    // Save the tracker state now and then
+    checkpointCheck();
+
+    // Refresh screen when in interactive mode. The screen is drawn from a
+    // snapshot, so the demodulators needn't wait for the terminal.
+    if (Modes.interactive) {
+        interactiveShowData();
+    }
 }
 //
 //=========================================================================
@@ -669,19 +930,28 @@ int main(int argc, char **argv) {
     // Set sane defaults
     modesInitConfig();
     signal(SIGINT, sigintHandler); // Define Ctrl/C handler (exit program)
+#ifdef SIGHUP
+    signal(SIGHUP, sighupHandler); // Reload the aircraft registry
+#endif
 
     // Parse the command line options
     for (j = 1; j < argc; j++) {
         int more = j+1 < argc; // There are more arguments
 
         if (!strcmp(argv[j],"--device-index") && more) {
-            Modes.dev_index = verbose_device_search(argv[++j]);
+            if (Modes.nreceivers == MODES_MAX_RECEIVERS) {
+                fprintf(stderr, "At most %d devices can be used.\n", MODES_MAX_RECEIVERS);
+                exit(1);
+            }
+            Modes.receivers[Modes.nreceivers++].dev_index = verbose_device_search(argv[++j]);
         } else if (!strcmp(argv[j],"--gain") && more) {
             Modes.gain = (int) (atof(argv[++j])*10); // Gain is in tens of DBs
         } else if (!strcmp(argv[j],"--enable-agc")) {
             Modes.enable_agc++;
         } else if (!strcmp(argv[j],"--freq") && more) {
             Modes.freq = (int) strtoll(argv[++j],NULL,10);
+        } else if (!strcmp(argv[j],"--sample-rate") && more) {
+            Modes.sample_rate = (int) (atof(argv[++j])*1000000 + 0.5); // Rate is in MS/s
         } else if (!strcmp(argv[j],"--ifile") && more) {
             Modes.filename = strdup(argv[++j]);
         } else if (!strcmp(argv[j],"--fix")) {
@@ -726,6 +996,24 @@ int main(int argc, char **argv) {
             Modes.net_http_port = atoi(argv[++j]);
         } else if (!strcmp(argv[j],"--net-sbs-port") && more) {
             Modes.net_output_sbs_port = atoi(argv[++j]);
+        } else if (!strcmp(argv[j],"--net-ro-filter") && more) {
+            Modes.net_output_raw_filter = strdup(argv[++j]);
+        } else if (!strcmp(argv[j],"--net-bo-filter") && more) {
+            Modes.net_output_beast_filter = strdup(argv[++j]);
+        } else if (!strcmp(argv[j],"--net-sbs-filter") && more) {
+            Modes.net_output_sbs_filter = strdup(argv[++j]);
+        } else if (!strcmp(argv[j],"--net-rec-filter") && more) {
+            Modes.net_output_rec_filter = strdup(argv[++j]);
+        } else if (!strcmp(argv[j],"--net-rec-port") && more) {
+            Modes.net_output_rec_port = atoi(argv[++j]);
+        } else if ((!strcmp(argv[j],"--net-rec-format") || !strcmp(argv[j],"--records")) && more) {
+            int format = modesRecordFormat(argv[j+1]);
+            if (format == 0) {
+                fprintf(stderr, "Unknown record format: %s (use json or binary)\n", argv[j+1]);
+                exit(1);
+            }
+            if (!strcmp(argv[j++],"--records")) {Modes.records = format;}
+            else                                {Modes.net_rec_format = format;}
         } else if (!strcmp(argv[j],"--net-buffer") && more) {
             Modes.net_sndbuf_size = atoi(argv[++j]);
         } else if (!strcmp(argv[j],"--onlyaddr")) {
@@ -734,6 +1022,35 @@ int main(int argc, char **argv) {
             Modes.metric = 1;
         } else if (!strcmp(argv[j],"--aggressive")) {
             Modes.nfix_crc = MODES_MAX_BITERRORS;
+        } else if (!strcmp(argv[j],"--fix-soft")) {
+            Modes.soft_fix = 1;
+        } else if (!strcmp(argv[j],"--fix-df11")) {
+            Modes.df11_fix = 1;
+        } else if (!strcmp(argv[j],"--cpu-budget") && more) {
+            Modes.cpu_budget = atoi(argv[++j]);
+        } else if (!strcmp(argv[j],"--db-source") && more) {
+            if ((Modes.db_nsources == MODES_DB_MAX_SOURCES) ||
+                (!planedb_source(&Modes.db_sources[Modes.db_nsources], argv[++j]))) {
+                fprintf(stderr, "Bad or too many registry sources: %s\n", argv[j]);
+                exit(1);
+            }
+            Modes.db_nsources++;
+        } else if (!strcmp(argv[j],"--db-check") && more) {
+            Modes.db_check_interval = atoi(argv[++j]);
+        } else if (!strcmp(argv[j],"--db-http-reload")) {
+            Modes.db_http_reload = 1;
+        } else if (!strcmp(argv[j],"--archive") && more) {
+            Modes.archive_dir = strdup(argv[++j]);
+        } else if (!strcmp(argv[j],"--checkpoint") && more) {
+            Modes.checkpoint_file = strdup(argv[++j]);
+        } else if (!strcmp(argv[j],"--checkpoint-every") && more) {
+            Modes.checkpoint_interval = atoi(argv[++j]);
+        } else if (!strcmp(argv[j],"--archive-segment") && more) {
+            Modes.archive_segment_mb = atoi(argv[++j]);
+            if ((Modes.archive_segment_mb < 1) || (Modes.archive_segment_mb > ARCHIVE_SEGMENT_MB_MAX)) {
+                fprintf(stderr, "Archive segments must be 1 to %d MB\n", ARCHIVE_SEGMENT_MB_MAX);
+                exit(1);
+            }
         } else if (!strcmp(argv[j],"--interactive")) {
             Modes.interactive = 1;
         } else if (!strcmp(argv[j],"--interactive-rows") && more) {
@@ -803,6 +1120,13 @@ int main(int argc, char **argv) {
     // Initialization
     modesInit();
 
+    // Messages printed on stdout are buffered and written by a thread of
+    // their own. Not with --debug, which prints from elsewhere too.
+    if ((!Modes.interactive) && (!Modes.debug)) {outputInit();}
+#ifdef _WIN32
+    if (Modes.records == MODES_RECORD_BINARY) {_setmode(_fileno(stdout), _O_BINARY);}
+#endif
+
     if (Modes.net_only) {
         fprintf(stderr,"Net-only mode, no RTL device or file open.\n");
     } else if (Modes.filename == NULL) {
@@ -826,77 +1150,89 @@ int main(int argc, char **argv) {
     // If the user specifies --net-only, just run in order to serve network
     // clients without reading data from the RTL device
     while (Modes.net_only) {
-        if (Modes.exit) exit(0); // If we exit net_only nothing further in main()
+        if (Modes.exit) { // If we exit net_only nothing further in main()
+            outputExit();
+            checkpointSave();
+            archiveExit();
+            exit(0);
+        }
         backgroundTasks();
         usleep(100000);
     }
 
-    // Create the thread that will read the data from the device.
-    pthread_create(&Modes.reader_thread, NULL, readerThreadEntryPoint, NULL);
-    pthread_mutex_lock(&Modes.data_mutex);
-
-    while (Modes.exit == 0) {
+    // Create the threads that will read the data from the devices.
+    for (j = 0; j < Modes.nreceivers; j++) {
+        pthread_create(&Modes.receivers[j].reader_thread, NULL, readerThreadEntryPoint, &Modes.receivers[j]);
+    }
 
-        if (Modes.iDataReady == 0) {
-            pthread_cond_wait(&Modes.data_cond,&Modes.data_mutex); // This unlocks Modes.data_mutex, and waits for Modes.data_cond 
-            continue;                                              // Once (Modes.data_cond) occurs, it locks Modes.data_mutex
+    if (Modes.nreceivers > 1) {
+        // One demodulator thread per receiver, leaving the main thread
+        // to look after the network, the screen and statistics
+        for (j = 0; j < Modes.nreceivers; j++) {
+            pthread_create(&Modes.receivers[j].demod_thread, NULL, demodThreadEntryPoint, &Modes.receivers[j]);
         }
+        while (Modes.exit == 0) {
+            backgroundTasks();
+            usleep(100000);
+        }
+        for (j = 0; j < Modes.nreceivers; j++) {
+            struct receiver *rx = &Modes.receivers[j];
+            pthread_mutex_lock(&rx->data_mutex);
+            pthread_cond_signal(&rx->data_cond);
+            pthread_mutex_unlock(&rx->data_mutex);
+            pthread_join(rx->demod_thread,NULL);
+        }
+    } else {
+        struct receiver *rx = &Modes.receivers[0];
 
-        // Modes.data_mutex is Locked, and (Modes.iDataReady != 0)
-        if (Modes.iDataReady) { // Check we have new data, just in case!!
- 
-            Modes.iDataOut &= (MODES_ASYNC_BUF_NUMBER-1); // Just incase
-
-            // Translate the next lot of I/Q samples into Modes.magnitude
-            computeMagnitudeVector(Modes.pData[Modes.iDataOut]);
-
-            Modes.stSystemTimeBlk = Modes.stSystemTimeRTL[Modes.iDataOut];
-
-            // Update the input buffer pointer queue
-            Modes.iDataOut   = (MODES_ASYNC_BUF_NUMBER-1) & (Modes.iDataOut + 1); 
-            Modes.iDataReady = (MODES_ASYNC_BUF_NUMBER-1) & (Modes.iDataIn - Modes.iDataOut);   
+        pthread_mutex_lock(&rx->data_mutex);
+        while (Modes.exit == 0) {
 
-            // If we lost some blocks, correct the timestamp
-            if (Modes.iDataLost) {
-                Modes.timestampBlk += (MODES_ASYNC_BUF_SAMPLES * 6 * Modes.iDataLost);
-                Modes.stat_blocks_dropped += Modes.iDataLost;
-                Modes.iDataLost = 0;
+            if (rx->iDataReady == 0) {
+                pthread_cond_wait(&rx->data_cond,&rx->data_mutex); // This unlocks rx->data_mutex, and waits for rx->data_cond 
+                continue;                                          // Once (rx->data_cond) occurs, it locks rx->data_mutex
             }
 
-            // It's safe to release the lock now
-            pthread_cond_signal (&Modes.data_cond);
-            pthread_mutex_unlock(&Modes.data_mutex);
-
-            // Process data after releasing the lock, so that the capturing
-            // thread can read data while we perform computationally expensive
-            // stuff at the same time.
-            detectModeS(Modes.magnitude, MODES_ASYNC_BUF_SAMPLES);
+            // rx->data_mutex is Locked, and (rx->iDataReady != 0).
+            // receiverProcessBlock() releases the lock
+            receiverProcessBlock(rx);
 
-            // Update the timestamp ready for the next block
-            Modes.timestampBlk += (MODES_ASYNC_BUF_SAMPLES*6);
-            Modes.stat_blocks_processed++;
-        } else {
-            pthread_cond_signal (&Modes.data_cond);
-            pthread_mutex_unlock(&Modes.data_mutex);
+            backgroundTasks();
+            pthread_mutex_lock(&rx->data_mutex);
         }
-
-        backgroundTasks();
-        pthread_mutex_lock(&Modes.data_mutex);
+        pthread_mutex_unlock(&rx->data_mutex);
     }
 
+    // Write out the last of the messages
+    outputExit();
+
     // If --stats were given, print statistics
     if (Modes.stats) {
         display_stats();
     }
 
     if (Modes.filename == NULL) {
-        rtlsdr_cancel_async(Modes.dev);  // Cancel rtlsdr_read_async will cause data input thread to terminate cleanly
-        rtlsdr_close(Modes.dev);
-		planedb_close(Modes.db);
+        for (j = 0; j < Modes.nreceivers; j++) {
+            rtlsdr_cancel_async(Modes.receivers[j].dev);  // Cancel rtlsdr_read_async will cause data input thread to terminate cleanly
+        }
+    }
+    for (j = 0; j < Modes.nreceivers; j++) {
+        struct receiver *rx = &Modes.receivers[j];
+        pthread_mutex_lock(&rx->data_mutex);       // Wake a file reader waiting for us to drain the fifo
+        pthread_cond_signal(&rx->data_cond);
+        pthread_mutex_unlock(&rx->data_mutex);
+        pthread_join(rx->reader_thread,NULL);      // Wait on reader thread exit
+        if (Modes.filename == NULL) {
+            rtlsdr_close(rx->dev);
+        }
+        pthread_cond_destroy(&rx->data_cond);      // Thread cleanup
+        pthread_mutex_destroy(&rx->data_mutex);
     }
-    pthread_cond_destroy(&Modes.data_cond);     // Thread cleanup
+    registryExit();
+    checkpointSave();
+    archiveExit();
+    pthread_cond_destroy(&Modes.data_cond);
     pthread_mutex_destroy(&Modes.data_mutex);
-    pthread_join(Modes.reader_thread,NULL);     // Wait on reader thread exit
 #ifndef _WIN32
     pthread_exit(0);
 #else
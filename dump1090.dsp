@@ -93,14 +93,30 @@ SOURCE=.\anet.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\archive.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\checkpoint.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\dump1090.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\filter.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\interactive.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\libmodes.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\mode_ac.c
 # End Source File
 # Begin Source File
@@ -111,6 +127,26 @@ SOURCE=.\mode_s.c
 
 SOURCE=.\net_io.c
 # End Source File
+# Begin Source File
+
+SOURCE=.\output.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\planedb.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\record.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\registry.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\trail.c
+# End Source File
 # End Group
 # Begin Group "Header Files"
 
@@ -121,10 +157,18 @@ SOURCE=.\anet.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\archive.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\dump1090.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\libmodes.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\winstubs.h
 # End Source File
 # End Group
@@ -68,6 +68,18 @@
 // Add our FAA db
 #include "planedb.h"
 
+// The frame archive format, shared with query1090
+#include "archive.h"
+
+// The public, explicit context, API
+#include "libmodes.h"
+
+// The demodulators use SSE2 where the compiler tells us it is available
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+    #define MODES_HAVE_SSE2
+    #include <emmintrin.h>
+#endif
+
 // ============================= #defines ===============================
 //
 // If you have a valid coaa.h, these values will come from it. If not,
@@ -87,8 +99,7 @@
 #define MODES_DEFAULT_WIDTH        1000
 #define MODES_DEFAULT_HEIGHT       700
 #define MODES_ASYNC_BUF_NUMBER     16
-#define MODES_ASYNC_BUF_SIZE       (16*16384)                 // 256k
-#define MODES_ASYNC_BUF_SAMPLES    (MODES_ASYNC_BUF_SIZE / 2) // Each sample is 2 bytes
+#define MODES_ASYNC_BUF_SAMPLES    (MODES_ASYNC_BUF_SIZE / 2) // Each sample is 2 bytes, the size is in libmodes.h
 #define MODES_AUTO_GAIN            -100                       // Use automatic gain
 #define MODES_MAX_GAIN             999999                     // Use max available gain
 #define MODES_MSG_SQUELCH_LEVEL    0x02FF                     // Average signal strength limit
@@ -97,7 +108,24 @@
 // When changing, change also fixBitErrors() and modesInitErrorTable() !!
 #define MODES_MAX_BITERRORS        2                          // Global max for fixable bit erros
 
+// Soft decision correction flips combinations of the least confident bits
+#define MODES_SOFT_CANDIDATES      8                          // Weakest bits considered
+#define MODES_SOFT_BUDGET          32768                      // Flip patterns tried per sample block
+// MODES_SOFT_MAX_FLIPS, the most bits flipped in one frame, is in libmodes.h
+
+// Optional work shed, in this order, when the demodulator can't keep up. Each
+// level includes the ones before it.
+#define MODES_SHED_NONE            0
+#define MODES_SHED_PHASE           1                          // No phase enhancement
+#define MODES_SHED_FIX2            2                          // No two bit or soft decision fixes
+#define MODES_SHED_MODEAC          3                          // No Mode A/C
+#define MODES_SHED_DISPLAY         4                          // No messages on stdout
+#define MODES_SHED_LEVELS          5
+#define MODES_SHED_UP_BLOCKS       4                          // Blocks to let a change settle before shedding more
+#define MODES_SHED_DOWN_BLOCKS     32                         // Blocks with headroom before restoring a level
+
 #define MODEAC_MSG_SAMPLES       (25 * 2)                     // include up to the SPI bit
+#define MODEAC_MAP_WORDS         ((MODES_ASYNC_BUF_SAMPLES + 31) / 32) // Candidate map, one bit per sample
 #define MODEAC_MSG_BYTES          2
 #define MODEAC_MSG_SQUELCH_LEVEL  0x07FF                      // Average signal strength limit
 #define MODEAC_MSG_FLAG          (1<<0)
@@ -110,8 +138,7 @@
 #define MODES_PREAMBLE_US        8              // microseconds = bits
 #define MODES_PREAMBLE_SAMPLES  (MODES_PREAMBLE_US       * 2)
 #define MODES_PREAMBLE_SIZE     (MODES_PREAMBLE_SAMPLES  * sizeof(uint16_t))
-#define MODES_LONG_MSG_BYTES     14
-#define MODES_SHORT_MSG_BYTES    7
+// MODES_LONG_MSG_BYTES and MODES_SHORT_MSG_BYTES are in libmodes.h
 #define MODES_LONG_MSG_BITS     (MODES_LONG_MSG_BYTES    * 8)
 #define MODES_SHORT_MSG_BITS    (MODES_SHORT_MSG_BYTES   * 8)
 #define MODES_LONG_MSG_SAMPLES  (MODES_LONG_MSG_BITS     * 2)
@@ -119,37 +146,45 @@
 #define MODES_LONG_MSG_SIZE     (MODES_LONG_MSG_SAMPLES  * sizeof(uint16_t))
 #define MODES_SHORT_MSG_SIZE    (MODES_SHORT_MSG_SAMPLES * sizeof(uint16_t))
 
+// Sample rates above 2MHz. Rates are described by the number of samples in
+// 5us (5 bits), which is a whole number for every rate we support. Positions
+// within a frame are kept in fifths of a sample, so that 1us is always
+// exactly sps5 units (Modes.sps5, one of the MODES_RATE_xxxx_SPS5 below) and a
+// half bit is half that.
+#define MODES_RATE_2000_SPS5     10             // 2.0 MS/s, the classic demodulator
+#define MODES_RATE_2400_SPS5     12             // 2.4 MS/s
+#define MODES_RATE_3200_SPS5     16             // 3.2 MS/s
+#define MODES_RATE_4000_SPS5     20             // 4.0 MS/s
+#define MODES_MAX_SPS5           MODES_RATE_4000_SPS5
+#define MODES_FRACTIONAL_SPILL   4              // Extra samples read by a half bit that straddles samples
+#define MODES_MAG_OVERLAP(sps5) (((MODES_PREAMBLE_US+MODES_LONG_MSG_BITS) * (sps5)) / 5 \
+                                 + (((sps5) == MODES_RATE_2000_SPS5) ? 0 : MODES_FRACTIONAL_SPILL))
+#define MODES_MAG_BUF_SAMPLES   (MODES_ASYNC_BUF_SAMPLES + MODES_MAG_OVERLAP(MODES_MAX_SPS5))
+#define MODES_MAG_BUF_SIZE      (MODES_MAG_BUF_SAMPLES * sizeof(uint16_t))
+
+// Convert a count of samples (or of fifths of a sample) into 12MHz timestamp ticks
+#define MODES_SAMPLES_TO_TICKS(n, sps5)  ((((uint64_t) (n)) * 60) / (sps5))
+#define MODES_FIFTHS_TO_TICKS(n, sps5)   ((((uint64_t) (n)) * 12) / (sps5))
+
 #define MODES_RAWOUT_BUF_SIZE   (1500)
 #define MODES_RAWOUT_BUF_FLUSH  (MODES_RAWOUT_BUF_SIZE - 200)
 #define MODES_RAWOUT_BUF_RATE   (1000)            // 1000 * 64mS = 1 Min approx
 
 #define MODES_ICAO_CACHE_LEN 1024 // Power of two required
 #define MODES_ICAO_CACHE_TTL 60   // Time to live of cached addresses
-#define MODES_UNIT_FEET 0
-#define MODES_UNIT_METERS 1
+
+#define MODES_AIRCRAFT_HASH_LEN 1024 // Power of two required
+#define MODES_AIRCRAFT_HASH(addr)    ((((addr) * 0x9E3779B1U) >> 16) & (MODES_AIRCRAFT_HASH_LEN-1))
+
+#define MODES_DF11_MAX_IID     80  // A DF11 parity of IID/SI code xor CRC leaves a syndrome below this
+
+#define MODES_MAX_RECEIVERS       8   // Max number of RTL devices in one process
+#define MODES_DUP_CACHE_LEN    1024   // Power of two required
+#define MODES_DUP_WINDOW_MS     100   // Same frame from another receiver within this is a duplicate
 
 #define MODES_USER_LATLON_VALID (1<<0)
 
-#define MODES_ACFLAGS_LATLON_VALID   (1<<0)  // Aircraft Lat/Lon is decoded
-#define MODES_ACFLAGS_ALTITUDE_VALID (1<<1)  // Aircraft altitude is known
-#define MODES_ACFLAGS_HEADING_VALID  (1<<2)  // Aircraft heading is known
-#define MODES_ACFLAGS_SPEED_VALID    (1<<3)  // Aircraft speed is known
-#define MODES_ACFLAGS_VERTRATE_VALID (1<<4)  // Aircraft vertical rate is known
-#define MODES_ACFLAGS_SQUAWK_VALID   (1<<5)  // Aircraft Mode A Squawk is known
-#define MODES_ACFLAGS_CALLSIGN_VALID (1<<6)  // Aircraft Callsign Identity
-#define MODES_ACFLAGS_EWSPEED_VALID  (1<<7)  // Aircraft East West Speed is known
-#define MODES_ACFLAGS_NSSPEED_VALID  (1<<8)  // Aircraft North South Speed is known
-#define MODES_ACFLAGS_AOG            (1<<9)  // Aircraft is On the Ground
-#define MODES_ACFLAGS_LLEVEN_VALID   (1<<10) // Aircraft Even Lot/Lon is known
-#define MODES_ACFLAGS_LLODD_VALID    (1<<11) // Aircraft Odd Lot/Lon is known
-#define MODES_ACFLAGS_AOG_VALID      (1<<12) // MODES_ACFLAGS_AOG is valid
-#define MODES_ACFLAGS_FS_VALID       (1<<13) // Aircraft Flight Status is known
-#define MODES_ACFLAGS_NSEWSPD_VALID  (1<<14) // Aircraft EW and NS Speed is known
-#define MODES_ACFLAGS_LATLON_REL_OK  (1<<15) // Indicates it's OK to do a relative CPR
-
-#define MODES_ACFLAGS_LLEITHER_VALID (MODES_ACFLAGS_LLEVEN_VALID | MODES_ACFLAGS_LLODD_VALID)
-#define MODES_ACFLAGS_LLBOTH_VALID   (MODES_ACFLAGS_LLEVEN_VALID | MODES_ACFLAGS_LLODD_VALID)
-#define MODES_ACFLAGS_AOG_GROUND     (MODES_ACFLAGS_AOG_VALID    | MODES_ACFLAGS_AOG)
+// The MODES_ACFLAGS_xxx flags and MODES_UNIT_xxx units are in libmodes.h
 
 #define MODES_DEBUG_DEMOD (1<<0)
 #define MODES_DEBUG_DEMODERR (1<<1)
@@ -164,22 +199,44 @@
 #define MODES_DEBUG_NOPREAMBLE_LEVEL 25
 
 #define MODES_INTERACTIVE_REFRESH_TIME 250      // Milliseconds
+#define MODES_SNAPSHOT_INTERVAL        250      // Milliseconds between aircraft snapshots
+#define MODES_DB_CHECK_INTERVAL         60      // Seconds between checks for new registry files
+#define MODES_DB_MAX_SOURCES             8      // Registry sources given with --db-source
+#define MODES_CHECKPOINT_INTERVAL       30      // Seconds between tracker checkpoints
+#define MODES_CHECKPOINT_REL_TTL       600      // Seconds a restored position may be used for relative CPR
+#define MODES_TRAIL_INTERVAL       2000      // Milliseconds between points on an aircraft's trail
+#define MODES_TRAIL_BYTES             8192      // Most an aircraft's encoded trail may take
+#define MODES_OUT_BUF_SIZE      (1024*1024)     // Each of the two standard output buffers
+#define MODES_OUT_FLUSH_BYTES    (64*1024)      // Write the output once there's this much
+#define MODES_OUT_FLUSH_MS              50      // or it has waited this long
+#define MODES_OUT_LINE_MAX             512      // Room made for each outputPrintf()
+#define MODES_RECORD_JSON                1      // Formats of message records, see record.c
+#define MODES_RECORD_BINARY              2
+#define MODES_RECORD_VERSION             1      // Of the binary format
+#define MODES_RECORD_MAX               512      // Longest a record can be
+#define MODES_FILTER_ALT              0x01      // netFilter.flags: alt_min/alt_max apply
+#define MODES_FILTER_BOX              0x02      // lat_min ... lon_max apply
+#define MODES_FILTER_SPEC_MAX          512      // Longest filter a client may send
 #define MODES_INTERACTIVE_ROWS          22      // Rows on screen
+#define MODES_INTERACTIVE_COLS         128      // Longest line of the table kept, see interactivePrintf()
+#define MODES_INTERACTIVE_HEADER_ROWS    2      // Lines above the aircraft
 #define MODES_INTERACTIVE_DELETE_TTL   300      // Delete from the list after 300 seconds
 #define MODES_INTERACTIVE_DISPLAY_TTL   60      // Delete from display after 60 seconds
 
 #define MODES_NET_HEARTBEAT_RATE       900      // Each block is approx 65mS - default is > 1 min
 
-#define MODES_NET_SERVICES_NUM          6
+#define MODES_NET_SERVICES_NUM          7
 #define MODES_NET_INPUT_RAW_PORT    30001
 #define MODES_NET_OUTPUT_RAW_PORT   30002
 #define MODES_NET_OUTPUT_SBS_PORT   30003
 #define MODES_NET_INPUT_BEAST_PORT  30004
 #define MODES_NET_OUTPUT_BEAST_PORT 30005
+#define MODES_NET_OUTPUT_REC_PORT   30006
 #define MODES_NET_HTTP_PORT          8080
 #define MODES_CLIENT_BUF_SIZE  1024
 #define MODES_NET_SNDBUF_SIZE (1024*64)
 #define MODES_NET_SNDBUF_MAX  (7)
+#define MODES_SBS_SLOTS       64 // SBS clients sent AIR records, one bit each in a uint64_t
 
 #ifndef HTMLPATH
 #define HTMLPATH   "./public_html"      // default path for gmap.html etc
@@ -195,7 +252,58 @@ struct client {
     int    fd;                           // File descriptor
     int    service;                      // TCP port the client is connected to
     int    buflen;                       // Amount of data on buffer
-    char   buf[MODES_CLIENT_BUF_SIZE+1]; // Read buffer
+    int    bufsize;                      // Size of the read buffer
+    char  *buf;                          // Read buffer, allocated along with the client
+    char  *wbuf;                         // HTTP reply still being sent, or NULL
+    int    wlen;                         // Length of wbuf
+    int    wpos;                         // Bytes of it sent so far
+    int    noread;                       // Output client that has shut down its sending side
+    struct netFilter *filter;            // Messages it's sent, or NULL for all of them
+    unsigned int sbs_epoch;              // Modes.sbs_epoch it connected at, SBS clients only
+    int    sbs_slot;                     // Its bit in aircraft sbs_sent masks, -1 if none
+};
+
+// A compiled output filter, see filter.c. Clients asking for the same messages
+// share one, so it's evaluated once per message however many clients use it,
+// and its raw and Beast clients are sent one batch of the messages it passed.
+struct netFilter {
+    struct netFilter *next;              // In Modes.filters
+    int       refs;                      // Clients and listeners using it
+    int       flags;                     // MODES_FILTER_xxx
+    uint64_t  dfmask;                    // Bit n set to pass DF n. Mode A/C is 32
+    uint32_t  memask;                    // Bit n set to pass DF17/18 with ME type n
+    uint32_t *allow;                     // Sorted addresses to pass, all if nallow is 0
+    int       nallow;
+    uint32_t *deny;                      // Sorted addresses never to pass
+    int       ndeny;
+    int       alt_min, alt_max;          // Altitude range in feet
+    double    lat_min, lat_max;          // Box, which crosses 180 if lon_min > lon_max
+    double    lon_min, lon_max;
+    uint64_t  seq;                       // Modes.net_msg_seq of the message last tested
+    int       match;                     // and whether it passed
+    int       rawClients;                // Raw clients using it
+    char     *rawOut;                    // Raw output batched for them, or NULL
+    int       rawOutUsed;
+    int       beastClients;              // Beast clients using it
+    char     *beastOut;                  // Beast output batched for them, or NULL
+    int       beastOutUsed;
+};
+
+// A point on an aircraft's trail, see trail.c
+struct trailPoint {
+    uint64_t      time;           // Wall clock time, in tenths of a second since 1970
+    int32_t       lat, lon;       // In units of 1e-5 degrees
+    int32_t       alt;            // Altitude in feet
+};
+
+// The positions an aircraft has been seen at, delta encoded
+struct aircraftTrail {
+    unsigned char    *data;       // Encoded points after the first
+    int               size;       // Bytes allocated to data
+    int               start, end; // data[start] to data[end-1] are in use
+    int               count;      // Points in the trail
+    struct trailPoint first;      // The oldest point
+    struct trailPoint last;       // The newest point, the next is encoded from it
 };
 
 // Structure used to describe an aircraft in iteractive mode
@@ -227,22 +335,39 @@ struct aircraft {
     uint64_t      even_cprtime;
     double        lat, lon;       // Coordinated obtained from CPR encoded data
     int           bFlags;         // Flags related to valid fields in this structure
+
+    // From the aircraft registry when the aircraft was first seen, "" if it isn't known
+    char          registration[12]; // Registration mark, e.g. N12345 or G-ABCD
+    char          manufacturer[32]; // Manufacturer name
+    char          model[24];        // Aircraft type
+    uint64_t      sbs_sent;         // SBS client slots sent its registration, see net_io.c
+    unsigned int  sbs_epoch;        // Modes.sbs_epoch when sbs_sent was last brought up to date
+
+    struct aircraftTrail *trail;  // Where it has been, or NULL. Always NULL in a snapshot
+
     struct aircraft *next;        // Next aircraft in our linked list
+    struct aircraft *hnext;       // Next aircraft in the same Modes.aircraft_hash[] bucket
 };
 
-struct stDF {
-    struct stDF     *pNext;                      // Pointer to next item in the linked list
-    struct stDF     *pPrev;                      // Pointer to previous item in the linked list
-    struct aircraft *pAircraft;                  // Pointer to the Aircraft structure for this DF
-    time_t           seen;                       // Dos/UNIX Time at which the this packet was received
-    uint64_t         llTimestamp;                // Timestamp at which the this packet was received
-    uint32_t         addr;                       // Timestamp at which the this packet was received
-    unsigned char    msg[MODES_LONG_MSG_BYTES];  // the binary
-} tDF;
+// An immutable copy of the tracked aircraft, for readers (the display, JSON,
+// ...) that mustn't touch the live list. The copies are linked through their
+// next pointers in the same order as Modes.aircrafts. Snapshots are reference
+// counted, see interactiveGetSnapshot().
+struct aircraftSnapshot {
+    int              refs;       // Readers holding it, plus one while it's Modes.snapshot
+    uint64_t         epoch;      // Modes.tracker_epoch when it was taken
+    int              count;      // Number of aircraft
+    struct aircraft *aircrafts;  // The first aircraft, or NULL
+};
 
-// Program global state
-struct {                             // Internal state
-    pthread_t       reader_thread;
+// Structure used to describe one RTL device (or the --ifile input) and the
+// fifo of sample blocks between its reader thread and its demodulator
+struct receiver {
+    int             index;           // Our index in Modes.receivers[]
+    int             dev_index;       // RTL device index
+    rtlsdr_dev_t   *dev;             // RTL device handle
+    pthread_t       reader_thread;   // Thread reading samples from the device
+    pthread_t       demod_thread;    // Thread demodulating this receivers blocks
 
     pthread_mutex_t data_mutex;      // Mutex to synchronize buffer access
     pthread_cond_t  data_cond;       // Conditional variable associated
@@ -253,22 +378,72 @@ struct {                             // Internal state
     int             iDataReady;      // Fifo content count
     int             iDataLost;       // Count of missed buffers
 
-    uint16_t       *pFileData;       // Raw IQ samples buffer (from a File)
     uint16_t       *magnitude;       // Magnitude vector
+    uint32_t       *modeACMap;       // Samples that may start a Mode A/C reply, one bit each
+    int             soft_budget;     // Soft decision flip patterns left for this block
     uint64_t        timestampBlk;    // Timestamp of the start of the current block
     struct timeb    stSystemTimeBlk; // System time when RTL passed us currently processing this block
+
+    // Statistics
+    unsigned int    stat_blocks_processed;
+    unsigned int    stat_blocks_dropped;
+    unsigned int    stat_messages;   // Messages passed to the tracker
+    unsigned int    stat_duplicates; // Messages already heard by another receiver
+};
+
+// Entry in the cache of recently used frames, used to suppress the same frame
+// being demodulated by more than one receiver
+struct dupEntry {
+    uint64_t      msTime;                   // Wall clock time the frame was received
+    int           rx;                       // Receiver that first heard it
+    int           msgbits;                  // Frame length
+    unsigned char msg[MODES_LONG_MSG_BYTES];
+};
+
+// One entry of the oversampled demodulators half bit table, see modesInitDemodTaps()
+struct halfBitTap {
+    uint16_t offset;  // First sample covered, from the start of the 5 bit group
+    uint8_t  w[3];    // Fifths of that sample, and of the next two, in the half bit
+};
+
+struct stDF {
+    struct stDF     *pNext;                      // Pointer to next item in the linked list
+    struct stDF     *pPrev;                      // Pointer to previous item in the linked list
+    struct aircraft *pAircraft;                  // Pointer to the Aircraft structure for this DF
+    time_t           seen;                       // Dos/UNIX Time at which the this packet was received
+    uint64_t         llTimestamp;                // Timestamp at which the this packet was received
+    uint32_t         addr;                       // Timestamp at which the this packet was received
+    unsigned char    msg[MODES_LONG_MSG_BYTES];  // the binary
+} tDF;
+
+// Decoder context. Everything the demodulator, decoder and tracker know lives
+// in one of these, so several can run side by side (see libmodes.h). The code
+// reaches the context of the calling thread as Modes.
+struct modes {                       // Internal state
+    struct receiver receivers[MODES_MAX_RECEIVERS]; // RTL devices (or the --ifile input)
+    int             nreceivers;      // Number of receivers in use
+
+    pthread_mutex_t data_mutex;      // Mutex to synchronize tracker and output access between demodulators
+    pthread_cond_t  data_cond;       // Conditional variable associated
+
+    uint16_t       *pFileData;       // Raw IQ samples buffer (from a File)
     int             fd;              // --ifile option file descriptor
     uint32_t       *icao_cache;      // Recently seen ICAO addresses cache
+    struct dupEntry *dup_cache;      // Recently used frames, for multi receiver duplicate suppression
     uint16_t       *maglut;          // I/Q -> Magnitude lookup table
     int             exit;            // Exit from the main loop when true
+    modesMessageHandler message_handler; // Called with each message used, see libmodes.h
+    void           *message_arg;     // Passed to message_handler
 
     // RTLSDR
-    int           dev_index;
     int           gain;
     int           enable_agc;
-    rtlsdr_dev_t *dev;
     int           freq;
     int           ppm_error;
+    int           sample_rate;       // Samples per second, from the device or --ifile
+    int           sps5;              // Samples per 5us, one of MODES_RATE_xxxx_SPS5
+    uint32_t      mag_overlap;       // Samples carried over between magnitude blocks
+    struct halfBitTap demodTaps[5][10]; // Oversampled demodulator taps [start phase][half bit]
 
     // Networking
     char           aneterr[ANET_ERR_LEN];
@@ -279,10 +454,16 @@ struct {                             // Internal state
     int            bos;              // Beast output listening socket
     int            bis;              // Beast input listening socket
     int            https;            // HTTP listening socket
+    int            recos;            // Record output listening socket
     char          *rawOut;           // Buffer for building raw output data
     int            rawOutUsed;       // How much of the buffer is currently used
     char          *beastOut;         // Buffer for building beast output data
     int            beastOutUsed;     // How much if the buffer is currently used
+    struct netFilter *filters;       // Filters in use, see filter.c
+    int            filtered_clients; // Output clients with a filter
+    uint64_t       net_msg_seq;      // Bumped for each message queued for output
+    unsigned int   sbs_epoch;        // Bumped for each SBS client that connects
+    uint64_t       sbs_slots;        // SBS client slots in use
 #ifdef _WIN32
     WSADATA        wsaData;          // Windows socket initialisation
 #endif
@@ -291,6 +472,9 @@ struct {                             // Internal state
     char *filename;                  // Input form file, --ifile option
     int   phase_enhance;             // Enable phase enhancement if true
     int   nfix_crc;                  // Number of crc bit error(s) to correct
+    int   soft_fix;                  // Soft decision correction using the demodulators bit confidence
+    int   df11_fix;                  // Single bit correction of DF11 all call replies
+    int   cpu_budget;                // Percent of real time demodulation may take, 0 for no limit
     int   check_crc;                 // Only display messages with good CRC
     int   raw;                       // Raw output format
     int   beast;                     // Beast binary format output
@@ -304,20 +488,29 @@ struct {                             // Internal state
     int   net_output_raw_size;       // Minimum Size of the output raw data
     int   net_output_raw_rate;       // Rate (in 64mS increments) of output raw data
     int   net_output_raw_rate_count; // Rate (in 64mS increments) of output raw data
+    int   net_output_filter_rate_count; // The same for the filtered clients' batches
     int   net_output_raw_port;       // Raw output TCP port
     int   net_input_raw_port;        // Raw input TCP port
     int   net_output_beast_port;     // Beast output TCP port
     int   net_input_beast_port;      // Beast input TCP port
     char  *net_bind_address;         // Bind address
     int   net_http_port;             // HTTP port
+    int   net_output_rec_port;       // Record output TCP port
+    int   net_rec_format;            // Format of the records sent to it, MODES_RECORD_xxx
     int   net_sndbuf_size;           // TCP output buffer size (64Kb * 2^n)
+    char *net_output_raw_filter;     // Filters for each output port's clients, or NULL
+    char *net_output_beast_filter;
+    char *net_output_sbs_filter;
+    char *net_output_rec_filter;
     int   quiet;                     // Suppress stdout
     int   interactive;               // Interactive mode
     int   interactive_rows;          // Interactive mode: max number of rows
+    int   interactive_cols;          // Interactive mode: terminal width, 0 if not known
     int   interactive_display_ttl;   // Interactive mode: TTL display
     int   interactive_delete_ttl;    // Interactive mode: TTL before deletion
     int   stats;                     // Print stats at exit in --ifile mode
     int   onlyaddr;                  // Print only ICAO addresses
+    int   records;                   // Print records in this MODES_RECORD_xxx format, 0 for text
     int   metric;                    // Use metric units
     int   mlat;                      // Use Beast ascii format for raw data output, i.e. @...; iso *...;
     int   interactive_rtl1090;       // flight table in interactive mode is formatted like RTL1090
@@ -329,6 +522,26 @@ struct {                             // Internal state
 
     // Interactive mode
     struct aircraft *aircrafts;
+    struct aircraft *aircraft_hash[MODES_AIRCRAFT_HASH_LEN]; // The same aircraft, hashed by address
+    uint64_t         tracker_epoch;           // Bumped whenever the aircraft change
+    struct aircraftSnapshot *snapshot;        // Latest published copy of the aircraft
+    pthread_mutex_t  snapshot_mutex;          // Guards Modes.snapshot and the snapshot refs only
+    uint64_t         snapshot_time;           // When Modes.snapshot was published, in milliseconds
+    char            *screen;                  // What the terminal shows, screen_lines lines of MODES_INTERACTIVE_COLS
+    char            *screen_next;             // The frame being built, the same size
+    int              screen_lines;            // Lines allocated for each
+    int              screen_used;             // Lines of screen drawn on the terminal
+    int              screen_width;            // Columns of each line drawn on the terminal
+    int              screen_next_used;        // Lines of screen_next built so far
+    int              screen_repaint;          // Clear the terminal and draw it all at the next refresh
+    void           (*interactive_footer)(void); // Adds lines below the table with interactivePrintf(), or NULL
+    int              interactive_footer_rows; // How many lines it adds
+
+    // CPU budget controller
+    int             shed_level;       // MODES_SHED_xxx currently in force
+    int             shed_hold;        // Blocks to wait before shedding more
+    int             shed_relief;      // Consecutive blocks with headroom
+    int             load_avg16;       // Smoothed demodulation time, percent of real time x16
     uint64_t         interactive_last_update; // Last screen update in milliseconds
     time_t           last_cleanup_time;       // Last cleanup time in seconds
 
@@ -351,10 +564,27 @@ struct {                             // Internal state
     // index 1 for double bit errors etc.
     unsigned int stat_bit_fix[MODES_MAX_BITERRORS];
 
+    // Soft decision correction
+    unsigned int stat_soft_fixed;    // Frames corrected
+    unsigned int stat_soft_rejected; // Corrections whose ICAO address we hadn't seen
+    unsigned int stat_soft_skipped;  // Frames not tried because the block's budget was spent
+
+    // DF11 correction
+    uint32_t     df11_iid_seen[MODES_DF11_MAX_IID / 32 + 1]; // IID/SI codes heard from known aircraft
+    unsigned int stat_df11_fixed;     // Frames corrected
+    unsigned int stat_df11_ambiguous; // Frames with more than one valid correction
+    unsigned int stat_df11_rejected;  // Frames with no valid correction
+
+    // CPU budget controller
+    unsigned int stat_shed_entered[MODES_SHED_LEVELS]; // Times each level was shed down to
+    unsigned int stat_shed_restored;                   // Times a level was restored
+    unsigned int stat_shed_blocks[MODES_SHED_LEVELS];  // Blocks demodulated at each level
+
     unsigned int stat_http_requests;
     unsigned int stat_sbs_connections;
     unsigned int stat_raw_connections;
     unsigned int stat_beast_connections;
+    unsigned int stat_rec_connections;
     unsigned int stat_out_of_phase;
     unsigned int stat_ph_demodulated0;
     unsigned int stat_ph_demodulated1;
@@ -371,56 +601,64 @@ struct {                             // Internal state
     unsigned int stat_DF_Type_Corrected;
     unsigned int stat_ModeAC;
 
-    unsigned int stat_blocks_processed;
-    unsigned int stat_blocks_dropped;
-	// Add the db here
-	PlaneDb *db; 
-} Modes;
-
-// The struct we use to store information about a decoded message.
-struct modesMessage {
-    // Generic fields
-    unsigned char msg[MODES_LONG_MSG_BYTES];      // Binary message.
-    int           msgbits;                        // Number of bits in message 
-    int           msgtype;                        // Downlink format #
-    int           crcok;                          // True if CRC was valid
-    uint32_t      crc;                            // Message CRC
-    int           correctedbits;                  // No. of bits corrected 
-    char          corrected[MODES_MAX_BITERRORS]; // corrected bit positions
-    uint32_t      addr;                           // ICAO Address from bytes 1 2 and 3
-    int           phase_corrected;                // True if phase correction was applied
-    uint64_t      timestampMsg;                   // Timestamp of the message
-    int           remote;                         // If set this message is from a remote station
-    unsigned char signalLevel;                    // Signal Amplitude
-
-    // DF 11
-    int  ca;                    // Responder capabilities
-    int  iid;
-
-    // DF 17, DF 18
-    int    metype;              // Extended squitter message type.
-    int    mesub;               // Extended squitter message subtype.
-    int    heading;             // Reported by aircraft, or computed from from EW and NS velocity
-    int    raw_latitude;        // Non decoded latitude.
-    int    raw_longitude;       // Non decoded longitude.
-    double fLat;                // Coordinates obtained from CPR encoded data if/when decoded
-    double fLon;                // Coordinates obtained from CPR encoded data if/when decoded
-    char   flight[16];          // 8 chars flight number.
-    int    ew_velocity;         // E/W velocity.
-    int    ns_velocity;         // N/S velocity.
-    int    vert_rate;           // Vertical rate.
-    int    velocity;            // Reported by aircraft, or computed from from EW and NS velocity
-
-    // DF4, DF5, DF20, DF21
-    int  fs;                    // Flight status for DF4,5,20,21
-    int  modeA;                 // 13 bits identity (Squawk).
-
-    // Fields used by multiple message types.
-    int  altitude;
-    int  unit; 
-    int  bFlags;                // Flags related to fields in this structure
+    // Aircraft registry, see registry.c
+    PlaneDb        *db;                // Current registry, NULL if none is loaded
+    PlaneDbSource   db_sources[MODES_DB_MAX_SOURCES]; // Where it's loaded from, in priority order
+    int             db_nsources;       // 0 for the FAA files in the current directory
+    pthread_mutex_t db_mutex;          // Guards Modes.db, its refs, db_reload and db_stop
+    pthread_cond_t  db_cond;           // Wakes the reloader thread
+    pthread_t       db_thread;         // The reloader thread
+    int             db_thread_running;
+    int             db_reload;         // A reload has been asked for
+    int             db_stop;           // The reloader thread should exit
+    int             db_check_interval; // Seconds between checks for new files, 0 to never check
+    int             db_http_reload;    // Allow reloads to be asked for over HTTP
+    time_t          db_mtime;          // Modification time of the files last seen
+    time_t          db_next_check;
+    unsigned int    stat_db_reloads;
+    unsigned int    stat_db_reload_failures;
+
+    // Frame archive, see archive.c
+    char           *archive_dir;       // Where to write segments, NULL if not archiving
+    int             archive_segment_mb; // Size of each segment
+    int             archive_fd;        // Segment being written
+    struct archiveHeader *archive_hdr; // Its mapping, NULL if there's none
+    struct archiveRecord *archive_records;
+    size_t          archive_size;      // Of the mapping
+    uint64_t        archive_last_time; // Time of the last record written
+    unsigned int    stat_archived;
+    unsigned int    stat_archive_segments;
+
+    // Tracker checkpoint, see checkpoint.c
+    char           *checkpoint_file;   // Where to save the tracker state, NULL if not saving it
+    int             checkpoint_interval; // Seconds between saves
+    time_t          checkpoint_next;   // When the next save is due
+
+    // Buffered standard output, see output.c
+    pthread_mutex_t out_mutex;         // Guards the out_ fields
+    pthread_cond_t  out_cond;          // Wakes the writer thread, or a decoder waiting for it
+    pthread_t       out_thread;        // The writer thread
+    int             out_thread_running;
+    int             out_stop;          // The writer thread should write what's left and exit
+    int             out_error;         // Writing failed, so output is being thrown away
+    char           *out_buf[2];        // Being filled, and being written
+    int             out_len;           // Bytes in out_buf[0]
+    int             out_wlen;          // Bytes in out_buf[1], 0 once they're written
+    uint64_t        out_since;         // When out_buf[0] was started
 };
 
+#ifdef _MSC_VER
+    #define MODES_THREAD_LOCAL __declspec(thread)
+#else
+    #define MODES_THREAD_LOCAL __thread
+#endif
+
+// The context used by the calling thread. Every thread starts out using
+// modesDefaultContext, which is what the programs themselves use.
+extern struct modes modesDefaultContext;
+extern MODES_THREAD_LOCAL struct modes *modesContext;
+#define Modes (*modesContext)
+
 // ======================== function declarations =========================
 
 #ifdef __cplusplus
@@ -433,36 +671,100 @@ extern "C" {
 int  detectModeA       (uint16_t *m, struct modesMessage *mm);
 void decodeModeAMessage(struct modesMessage *mm, int ModeA);
 int  ModeAToModeC      (unsigned int ModeA);
+void detectModeACandidates(uint16_t *m, uint32_t mlen, uint32_t *map);
 
 //
 // Functions exported from mode_s.c
 //
-void detectModeS        (uint16_t *m, uint32_t mlen);
+void detectModeS        (struct receiver *rx, uint16_t *m, uint32_t mlen);
 void decodeModesMessage (struct modesMessage *mm, unsigned char *msg);
 void displayModesMessage(struct modesMessage *mm);
 void useModesMessage    (struct modesMessage *mm);
-void computeMagnitudeVector(uint16_t *pData);
+void computeMagnitudeVector(struct receiver *rx, uint16_t *pData);
 int  decodeCPR          (struct aircraft *a, int fflag, int surface);
 int  decodeCPRrelative  (struct aircraft *a, int fflag, int surface);
 void modesInitErrorInfo ();
+void modesInitDemodTaps ();
+int  modesCheckDuplicate(struct modesMessage *mm, uint64_t msTime);
+void addRecentlySeenICAOAddr(uint32_t addr);
 //
 // Functions exported from interactive.c
 //
+uint64_t mstime(void);
 struct aircraft* interactiveReceiveData(struct modesMessage *mm);
 void  interactiveShowData(void);
+void  interactivePrintf(const char *fmt, ...);
 void  interactiveRemoveStaleAircrafts(void);
 int   decodeBinMessage   (struct client *c, char *p);
+int   decodeHexMessage   (struct client *c, char *hex);
+int   hexDigitVal        (int c);
 struct aircraft *interactiveFindAircraft(uint32_t addr);
+void  interactivePublishSnapshot(void);
+struct aircraftSnapshot *interactiveGetSnapshot(void);
+void  interactiveReleaseSnapshot(struct aircraftSnapshot *s);
 struct stDF     *interactiveFindDF      (uint32_t addr);
 
+//
+// Functions exported from registry.c
+//
+void     registryInit         (void);
+void     registryExit         (void);
+PlaneDb *registryGet          (void);
+void     registryRelease      (PlaneDb *db);
+void     registryRequestReload(void);
+void     registryCheckFiles   (void);
+void     registryFillAircraft (struct aircraft *a);
+//
+// Functions exported from archive.c
+//
+void archiveInit   (void);
+void archiveExit   (void);
+void archiveMessage(struct modesMessage *mm);
+//
+// Functions exported from checkpoint.c
+//
+void checkpointLoad (void);
+void checkpointSave (void);
+void checkpointCheck(void);
+//
+// Functions exported from trail.c
+//
+void trailAdd (struct aircraft *a, uint64_t now);
+int  trailNext(const struct aircraftTrail *t, int *pos, struct trailPoint *pt);
+void trailFree(struct aircraft *a);
+//
+// Functions exported from record.c
+//
+int  modesRecord      (struct modesMessage *mm, int format, char *buf);
+int  modesRecordFormat(const char *name);
+//
+// Functions exported from filter.c
+//
+int  filterCompile(const char *spec, struct netFilter **f, char *err, int errlen);
+int  filterMatch  (struct netFilter *f, struct modesMessage *mm);
+void filterRelease(struct netFilter *f);
+//
+// Functions exported from output.c
+//
+void outputInit  (void);
+void outputExit  (void);
+void outputFlush (void);
+void outputBegin (void);
+void outputEnd   (int urgent);
+void outputWrite (const char *p, int len);
+void outputHex   (const unsigned char *msg, int len);
+void outputPrintf(const char *fmt, ...);
 //
 // Functions exported from net_io.c
 //
 void modesInitNet         (void);
 void modesReadFromClients (void);
 void modesSendAllClients  (int service, void *msg, int len);
+void modesFlushFilteredOutput(void);
 void modesQueueOutput     (struct modesMessage *mm);
 void modesReadFromClient(struct client *c, char *sep, int(*handler)(struct client *, char *));
+struct client *modesCreateClient(int fd, int service, int bufsize);
+void modesCloseClient     (struct client *c);
 
 #ifdef __cplusplus
 }
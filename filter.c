@@ -0,0 +1,343 @@
+// dump1090, a Mode S messages decoder for RTLSDR devices.
+//
+// Copyright (C) 2012 by Salvatore Sanfilippo <antirez@gmail.com>
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//  *  Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//  *  Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#include "dump1090.h"
+//
+// ============================= Output filters =============================
+//
+// A client of one of the output ports (raw, Beast, SBS or records) can ask to
+// be sent only some of the messages, by sending a line such as
+//
+//   FILTER df=17,18 me=1-4,9-18 alt=0,10000 box=51.0,-1.0,52.5,1.0
+//
+// or the port can be given a filter for all its clients with --net-ro-filter,
+// --net-bo-filter, --net-sbs-filter or --net-rec-filter. A line with just
+// FILTER goes back to sending everything. The terms, separated by spaces or
+// semicolons, are
+//
+//   icao=<hex>[,<hex>...]          only these aircraft
+//   deny=<hex>[,<hex>...]          never these aircraft
+//   df=<n>[-<m>][,...]             only these downlink formats, 32 for Mode A/C
+//   me=<n>[-<m>][,...]             only these ME types, for DF17 and DF18
+//   alt=<min>,<max>                only aircraft at these altitudes, in feet
+//   box=<lat1>,<lon1>,<lat2>,<lon2>  only aircraft inside this box
+//
+// alt and box use the message's altitude or position when it has one, and
+// otherwise what's known of the aircraft. An aircraft that isn't known to be
+// inside the range isn't sent.
+//
+// A filter is compiled to masks, sorted address lists and ranges. Clients with
+// the same filter share it, and it remembers its verdict on the last message,
+// so each message is tested once for each distinct filter, however many
+// clients use it.
+//
+static int filterCompareAddr(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *) a;
+    uint32_t y = *(const uint32_t *) b;
+
+    return ((x > y) - (x < y));
+}
+//
+//=========================================================================
+//
+// Parse a comma separated list of hex addresses into a sorted list
+//
+static int filterAddresses(const char *v, uint32_t **list, int *n) {
+    char *end;
+
+    while (*v) {
+        unsigned long addr = strtoul(v, &end, 16);
+        uint32_t *grown;
+
+        if ((end == v) || (addr > 0xFFFFFF) || ((*end) && (*end != ','))) {return (-1);}
+        if ((grown = (uint32_t *) realloc(*list, (*n + 1) * sizeof(uint32_t))) == NULL) {return (-1);}
+        *list = grown;
+        (*list)[(*n)++] = (uint32_t) addr;
+        v = (*end) ? (end + 1) : end;
+    }
+    if (*n == 0) {return (-1);}
+    qsort(*list, *n, sizeof(uint32_t), filterCompareAddr);
+    return (0);
+}
+//
+//=========================================================================
+//
+// Parse a comma separated list of numbers and ranges, none above max, into
+// a mask
+//
+static int filterRanges(const char *v, int max, uint64_t *mask) {
+    char *end;
+
+    *mask = 0;
+    while (*v) {
+        long lo = strtol(v, &end, 10), hi = lo;
+
+        if (end == v) {return (-1);}
+        if (*end == '-') {
+            v  = end + 1;
+            hi = strtol(v, &end, 10);
+            if (end == v) {return (-1);}
+        }
+        if ((lo < 0) || (hi > max) || (lo > hi) || ((*end) && (*end != ','))) {return (-1);}
+        for (; lo <= hi; lo++) {*mask |= ((uint64_t) 1) << lo;}
+        v = (*end) ? (end + 1) : end;
+    }
+    return ((*mask) ? 0 : -1);
+}
+//
+//=========================================================================
+//
+// Parse exactly count comma separated numbers
+//
+static int filterNumbers(const char *v, double *out, int count) {
+    char *end;
+    int j;
+
+    for (j = 0; j < count; j++) {
+        out[j] = strtod(v, &end);
+        if ((end == v) || (*end != ((j == count - 1) ? '\0' : ','))) {return (-1);}
+        v = end + 1;
+    }
+    return (0);
+}
+//
+//=========================================================================
+//
+static int filterEqual(const struct netFilter *a, const struct netFilter *b) {
+    if ((a->flags  != b->flags)  || (a->dfmask != b->dfmask) || (a->memask != b->memask) ||
+        (a->nallow != b->nallow) || (a->ndeny  != b->ndeny)) {return (0);}
+    if ((a->nallow) && (memcmp(a->allow, b->allow, a->nallow * sizeof(uint32_t)))) {return (0);}
+    if ((a->ndeny)  && (memcmp(a->deny,  b->deny,  a->ndeny  * sizeof(uint32_t)))) {return (0);}
+    if ((a->flags & MODES_FILTER_ALT) &&
+        ((a->alt_min != b->alt_min) || (a->alt_max != b->alt_max))) {return (0);}
+    if ((a->flags & MODES_FILTER_BOX) &&
+        ((a->lat_min != b->lat_min) || (a->lat_max != b->lat_max) ||
+         (a->lon_min != b->lon_min) || (a->lon_max != b->lon_max))) {return (0);}
+    return (1);
+}
+//
+//=========================================================================
+//
+static void filterFree(struct netFilter *f) {
+    free(f->allow);
+    free(f->deny);
+    free(f->rawOut);
+    free(f->beastOut);
+    free(f);
+}
+//
+//=========================================================================
+//
+// Compile spec into *f, which is NULL if it lets everything through. If
+// another client already has the same filter, *f is that one. Returns 0, or
+// -1 with a message in err if spec can't be understood.
+//
+int filterCompile(const char *spec, struct netFilter **f, char *err, int errlen) {
+    char buf[MODES_FILTER_SPEC_MAX];
+    char *term, *next, *v;
+    struct netFilter *nf, *other;
+    double n[4];
+    uint64_t mask;
+    int terms = 0;
+
+    *f = NULL;
+    if (strlen(spec) >= sizeof(buf)) {
+        snprintf(err, errlen, "Filter is too long");
+        return (-1);
+    }
+    strcpy(buf, spec);
+
+    if ((nf = (struct netFilter *) calloc(1, sizeof(*nf))) == NULL) {
+        snprintf(err, errlen, "Out of memory");
+        return (-1);
+    }
+    nf->dfmask = ~((uint64_t) 0);
+    nf->memask = ~((uint32_t) 0);
+
+    for (term = buf; *term; term = next) {
+        int bad = 0;
+
+        // Terms are separated by spaces or semicolons
+        while ((*term == ' ') || (*term == '\t') || (*term == ';') || (*term == '\r')) {term++;}
+        if (*term == 0) break;
+        for (next = term; (*next) && (*next != ' ') && (*next != '\t') && (*next != ';') && (*next != '\r'); next++);
+        if (*next) {*next++ = 0;}
+
+        if ((v = strchr(term, '=')) == NULL) {
+            bad = 1;
+        } else {
+            *v++ = 0;
+            if        (!strcmp(term, "icao")) {
+                bad = filterAddresses(v, &nf->allow, &nf->nallow);
+            } else if (!strcmp(term, "deny")) {
+                bad = filterAddresses(v, &nf->deny, &nf->ndeny);
+            } else if (!strcmp(term, "df")) {
+                bad = filterRanges(v, 32, &nf->dfmask);
+            } else if (!strcmp(term, "me")) {
+                bad = filterRanges(v, 31, &mask);
+                nf->memask = (uint32_t) mask;
+            } else if (!strcmp(term, "alt")) {
+                if ((bad = filterNumbers(v, n, 2)) == 0) {
+                    nf->alt_min = (int) n[0];
+                    nf->alt_max = (int) n[1];
+                    nf->flags  |= MODES_FILTER_ALT;
+                }
+            } else if (!strcmp(term, "box")) {
+                if ((bad = filterNumbers(v, n, 4)) == 0) {
+                    nf->lat_min = (n[0] < n[2]) ? n[0] : n[2];
+                    nf->lat_max = (n[0] < n[2]) ? n[2] : n[0];
+                    nf->lon_min = n[1];
+                    nf->lon_max = n[3];
+                    nf->flags  |= MODES_FILTER_BOX;
+                }
+            } else {
+                bad = 1;
+            }
+        }
+        if (bad) {
+            if (v) {v[-1] = '=';}
+            snprintf(err, errlen, "Bad filter term: %s", term);
+            filterFree(nf);
+            return (-1);
+        }
+        terms++;
+    }
+
+    if (terms == 0) { // Everything
+        filterFree(nf);
+        return (0);
+    }
+
+    // Share it with any other client that asked for the same
+    for (other = Modes.filters; other; other = other->next) {
+        if (filterEqual(other, nf)) {
+            filterFree(nf);
+            other->refs++;
+            *f = other;
+            return (0);
+        }
+    }
+    nf->refs      = 1;
+    nf->next      = Modes.filters;
+    Modes.filters = nf;
+    *f = nf;
+    return (0);
+}
+//
+//=========================================================================
+//
+// Drop a client's (or listener's) use of f, freeing it after the last
+//
+void filterRelease(struct netFilter *f) {
+    struct netFilter **p;
+
+    if ((f == NULL) || (--f->refs > 0)) {return;}
+
+    for (p = &Modes.filters; *p; p = &(*p)->next) {
+        if (*p == f) {
+            *p = f->next;
+            break;
+        }
+    }
+    filterFree(f);
+}
+//
+//=========================================================================
+//
+static int filterTest(struct netFilter *f, struct modesMessage *mm) {
+    struct aircraft *a = NULL;
+
+    if ((mm->msgtype > 32) || (((f->dfmask >> mm->msgtype) & 1) == 0)) {return (0);}
+    if (((mm->msgtype == 17) || (mm->msgtype == 18)) &&
+        (((f->memask >> (mm->metype & 31)) & 1) == 0)) {return (0);}
+
+    if ((f->nallow) &&
+        (bsearch(&mm->addr, f->allow, f->nallow, sizeof(uint32_t), filterCompareAddr) == NULL)) {return (0);}
+    if ((f->ndeny) &&
+        (bsearch(&mm->addr, f->deny,  f->ndeny,  sizeof(uint32_t), filterCompareAddr) != NULL)) {return (0);}
+
+    // The ranges need the aircraft when the message doesn't say
+    if (f->flags) {a = interactiveFindAircraft(mm->addr);}
+
+    if (f->flags & MODES_FILTER_ALT) {
+        int alt;
+
+        if ((mm->bFlags & MODES_ACFLAGS_AOG_GROUND) == MODES_ACFLAGS_AOG_GROUND) {
+            alt = 0;
+        } else if (mm->bFlags & MODES_ACFLAGS_ALTITUDE_VALID) {
+            alt = (mm->unit == MODES_UNIT_METERS) ? (int) (mm->altitude * 3.2808) : mm->altitude;
+        } else if ((a) && ((a->bFlags & MODES_ACFLAGS_AOG_GROUND) == MODES_ACFLAGS_AOG_GROUND)) {
+            alt = 0;
+        } else if ((a) && (a->bFlags & MODES_ACFLAGS_ALTITUDE_VALID)) {
+            alt = a->altitude;
+        } else {
+            return (0);
+        }
+        if ((alt < f->alt_min) || (alt > f->alt_max)) {return (0);}
+    }
+
+    if (f->flags & MODES_FILTER_BOX) {
+        double lat, lon;
+
+        if (mm->bFlags & MODES_ACFLAGS_LATLON_VALID) {
+            lat = mm->fLat; lon = mm->fLon;
+        } else if ((a) && (a->bFlags & MODES_ACFLAGS_LATLON_VALID)) {
+            lat = a->lat;   lon = a->lon;
+        } else {
+            return (0);
+        }
+        if ((lat < f->lat_min) || (lat > f->lat_max)) {return (0);}
+        if (f->lon_min <= f->lon_max) {
+            if ((lon < f->lon_min) || (lon > f->lon_max)) {return (0);}
+        } else if ((lon < f->lon_min) && (lon > f->lon_max)) {
+            return (0); // The box crosses 180
+        }
+    }
+    return (1);
+}
+//
+//=========================================================================
+//
+// Whether mm is to be sent to clients with filter f. Heartbeats always are,
+// to keep the link up.
+//
+int filterMatch(struct netFilter *f, struct modesMessage *mm) {
+    if ((f == NULL) || (mm->heartbeat)) {return (1);}
+
+    if (f->seq != Modes.net_msg_seq) {
+        f->seq   = Modes.net_msg_seq;
+        f->match = filterTest(f, mm);
+    }
+    return (f->match);
+}
+//
+//=========================================================================
+//
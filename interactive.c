@@ -29,10 +29,13 @@
 //
 
 #include "dump1090.h"
+#include <stdarg.h>
 //
 // ============================= Utility functions ==========================
 //
-static uint64_t mstime(void) {
+// Milliseconds since 1970
+//
+uint64_t mstime(void) {
     struct timeval tv;
     uint64_t mst;
 
@@ -152,6 +155,8 @@ struct aircraft *interactiveCreateAircraft(struct modesMessage *mm) {
             mm->altitude = modeC * 100;
             mm->bFlags  |= MODES_ACFLAGS_ALTITUDE_VALID;
         }
+    } else {
+        registryFillAircraft(a); // Once, rather than for every message
     }
     return (a);
 }
@@ -162,17 +167,30 @@ struct aircraft *interactiveCreateAircraft(struct modesMessage *mm) {
 // exists with this address.
 //
 struct aircraft *interactiveFindAircraft(uint32_t addr) {
-    struct aircraft *a = Modes.aircrafts;
+    struct aircraft *a = Modes.aircraft_hash[MODES_AIRCRAFT_HASH(addr)];
 
     while(a) {
         if (a->addr == addr) return (a);
-        a = a->next;
+        a = a->hnext;
     }
     return (NULL);
 }
 //
 //=========================================================================
 //
+// Take aircraft a out of its Modes.aircraft_hash[] bucket, before freeing it
+//
+static void interactiveUnhashAircraft(struct aircraft *a) {
+    struct aircraft **pp = &Modes.aircraft_hash[MODES_AIRCRAFT_HASH(a->addr)];
+
+    while (*pp) {
+        if (*pp == a) {*pp = a->hnext; return;}
+        pp = &(*pp)->hnext;
+    }
+}
+//
+//=========================================================================
+//
 // We have received a Mode A or C response. 
 //
 // Search through the list of known Mode-S aircraft and tag them if this Mode A/C 
@@ -269,6 +287,8 @@ struct aircraft *interactiveReceiveData(struct modesMessage *mm) {
         a = interactiveCreateAircraft(mm); // ., create a new record for it,
         a->next = Modes.aircrafts;         // .. and put it at the head of the list
         Modes.aircrafts = a;
+        a->hnext = Modes.aircraft_hash[MODES_AIRCRAFT_HASH(a->addr)]; // ... and in its hash bucket
+        Modes.aircraft_hash[MODES_AIRCRAFT_HASH(a->addr)] = a;
     } else {
         /* If it is an already known aircraft, move it on head
          * so we keep aircrafts ordered by received message time.
@@ -288,6 +308,8 @@ struct aircraft *interactiveReceiveData(struct modesMessage *mm) {
         }
     }
 
+    Modes.tracker_epoch++;                            // Readers' snapshot is now out of date
+
     a->signalLevel[a->messages & 7] = mm->signalLevel;// replace the 8th oldest signal strength
     a->seen      = time(NULL);
     a->timestamp = mm->timestampMsg;
@@ -372,6 +394,7 @@ struct aircraft *interactiveReceiveData(struct modesMessage *mm) {
             mm->bFlags |= MODES_ACFLAGS_LATLON_VALID;
             mm->fLat    = a->lat;
             mm->fLon    = a->lon;
+            trailAdd(a, mstime());
         }
     }
 
@@ -406,14 +429,138 @@ struct aircraft *interactiveReceiveData(struct modesMessage *mm) {
 //
 //=========================================================================
 //
+// The table is drawn by building each frame as lines of MODES_INTERACTIVE_COLS
+// characters, padded with spaces, and comparing them with the last frame
+// drawn. Only the span of each line that changed is written, after a cursor
+// move, all in one write. Most refreshes only change the seconds since each
+// aircraft was last seen and the odd altitude, so over a slow link (ssh)
+// this is a few hundred bytes rather than the whole screen, and it doesn't
+// flicker. Lines are cut to the width of the terminal, as one that wrapped
+// would put everything drawn after it in the wrong place.
+//
+// Add a line to the frame being built
+//
+void interactivePrintf(const char *fmt, ...) {
+    va_list ap;
+    char *line;
+    int len;
+
+    if (Modes.screen_next_used == Modes.screen_lines) {
+        int   lines = (Modes.screen_lines) ? (Modes.screen_lines * 2) : 64;
+        char *screen, *next;
+
+        if ((screen = (char *) realloc(Modes.screen, lines * MODES_INTERACTIVE_COLS)) != NULL) {
+            Modes.screen = screen;
+        }
+        if ((next = (char *) realloc(Modes.screen_next, lines * MODES_INTERACTIVE_COLS)) != NULL) {
+            Modes.screen_next = next;
+        }
+        if ((screen == NULL) || (next == NULL)) {return;} // Leave the line out
+        Modes.screen_lines = lines;
+    }
+
+    line = Modes.screen_next + (Modes.screen_next_used++ * MODES_INTERACTIVE_COLS);
+    va_start(ap, fmt);
+    len = vsnprintf(line, MODES_INTERACTIVE_COLS, fmt, ap);
+    va_end(ap);
+    if (len < 0) {len = 0;}
+    if (len >= MODES_INTERACTIVE_COLS) {len = MODES_INTERACTIVE_COLS - 1;} // Cut short
+    memset(line + len, ' ', MODES_INTERACTIVE_COLS - len);
+}
+//
+//=========================================================================
+//
+// Put the frame built with interactivePrintf() on the terminal, writing only
+// what differs from the last one, and make it the last one.
+//
+static void interactiveDrawScreen(void) {
+    int   lines = (Modes.screen_used > Modes.screen_next_used) ? Modes.screen_used : Modes.screen_next_used;
+    int   width = MODES_INTERACTIVE_COLS;
+    char *out, *p;
+    int   j;
+
+    // Stop short of the last column, so no terminal wraps the line
+    if ((Modes.interactive_cols > 1) && (Modes.interactive_cols <= MODES_INTERACTIVE_COLS)) {
+        width = Modes.interactive_cols - 1;
+    }
+
+    // At worst every line is rewritten, with a cursor move before it
+    if ((out = (char *) malloc(lines * (MODES_INTERACTIVE_COLS + 16) + 16)) == NULL) {return;}
+    p = out;
+
+#ifndef _WIN32
+    if ((Modes.screen_repaint) || (Modes.screen_used == 0) || (width != Modes.screen_width)) {
+        p += sprintf(p, "\x1b[H\x1b[2J"); // Clear the screen
+        Modes.screen_used = 0;
+    }
+
+    for (j = 0; j < lines; j++) {
+        const char *now = (j < Modes.screen_next_used) ? Modes.screen_next + (j * MODES_INTERACTIVE_COLS) : NULL;
+        const char *was = (j < Modes.screen_used)      ? Modes.screen      + (j * MODES_INTERACTIVE_COLS) : NULL;
+        int first, last;
+
+        // A line that isn't there is all spaces
+        for (first = 0; first < width; first++) {
+            if (((now) ? now[first] : ' ') != ((was) ? was[first] : ' ')) break;
+        }
+        if (first == width) {continue;}
+
+        for (last = width; last > first; last--) {
+            if (((now) ? now[last-1] : ' ') != ((was) ? was[last-1] : ' ')) break;
+        }
+
+        p += sprintf(p, "\x1b[%d;%dH", j + 1, first + 1);
+        if (now) {memcpy(p, now + first, last - first);}
+        else     {memset(p, ' ',         last - first);}
+        p += last - first;
+    }
+
+    // Leave the cursor below the table
+    if (p != out) {
+        p += sprintf(p, "\x1b[%d;1H", Modes.screen_next_used + 1);
+    }
+#else
+    // The console doesn't follow escape sequences, so draw it all
+    cls();
+    for (j = 0; j < Modes.screen_next_used; j++) {
+        const char *now = Modes.screen_next + (j * MODES_INTERACTIVE_COLS);
+        int last;
+
+        for (last = width; (last > 0) && (now[last-1] == ' '); last--);
+        memcpy(p, now, last);
+        p += last;
+        *p++ = '\n';
+    }
+#endif
+
+    fwrite(out, 1, p - out, stdout);
+    fflush(stdout);
+    free(out);
+
+    // That's what's on the terminal now
+    if (Modes.screen_next_used) {
+        memcpy(Modes.screen, Modes.screen_next, Modes.screen_next_used * MODES_INTERACTIVE_COLS);
+    }
+    Modes.screen_used      = Modes.screen_next_used;
+    Modes.screen_width     = width;
+    Modes.screen_next_used = 0;
+    Modes.screen_repaint   = 0;
+}
+//
+//=========================================================================
+//
 // Show the currently captured interactive data on screen.
 //
 void interactiveShowData(void) {
-    struct aircraft *a = Modes.aircrafts;
+    struct aircraftSnapshot *snap;
+    struct aircraft *a;
     time_t now = time(NULL);
     int count = 0;
+    int rows;
     char progress;
     char spinner[4] = "|/-\\";
+    PlaneDb *db;
+    int registry;
 
     // Refresh screen every (MODES_INTERACTIVE_REFRESH_TIME) miliseconde
     if ((mstime() - Modes.interactive_last_update) < MODES_INTERACTIVE_REFRESH_TIME)
@@ -421,31 +568,35 @@ void interactiveShowData(void) {
 
     Modes.interactive_last_update = mstime();
 
-    // Attempt to reconsile any ModeA/C with known Mode-S
-    // We can't condition on Modes.modeac because ModeA/C could be comming
-    // in from a raw input port which we can't turn off.
-    interactiveUpdateAircraftModeS();
+    // Only widen the table if there's a registry. The reloader may be
+    // swapping it, so ask registryGet() rather than reading Modes.db
+    db       = registryGet();
+    registry = (db != NULL);
+    registryRelease(db);
+
+    // Work from the latest snapshot, so the decoder can carry on meanwhile
+    snap = interactiveGetSnapshot();
+    a    = (snap) ? snap->aircrafts : NULL;
 
     progress = spinner[time(NULL)%4];
 
-#ifndef _WIN32
-    printf("\x1b[H\x1b[2J");    // Clear the screen
-#else
-    cls();
-#endif
+    // The whole frame has to fit on the screen, or the lines past the bottom
+    // would all be drawn over the last one
+    rows = Modes.interactive_rows - MODES_INTERACTIVE_HEADER_ROWS - Modes.interactive_footer_rows;
 
     if (Modes.interactive_rtl1090 == 0) {
-        printf (
-"Hex     Mode  Sqwk  Flight   Alt    Spd  Hdg    Lat      Long   Sig  Msgs   Ti%c\n", progress);
+        interactivePrintf(
+"Hex     Mode  Sqwk  Flight   Alt    Spd  Hdg    Lat      Long   Sig  Msgs   Ti%c%s", progress,
+        (registry) ? "  Reg     Type" : "");
     } else {
-        printf (
-"Hex    Flight   Alt      V/S GS  TT  SSR  G*456^ Msgs    Seen %c\n", progress);
+        interactivePrintf(
+"Hex    Flight   Alt      V/S GS  TT  SSR  G*456^ Msgs    Seen %c", progress);
     }
-    printf(
-"-------------------------------------------------------------------------------\n");
-
-    while(a && (count < Modes.interactive_rows)) {
+    interactivePrintf(
+"-------------------------------------------------------------------------------%s",
+        (registry && !Modes.interactive_rtl1090) ? "------------------" : "");
 
+    while(a && (count < rows)) {
         if ((now - a->seen) < Modes.interactive_display_ttl)
             {
             int msgs  = a->messages;
@@ -484,13 +635,14 @@ void interactiveShowData(void) {
                     if (a->bFlags & MODES_ACFLAGS_ALTITUDE_VALID) {
                         snprintf(strFl,6,"F%03d",(altitude/100));
                     }
-                    printf("%06x %-8s %-4s         %-3s %-3s %4s        %-6d  %-2d\n", 
+                    interactivePrintf("%06x %-8s %-4s         %-3s %-3s %4s        %-6d  %-2d", 
                     a->addr, a->flight, strFl, strGs, strTt, strSquawk, msgs, (int)(now - a->seen));
 
                 } else {                         // Dump1090 display mode
                     char strMode[5]               = "    ";
                     char strLat[8]                = " ";
                     char strLon[9]                = " ";
+                    char strReg[32]               = "";
                     unsigned char * pSig       = a->signalLevel;
                     unsigned int signalAverage = (pSig[0] + pSig[1] + pSig[2] + pSig[3] + 
                                                   pSig[4] + pSig[5] + pSig[6] + pSig[7] + 3) >> 3; 
@@ -514,15 +666,105 @@ void interactiveShowData(void) {
                         snprintf(strFl, 6, "%5d", altitude);
                     }
 
-                    printf("%06X  %-4s  %-4s  %-8s %5s  %3s  %3s  %7s %8s  %3d %5d   %2d\n",
+                    if (registry) {
+                        snprintf(strReg, sizeof(strReg), "   %-7s %.10s", a->registration, a->model);
+                    }
+
+                    interactivePrintf("%06X  %-4s  %-4s  %-8s %5s  %3s  %3s  %7s %8s  %3d %5d   %2d%s",
                     a->addr, strMode, strSquawk, a->flight, strFl, strGs, strTt,
-                    strLat, strLon, signalAverage, msgs, (int)(now - a->seen));
+                    strLat, strLon, signalAverage, msgs, (int)(now - a->seen), strReg);
                 }
                 count++;
             }
         }
         a = a->next;
     }
+
+    interactiveReleaseSnapshot(snap);
+
+    if (Modes.interactive_footer) {Modes.interactive_footer();}
+    interactiveDrawScreen();
+}
+//
+//=========================================================================
+//
+// Publish a snapshot of the aircraft for the readers, if they've changed since
+// the last one and that was at least MODES_SNAPSHOT_INTERVAL ago. Called by
+// the writer, with Modes.data_mutex held.
+//
+// The snapshot_mutex is only held to swap the pointer, so the writer never
+// waits for a reader to finish with a snapshot. The old snapshot is freed by
+// whoever drops the last reference to it.
+//
+void interactivePublishSnapshot(void) {
+    struct aircraftSnapshot *s, *old;
+    struct aircraft *a, *copy;
+    uint64_t now = mstime();
+    int count = 0;
+
+    if ((Modes.snapshot) && 
+       ((Modes.snapshot->epoch == Modes.tracker_epoch) || ((now - Modes.snapshot_time) < MODES_SNAPSHOT_INTERVAL)))
+        {return;}
+
+    // Attempt to reconsile any ModeA/C with known Mode-S, for the display
+    // We can't condition on Modes.modeac because ModeA/C could be comming
+    // in from a raw input port which we can't turn off.
+    if (Modes.interactive) {
+        interactiveUpdateAircraftModeS();
+    }
+
+    for (a = Modes.aircrafts; a; a = a->next) {count++;}
+
+    s = (struct aircraftSnapshot *) malloc(sizeof(*s) + (count * sizeof(struct aircraft)));
+    if (s == NULL) {return;} // Readers keep the last one
+
+    s->refs      = 1;
+    s->epoch     = Modes.tracker_epoch;
+    s->count     = count;
+    s->aircrafts = (count) ? (struct aircraft *) (s + 1) : NULL;
+
+    for (a = Modes.aircrafts, copy = s->aircrafts; a; a = a->next, copy++) {
+        *copy       = *a;
+        copy->next  = (a->next) ? (copy + 1) : NULL;
+        copy->hnext = NULL;
+        copy->trail = NULL; // It belongs to the live aircraft
+    }
+
+    pthread_mutex_lock(&Modes.snapshot_mutex);
+    old = Modes.snapshot;
+    Modes.snapshot = s;
+    pthread_mutex_unlock(&Modes.snapshot_mutex);
+
+    Modes.snapshot_time = now;
+    interactiveReleaseSnapshot(old);
+}
+//
+//=========================================================================
+//
+// Return the latest aircraft snapshot, which stays valid until it's given to
+// interactiveReleaseSnapshot(). NULL if none has been published yet.
+//
+struct aircraftSnapshot *interactiveGetSnapshot(void) {
+    struct aircraftSnapshot *s;
+
+    pthread_mutex_lock(&Modes.snapshot_mutex);
+    if ((s = Modes.snapshot) != NULL) {s->refs++;}
+    pthread_mutex_unlock(&Modes.snapshot_mutex);
+    return (s);
+}
+//
+//=========================================================================
+//
+void interactiveReleaseSnapshot(struct aircraftSnapshot *s) {
+    int last;
+
+    if (s == NULL) {return;}
+
+    pthread_mutex_lock(&Modes.snapshot_mutex);
+    last = (--s->refs == 0);
+    pthread_mutex_unlock(&Modes.snapshot_mutex);
+
+    if (last) {free(s);}
 }
 //
 //=========================================================================
@@ -545,6 +787,9 @@ void interactiveRemoveStaleAircrafts(void) {
             if ((now - a->seen) > Modes.interactive_delete_ttl) {
                 // Remove the element from the linked list, with care
                 // if we are removing the first element
+                interactiveUnhashAircraft(a);
+                trailFree(a);
+                Modes.tracker_epoch++;
                 if (!prev) {
                     Modes.aircrafts = a->next; free(a); a = Modes.aircrafts;
                 } else {
@@ -0,0 +1,381 @@
+// dump1090, a Mode S messages decoder for RTLSDR devices.
+//
+// Copyright (C) 2012 by Salvatore Sanfilippo <antirez@gmail.com>
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//  *  Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//  *  Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include "dump1090.h"
+//
+// ======================== Decoder contexts ================================
+//
+// The context the programs use, and the one each thread is using. Every
+// thread starts out with modesDefaultContext.
+//
+struct modes modesDefaultContext;
+MODES_THREAD_LOCAL struct modes *modesContext = &modesDefaultContext;
+//
+//=========================================================================
+//
+// The error correction tables are the same for every context, so are only
+// built once
+//
+static pthread_once_t errorInfoOnce = PTHREAD_ONCE_INIT;
+//
+//=========================================================================
+//
+// Bind ctx to the calling thread and return the context it was using
+//
+struct modes *modesUseContext(struct modes *ctx) {
+    struct modes *prev = modesContext;
+
+    modesContext = ctx;
+    return (prev);
+}
+//
+//=========================================================================
+//
+// Return a new context with the default configuration. Library users get a
+// quiet context: nothing is printed on stdout, and there's no networking.
+//
+struct modes *modesNewContext(void) {
+    struct modes *ctx = (struct modes *) calloc(1, sizeof(struct modes));
+
+    if (ctx) {
+        ctx->sample_rate             = MODES_DEFAULT_RATE;
+        ctx->check_crc               = 1;
+        ctx->quiet                   = 1;
+        ctx->interactive_rows        = MODES_INTERACTIVE_ROWS;
+        ctx->interactive_delete_ttl  = MODES_INTERACTIVE_DELETE_TTL;
+        ctx->interactive_display_ttl = MODES_INTERACTIVE_DISPLAY_TTL;
+        ctx->fUserLat                = MODES_USER_LATITUDE_DFLT;
+        ctx->fUserLon                = MODES_USER_LONGITUDE_DFLT;
+    }
+    return (ctx);
+}
+//
+//=========================================================================
+//
+// Configuration setters for library users. ctx->maglut is only allocated by
+// modesInitContext(), so it tells whether it's too late for a change.
+//
+int modesSetSampleRate(struct modes *ctx, int rate) {
+    if ((ctx == NULL) || (ctx->maglut)) {return (-1);}
+    if ((rate != 2000000) && (rate != 2400000) && (rate != 3200000) && (rate != 4000000)) {return (-1);}
+    ctx->sample_rate = rate;
+    return (0);
+}
+
+int modesSetReceivers(struct modes *ctx, int count) {
+    if ((ctx == NULL) || (ctx->maglut) || (count < 1) || (count > MODES_MAX_RECEIVERS)) {return (-1);}
+    ctx->nreceivers = count;
+    return (0);
+}
+
+int modesSetFixModes(struct modes *ctx, int nbits, int flags) {
+    if ((ctx == NULL) || (ctx->maglut) || (nbits < 0) || (nbits > MODES_MAX_BITERRORS) ||
+        (flags & ~(MODES_FIX_PHASE | MODES_FIX_SOFT | MODES_FIX_DF11))) {return (-1);}
+    ctx->nfix_crc      = nbits;
+    ctx->phase_enhance = (flags & MODES_FIX_PHASE) ? 1 : 0;
+    ctx->soft_fix      = (flags & MODES_FIX_SOFT)  ? 1 : 0;
+    ctx->df11_fix      = (flags & MODES_FIX_DF11)  ? 1 : 0;
+    return (0);
+}
+//
+//=========================================================================
+//
+// Return receiver n of ctx, or NULL if ctx hasn't got one
+//
+struct receiver *modesGetReceiver(struct modes *ctx, int n) {
+    if ((ctx == NULL) || (ctx->maglut == NULL) || (n < 0) || (n >= ctx->nreceivers)) {return (NULL);}
+    return (&ctx->receivers[n]);
+}
+
+void modesSetMessageHandler(struct modes *ctx, modesMessageHandler fn, void *arg) {
+    ctx->message_handler = fn;
+    ctx->message_arg     = arg;
+}
+//
+//=========================================================================
+//
+// Build the I/Q to magnitude lookup table
+//
+static void modesInitMagnitudeLUT(void) {
+    int i, q;
+
+    // Each I and Q value varies from 0 to 255, which represents a range from -1 to +1. To get from the 
+    // unsigned (0-255) range you therefore subtract 127 (or 128 or 127.5) from each I and Q, giving you 
+    // a range from -127 to +128 (or -128 to +127, or -127.5 to +127.5)..
+    //
+    // To decode the AM signal, you need the magnitude of the waveform, which is given by sqrt((I^2)+(Q^2))
+    // The most this could be is if I&Q are both 128 (or 127 or 127.5), so you could end up with a magnitude 
+    // of 181.019 (or 179.605, or 180.312)
+    //
+    // However, in reality the magnitude of the signal should never exceed the range -1 to +1, because the 
+    // values are I = rCos(w) and Q = rSin(w). Therefore the integer computed magnitude should (can?) never 
+    // exceed 128 (or 127, or 127.5 or whatever)
+    //
+    // If we scale up the results so that they range from 0 to 65535 (16 bits) then we need to multiply 
+    // by 511.99, (or 516.02 or 514). antirez's original code multiplies by 360, presumably because he's 
+    // assuming the maximim calculated amplitude is 181.019, and (181.019 * 360) = 65166.
+    //
+    // So lets see if we can improve things by subtracting 127.5, Well in integer arithmatic we can't
+    // subtract half, so, we'll double everything up and subtract one, and then compensate for the doubling 
+    // in the multiplier at the end.
+    //
+    // If we do this we can never have I or Q equal to 0 - they can only be as small as +/- 1.
+    // This gives us a minimum magnitude of root 2 (0.707), so the dynamic range becomes (1.414-255). This 
+    // also affects our scaling value, which is now 65535/(255 - 1.414), or 258.433254
+    //
+    // The sums then become mag = 258.433254 * (sqrt((I*2-255)^2 + (Q*2-255)^2) - 1.414)
+    //                   or mag = (258.433254 * sqrt((I*2-255)^2 + (Q*2-255)^2)) - 365.4798
+    //
+    // We also need to clip mag just incaes any rogue I/Q values somehow do have a magnitude greater than 255.
+    //
+
+    for (i = 0; i <= 255; i++) {
+        for (q = 0; q <= 255; q++) {
+            int mag, mag_i, mag_q;
+
+            mag_i = (i * 2) - 255;
+            mag_q = (q * 2) - 255;
+
+            mag = (int) round((sqrt((mag_i*mag_i)+(mag_q*mag_q)) * 258.433254) - 365.4798);
+
+            Modes.maglut[(i*256)+q] = (uint16_t) ((mag < 65535) ? mag : 65535);
+        }
+    }
+
+}
+//
+//=========================================================================
+//
+// Allocate and initialise the demodulator, decoder and tracker state of ctx,
+// and of its first ctx->nreceivers receivers (at least one). Returns 0, or -1
+// on failure.
+//
+int modesInitContext(struct modes *ctx) {
+    struct modes *prev = modesUseContext(ctx);
+    int i, q;
+
+    pthread_mutex_init(&Modes.pDF_mutex,NULL);
+    pthread_mutex_init(&Modes.data_mutex,NULL);
+    pthread_mutex_init(&Modes.snapshot_mutex,NULL);
+    pthread_mutex_init(&Modes.db_mutex,NULL);
+    pthread_cond_init(&Modes.db_cond,NULL);
+    pthread_cond_init(&Modes.data_cond,NULL);
+    pthread_mutex_init(&Modes.out_mutex,NULL);
+    pthread_cond_init(&Modes.out_cond,NULL);
+
+    // Allocate the various buffers used by Modes
+    if ( ((Modes.icao_cache = (uint32_t *) malloc(sizeof(uint32_t) * MODES_ICAO_CACHE_LEN * 2)                  ) == NULL) ||
+         ((Modes.dup_cache  = (struct dupEntry *) malloc(sizeof(struct dupEntry) * MODES_DUP_CACHE_LEN)         ) == NULL) ||
+         ((Modes.maglut     = (uint16_t *) malloc(sizeof(uint16_t) * 256 * 256)                                 ) == NULL) ) 
+    {
+        fprintf(stderr, "Out of memory allocating data buffer.\n");
+        modesUseContext(prev);
+        return (-1);
+    }
+
+    // Clear the buffers that have just been allocated, just in-case
+    memset(Modes.icao_cache, 0,   sizeof(uint32_t) * MODES_ICAO_CACHE_LEN * 2);
+    memset(Modes.dup_cache,  0,   sizeof(struct dupEntry) * MODES_DUP_CACHE_LEN);
+
+    // Work out the per rate constants. Above 2MHz the demodulator correlates
+    // against the preamble at fractional sample phases, which replaces the
+    // phase enhancement retry. Mode A/C detection is only done at 2MHz.
+    switch (Modes.sample_rate) {
+        case 2000000: Modes.sps5 = MODES_RATE_2000_SPS5; break;
+        case 2400000: Modes.sps5 = MODES_RATE_2400_SPS5; break;
+        case 3200000: Modes.sps5 = MODES_RATE_3200_SPS5; break;
+        case 4000000: Modes.sps5 = MODES_RATE_4000_SPS5; break;
+        default:
+            fprintf(stderr, "Unsupported sample rate %d, use 2.0, 2.4, 3.2 or 4.0 MS/s.\n", Modes.sample_rate);
+            modesUseContext(prev);
+            return (-1);
+    }
+    Modes.mag_overlap = MODES_MAG_OVERLAP(Modes.sps5);
+    if (Modes.sps5 != MODES_RATE_2000_SPS5) {
+        if (Modes.mode_ac) {
+            fprintf(stderr, "Mode A/C decoding is only supported at 2.0 MS/s, disabled.\n");
+            Modes.mode_ac = 0;
+        }
+        Modes.phase_enhance = 0;
+    }
+
+    // Each receiver gets its own fifo and magnitude vector
+    if (Modes.nreceivers == 0) {
+        Modes.nreceivers = 1;
+    }
+    for (i = 0; i < Modes.nreceivers; i++) {
+        struct receiver *rx = &Modes.receivers[i];
+
+        rx->index = i;
+        pthread_mutex_init(&rx->data_mutex,NULL);
+        pthread_cond_init(&rx->data_cond,NULL);
+
+        if ( ((rx->magnitude = (uint16_t *) malloc(MODES_MAG_BUF_SIZE)) == NULL) ||
+             ((Modes.mode_ac) &&
+              ((rx->modeACMap = (uint32_t *) malloc(MODEAC_MAP_WORDS * sizeof(uint32_t))) == NULL)) ) {
+            fprintf(stderr, "Out of memory allocating data buffer.\n");
+            modesUseContext(prev);
+            return (-1);
+        }
+        memset(rx->magnitude, 0, MODES_MAG_BUF_SIZE);
+
+        rx->soft_budget = MODES_SOFT_BUDGET;
+
+        // Initialise the Block Timers to something half sensible
+        ftime(&rx->stSystemTimeBlk);
+        for (q = 0; q < MODES_ASYNC_BUF_NUMBER; q++)
+          {rx->stSystemTimeRTL[q] = rx->stSystemTimeBlk;}
+    }
+
+    modesInitMagnitudeLUT();
+
+    // Prepare error correction tables
+    pthread_once(&errorInfoOnce, modesInitErrorInfo);
+    modesInitDemodTaps();
+
+    modesUseContext(prev);
+    return (0);
+}
+//
+//=========================================================================
+//
+// Free everything modesInitContext() allocated, the tracked aircraft, and
+// ctx itself. The default context can't be freed.
+//
+void modesFreeContext(struct modes *ctx) {
+    struct aircraft *a, *next;
+    int i;
+
+    if ((ctx == NULL) || (ctx == &modesDefaultContext)) {
+        return;
+    }
+
+    for (a = ctx->aircrafts; a; a = next) {
+        next = a->next;
+        trailFree(a);
+        free(a);
+    }
+    for (i = 0; i < ctx->nreceivers; i++) {
+        free(ctx->receivers[i].magnitude);
+        free(ctx->receivers[i].modeACMap);
+        pthread_mutex_destroy(&ctx->receivers[i].data_mutex);
+        pthread_cond_destroy(&ctx->receivers[i].data_cond);
+    }
+    free(ctx->snapshot); // Its readers must all be finished with it by now
+    free(ctx->screen);
+    while (ctx->filters) { // Whatever the listeners and clients still hold
+        struct netFilter *f = ctx->filters;
+        ctx->filters = f->next;
+        free(f->allow);
+        free(f->deny);
+        free(f->rawOut);
+        free(f->beastOut);
+        free(f);
+    }
+    free(ctx->screen_next);
+    free(ctx->icao_cache);
+    free(ctx->dup_cache);
+    free(ctx->maglut);
+
+    pthread_mutex_destroy(&ctx->pDF_mutex);
+    pthread_mutex_destroy(&ctx->data_mutex);
+    pthread_mutex_destroy(&ctx->snapshot_mutex);
+    pthread_mutex_destroy(&ctx->db_mutex);
+    pthread_cond_destroy(&ctx->db_cond);
+    pthread_cond_destroy(&ctx->data_cond);
+    pthread_mutex_destroy(&ctx->out_mutex);
+    pthread_cond_destroy(&ctx->out_cond);
+    free(ctx);
+}
+//
+// ============================= Library API ================================
+//
+// Each of these runs one of the internal functions with ctx bound to the
+// calling thread
+//
+void modesDemodulateBlock(struct modes *ctx, struct receiver *rx, uint16_t *iq) {
+    struct modes *prev = modesUseContext(ctx);
+
+    computeMagnitudeVector(rx, iq);
+    detectModeS(rx, rx->magnitude, MODES_ASYNC_BUF_SAMPLES);
+    rx->timestampBlk += MODES_SAMPLES_TO_TICKS(MODES_ASYNC_BUF_SAMPLES, Modes.sps5);
+    rx->stat_blocks_processed++;
+
+    modesUseContext(prev);
+}
+//
+//=========================================================================
+//
+void modesDecode(struct modes *ctx, struct modesMessage *mm, unsigned char *msg) {
+    struct modes *prev = modesUseContext(ctx);
+
+    decodeModesMessage(mm, msg);
+
+    modesUseContext(prev);
+}
+//
+//=========================================================================
+//
+struct aircraft *modesTrack(struct modes *ctx, struct modesMessage *mm) {
+    struct modes *prev = modesUseContext(ctx);
+    struct aircraft *a = interactiveReceiveData(mm);
+
+    modesUseContext(prev);
+    return (a);
+}
+//
+//=========================================================================
+//
+struct aircraft *modesFindAircraft(struct modes *ctx, uint32_t addr) {
+    struct modes *prev = modesUseContext(ctx);
+    struct aircraft *a = interactiveFindAircraft(addr);
+
+    modesUseContext(prev);
+    return (a);
+}
+
+void modesGetAircraftInfo(struct aircraft *a, struct modesAircraftInfo *info) {
+    memset(info, 0, sizeof(*info));
+    info->addr      = a->addr;
+    memcpy(info->flight, a->flight, sizeof(info->flight));
+    info->altitude  = a->altitude;
+    info->speed     = a->speed;
+    info->track     = a->track;
+    info->vert_rate = a->vert_rate;
+    info->modeA     = a->modeA;
+    info->lat       = a->lat;
+    info->lon       = a->lon;
+    info->seen      = a->seen;
+    info->messages  = a->messages;
+    info->bFlags    = a->bFlags;
+}
+//
+// ============================= Library API end ============================
+//
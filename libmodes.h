@@ -0,0 +1,237 @@
+// libmodes, the dump1090 Mode S demodulator, decoder and tracker as a library.
+//
+// Copyright (C) 2012 by Salvatore Sanfilippo <antirez@gmail.com>
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//  *  Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//  *  Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#ifndef __LIBMODES_H
+#define __LIBMODES_H
+
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// Every piece of demodulator, decoder and tracker state lives in a struct
+// modes context. Any number of contexts may be used at once, from any number
+// of threads, as long as each context is only used by one thread at a time
+// (or, like dump1090 with several receivers, its callers hold its data_mutex
+// around decoding and tracking).
+//
+// Within a context each receiver, struct receiver, holds the per source
+// demodulator state: fifo, magnitude vector, timestamps and statistics.
+//
+// The functions below take the context explicitly. Internally the code uses
+// the context bound to the calling thread; these bind theirs for the length
+// of the call, and restore whatever was bound before.
+//
+struct modes;
+struct receiver;
+struct aircraft;
+
+//
+// A decoded message, as modesDecode() fills it in and the message handler
+// is given it. bFlags says which of the decoded fields are valid.
+//
+#define MODES_LONG_MSG_BYTES     14
+#define MODES_SHORT_MSG_BYTES    7
+#define MODES_SOFT_MAX_FLIPS     3   // Most bits flipped in one frame, >= MODES_MAX_BITERRORS
+
+#define MODES_UNIT_FEET 0
+#define MODES_UNIT_METERS 1
+
+#define MODES_ACFLAGS_LATLON_VALID   (1<<0)  // Aircraft Lat/Lon is decoded
+#define MODES_ACFLAGS_ALTITUDE_VALID (1<<1)  // Aircraft altitude is known
+#define MODES_ACFLAGS_HEADING_VALID  (1<<2)  // Aircraft heading is known
+#define MODES_ACFLAGS_SPEED_VALID    (1<<3)  // Aircraft speed is known
+#define MODES_ACFLAGS_VERTRATE_VALID (1<<4)  // Aircraft vertical rate is known
+#define MODES_ACFLAGS_SQUAWK_VALID   (1<<5)  // Aircraft Mode A Squawk is known
+#define MODES_ACFLAGS_CALLSIGN_VALID (1<<6)  // Aircraft Callsign Identity
+#define MODES_ACFLAGS_EWSPEED_VALID  (1<<7)  // Aircraft East West Speed is known
+#define MODES_ACFLAGS_NSSPEED_VALID  (1<<8)  // Aircraft North South Speed is known
+#define MODES_ACFLAGS_AOG            (1<<9)  // Aircraft is On the Ground
+#define MODES_ACFLAGS_LLEVEN_VALID   (1<<10) // Aircraft Even Lot/Lon is known
+#define MODES_ACFLAGS_LLODD_VALID    (1<<11) // Aircraft Odd Lot/Lon is known
+#define MODES_ACFLAGS_AOG_VALID      (1<<12) // MODES_ACFLAGS_AOG is valid
+#define MODES_ACFLAGS_FS_VALID       (1<<13) // Aircraft Flight Status is known
+#define MODES_ACFLAGS_NSEWSPD_VALID  (1<<14) // Aircraft EW and NS Speed is known
+#define MODES_ACFLAGS_LATLON_REL_OK  (1<<15) // Indicates it's OK to do a relative CPR
+
+#define MODES_ACFLAGS_LLEITHER_VALID (MODES_ACFLAGS_LLEVEN_VALID | MODES_ACFLAGS_LLODD_VALID)
+#define MODES_ACFLAGS_LLBOTH_VALID   (MODES_ACFLAGS_LLEVEN_VALID | MODES_ACFLAGS_LLODD_VALID)
+#define MODES_ACFLAGS_AOG_GROUND     (MODES_ACFLAGS_AOG_VALID    | MODES_ACFLAGS_AOG)
+
+struct modesMessage {
+    // Generic fields
+    unsigned char msg[MODES_LONG_MSG_BYTES];      // Binary message.
+    int           msgbits;                        // Number of bits in message 
+    int           msgtype;                        // Downlink format #
+    int           crcok;                          // True if CRC was valid
+    uint32_t      crc;                            // Message CRC
+    int           correctedbits;                  // No. of bits corrected 
+    char          corrected[MODES_SOFT_MAX_FLIPS]; // corrected bit positions
+    uint32_t      addr;                           // ICAO Address from bytes 1 2 and 3
+    int           phase_corrected;                // True if phase correction was applied
+    uint64_t      timestampMsg;                   // Timestamp of the message
+    int           remote;                         // If set this message is from a remote station
+    int           rx;                             // Index of the receiver that demodulated this message
+    uint16_t     *confidence;                     // Per bit confidence from the demodulator, or NULL
+    int           heartbeat;                      // A null message sent to keep idle links up
+    unsigned char signalLevel;                    // Signal Amplitude
+
+    // DF 11
+    int  ca;                    // Responder capabilities
+    int  iid;
+
+    // DF 17, DF 18
+    int    metype;              // Extended squitter message type.
+    int    mesub;               // Extended squitter message subtype.
+    int    heading;             // Reported by aircraft, or computed from from EW and NS velocity
+    int    raw_latitude;        // Non decoded latitude.
+    int    raw_longitude;       // Non decoded longitude.
+    double fLat;                // Coordinates obtained from CPR encoded data if/when decoded
+    double fLon;                // Coordinates obtained from CPR encoded data if/when decoded
+    char   flight[16];          // 8 chars flight number.
+    int    ew_velocity;         // E/W velocity.
+    int    ns_velocity;         // N/S velocity.
+    int    vert_rate;           // Vertical rate.
+    int    velocity;            // Reported by aircraft, or computed from from EW and NS velocity
+
+    // DF4, DF5, DF20, DF21
+    int  fs;                    // Flight status for DF4,5,20,21
+    int  modeA;                 // 13 bits identity (Squawk).
+
+    // Fields used by multiple message types.
+    int  altitude;
+    int  unit; 
+    int  bFlags;                // Flags related to fields in this structure
+};
+
+//
+// What the tracker knows about an aircraft, copied out by
+// modesGetAircraftInfo(). bFlags is as for a message.
+//
+struct modesAircraftInfo {
+    uint32_t addr;                // ICAO address
+    char     flight[16];          // Flight number
+    int      altitude;            // In feet
+    int      speed;               // In knots
+    int      track;               // In degrees
+    int      vert_rate;           // In feet per minute
+    int      modeA;               // Squawk
+    double   lat, lon;            // Position, if MODES_ACFLAGS_LATLON_VALID
+    time_t   seen;                // When the last message was received
+    long     messages;            // Number of Mode S messages received
+    int      bFlags;              // MODES_ACFLAGS_xxx
+};
+
+//
+// Context lifetime. modesNewContext() returns a context with the default
+// configuration, which may be changed before modesInitContext() allocates
+// its caches and tables. Returns NULL/-1 if out of memory, or the sample
+// rate isn't supported.
+//
+struct modes    *modesNewContext (void);
+int              modesInitContext(struct modes *ctx);
+void             modesFreeContext(struct modes *ctx);
+
+//
+// Configuration, between modesNewContext() and modesInitContext(). The sample
+// rate is 2000000 (the default), 2400000, 3200000 or 4000000 samples per
+// second, and there are 1 (the default) to 8 receivers. The fix modes are up
+// to nbits bit errors corrected using the CRC (0 to 2, default 0) and the
+// MODES_FIX_xxx corrections in flags. Each returns 0, or -1 if the value is
+// out of range or ctx has already been initialised.
+//
+#define MODES_FIX_PHASE  1  // Retry failed frames with phase enhancement, 2MHz only
+#define MODES_FIX_SOFT   2  // Fix up to 3 weak bits using the demodulator's confidence
+#define MODES_FIX_DF11   4  // Fix single bit errors in DF11 replies from known aircraft
+
+int              modesSetSampleRate(struct modes *ctx, int rate);
+int              modesSetReceivers (struct modes *ctx, int count);
+int              modesSetFixModes  (struct modes *ctx, int nbits, int flags);
+
+//
+// Receiver n (from 0) of an initialised context, NULL if it has no such
+// receiver
+//
+struct receiver *modesGetReceiver(struct modes *ctx, int n);
+
+//
+// Have fn called with each message the context passes on, whether it was
+// demodulated by modesDemodulateBlock() or came in from the network, and the
+// aircraft the tracker filed it under (NULL if it wasn't tracked). fn is called from the
+// thread doing the demodulating, holding the context's data_mutex, so it
+// mustn't call back into ctx except for modesGetAircraftInfo(). NULL stops
+// the calls.
+//
+typedef void (*modesMessageHandler)(struct modesMessage *mm, struct aircraft *a, void *arg);
+
+void             modesSetMessageHandler(struct modes *ctx, modesMessageHandler fn, void *arg);
+
+//
+// Bind ctx to the calling thread, returning the context it replaces. Only
+// needed to call the internal functions in dump1090.h directly.
+//
+struct modes    *modesUseContext (struct modes *ctx);
+
+//
+// Demodulator: turn a block of MODES_ASYNC_BUF_SIZE bytes of I/Q samples into
+// receiver rx's magnitude vector, then demodulate it. Messages found are
+// decoded and passed to the tracker (and displayed or sent to the network if
+// the context is configured for it).
+//
+#define MODES_ASYNC_BUF_SIZE (16*16384) // 256k
+
+void             modesDemodulateBlock(struct modes *ctx, struct receiver *rx, uint16_t *iq);
+
+//
+// Decoder: decode the raw message msg into mm
+//
+void             modesDecode(struct modes *ctx, struct modesMessage *mm, unsigned char *msg);
+
+//
+// Tracker: update the contexts aircraft with a decoded message, returning the
+// aircraft it was from (NULL if it was rejected), and find an aircraft by its
+// ICAO address.
+//
+struct aircraft *modesTrack      (struct modes *ctx, struct modesMessage *mm);
+struct aircraft *modesFindAircraft(struct modes *ctx, uint32_t addr);
+
+//
+// Copy what the tracker knows about a, as returned by the functions above or
+// given to the message handler, into info
+//
+void             modesGetAircraftInfo(struct aircraft *a, struct modesAircraftInfo *info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __LIBMODES_H
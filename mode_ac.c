@@ -132,6 +132,114 @@ uint32_t ModeAMidTable[24] = {
 // in two adjacent samples must be from the same pulse, so we can simply 
 // add the values together.. 
 // 
+//
+// Return (m2 * 20) / (m1 + m2), the position of the F1 pulse between m1 and m2 in
+// 20ths of a sample. It's always 0 to 20, so find it a bit at a time rather than
+// with a divide.
+//
+static int modeACPhase(int m1, int m2)
+  {
+  int num = m2 * 20;
+  int den = m1 + m2;
+  int q   = 0;
+  int bit;
+
+  for (bit = 16; bit; bit >>= 1)
+    {
+    if (((q + bit) * den) <= num)
+      {q += bit;}
+    }
+  return q;
+  }
+//
+//=========================================================================
+//
+// Mark the samples in m[0 .. mlen-1] that could be the start of a Mode A/C
+// reply, one bit per sample in map[], so that detectModeA() is only called on
+// those. A frame pulse starting at p[0] needs p[1] > p[0] and p[1] larger than
+// at least one of p[2] and p[3] (the trailing quiet sample), and since the pulse
+// energy is in p[1] and at most the larger of p[0] and p[2], it also needs
+//
+//     p[1] + max(p[0],p[2]) >= MODEAC_MSG_SQUELCH_LEVEL + 2*p[0]   and
+//     p[1] + max(p[0],p[2]) >= 4*p[0] - 2
+//
+// for the squelch and signal to noise tests. F1 must pass at the sample and F2
+// at 40 or 41 samples later. These are all weaker forms of tests detectModeA()
+// makes, so nothing it would find is filtered out.
+//
+// The noise test allows for detectModeA() rounding the noise down.
+//
+// m[] must be readable up to m[mlen + 44].
+//
+#ifdef MODES_HAVE_SSE2
+//
+// SSE2 has no unsigned 16 bit compares, so a >= b is tested as (b -sat a) == 0.
+// Saturation only ever lets a sample through, never rejects one.
+//
+static __m128i modeACPulseFail(uint16_t *p)
+  {
+  const __m128i zero    = _mm_setzero_si128();
+  const __m128i squelch = _mm_set1_epi16(MODEAC_MSG_SQUELCH_LEVEL);
+  __m128i v0  = _mm_loadu_si128((__m128i *) &p[0]);
+  __m128i v1  = _mm_loadu_si128((__m128i *) &p[1]);
+  __m128i v2  = _mm_loadu_si128((__m128i *) &p[2]);
+  __m128i v3  = _mm_loadu_si128((__m128i *) &p[3]);
+  __m128i m02 = _mm_adds_epu16(_mm_subs_epu16(v0, v2), v2); // max(v0, v2)
+  __m128i m23 = _mm_subs_epu16(v2, _mm_subs_epu16(v2, v3)); // min(v2, v3)
+  __m128i sig = _mm_adds_epu16(v1, m02);
+  __m128i v00 = _mm_adds_epu16(v0, v0);
+  __m128i fail;
+
+  fail = _mm_cmpeq_epi16(_mm_subs_epu16(v1, v0), zero);
+  fail = _mm_or_si128(fail, _mm_cmpeq_epi16(_mm_subs_epu16(v1, m23), zero));
+  fail = _mm_or_si128(fail, _mm_xor_si128(_mm_cmpeq_epi16(_mm_subs_epu16(_mm_adds_epu16(v00, squelch), sig), zero), _mm_set1_epi16(-1)));
+  fail = _mm_or_si128(fail, _mm_xor_si128(_mm_cmpeq_epi16(_mm_subs_epu16(_mm_adds_epu16(v00, v00), _mm_adds_epu16(sig, _mm_set1_epi16(2))), zero), _mm_set1_epi16(-1)));
+  return fail;
+  }
+#endif
+
+static int modeACPulse(uint16_t *p)
+  {
+  uint32_t m02 = (p[0] > p[2]) ? p[0] : p[2];
+  uint32_t sig = p[1] + m02;
+
+  uint32_t m23 = (p[2] < p[3]) ? p[2] : p[3];
+
+  return ( (p[0] < p[1])
+        && (m23  < p[1])
+        && (sig >= (MODEAC_MSG_SQUELCH_LEVEL + ((uint32_t) p[0] << 1)))
+        && ((sig + 2) >= ((uint32_t) p[0] << 2)) );
+  }
+
+void detectModeACandidates(uint16_t *m, uint32_t mlen, uint32_t *map)
+  {
+  uint32_t j = 0;
+
+  memset(map, 0, ((mlen + 31) / 32) * sizeof(uint32_t));
+
+#ifdef MODES_HAVE_SSE2
+  // Eight samples at a time
+  for (; (j + 8) <= mlen; j += 8)
+    {
+    __m128i fail = _mm_or_si128(modeACPulseFail(&m[j]),
+                                _mm_and_si128(modeACPulseFail(&m[j+40]), modeACPulseFail(&m[j+41])));
+    int mask = (~_mm_movemask_epi8(_mm_packs_epi16(fail, _mm_setzero_si128()))) & 0xFF;
+
+    if (mask)
+      {map[j >> 5] |= ((uint32_t) mask) << (j & 31);}
+    }
+#endif
+
+  for (; j < mlen; j++)
+    {
+    if ( (modeACPulse(&m[j]))
+      && ((modeACPulse(&m[j+40])) || (modeACPulse(&m[j+41]))) )
+      {map[j >> 5] |= ((uint32_t) 1) << (j & 31);}
+    }
+  }
+//
+//=========================================================================
+//
 int detectModeA(uint16_t *m, struct modesMessage *mm)
   {
   int j, lastBitWasOne;
@@ -205,8 +313,11 @@ int detectModeA(uint16_t *m, struct modesMessage *mm)
   // Our F1 is centered somewhere between samples m[1] and m[2]. We can guestimate where F2 is 
   // by comparing the ratio of m1 and m2, and adding on 20.3 uS (40.6 samples)
   //
-  mPhase = ((m2 * 20) / (m1 + m2));
-  byte   = (mPhase + 812) / 20; 
+  // mPhase is in 20ths of a sample, 0 to 20, so (mPhase + 812) / 20 is 40 up to
+  // mPhase 7 and 41 after it, and only lands exactly on a sample at mPhase 8
+  //
+  mPhase = modeACPhase(m1, m2);
+  byte   = (mPhase < 8) ? 40 : 41;
   n0     = m[byte++]; n1 = m[byte++]; 
 
   if (n0 >= n1)   // n1 *must* be bigger than n0 for this to be F2
@@ -216,7 +327,7 @@ int detectModeA(uint16_t *m, struct modesMessage *mm)
   // 
   // if the sample bob on (Phase == 0), don't look at n3 
   //
-  if ((mPhase + 812) % 20)
+  if (mPhase != 8)
     {n3 = m[byte++];}
   else
     {n3 = n2; n2 = n0;}
@@ -244,12 +355,16 @@ int detectModeA(uint16_t *m, struct modesMessage *mm)
   // No need to do bit 0 because we've already selected it as a valid F1
   // Do several bits past the SPI to increase error rejection
   //
-  for (j = 1, mPhase += 29; j < 48; mPhase += 29, j ++)
+  // The position is kept as a whole sample (byte) and 20ths of a sample (mPhase),
+  // so each step is one sample and 9/20ths, with a carry, rather than a divide
+  //
+  mPhase += 29 - 20; byte = 2;
+  if (mPhase >= 20) {mPhase -= 20; byte++;}
+
+  for (j = 1; j < 48; j ++)
     {
-    byte  = 1 + (mPhase / 20);
-    
     thisSample = m[byte] - fNoise;
-    if (mPhase % 20)                     // If the bit is split over two samples...
+    if (mPhase)                          // If the bit is split over two samples...
       {thisSample += (m[byte+1] - fNoise);}  //    add in the second sample's energy
 
      // If we're calculating a space value
@@ -298,6 +413,9 @@ int detectModeA(uint16_t *m, struct modesMessage *mm)
 
       lastBit = (thisSample >> 1); 
       }
+
+    mPhase += 9; byte++;
+    if (mPhase >= 20) {mPhase -= 20; byte++;}
     }
 
   //
@@ -337,6 +337,101 @@ int fixBitErrors(unsigned char *msg, int bits, int maxfix, char *fixedbits) {
     return res;
 }
 //
+//=========================================================================
+//
+// Return the contribution of message bit 'bit' to the CRC syndrome of a
+// message of 'bits' bits. The syndrome is linear, so flipping the bit just
+// xors this into it.
+//
+static uint32_t bitSyndrome(int bit, int bits) {
+    if (bit < (bits - 24)) {
+        return modes_checksum_table[bit + ((bits == 112) ? 0 : (112-56))];
+    }
+    return 1 << (bits - 1 - bit); // A bit of the parity field itself
+}
+//
+//=========================================================================
+//
+// Soft decision (Chase style) error correction. confidence[] holds, for every
+// bit, how far apart the demodulator found the two halves of it. The
+// MODES_SOFT_CANDIDATES least confident bits outside the DF field are the
+// ones most likely to be wrong, so try every combination of flipping up to
+// MODES_SOFT_MAX_FLIPS of them, and keep the one with a zero syndrome that
+// needs the least total confidence flipped.
+//
+// Combinations are visited in Gray code order so each one costs a single
+// xor of the syndrome. *budget is the number of combinations we may still
+// try, and is reduced by what this frame needs.
+//
+// The message is not changed. Returns the number of bits to flip, with
+// their positions in fixedbits[], or 0 if there's no correction.
+//
+int fixSoftBitErrors(unsigned char *msg, int bits, uint16_t *confidence, int *budget, char *fixedbits) {
+    int      weak[MODES_SOFT_CANDIDATES];
+    uint32_t syndrome[MODES_SOFT_CANDIDATES];
+    uint32_t crc, s, bestCost;
+    int      nweak = 0, i, k, g, pattern, best;
+
+    // Find the weakest bits, kept sorted by confidence
+    for (i = 5; i < bits; i++) {
+        if ((nweak == MODES_SOFT_CANDIDATES) && (confidence[i] >= confidence[weak[nweak-1]])) {
+            continue;
+        }
+        if (nweak < MODES_SOFT_CANDIDATES) {nweak++;}
+        for (k = nweak - 1; (k > 0) && (confidence[weak[k-1]] > confidence[i]); k--) {
+            weak[k] = weak[k-1];
+        }
+        weak[k] = i;
+    }
+
+    // Nothing to do if an earlier fix has left the message good
+    crc = modesChecksum(msg, bits);
+    if (crc == 0) {
+        return 0;
+    }
+
+    if (*budget < (1 << nweak)) {
+        Modes.stat_soft_skipped++;
+        return 0;
+    }
+    *budget -= (1 << nweak);
+
+    for (k = 0; k < nweak; k++) {
+        syndrome[k] = bitSyndrome(weak[k], bits);
+    }
+
+    s        = 0;
+    pattern  = 0;
+    best     = 0;
+    bestCost = 0xFFFFFFFF;
+    for (g = 1; g < (1 << nweak); g++) {
+        int flips = 0;
+        uint32_t cost = 0;
+
+        // Going from Gray code g-1 to g changes the bit at the lowest set bit of g
+        for (k = 0; (g & (1 << k)) == 0; k++) {}
+        s       ^= syndrome[k];
+        pattern ^= (1 << k);
+
+        if (s != crc) continue;
+
+        for (k = 0; k < nweak; k++) {
+            if (pattern & (1 << k)) {flips++; cost += confidence[weak[k]];}
+        }
+        if ((flips <= MODES_SOFT_MAX_FLIPS) && (cost < bestCost)) {
+            bestCost = cost;
+            best     = pattern;
+        }
+    }
+
+    for (k = i = 0; k < nweak; k++) {
+        if (best & (1 << k)) {
+            fixedbits[i++] = (char) weak[k];
+        }
+    }
+    return i;
+}
+//
 // ============================== Debugging =================================
 //
 // Helper function for dumpMagnitudeVector().
@@ -632,6 +727,105 @@ int ICAOAddressWasRecentlySeen(uint32_t addr) {
 //
 //=========================================================================
 //
+// Remember that we are hearing DF11 replies to interrogator code iid from
+// aircraft we know, so corrections that produce it are plausible.
+//
+static void noteDF11IID(uint32_t iid) {
+    Modes.df11_iid_seen[iid >> 5] |= (1U << (iid & 31));
+}
+//
+//=========================================================================
+//
+// Try to fix a single bit error in a DF11 all call reply.
+//
+// DF11 has no parity of its own to correct against, because the interrogators
+// IID/SI code is xored into it, so any syndrome below MODES_DF11_MAX_IID looks
+// valid. Instead every one of the 51 single bit corrections is tried, and kept
+// only if it gives an IID we have already heard from known aircraft, a CA that
+// isn't reserved, and the address of an aircraft in the ICAO cache or the
+// aircraft table. Both of those are hashed, so the whole search is a fixed
+// handful of table lookups.
+//
+// Returns the number of corrections that passed. If that's exactly one, its
+// bit number is in *fixedbit and the IID it gives in *iid. The message is not
+// changed.
+//
+int fixDF11BitErrors(unsigned char *msg, uint32_t crc, int *fixedbit, uint32_t *iid) {
+    int bit, n = 0;
+
+    for (bit = 5; bit < MODES_SHORT_MSG_BITS; bit++) {
+        uint32_t cand = crc ^ bitSyndrome(bit, MODES_SHORT_MSG_BITS);
+        unsigned char mask = (unsigned char) (1 << (7 - (bit & 7)));
+        uint32_t addr;
+        int ca;
+
+        if (cand >= MODES_DF11_MAX_IID) continue;
+        if ((cand) && (!(Modes.df11_iid_seen[cand >> 5] & (1U << (cand & 31))))) continue;
+
+        msg[bit >> 3] ^= mask;
+        addr = (msg[1] << 16) | (msg[2] << 8) | (msg[3]);
+        ca   = (msg[0] & 0x07);
+        msg[bit >> 3] ^= mask;
+
+        if ((ca >= 1) && (ca <= 3)) continue; // Reserved capability codes
+        if ((!ICAOAddressWasRecentlySeen(addr)) && (!interactiveFindAircraft(addr))) continue;
+
+        *fixedbit = bit;
+        *iid      = cand;
+        n++;
+    }
+    return n;
+}
+//
+//=========================================================================
+//
+// Hash the message bytes to index our cache of MODES_DUP_CACHE_LEN recently
+// used frames, that is assumed to be a power of two
+//
+uint32_t dupCacheHashMessage(unsigned char *msg, int len) {
+    uint32_t a = 0;
+    int j;
+
+    for (j = 0; j < len; j++) {
+        a = ((a << 5) | (a >> 27)) ^ msg[j];
+    }
+    a = ((a >> 16) ^ a) * 0x45d9f3b;
+    a = ((a >> 16) ^ a) * 0x45d9f3b;
+    a = ((a >> 16) ^ a);
+    return a & (MODES_DUP_CACHE_LEN-1);
+}
+//
+//=========================================================================
+//
+// Returns 1 if an identical frame was received by a different receiver no
+// more than MODES_DUP_WINDOW_MS milliseconds either side of msTime. Otherwise
+// the frame is remembered and 0 is returned.
+//
+// A repeat of the same frame by the same receiver is not a duplicate, it's
+// the aircraft sending the same thing again (DF11 all-call replies, etc).
+//
+int modesCheckDuplicate(struct modesMessage *mm, uint64_t msTime) {
+    int len = mm->msgbits / 8;
+    struct dupEntry *d = &Modes.dup_cache[dupCacheHashMessage(mm->msg, len)];
+
+    if ( (d->msgbits == mm->msgbits) 
+      && (d->rx      != mm->rx) 
+      && (!memcmp(d->msg, mm->msg, len)) ) {
+        uint64_t dt = (msTime > d->msTime) ? (msTime - d->msTime) : (d->msTime - msTime);
+        if (dt <= MODES_DUP_WINDOW_MS) {
+            return 1;
+        }
+    }
+
+    d->msTime  = msTime;
+    d->rx      = mm->rx;
+    d->msgbits = mm->msgbits;
+    memcpy(d->msg, mm->msg, len);
+    return 0;
+}
+//
+//=========================================================================
+//
 // In the squawk (identity) field bits are interleaved as follows in
 // (message bit 20 to bit 32):
 //
@@ -844,18 +1038,17 @@ void decodeModesMessage(struct modesMessage *mm, unsigned char *msg) {
     mm->crc             = modesChecksum(msg, mm->msgbits);
 
     if ((mm->crc) && (Modes.nfix_crc) && ((mm->msgtype == 17) || (mm->msgtype == 18))) {
-//  if ((mm->crc) && (Modes.nfix_crc) && ((mm->msgtype == 11) || (mm->msgtype == 17))) {
         //
         // Fixing single bit errors in DF-11 is a bit dodgy because we have no way to 
         // know for sure if the crc is supposed to be 0 or not - it could be any value 
         // less than 80. Therefore, attempting to fix DF-11 errors can result in a 
-        // multitude of possible crc solutions, only one of which is correct.
-        // 
-        // We should probably perform some sanity checks on corrected DF-11's before 
-        // using the results. Perhaps check the ICAO against known aircraft, and check
-        // IID against known good IID's. That's a TODO.
+        // multitude of possible crc solutions, only one of which is correct. Those
+        // are handled separately by fixDF11BitErrors(), with extra sanity checks.
         //
-        mm->correctedbits = fixBitErrors(msg, mm->msgbits, Modes.nfix_crc, mm->corrected);
+        // Two bit fixes are the first to go if the CPU budget is tight.
+        //
+        int maxfix = (Modes.shed_level >= MODES_SHED_FIX2) ? 1 : Modes.nfix_crc;
+        mm->correctedbits = fixBitErrors(msg, mm->msgbits, maxfix, mm->corrected);
 
         // If we correct, validate ICAO addr to help filter birthday paradox solutions.
         if (mm->correctedbits) {
@@ -864,6 +1057,35 @@ void decodeModesMessage(struct modesMessage *mm, unsigned char *msg) {
                 mm->correctedbits = 0;
         }
     }
+
+    // If the syndrome table didn't help, and the demodulator told us how sure
+    // it was of each bit, try flipping the weakest ones
+    if ((mm->crc) && (!mm->correctedbits) && (Modes.soft_fix) && (mm->confidence) 
+     && (Modes.shed_level < MODES_SHED_FIX2)
+     && ((mm->msgtype == 17) || (mm->msgtype == 18))) {
+        int n = fixSoftBitErrors(msg, mm->msgbits, mm->confidence,
+                                 &Modes.receivers[mm->rx].soft_budget, mm->corrected);
+        if (n) {
+            unsigned char fixed[MODES_LONG_MSG_BYTES];
+            uint32_t ulAddr;
+            int i;
+
+            memcpy(fixed, msg, MODES_LONG_MSG_BYTES);
+            for (i = 0; i < n; i++) {
+                fixed[mm->corrected[i] >> 3] ^= (1 << (7 - (mm->corrected[i] & 7)));
+            }
+
+            // As above, only believe it if it's an aircraft we've heard from
+            ulAddr = (fixed[1] << 16) | (fixed[2] << 8) | (fixed[3]);
+            if (ICAOAddressWasRecentlySeen(ulAddr)) {
+                memcpy(msg, fixed, MODES_LONG_MSG_BYTES);
+                mm->correctedbits = n;
+                Modes.stat_soft_fixed++;
+            } else {
+                Modes.stat_soft_rejected++;
+            }
+        }
+    }
     //
     // Note that most of the other computation happens *after* we fix the 
     // single/two bit errors, otherwise we would need to recompute the fields again.
@@ -876,13 +1098,36 @@ void decodeModesMessage(struct modesMessage *mm, unsigned char *msg) {
         if ((mm->crcok = (0 == mm->crc))) {
             // DF 11 : if crc == 0 try to populate our ICAO addresses whitelist.
             addRecentlySeenICAOAddr(mm->addr);
-        } else if (mm->crc < 80) {
+        } else if (mm->crc < MODES_DF11_MAX_IID) {
             mm->crcok = ICAOAddressWasRecentlySeen(mm->addr);
             if (mm->crcok) {
                 addRecentlySeenICAOAddr(mm->addr);
             }
         }
 
+        if (mm->crcok) {
+            noteDF11IID(mm->crc);
+
+        } else if (Modes.df11_fix) {
+            int bit, n;
+            uint32_t iid;
+
+            n = fixDF11BitErrors(msg, mm->crc, &bit, &iid);
+            if (n == 1) {
+                msg[bit >> 3] ^= (1 << (7 - (bit & 7)));
+                mm->iid           = iid;
+                mm->addr          = (msg[1] << 16) | (msg[2] << 8) | (msg[3]);
+                mm->ca            = (msg[0] & 0x07);
+                mm->corrected[0]  = (char) bit;
+                mm->correctedbits = 1;
+                Modes.stat_df11_fixed++;
+            } else if (n) {
+                Modes.stat_df11_ambiguous++;
+            } else {
+                Modes.stat_df11_rejected++;
+            }
+        }
+
     } else if (mm->msgtype == 17) { // DF 17
         mm->addr  = (msg[1] << 16) | (msg[2] << 8) | (msg[3]); 
         mm->ca    = (msg[0] & 0x07); // Responder capabilities
@@ -1139,305 +1384,323 @@ void decodeModesMessage(struct modesMessage *mm, unsigned char *msg) {
 //
 //=========================================================================
 //
-// This function gets a decoded Mode S Message and prints it on the screen
-// in a human readable format.
+// Print a decoded Mode S Message in a human readable format, through the
+// buffered output (see output.c).
 //
-void displayModesMessage(struct modesMessage *mm) {
-    int j;
+static void formatModesMessage(struct modesMessage *mm) {
     unsigned char * pTimeStamp;
+    struct aircraft *a;
+
+    // A record for a program to read, rather than text
+    if (Modes.records) {
+        char rec[MODES_RECORD_MAX];
+        outputWrite(rec, modesRecord(mm, Modes.records, rec));
+        return;
+    }
 
     // Handle only addresses mode first.
     if (Modes.onlyaddr) {
-        printf("%06x\n", mm->addr);
+        outputPrintf("%06x\n", mm->addr);
         return;         // Enough for --onlyaddr mode
     }
 
     // Show the raw message.
     if (Modes.mlat && mm->timestampMsg) {
-        printf("@");
         pTimeStamp = (unsigned char *) &mm->timestampMsg;
-        for (j=5; j>=0;j--) {
-            printf("%02X",pTimeStamp[j]);
-        } 
+        outputPrintf("@%02X%02X%02X%02X%02X%02X", pTimeStamp[5], pTimeStamp[4],
+                     pTimeStamp[3], pTimeStamp[2], pTimeStamp[1], pTimeStamp[0]);
     } else
-        printf("*");
+        outputWrite("*", 1);
 
-    for (j = 0; j < mm->msgbits/8; j++) printf("%02x", mm->msg[j]);
-    printf(";\n");
+    outputHex(mm->msg, mm->msgbits/8);
+    outputWrite(";\n", 2);
 
     if (Modes.raw) {
-        fflush(stdout); // Provide data to the reader ASAP
         return;         // Enough for --raw mode
     }
 
     if (mm->msgtype < 32)
-        printf("CRC: %06x (%s)\n", (int)mm->crc, mm->crcok ? "ok" : "wrong");
+        outputPrintf("CRC: %06x (%s)\n", (int)mm->crc, mm->crcok ? "ok" : "wrong");
 
     if (mm->correctedbits != 0)
-        printf("No. of bit errors fixed: %d\n", mm->correctedbits);
+        outputPrintf("No. of bit errors fixed: %d\n", mm->correctedbits);
 
     if (mm->msgtype == 0) { // DF 0
-        printf("DF 0: Short Air-Air Surveillance.\n");
-        printf("  VS             : %s\n",  (mm->msg[0] & 0x04) ? "Ground" : "Airborne");
-        printf("  CC             : %d\n", ((mm->msg[0] & 0x02) >> 1));
-        printf("  SL             : %d\n", ((mm->msg[1] & 0xE0) >> 5));
-        printf("  Altitude       : %d %s\n", mm->altitude,
+        outputPrintf("DF 0: Short Air-Air Surveillance.\n");
+        outputPrintf("  VS             : %s\n",  (mm->msg[0] & 0x04) ? "Ground" : "Airborne");
+        outputPrintf("  CC             : %d\n", ((mm->msg[0] & 0x02) >> 1));
+        outputPrintf("  SL             : %d\n", ((mm->msg[1] & 0xE0) >> 5));
+        outputPrintf("  Altitude       : %d %s\n", mm->altitude,
             (mm->unit == MODES_UNIT_METERS) ? "meters" : "feet");
-        printf("  ICAO Address   : %06x\n", mm->addr);
+        outputPrintf("  ICAO Address   : %06x\n", mm->addr);
 
     } else if (mm->msgtype == 4 || mm->msgtype == 20) {
-        printf("DF %d: %s, Altitude Reply.\n", mm->msgtype,
+        outputPrintf("DF %d: %s, Altitude Reply.\n", mm->msgtype,
             (mm->msgtype == 4) ? "Surveillance" : "Comm-B");
-        printf("  Flight Status  : %s\n", fs_str[mm->fs]);
-        printf("  DR             : %d\n", ((mm->msg[1] >> 3) & 0x1F));
-        printf("  UM             : %d\n", (((mm->msg[1]  & 7) << 3) | (mm->msg[2] >> 5)));
-        printf("  Altitude       : %d %s\n", mm->altitude,
+        outputPrintf("  Flight Status  : %s\n", fs_str[mm->fs]);
+        outputPrintf("  DR             : %d\n", ((mm->msg[1] >> 3) & 0x1F));
+        outputPrintf("  UM             : %d\n", (((mm->msg[1]  & 7) << 3) | (mm->msg[2] >> 5)));
+        outputPrintf("  Altitude       : %d %s\n", mm->altitude,
             (mm->unit == MODES_UNIT_METERS) ? "meters" : "feet");
-        printf("  ICAO Address   : %06x\n", mm->addr);
+        outputPrintf("  ICAO Address   : %06x\n", mm->addr);
 
         if (mm->msgtype == 20) {
-            printf("  Comm-B BDS     : %x\n", mm->msg[4]);
+            outputPrintf("  Comm-B BDS     : %x\n", mm->msg[4]);
 
             // Decode the extended squitter message
             if        ( mm->msg[4]       == 0x20) { // BDS 2,0 Aircraft identification
-                printf("    BDS 2,0 Aircraft Identification : %s\n", mm->flight);
+                outputPrintf("    BDS 2,0 Aircraft Identification : %s\n", mm->flight);
 /*
             } else if ( mm->msg[4]       == 0x10) { // BDS 1,0 Datalink Capability report
-                printf("    BDS 1,0 Datalink Capability report\n");
+                outputPrintf("    BDS 1,0 Datalink Capability report\n");
 
             } else if ( mm->msg[4]       == 0x30) { // BDS 3,0 ACAS Active Resolution Advisory
-                printf("    BDS 3,0 ACAS Active Resolution Advisory\n");
+                outputPrintf("    BDS 3,0 ACAS Active Resolution Advisory\n");
 
             } else if ((mm->msg[4] >> 3) ==   28) { // BDS 6,1 Extended Squitter Emergency/Priority Status
-                printf("    BDS 6,1 Emergency/Priority Status\n");
+                outputPrintf("    BDS 6,1 Emergency/Priority Status\n");
 
             } else if ((mm->msg[4] >> 3) ==   29) { // BDS 6,2 Target State and Status
-                printf("    BDS 6,2 Target State and Status\n");
+                outputPrintf("    BDS 6,2 Target State and Status\n");
 
             } else if ((mm->msg[4] >> 3) ==   31) { // BDS 6,5 Extended Squitter Aircraft Operational Status
-                printf("    BDS 6,5 Aircraft Operational Status\n");
+                outputPrintf("    BDS 6,5 Aircraft Operational Status\n");
 */
             }        
         }
 
     } else if (mm->msgtype == 5 || mm->msgtype == 21) {
-        printf("DF %d: %s, Identity Reply.\n", mm->msgtype,
+        outputPrintf("DF %d: %s, Identity Reply.\n", mm->msgtype,
             (mm->msgtype == 5) ? "Surveillance" : "Comm-B");
-        printf("  Flight Status  : %s\n", fs_str[mm->fs]);
-        printf("  DR             : %d\n", ((mm->msg[1] >> 3) & 0x1F));
-        printf("  UM             : %d\n", (((mm->msg[1]  & 7) << 3) | (mm->msg[2] >> 5)));
-        printf("  Squawk         : %04x\n", mm->modeA);
-        printf("  ICAO Address   : %06x\n", mm->addr);
+        outputPrintf("  Flight Status  : %s\n", fs_str[mm->fs]);
+        outputPrintf("  DR             : %d\n", ((mm->msg[1] >> 3) & 0x1F));
+        outputPrintf("  UM             : %d\n", (((mm->msg[1]  & 7) << 3) | (mm->msg[2] >> 5)));
+        outputPrintf("  Squawk         : %04x\n", mm->modeA);
+        outputPrintf("  ICAO Address   : %06x\n", mm->addr);
 
         if (mm->msgtype == 21) {
-            printf("  Comm-B BDS     : %x\n", mm->msg[4]);
+            outputPrintf("  Comm-B BDS     : %x\n", mm->msg[4]);
 
             // Decode the extended squitter message
             if        ( mm->msg[4]       == 0x20) { // BDS 2,0 Aircraft identification
-                printf("    BDS 2,0 Aircraft Identification : %s\n", mm->flight);
+                outputPrintf("    BDS 2,0 Aircraft Identification : %s\n", mm->flight);
 /*
             } else if ( mm->msg[4]       == 0x10) { // BDS 1,0 Datalink Capability report
-                printf("    BDS 1,0 Datalink Capability report\n");
+                outputPrintf("    BDS 1,0 Datalink Capability report\n");
 
             } else if ( mm->msg[4]       == 0x30) { // BDS 3,0 ACAS Active Resolution Advisory
-                printf("    BDS 3,0 ACAS Active Resolution Advisory\n");
+                outputPrintf("    BDS 3,0 ACAS Active Resolution Advisory\n");
 
             } else if ((mm->msg[4] >> 3) ==   28) { // BDS 6,1 Extended Squitter Emergency/Priority Status
-                printf("    BDS 6,1 Emergency/Priority Status\n");
+                outputPrintf("    BDS 6,1 Emergency/Priority Status\n");
 
             } else if ((mm->msg[4] >> 3) ==   29) { // BDS 6,2 Target State and Status
-                printf("    BDS 6,2 Target State and Status\n");
+                outputPrintf("    BDS 6,2 Target State and Status\n");
 
             } else if ((mm->msg[4] >> 3) ==   31) { // BDS 6,5 Extended Squitter Aircraft Operational Status
-                printf("    BDS 6,5 Aircraft Operational Status\n");
+                outputPrintf("    BDS 6,5 Aircraft Operational Status\n");
 */
             }        
         }
 
     } else if (mm->msgtype == 11) { // DF 11
-        printf("DF 11: All Call Reply.\n");
-        printf("  Capability  : %d (%s)\n", mm->ca, ca_str[mm->ca]);
-        printf("  ICAO Address: %06x\n", mm->addr);
+        outputPrintf("DF 11: All Call Reply.\n");
+        outputPrintf("  Capability  : %d (%s)\n", mm->ca, ca_str[mm->ca]);
+        outputPrintf("  ICAO Address: %06x\n", mm->addr);
         if (mm->iid > 16)
-            {printf("  IID         : SI-%02d\n", mm->iid-16);}
+            {outputPrintf("  IID         : SI-%02d\n", mm->iid-16);}
         else
-            {printf("  IID         : II-%02d\n", mm->iid);}
+            {outputPrintf("  IID         : II-%02d\n", mm->iid);}
 
     } else if (mm->msgtype == 16) { // DF 16
-        printf("DF 16: Long Air to Air ACAS\n");
-        printf("  VS             : %s\n",  (mm->msg[0] & 0x04) ? "Ground" : "Airborne");
-        printf("  CC             : %d\n", ((mm->msg[0] & 0x02) >> 1));
-        printf("  SL             : %d\n", ((mm->msg[1] & 0xE0) >> 5));
-        printf("  Altitude       : %d %s\n", mm->altitude,
+        outputPrintf("DF 16: Long Air to Air ACAS\n");
+        outputPrintf("  VS             : %s\n",  (mm->msg[0] & 0x04) ? "Ground" : "Airborne");
+        outputPrintf("  CC             : %d\n", ((mm->msg[0] & 0x02) >> 1));
+        outputPrintf("  SL             : %d\n", ((mm->msg[1] & 0xE0) >> 5));
+        outputPrintf("  Altitude       : %d %s\n", mm->altitude,
             (mm->unit == MODES_UNIT_METERS) ? "meters" : "feet");
-        printf("  ICAO Address   : %06x\n", mm->addr);
+        outputPrintf("  ICAO Address   : %06x\n", mm->addr);
 
     } else if (mm->msgtype == 17) { // DF 17
-        printf("DF 17: ADS-B message.\n");
-        printf("  Capability     : %d (%s)\n", mm->ca, ca_str[mm->ca]);
-        printf("  ICAO Address   : %06x\n", mm->addr);
-        printf("  Extended Squitter  Type: %d\n", mm->metype);
-        printf("  Extended Squitter  Sub : %d\n", mm->mesub);
-        printf("  Extended Squitter  Name: %s\n", getMEDescription(mm->metype, mm->mesub));
+        outputPrintf("DF 17: ADS-B message.\n");
+        outputPrintf("  Capability     : %d (%s)\n", mm->ca, ca_str[mm->ca]);
+        outputPrintf("  ICAO Address   : %06x\n", mm->addr);
+        outputPrintf("  Extended Squitter  Type: %d\n", mm->metype);
+        outputPrintf("  Extended Squitter  Sub : %d\n", mm->mesub);
+        outputPrintf("  Extended Squitter  Name: %s\n", getMEDescription(mm->metype, mm->mesub));
 
         // Decode the extended squitter message
         if (mm->metype >= 1 && mm->metype <= 4) { // Aircraft identification
-            printf("    Aircraft Type  : %c%d\n", ('A' + 4 - mm->metype), mm->mesub);
-            printf("    Identification : %s\n", mm->flight);
+            outputPrintf("    Aircraft Type  : %c%d\n", ('A' + 4 - mm->metype), mm->mesub);
+            outputPrintf("    Identification : %s\n", mm->flight);
 
         } else if (mm->metype == 19) { // Airborne Velocity
             if (mm->mesub == 1 || mm->mesub == 2) {
-                printf("    EW status         : %s\n", (mm->bFlags & MODES_ACFLAGS_EWSPEED_VALID)  ? "Valid" : "Unavailable");
-                printf("    EW velocity       : %d\n", mm->ew_velocity);
-                printf("    NS status         : %s\n", (mm->bFlags & MODES_ACFLAGS_NSSPEED_VALID)  ? "Valid" : "Unavailable");
-                printf("    NS velocity       : %d\n", mm->ns_velocity);
-                printf("    Vertical status   : %s\n", (mm->bFlags & MODES_ACFLAGS_VERTRATE_VALID) ? "Valid" : "Unavailable");
-                printf("    Vertical rate src : %d\n", ((mm->msg[8] >> 4) & 1));
-                printf("    Vertical rate     : %d\n", mm->vert_rate);
+                outputPrintf("    EW status         : %s\n", (mm->bFlags & MODES_ACFLAGS_EWSPEED_VALID)  ? "Valid" : "Unavailable");
+                outputPrintf("    EW velocity       : %d\n", mm->ew_velocity);
+                outputPrintf("    NS status         : %s\n", (mm->bFlags & MODES_ACFLAGS_NSSPEED_VALID)  ? "Valid" : "Unavailable");
+                outputPrintf("    NS velocity       : %d\n", mm->ns_velocity);
+                outputPrintf("    Vertical status   : %s\n", (mm->bFlags & MODES_ACFLAGS_VERTRATE_VALID) ? "Valid" : "Unavailable");
+                outputPrintf("    Vertical rate src : %d\n", ((mm->msg[8] >> 4) & 1));
+                outputPrintf("    Vertical rate     : %d\n", mm->vert_rate);
 
             } else if (mm->mesub == 3 || mm->mesub == 4) {
-                printf("    Heading status    : %s\n", (mm->bFlags & MODES_ACFLAGS_HEADING_VALID)  ? "Valid" : "Unavailable");
-                printf("    Heading           : %d\n", mm->heading);
-                printf("    Airspeed status   : %s\n", (mm->bFlags & MODES_ACFLAGS_SPEED_VALID)    ? "Valid" : "Unavailable");
-                printf("    Airspeed          : %d\n", mm->velocity);
-                printf("    Vertical status   : %s\n", (mm->bFlags & MODES_ACFLAGS_VERTRATE_VALID) ? "Valid" : "Unavailable");
-                printf("    Vertical rate src : %d\n", ((mm->msg[8] >> 4) & 1));
-                printf("    Vertical rate     : %d\n", mm->vert_rate);
+                outputPrintf("    Heading status    : %s\n", (mm->bFlags & MODES_ACFLAGS_HEADING_VALID)  ? "Valid" : "Unavailable");
+                outputPrintf("    Heading           : %d\n", mm->heading);
+                outputPrintf("    Airspeed status   : %s\n", (mm->bFlags & MODES_ACFLAGS_SPEED_VALID)    ? "Valid" : "Unavailable");
+                outputPrintf("    Airspeed          : %d\n", mm->velocity);
+                outputPrintf("    Vertical status   : %s\n", (mm->bFlags & MODES_ACFLAGS_VERTRATE_VALID) ? "Valid" : "Unavailable");
+                outputPrintf("    Vertical rate src : %d\n", ((mm->msg[8] >> 4) & 1));
+                outputPrintf("    Vertical rate     : %d\n", mm->vert_rate);
 
             } else {
-                printf("    Unrecognized ME subtype: %d subtype: %d\n", mm->metype, mm->mesub);
+                outputPrintf("    Unrecognized ME subtype: %d subtype: %d\n", mm->metype, mm->mesub);
             }
 
         } else if (mm->metype >= 5 && mm->metype <= 22) { // Airborne position Baro
-            printf("    F flag   : %s\n", (mm->msg[6] & 0x04) ? "odd" : "even");
-            printf("    T flag   : %s\n", (mm->msg[6] & 0x08) ? "UTC" : "non-UTC");
-            printf("    Altitude : %d feet\n", mm->altitude);
+            outputPrintf("    F flag   : %s\n", (mm->msg[6] & 0x04) ? "odd" : "even");
+            outputPrintf("    T flag   : %s\n", (mm->msg[6] & 0x08) ? "UTC" : "non-UTC");
+            outputPrintf("    Altitude : %d feet\n", mm->altitude);
             if (mm->bFlags & MODES_ACFLAGS_LATLON_VALID) {
-                printf("    Latitude : %f\n", mm->fLat);
-                printf("    Longitude: %f\n", mm->fLon);
+                outputPrintf("    Latitude : %f\n", mm->fLat);
+                outputPrintf("    Longitude: %f\n", mm->fLon);
             } else {
-                printf("    Latitude : %d (not decoded)\n", mm->raw_latitude);
-                printf("    Longitude: %d (not decoded)\n", mm->raw_longitude);
+                outputPrintf("    Latitude : %d (not decoded)\n", mm->raw_latitude);
+                outputPrintf("    Longitude: %d (not decoded)\n", mm->raw_longitude);
             }
 
         } else if (mm->metype == 28) { // Extended Squitter Aircraft Status
             if (mm->mesub == 1) {
-				printf("    Emergency State: %s\n", es_str[(mm->msg[5] & 0xE0) >> 5]);
-				printf("    Squawk: %04x\n", mm->modeA);
+				outputPrintf("    Emergency State: %s\n", es_str[(mm->msg[5] & 0xE0) >> 5]);
+				outputPrintf("    Squawk: %04x\n", mm->modeA);
             } else {
-                printf("    Unrecognized ME subtype: %d subtype: %d\n", mm->metype, mm->mesub);
+                outputPrintf("    Unrecognized ME subtype: %d subtype: %d\n", mm->metype, mm->mesub);
             }
 
         } else if (mm->metype == 23) { // Test Message
 			if (mm->mesub == 7) {
-				printf("    Squawk: %04x\n", mm->modeA);
+				outputPrintf("    Squawk: %04x\n", mm->modeA);
             } else {
-                printf("    Unrecognized ME subtype: %d subtype: %d\n", mm->metype, mm->mesub);
+                outputPrintf("    Unrecognized ME subtype: %d subtype: %d\n", mm->metype, mm->mesub);
 			}
         } else {
-            printf("    Unrecognized ME type: %d subtype: %d\n", mm->metype, mm->mesub);
+            outputPrintf("    Unrecognized ME type: %d subtype: %d\n", mm->metype, mm->mesub);
         }
 
     } else if (mm->msgtype == 18) { // DF 18 
-        printf("DF 18: Extended Squitter.\n");
-        printf("  Control Field : %d (%s)\n", mm->ca, cf_str[mm->ca]);
+        outputPrintf("DF 18: Extended Squitter.\n");
+        outputPrintf("  Control Field : %d (%s)\n", mm->ca, cf_str[mm->ca]);
         if ((mm->ca == 0) || (mm->ca == 1) || (mm->ca == 6)) {
             if (mm->ca == 1) {
-                printf("  Other Address : %06x\n", mm->addr);
+                outputPrintf("  Other Address : %06x\n", mm->addr);
             } else {
-                printf("  ICAO Address  : %06x\n", mm->addr);
+                outputPrintf("  ICAO Address  : %06x\n", mm->addr);
             }
-            printf("  Extended Squitter  Type: %d\n", mm->metype);
-            printf("  Extended Squitter  Sub : %d\n", mm->mesub);
-            printf("  Extended Squitter  Name: %s\n", getMEDescription(mm->metype, mm->mesub));
+            outputPrintf("  Extended Squitter  Type: %d\n", mm->metype);
+            outputPrintf("  Extended Squitter  Sub : %d\n", mm->mesub);
+            outputPrintf("  Extended Squitter  Name: %s\n", getMEDescription(mm->metype, mm->mesub));
 
             // Decode the extended squitter message
             if (mm->metype >= 1 && mm->metype <= 4) { // Aircraft identification
-                printf("    Aircraft Type  : %c%d\n", ('A' + 4 - mm->metype), mm->mesub);
-                printf("    Identification : %s\n", mm->flight);
+                outputPrintf("    Aircraft Type  : %c%d\n", ('A' + 4 - mm->metype), mm->mesub);
+                outputPrintf("    Identification : %s\n", mm->flight);
 
             } else if (mm->metype == 19) { // Airborne Velocity
                 if (mm->mesub == 1 || mm->mesub == 2) {
-                    printf("    EW status         : %s\n", (mm->bFlags & MODES_ACFLAGS_EWSPEED_VALID)  ? "Valid" : "Unavailable");
-                    printf("    EW velocity       : %d\n", mm->ew_velocity);
-                    printf("    NS status         : %s\n", (mm->bFlags & MODES_ACFLAGS_NSSPEED_VALID)  ? "Valid" : "Unavailable");
-                    printf("    NS velocity       : %d\n", mm->ns_velocity);
-                    printf("    Vertical status   : %s\n", (mm->bFlags & MODES_ACFLAGS_VERTRATE_VALID) ? "Valid" : "Unavailable");
-                    printf("    Vertical rate src : %d\n", ((mm->msg[8] >> 4) & 1));
-                    printf("    Vertical rate     : %d\n", mm->vert_rate);
+                    outputPrintf("    EW status         : %s\n", (mm->bFlags & MODES_ACFLAGS_EWSPEED_VALID)  ? "Valid" : "Unavailable");
+                    outputPrintf("    EW velocity       : %d\n", mm->ew_velocity);
+                    outputPrintf("    NS status         : %s\n", (mm->bFlags & MODES_ACFLAGS_NSSPEED_VALID)  ? "Valid" : "Unavailable");
+                    outputPrintf("    NS velocity       : %d\n", mm->ns_velocity);
+                    outputPrintf("    Vertical status   : %s\n", (mm->bFlags & MODES_ACFLAGS_VERTRATE_VALID) ? "Valid" : "Unavailable");
+                    outputPrintf("    Vertical rate src : %d\n", ((mm->msg[8] >> 4) & 1));
+                    outputPrintf("    Vertical rate     : %d\n", mm->vert_rate);
 
                 } else if (mm->mesub == 3 || mm->mesub == 4) {
-                    printf("    Heading status    : %s\n", (mm->bFlags & MODES_ACFLAGS_HEADING_VALID)  ? "Valid" : "Unavailable");
-                    printf("    Heading           : %d\n", mm->heading);
-                    printf("    Airspeed status   : %s\n", (mm->bFlags & MODES_ACFLAGS_SPEED_VALID)    ? "Valid" : "Unavailable");
-                    printf("    Airspeed          : %d\n", mm->velocity);
-                    printf("    Vertical status   : %s\n", (mm->bFlags & MODES_ACFLAGS_VERTRATE_VALID) ? "Valid" : "Unavailable");
-                    printf("    Vertical rate src : %d\n", ((mm->msg[8] >> 4) & 1));
-                    printf("    Vertical rate     : %d\n", mm->vert_rate);
+                    outputPrintf("    Heading status    : %s\n", (mm->bFlags & MODES_ACFLAGS_HEADING_VALID)  ? "Valid" : "Unavailable");
+                    outputPrintf("    Heading           : %d\n", mm->heading);
+                    outputPrintf("    Airspeed status   : %s\n", (mm->bFlags & MODES_ACFLAGS_SPEED_VALID)    ? "Valid" : "Unavailable");
+                    outputPrintf("    Airspeed          : %d\n", mm->velocity);
+                    outputPrintf("    Vertical status   : %s\n", (mm->bFlags & MODES_ACFLAGS_VERTRATE_VALID) ? "Valid" : "Unavailable");
+                    outputPrintf("    Vertical rate src : %d\n", ((mm->msg[8] >> 4) & 1));
+                    outputPrintf("    Vertical rate     : %d\n", mm->vert_rate);
 
                 } else {
-                    printf("    Unrecognized ME subtype: %d subtype: %d\n", mm->metype, mm->mesub);
+                    outputPrintf("    Unrecognized ME subtype: %d subtype: %d\n", mm->metype, mm->mesub);
                 }
 
             } else if (mm->metype >= 5 && mm->metype <= 22) { // Ground or Airborne position, Baro or GNSS
-                printf("    F flag   : %s\n", (mm->msg[6] & 0x04) ? "odd" : "even");
-                printf("    T flag   : %s\n", (mm->msg[6] & 0x08) ? "UTC" : "non-UTC");
-                printf("    Altitude : %d feet\n", mm->altitude);
+                outputPrintf("    F flag   : %s\n", (mm->msg[6] & 0x04) ? "odd" : "even");
+                outputPrintf("    T flag   : %s\n", (mm->msg[6] & 0x08) ? "UTC" : "non-UTC");
+                outputPrintf("    Altitude : %d feet\n", mm->altitude);
                 if (mm->bFlags & MODES_ACFLAGS_LATLON_VALID) {
-                    printf("    Latitude : %f\n", mm->fLat);
-                    printf("    Longitude: %f\n", mm->fLon);
+                    outputPrintf("    Latitude : %f\n", mm->fLat);
+                    outputPrintf("    Longitude: %f\n", mm->fLon);
                 } else {
-                    printf("    Latitude : %d (not decoded)\n", mm->raw_latitude);
-                    printf("    Longitude: %d (not decoded)\n", mm->raw_longitude);
+                    outputPrintf("    Latitude : %d (not decoded)\n", mm->raw_latitude);
+                    outputPrintf("    Longitude: %d (not decoded)\n", mm->raw_longitude);
                 }
 
             } else {
-                printf("    Unrecognized ME type: %d subtype: %d\n", mm->metype, mm->mesub);
+                outputPrintf("    Unrecognized ME type: %d subtype: %d\n", mm->metype, mm->mesub);
             }
         }             
 
     } else if (mm->msgtype == 19) { // DF 19
-        printf("DF 19: Military Extended Squitter.\n");
+        outputPrintf("DF 19: Military Extended Squitter.\n");
 
     } else if (mm->msgtype == 22) { // DF 22
-        printf("DF 22: Military Use.\n");
+        outputPrintf("DF 22: Military Use.\n");
 
     } else if (mm->msgtype == 24) { // DF 24
-        printf("DF 24: Comm D Extended Length Message.\n");
+        outputPrintf("DF 24: Comm D Extended Length Message.\n");
 
     } else if (mm->msgtype == 32) { // DF 32 is special code we use for Mode A/C
-        printf("SSR : Mode A/C Reply.\n");
+        outputPrintf("SSR : Mode A/C Reply.\n");
         if (mm->fs & 0x0080) {
-            printf("  Mode A : %04x IDENT\n", mm->modeA);
+            outputPrintf("  Mode A : %04x IDENT\n", mm->modeA);
         } else {
-            printf("  Mode A : %04x\n", mm->modeA);
+            outputPrintf("  Mode A : %04x\n", mm->modeA);
             if (mm->bFlags & MODES_ACFLAGS_ALTITUDE_VALID)
-                {printf("  Mode C : %d feet\n", mm->altitude);}
+                {outputPrintf("  Mode C : %d feet\n", mm->altitude);}
         }
 
     } else {
-        printf("DF %d: Unknown DF Format.\n", mm->msgtype);
+        outputPrintf("DF %d: Unknown DF Format.\n", mm->msgtype);
     }
 
-	char icao[7];  // PLANEDB
-	snprintf(icao, 7, "%06x", mm->addr);
-	PlaneInfo *pi = planedb_lookup(Modes.db, icao);
-	if (pi)
-		planeInfoPrint(Modes.db, pi);
+    // What the registry knows about the aircraft, looked up when it was first seen
+    if ((mm->msgtype < 32) && ((a = interactiveFindAircraft(mm->addr)) != NULL) && (a->registration[0])) {
+        outputPrintf("  Registration   : %s\n", a->registration);
+        if (a->model[0]) {
+            outputPrintf("  Registered Type: %s %s\n", a->manufacturer, a->model);
+        }
+    }
 
-    printf("\n");
+    outputWrite("\n", 1);
+}
+//
+//=========================================================================
+//
+// This function gets a decoded Mode S Message and prints it on the screen
+// in a human readable format.
+//
+void displayModesMessage(struct modesMessage *mm) {
+    outputBegin();
+    formatModesMessage(mm);
+    outputEnd(Modes.raw); // Provide raw data to the reader ASAP
 }
 //
 //=========================================================================
 //
-// Turn I/Q samples pointed by Modes.data into the magnitude vector
-// pointed by Modes.magnitude.
+// Turn I/Q samples pointed by p into the magnitude vector pointed by
+// rx->magnitude. The last Modes.mag_overlap samples of the previous block
+// are kept at the start, so a frame can straddle two blocks.
 //
-void computeMagnitudeVector(uint16_t *p) {
-    uint16_t *m = &Modes.magnitude[MODES_PREAMBLE_SAMPLES+MODES_LONG_MSG_SAMPLES];
+void computeMagnitudeVector(struct receiver *rx, uint16_t *p) {
+    uint16_t *m = &rx->magnitude[Modes.mag_overlap];
     uint32_t j;
 
-    memcpy(Modes.magnitude,&Modes.magnitude[MODES_ASYNC_BUF_SAMPLES], MODES_PREAMBLE_SIZE+MODES_LONG_MSG_SIZE);
+    memcpy(rx->magnitude,&rx->magnitude[MODES_ASYNC_BUF_SAMPLES], Modes.mag_overlap * sizeof(uint16_t));
 
     // Compute the magnitudo vector. It's just SQRT(I^2 + Q^2), but
     // we rescale to the 0-255 range to exploit the full resolution.
@@ -1448,21 +1711,29 @@ void computeMagnitudeVector(uint16_t *p) {
 //
 //=========================================================================
 //
-// Return -1 if the message is out of fase left-side
-// Return  1 if the message is out of fase right-size
+// Score the preamble at pPreamble against three sub-sample phase templates:
+// pulses centred on our samples, pulses that arrived early and spill into the
+// samples before them, and pulses that arrived late and spill into the
+// samples after them. The early or late template only fits better if the
+// average spill is more than a third of the average pulse.
+//
+// Return -1 if the message is out of phase left-side (early)
+// Return  1 if the message is out of phase right-side (late)
 // Return  0 if the message is not particularly out of phase.
 //
 // Note: this function will access pPreamble[-1], so the caller should make sure to
 // call it only if we are not at the start of the current buffer
 //
-int detectOutOfPhase(uint16_t *pPreamble) {
-    if (pPreamble[ 3] > pPreamble[2]/3) return  1;
-    if (pPreamble[10] > pPreamble[9]/3) return  1;
-    if (pPreamble[ 6] > pPreamble[7]/3) return -1;
-    if (pPreamble[-1] > pPreamble[1]/3) return -1;
-    return 0;
-}
+int detectPreamblePhase(uint16_t *pPreamble) {
+    uint32_t onTime = (pPreamble[0] + pPreamble[2] + pPreamble[7] + pPreamble[9]);
+    uint32_t early  = (pPreamble[-1] + pPreamble[6]) << 1;
+    uint32_t late   = (pPreamble[3] + pPreamble[10]) << 1;
 
+    if (early > late) {
+        return ((early * 3) > onTime) ? -1 : 0;
+    }
+    return ((late * 3) > onTime) ? 1 : 0;
+}
 
 uint16_t clamped_scale(uint16_t v, uint16_t scale) {
     uint32_t scaled = (uint32_t)v * scale / 16384;
@@ -1537,16 +1808,425 @@ void applyPhaseCorrection(uint16_t *pPayload) {
 //
 //=========================================================================
 //
+// Slice all 112 bits of the payload at pPayload (224 samples at 2MHz) in one
+// pass, without the branches of the bit by bit slicer. A bit is a 1 if its
+// first sample is larger than its second. The message bytes are returned in
+// msg, the bits where both samples were equal are set in ambiguous, and how
+// far apart the samples were (the bits confidence) in confidence. The
+// return value is the sum of the sample differences over the first 56 bits,
+// for the signal strength.
+//
+#ifdef MODES_HAVE_SSE2
+static uint32_t slicePayload(uint16_t *pPayload, unsigned char *msg, unsigned char *ambiguous, uint16_t *confidence) {
+    const __m128i lo16 = _mm_set1_epi32(0xFFFF);
+    __m128i sum = _mm_setzero_si128();
+    int k, h;
+
+    // Each 32 bit lane holds the two samples of one bit, so a register is
+    // four bits and two registers are a byte. The lanes are reversed before
+    // taking the movemask so that the first bit ends up as the MSB.
+    for (k = 0; k < MODES_LONG_MSG_BYTES; k++) {
+        int gt = 0, eq = 0;
+
+        for (h = 0; h < 2; h++) {
+            __m128i v = _mm_loadu_si128((__m128i *) &pPayload[(k * 16) + (h * 8)]);
+            __m128i a = _mm_and_si128(v, lo16);
+            __m128i b = _mm_srli_epi32(v, 16);
+
+            gt = (gt << 4) | _mm_movemask_ps(_mm_castsi128_ps(_mm_shuffle_epi32(_mm_cmpgt_epi32(a, b), 0x1B)));
+            eq = (eq << 4) | _mm_movemask_ps(_mm_castsi128_ps(_mm_shuffle_epi32(_mm_cmpeq_epi32(a, b), 0x1B)));
+
+            __m128i d = _mm_sub_epi32(a, b);
+            __m128i s = _mm_srai_epi32(d, 31);
+            d = _mm_sub_epi32(_mm_xor_si128(d, s), s);
+
+            // |a-b| fits in 16 bits signed except for the very strongest signals,
+            // which saturate at 32767. That's still plenty confident.
+            _mm_storel_epi64((__m128i *) &confidence[(k * 8) + (h * 4)], _mm_packs_epi32(d, d));
+            if (k < (MODES_SHORT_MSG_BYTES)) {
+                sum = _mm_add_epi32(sum, d);
+            }
+        }
+        msg[k]       = (unsigned char) gt;
+        ambiguous[k] = (unsigned char) eq;
+    }
+
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+    return (uint32_t) _mm_cvtsi128_si32(sum);
+}
+#else
+static uint32_t slicePayload(uint16_t *pPayload, unsigned char *msg, unsigned char *ambiguous, uint16_t *confidence) {
+    uint32_t sum = 0;
+    int k, i;
+
+    for (k = 0; k < MODES_LONG_MSG_BYTES; k++) {
+        unsigned char theByte = 0, theAmb = 0;
+
+        for (i = 0; i < 8; i++) {
+            uint32_t a = *pPayload++;
+            uint32_t b = *pPayload++;
+
+            uint32_t d = (a > b) ? (a-b) : (b-a);
+
+            theByte = (unsigned char) ((theByte << 1) | (a > b));
+            theAmb  = (unsigned char) ((theAmb  << 1) | (a == b));
+            *confidence++ = (uint16_t) ((d < 32767) ? d : 32767);
+            if (k < MODES_SHORT_MSG_BYTES) {sum += d;}
+        }
+        msg[k]       = theByte;
+        ambiguous[k] = theAmb;
+    }
+    return sum;
+}
+#endif
+//
+//=========================================================================
+//
+// Return true if any of the first msglen bits were ambiguous when sliced
+//
+static int payloadIsAmbiguous(unsigned char *ambiguous, int msglen) {
+    int k;
+
+    for (k = 0; k < (msglen / 8); k++) {
+        if (ambiguous[k]) return 1;
+    }
+    return 0;
+}
+//
+//=========================================================================
+//
+// Pass a message demodulated by receiver rx, at sample j of the current block,
+// to the next layer. When more than one receiver is running, frames already
+// passed on by another receiver are dropped here rather than being tracked
+// and output twice.
+//
+// Must be called with Modes.data_mutex held.
+//
+static void useReceivedMessage(struct receiver *rx, struct modesMessage *mm, uint32_t j) {
+    mm->rx = rx->index;
+
+    if ((Modes.check_crc) && (!mm->crcok) && (!mm->correctedbits)) {
+        return;
+    }
+
+    if (Modes.nreceivers > 1) {
+        // There are sps5 * 200 samples per millisecond
+        uint64_t msTime = ((uint64_t) rx->stSystemTimeBlk.time * 1000)
+                        + rx->stSystemTimeBlk.millitm + (j / (Modes.sps5 * 200));
+        if (modesCheckDuplicate(mm, msTime)) {
+            rx->stat_duplicates++;
+            return;
+        }
+    }
+
+    rx->stat_messages++;
+    useModesMessage(mm);
+}
+//
+//=========================================================================
+//
+// Called once the demodulator has finished with a block, to send any raw
+// output that has been waiting too long and to keep idle links alive.
+//
+static void modesEndOfBlock(struct receiver *rx) {
+    struct modesMessage mm;
+
+    // The soft decision error correction gets a fresh allowance every block
+    rx->soft_budget = MODES_SOFT_BUDGET;
+
+    pthread_mutex_lock(&Modes.data_mutex);
+
+    // The filtered clients' batches keep their own count, as the unfiltered
+    // batch being sent when it's full mustn't hold them back
+    if ((Modes.filtered_clients) && (++Modes.net_output_filter_rate_count > Modes.net_output_raw_rate)) {
+        modesFlushFilteredOutput();
+        Modes.net_output_filter_rate_count = 0;
+    }
+
+    //Send any remaining partial raw buffers now
+    if (Modes.rawOutUsed || Modes.beastOutUsed)
+      {
+      Modes.net_output_raw_rate_count++;
+      if (Modes.net_output_raw_rate_count > Modes.net_output_raw_rate)
+        {
+        if (Modes.rawOutUsed) {
+            modesSendAllClients(Modes.ros, Modes.rawOut, Modes.rawOutUsed);
+            Modes.rawOutUsed = 0;
+        }
+        if (Modes.beastOutUsed) {
+            modesSendAllClients(Modes.bos, Modes.beastOut, Modes.beastOutUsed);
+            Modes.beastOutUsed = 0;
+        }
+        Modes.net_output_raw_rate_count = 0;
+        }
+      }
+    else if ( (Modes.net) 
+           && (Modes.net_heartbeat_rate) 
+           && ((++Modes.net_heartbeat_count) > Modes.net_heartbeat_rate) ) {
+      //
+      // We haven't received any Mode A/C/S messages for some time. To try and keep any TCP
+      // links alive, send a null frame. This will help stop any routers discarding our TCP 
+      // link which will cause an un-recoverable link error if/when a real frame arrives.   
+      //
+      // Fudge up a null message
+      memset(&mm, 0, sizeof(mm));
+      mm.msgbits      = MODES_SHORT_MSG_BITS;
+      mm.timestampMsg = rx->timestampBlk;
+      mm.rx           = rx->index;
+      mm.heartbeat    = 1;
+
+      // Feed output clients
+      modesQueueOutput(&mm);
+
+      // Reset the heartbeat counter
+      Modes.net_heartbeat_count = 0;
+      }
+
+    pthread_mutex_unlock(&Modes.data_mutex);
+}
+//
+//=========================================================================
+//
+// Demodulation at sample rates above 2MHz.
+//
+// At 2.4, 3.2 and 4.0 MS/s a half bit (0.5us) is 1.2, 1.6 and 2 samples
+// long, so bits no longer line up with samples. Positions are kept in fifths
+// of a sample instead, and the energy in a half bit is the magnitude of each
+// sample it covers weighted by how many fifths of that sample fall inside
+// it. The weights repeat every 5 bits (Modes.sps5 samples), and depend on
+// where within a sample the frame starts, so they are tabulated once for
+// each of the five starting phases.
+//
+// The table lives in the context, Modes.demodTaps[start phase][half bit
+// within the group], as each context can run at its own rate.
+//
+//=========================================================================
+//
+// Build demodTaps[] for Modes.sps5. Must be called before the first block is
+// demodulated at a rate above 2MHz.
+//
+void modesInitDemodTaps(void) {
+    int half = Modes.sps5 / 2;
+    int p, h, k;
+
+    for (p = 0; p < 5; p++) {
+        for (h = 0; h < 10; h++) {
+            struct halfBitTap *t = &Modes.demodTaps[p][h];
+            int u0 = p + (h * half); // Start of the half bit, in fifths of a sample
+            int u1 = u0 + half;      // End of the half bit
+
+            t->offset = (uint16_t) (u0 / 5);
+            for (k = 0; k < 3; k++) {
+                int s0 = (t->offset + k) * 5; // This sample covers [s0, s0+5)
+                int lo = (u0 > s0)     ? u0 : s0;
+                int hi = (u1 < s0 + 5) ? u1 : s0 + 5;
+                t->w[k] = (uint8_t) ((hi > lo) ? (hi - lo) : 0);
+            }
+        }
+    }
+}
+//
+//=========================================================================
+//
+// Return the energy in half bit n of a frame whose preamble starts at pFrame,
+// using the taps for the frames starting phase.
+//
+static uint32_t halfBitEnergy(uint16_t *pFrame, struct halfBitTap *taps, int n, int sps5) {
+    struct halfBitTap *t  = &taps[n % 10];
+    uint16_t          *pS = &pFrame[((n / 10) * sps5) + t->offset];
+
+    return (pS[0] * t->w[0]) + (pS[1] * t->w[1]) + (pS[2] * t->w[2]);
+}
+//
+//=========================================================================
+//
+// The demodulator proper. sps5 is always passed as a constant by
+// detectModeSOversampled(), so the compiler can fold the group arithmetic
+// in halfBitEnergy() separately for each rate.
+//
+static void demodulateOversampled(struct receiver *rx, uint16_t *m, uint32_t mlen, const int sps5) {
+    struct modesMessage mm;
+    unsigned char msg[MODES_LONG_MSG_BYTES];
+    uint16_t confidence[MODES_LONG_MSG_BITS];
+    uint32_t h[16];
+    uint32_t j;
+
+    memset(&mm, 0, sizeof(mm));
+
+    for (j = 0; j < mlen; j++) {
+        uint16_t *pPreamble = &m[j];
+        struct halfBitTap *taps;
+        uint32_t bestScore = 0;
+        int bestPhase = -1;
+        int p, i, errors, msglen, sigStrength;
+
+        // Correlate against the preamble at each of the five phases within
+        // this sample, and keep the best. The preamble has pulses in half
+        // bits 0, 2, 7 and 9, and the rest of the first 16 are quiet. The
+        // tests are the same as the 2MHz demodulator uses on samples.
+        for (p = 0; p < 5; p++) {
+            struct halfBitTap *t = Modes.demodTaps[p];
+            uint32_t high, score;
+
+            h[0] = halfBitEnergy(pPreamble, t, 0, sps5);
+            h[1] = halfBitEnergy(pPreamble, t, 1, sps5);
+            if (h[0] <= h[1]) continue;
+            h[2] = halfBitEnergy(pPreamble, t, 2, sps5);
+            if (h[2] <= h[1]) continue;
+            h[3] = halfBitEnergy(pPreamble, t, 3, sps5);
+            if ((h[3] >= h[2]) || (h[3] >= h[0])) continue;
+
+            for (i = 4; i < 16; i++) {
+                h[i] = halfBitEnergy(pPreamble, t, i, sps5);
+            }
+            if (!(h[4] < h[0] &&
+                  h[5] < h[0] &&
+                  h[6] < h[0] &&
+                  h[7] > h[8] &&
+                  h[8] < h[9] &&
+                  h[9] > h[6])) continue;
+
+            high = (h[0] + h[2] + h[7] + h[9]) / 6;
+            if ((h[4]  >= high) || (h[5]  >= high) ||
+                (h[11] >= high) || (h[12] >= high) ||
+                (h[13] >= high) || (h[14] >= high)) continue;
+
+            score = (h[0] - h[1]) + (h[2] - h[3]) + (h[7] - h[6]) + (h[9] - h[8]);
+            if (score > bestScore) {
+                bestScore = score;
+                bestPhase = p;
+            }
+        }
+        if (bestPhase < 0) continue;
+
+        Modes.stat_valid_preamble++;
+        taps = Modes.demodTaps[bestPhase];
+
+        // Slice all 112 bits, a bit is a 1 if there's more energy in its
+        // first half than in its second
+        memset(msg, 0, sizeof(msg));
+        msglen = MODES_LONG_MSG_BITS;
+        sigStrength = (int) bestScore;
+        errors = 0;
+        for (i = 0; i < msglen; i++) {
+            uint32_t a = halfBitEnergy(pPreamble, taps, MODES_PREAMBLE_US*2 + i*2,     sps5);
+            uint32_t b = halfBitEnergy(pPreamble, taps, MODES_PREAMBLE_US*2 + i*2 + 1, sps5);
+
+            confidence[i] = (uint16_t) ((((a > b) ? (a-b) : (b-a)) * 2) / sps5);
+            if      (a > b) {msg[i >> 3] |= (0x80 >> (i & 7)); if (i < 56) {sigStrength += (a-b);}}
+            else if (a < b) {if (i < 56) {sigStrength += (b-a);}}
+            else            {if (++errors > MODES_MSG_ENCODER_ERRS) break;}
+
+            if (i == 4) {
+                msglen = modesMessageLenByType(msg[0] >> 3);
+            }
+        }
+
+        // Each half bit energy is the sum of sps5/2 fifths of samples, so scale
+        // back to magnitudes, then average over the preamble and 56 bits
+        sigStrength = (((sigStrength * 2) / sps5) + 29) / 60;
+
+        if ( (sigStrength >  MODES_MSG_SQUELCH_LEVEL)
+          && (errors      <= MODES_MSG_ENCODER_ERRS) ) {
+
+            mm.bFlags          =
+            mm.crcok           =
+            mm.correctedbits   = 0;
+
+            mm.timestampMsg    = rx->timestampBlk + MODES_FIFTHS_TO_TICKS((j * 5) + bestPhase, sps5);
+            sigStrength        = (sigStrength + 0x7F) >> 8;
+            mm.signalLevel     = ((sigStrength < 255) ? sigStrength : 255);
+            mm.phase_corrected = 0;
+            mm.confidence      = confidence;
+            mm.rx              = rx->index;
+
+            pthread_mutex_lock(&Modes.data_mutex);
+
+            // Decode the received message
+            decodeModesMessage(&mm, msg);
+
+            // Update statistics
+            if ((Modes.stats) && (mm.crcok || mm.correctedbits)) {
+                switch (errors) {
+                    case 0: {Modes.stat_demodulated0++; break;}
+                    case 1: {Modes.stat_demodulated1++; break;}
+                    case 2: {Modes.stat_demodulated2++; break;}
+                    default:{Modes.stat_demodulated3++; break;}
+                }
+                if (mm.correctedbits == 0) {
+                    if (mm.crcok) {Modes.stat_goodcrc++;}
+                    else          {Modes.stat_badcrc++;}
+                } else {
+                    Modes.stat_badcrc++;
+                    Modes.stat_fixed++;
+                    if (mm.correctedbits <= MODES_MAX_BITERRORS) {
+                        Modes.stat_bit_fix[mm.correctedbits-1] += 1;
+                    }
+                }
+            }
+
+            // Skip this message if we are sure it's fine
+            if (mm.crcok) {
+                j += (((MODES_PREAMBLE_US+msglen) * sps5) / 5) - 1;
+            }
+
+            // Pass data to the next layer
+            useReceivedMessage(rx, &mm, j);
+
+            pthread_mutex_unlock(&Modes.data_mutex);
+        }
+    }
+}
+//
+//=========================================================================
+//
+// Demodulate a block at 2.4, 3.2 or 4.0 MS/s
+//
+static void detectModeSOversampled(struct receiver *rx, uint16_t *m, uint32_t mlen) {
+    switch (Modes.sps5) {
+        case MODES_RATE_2400_SPS5: demodulateOversampled(rx, m, mlen, MODES_RATE_2400_SPS5); break;
+        case MODES_RATE_3200_SPS5: demodulateOversampled(rx, m, mlen, MODES_RATE_3200_SPS5); break;
+        case MODES_RATE_4000_SPS5: demodulateOversampled(rx, m, mlen, MODES_RATE_4000_SPS5); break;
+    }
+    modesEndOfBlock(rx);
+}
+//
+//=========================================================================
+//
 // Detect a Mode S messages inside the magnitude buffer pointed by 'm' and of
 // size 'mlen' bytes. Every detected Mode S message is convert it into a
 // stream of bits and passed to the function to display it.
 //
-void detectModeS(uint16_t *m, uint32_t mlen) {
+// Demodulation runs concurrently when there is more than one receiver, so
+// everything from decoding onwards (ICAO cache, tracker, network output) is
+// done holding Modes.data_mutex.
+//
+void detectModeS(struct receiver *rx, uint16_t *m, uint32_t mlen) {
     struct modesMessage mm;
     unsigned char msg[MODES_LONG_MSG_BYTES], *pMsg;
+    unsigned char ambiguous[MODES_LONG_MSG_BYTES];
+    uint16_t confidence[MODES_LONG_MSG_BITS];
     uint16_t aux[MODES_PREAMBLE_SAMPLES+MODES_LONG_MSG_SAMPLES+1];
     uint32_t j;
-    int use_correction = 0;
+    int use_correction, phase;
+
+    // Optional work that the CPU budget controller may have shed. Read once so
+    // a change by another receivers thread can't catch us halfway through.
+    int shed_level    = Modes.shed_level;
+    int mode_ac       = (Modes.mode_ac)       && (shed_level < MODES_SHED_MODEAC);
+    int phase_enhance = (Modes.phase_enhance) && (shed_level < MODES_SHED_PHASE);
+
+    // Sample rates above 2MHz have their own demodulator
+    if (Modes.sps5 != MODES_RATE_2000_SPS5) {
+        detectModeSOversampled(rx, m, mlen);
+        return;
+    }
+
+    // Find the few samples worth handing to detectModeA() in one pass
+    if (mode_ac) {
+        detectModeACandidates(m, mlen, rx->modeACMap);
+    }
 
     memset(&mm, 0, sizeof(mm));
 
@@ -1578,6 +2258,7 @@ void detectModeS(uint16_t *m, uint32_t mlen) {
         uint16_t *pPreamble, *pPayload, *pPtr;
         uint8_t  theByte, theErrs;
         int msglen, scanlen, sigStrength;
+        uint32_t sigSum;
 
         pPreamble = &m[j];
         pPayload  = &m[j+MODES_PREAMBLE_SAMPLES];
@@ -1589,338 +2270,324 @@ void detectModeS(uint16_t *m, uint32_t mlen) {
         mm.crcok           = 
         mm.correctedbits   = 0;
 
-        if (!use_correction)  // This is not a re-try with phase correction
-            {                 // so try to find a new preamble
 
-            if (Modes.mode_ac) 
+        if ((mode_ac) && (rx->modeACMap[j >> 5] & (1U << (j & 31))))
+            {
+            int ModeA = detectModeA(pPreamble, &mm);
+
+            if (ModeA) // We have found a valid ModeA/C in the data                    
                 {
-                int ModeA = detectModeA(pPreamble, &mm);
+                mm.timestampMsg = rx->timestampBlk + ((j+1) * 6);
 
-                if (ModeA) // We have found a valid ModeA/C in the data                    
-                    {
-                    mm.timestampMsg = Modes.timestampBlk + ((j+1) * 6);
+                pthread_mutex_lock(&Modes.data_mutex);
 
-                    // Decode the received message
-                    decodeModeAMessage(&mm, ModeA);
+                // Decode the received message
+                decodeModeAMessage(&mm, ModeA);
 
-                    // Pass data to the next layer
-                    useModesMessage(&mm);
+                // Pass data to the next layer
+                useReceivedMessage(rx, &mm, j);
 
-                    j += MODEAC_MSG_SAMPLES;
-                    Modes.stat_ModeAC++;
-                    continue;
-                    }
-                }
+                Modes.stat_ModeAC++;
+                pthread_mutex_unlock(&Modes.data_mutex);
 
-            // First check of relations between the first 10 samples
-            // representing a valid preamble. We don't even investigate further
-            // if this simple test is not passed
-            if (!(pPreamble[0] > pPreamble[1] &&
-                  pPreamble[1] < pPreamble[2] &&
-                  pPreamble[2] > pPreamble[3] &&
-                  pPreamble[3] < pPreamble[0] &&
-                  pPreamble[4] < pPreamble[0] &&
-                  pPreamble[5] < pPreamble[0] &&
-                  pPreamble[6] < pPreamble[0] &&
-                  pPreamble[7] > pPreamble[8] &&
-                  pPreamble[8] < pPreamble[9] &&
-                  pPreamble[9] > pPreamble[6]))
-            {
-                if (Modes.debug & MODES_DEBUG_NOPREAMBLE &&
-                    *pPreamble  > MODES_DEBUG_NOPREAMBLE_LEVEL)
-                    dumpRawMessage("Unexpected ratio among first 10 samples", msg, m, j);
+                j += MODEAC_MSG_SAMPLES;
                 continue;
+                }
             }
 
-            // The samples between the two spikes must be < than the average
-            // of the high spikes level. We don't test bits too near to
-            // the high levels as signals can be out of phase so part of the
-            // energy can be in the near samples
-            high = (pPreamble[0] + pPreamble[2] + pPreamble[7] + pPreamble[9]) / 6;
-            if (pPreamble[4] >= high ||
-                pPreamble[5] >= high)
-            {
-                if (Modes.debug & MODES_DEBUG_NOPREAMBLE &&
-                    *pPreamble  > MODES_DEBUG_NOPREAMBLE_LEVEL)
-                    dumpRawMessage("Too high level in samples between 3 and 6", msg, m, j);
-                continue;
-            }
+        // First check of relations between the first 10 samples
+        // representing a valid preamble. We don't even investigate further
+        // if this simple test is not passed
+        if (!(pPreamble[0] > pPreamble[1] &&
+              pPreamble[1] < pPreamble[2] &&
+              pPreamble[2] > pPreamble[3] &&
+              pPreamble[3] < pPreamble[0] &&
+              pPreamble[4] < pPreamble[0] &&
+              pPreamble[5] < pPreamble[0] &&
+              pPreamble[6] < pPreamble[0] &&
+              pPreamble[7] > pPreamble[8] &&
+              pPreamble[8] < pPreamble[9] &&
+              pPreamble[9] > pPreamble[6]))
+        {
+            if (Modes.debug & MODES_DEBUG_NOPREAMBLE &&
+                *pPreamble  > MODES_DEBUG_NOPREAMBLE_LEVEL)
+                dumpRawMessage("Unexpected ratio among first 10 samples", msg, m, j);
+            continue;
+        }
 
-            // Similarly samples in the range 11-14 must be low, as it is the
-            // space between the preamble and real data. Again we don't test
-            // bits too near to high levels, see above
-            if (pPreamble[11] >= high ||
-                pPreamble[12] >= high ||
-                pPreamble[13] >= high ||
-                pPreamble[14] >= high)
-            {
-                if (Modes.debug & MODES_DEBUG_NOPREAMBLE &&
-                    *pPreamble  > MODES_DEBUG_NOPREAMBLE_LEVEL)
-                    dumpRawMessage("Too high level in samples between 10 and 15", msg, m, j);
-                continue;
-            }
-            Modes.stat_valid_preamble++;
-        } 
-
-        else {
-            // If the previous attempt with this message failed, retry using
-            // magnitude correction
-            // Make a copy of the Payload, and phase correct the copy
-            memcpy(aux, &pPreamble[-1], sizeof(aux));
-            applyPhaseCorrection(&aux[1]);
-            Modes.stat_out_of_phase++;
-            pPayload = &aux[1 + MODES_PREAMBLE_SAMPLES];
-            // TODO ... apply other kind of corrections
-            }
+        // The samples between the two spikes must be < than the average
+        // of the high spikes level. We don't test bits too near to
+        // the high levels as signals can be out of phase so part of the
+        // energy can be in the near samples
+        high = (pPreamble[0] + pPreamble[2] + pPreamble[7] + pPreamble[9]) / 6;
+        if (pPreamble[4] >= high ||
+            pPreamble[5] >= high)
+        {
+            if (Modes.debug & MODES_DEBUG_NOPREAMBLE &&
+                *pPreamble  > MODES_DEBUG_NOPREAMBLE_LEVEL)
+                dumpRawMessage("Too high level in samples between 3 and 6", msg, m, j);
+            continue;
+        }
 
-        // Decode all the next 112 bits, regardless of the actual message
-        // size. We'll check the actual message type later
-        pMsg    = &msg[0];
-        pPtr    = pPayload;
-        theByte = 0;
-        theErrs = 0; errorsTy = 0;
-        errors  = 0; errors56 = 0;
-
-        // We should have 4 'bits' of 0/1 and 1/0 samples in the preamble, 
-        // so include these in the signal strength 
-        sigStrength = (pPreamble[0]-pPreamble[1])
-                    + (pPreamble[2]-pPreamble[3])
-                    + (pPreamble[7]-pPreamble[6])
-                    + (pPreamble[9]-pPreamble[8]);
-
-        msglen = scanlen = MODES_LONG_MSG_BITS;
-        for (i = 0; i < scanlen; i++) {
-            uint32_t a = *pPtr++;
-            uint32_t b = *pPtr++;
-
-            if      (a > b) 
-                {theByte |= 1; if (i < 56) {sigStrength += (a-b);}} 
-            else if (a < b) 
-                {/*theByte |= 0;*/ if (i < 56) {sigStrength += (b-a);}} 
-            else if (i >= MODES_SHORT_MSG_BITS) //(a == b), and we're in the long part of a frame
-                {errors++;  /*theByte |= 0;*/} 
-            else if (i >= 5)                    //(a == b), and we're in the short part of a frame
-                {scanlen = MODES_LONG_MSG_BITS; errors56 = ++errors;/*theByte |= 0;*/}            
-            else if (i)                         //(a == b), and we're in the message type part of a frame
-                {errorsTy = errors56 = ++errors; theErrs |= 1; /*theByte |= 0;*/} 
-            else                                //(a == b), and we're in the first bit of the message type part of a frame
-                {errorsTy = errors56 = ++errors; theErrs |= 1; theByte |= 1;} 
-
-            if ((i & 7) == 7) 
-              {*pMsg++ = theByte;}
-            else if (i == 4) {
-              msglen  = modesMessageLenByType(theByte);
-              if (errors == 0)
-                  {scanlen = msglen;}
+        // Similarly samples in the range 11-14 must be low, as it is the
+        // space between the preamble and real data. Again we don't test
+        // bits too near to high levels, see above
+        if (pPreamble[11] >= high ||
+            pPreamble[12] >= high ||
+            pPreamble[13] >= high ||
+            pPreamble[14] >= high)
+        {
+            if (Modes.debug & MODES_DEBUG_NOPREAMBLE &&
+                *pPreamble  > MODES_DEBUG_NOPREAMBLE_LEVEL)
+                dumpRawMessage("Too high level in samples between 10 and 15", msg, m, j);
+            continue;
+        }
+        Modes.stat_valid_preamble++;
+
+        // With --phase-enhance the preamble is scored against the early and
+        // late phase templates. The payload is sliced as it is first, and only
+        // if that frame fails its CRC, and the pulses arrived early or late,
+        // is a phase corrected copy sliced, in this same pass. Frames that
+        // are already good are never touched by the correction.
+        phase = (phase_enhance && j) ? detectPreamblePhase(pPreamble) : 0;
+        for (use_correction = 0; ; use_correction = 1) {
+            if (use_correction) {
+                memcpy(aux, &pPreamble[-1], sizeof(aux));
+                applyPhaseCorrection(&aux[1]);
+                Modes.stat_out_of_phase++;
+                pPayload = &aux[1 + MODES_PREAMBLE_SAMPLES];
+                mm.bFlags        =
+                mm.crcok         =
+                mm.correctedbits = 0;
             }
 
-            theByte = theByte << 1;
-            if (i < 7)
-              {theErrs = theErrs << 1;}
-
-            // If we've exceeded the permissible number of encoding errors, abandon ship now
-            if (errors > MODES_MSG_ENCODER_ERRS) {
-
-                if        (i < MODES_SHORT_MSG_BITS) {
-                    msglen = 0;
-
-                } else if ((errorsTy == 1) && (theErrs == 0x80)) {
-                    // If we only saw one error in the first bit of the byte of the frame, then it's possible 
-                    // we guessed wrongly about the value of the bit. We may be able to correct it by guessing
-                    // the other way.
-                    //
-                    // We guessed a '1' at bit 7, which is the DF length bit == 112 Bits.
-                    // Inverting bit 7 will change the message type from a long to a short. 
-                    // Invert the bit, cross your fingers and carry on.
-                    msglen  = MODES_SHORT_MSG_BITS;
-                    msg[0] ^= theErrs; errorsTy = 0;
-                    errors  = errors56; // revert to the number of errors prior to bit 56
-                    Modes.stat_DF_Len_Corrected++;
-
-                } else if (i < MODES_LONG_MSG_BITS) {
-                    msglen = MODES_SHORT_MSG_BITS;
-                    errors = errors56;
+            // We should have 4 'bits' of 0/1 and 1/0 samples in the preamble, 
+            // so include these in the signal strength 
+            sigStrength = (pPreamble[0]-pPreamble[1])
+                        + (pPreamble[2]-pPreamble[3])
+                        + (pPreamble[7]-pPreamble[6])
+                        + (pPreamble[9]-pPreamble[8]);
+
+            // Slice the whole payload in one pass. If none of the bits in the
+            // frame were ambiguous (both samples equal), that's the answer.
+            // Otherwise fall back to slicing bit by bit, which knows how to
+            // recover from guessing at them.
+            sigSum = slicePayload(pPayload, msg, ambiguous, confidence);
+            msglen = modesMessageLenByType(msg[0] >> 3);
+            theErrs = 0; errorsTy = 0;
+            errors  = 0; errors56 = 0;
+
+            if (!payloadIsAmbiguous(ambiguous, msglen)) {
+                sigStrength += sigSum;
 
-                } else {
-                    msglen = MODES_LONG_MSG_BITS;
-                }
+            } else {
+                // Decode all the next 112 bits, regardless of the actual message
+                // size. We'll check the actual message type later
+                pMsg    = &msg[0];
+                pPtr    = pPayload;
+                theByte = 0;
+
+                msglen = scanlen = MODES_LONG_MSG_BITS;
+                for (i = 0; i < scanlen; i++) {
+                    uint32_t a = *pPtr++;
+                    uint32_t b = *pPtr++;
+
+                    if      (a > b) 
+                        {theByte |= 1; if (i < 56) {sigStrength += (a-b);}} 
+                    else if (a < b) 
+                        {/*theByte |= 0;*/ if (i < 56) {sigStrength += (b-a);}} 
+                    else if (i >= MODES_SHORT_MSG_BITS) //(a == b), and we're in the long part of a frame
+                        {errors++;  /*theByte |= 0;*/} 
+                    else if (i >= 5)                    //(a == b), and we're in the short part of a frame
+                        {scanlen = MODES_LONG_MSG_BITS; errors56 = ++errors;/*theByte |= 0;*/}            
+                    else if (i)                         //(a == b), and we're in the message type part of a frame
+                        {errorsTy = errors56 = ++errors; theErrs |= 1; /*theByte |= 0;*/} 
+                    else                                //(a == b), and we're in the first bit of the message type part of a frame
+                        {errorsTy = errors56 = ++errors; theErrs |= 1; theByte |= 1;} 
+
+                    if ((i & 7) == 7) 
+                      {*pMsg++ = theByte;}
+                    else if (i == 4) {
+                      msglen  = modesMessageLenByType(theByte);
+                      if (errors == 0)
+                          {scanlen = msglen;}
+                    }
 
-            break;
-            }
-        }
+                    theByte = theByte << 1;
+                    if (i < 7)
+                      {theErrs = theErrs << 1;}
+
+                    // If we've exceeded the permissible number of encoding errors, abandon ship now
+                    if (errors > MODES_MSG_ENCODER_ERRS) {
+
+                        if        (i < MODES_SHORT_MSG_BITS) {
+                            msglen = 0;
+
+                        } else if ((errorsTy == 1) && (theErrs == 0x80)) {
+                            // If we only saw one error in the first bit of the byte of the frame, then it's possible 
+                            // we guessed wrongly about the value of the bit. We may be able to correct it by guessing
+                            // the other way.
+                            //
+                            // We guessed a '1' at bit 7, which is the DF length bit == 112 Bits.
+                            // Inverting bit 7 will change the message type from a long to a short. 
+                            // Invert the bit, cross your fingers and carry on.
+                            msglen  = MODES_SHORT_MSG_BITS;
+                            msg[0] ^= theErrs; errorsTy = 0;
+                            errors  = errors56; // revert to the number of errors prior to bit 56
+                            Modes.stat_DF_Len_Corrected++;
+
+                        } else if (i < MODES_LONG_MSG_BITS) {
+                            msglen = MODES_SHORT_MSG_BITS;
+                            errors = errors56;
 
-        // Ensure msglen is consistent with the DF type
-        i = modesMessageLenByType(msg[0] >> 3);
-        if      (msglen > i) {msglen = i;}
-        else if (msglen < i) {msglen = 0;}
+                        } else {
+                            msglen = MODES_LONG_MSG_BITS;
+                        }
 
-        //
-        // If we guessed at any of the bits in the DF type field, then look to see if our guess was sensible.
-        // Do this by looking to see if the original guess results in the DF type being one of the ICAO defined
-        // message types. If it isn't then toggle the guessed bit and see if this new value is ICAO defined.
-        // if the new value is ICAO defined, then update it in our message.
-        if ((msglen) && (errorsTy == 1) && (theErrs & 0x78)) {
-            // We guessed at one (and only one) of the message type bits. See if our guess is "likely" 
-            // to be correct by comparing the DF against a list of known good DF's
-            int      thisDF      = ((theByte = msg[0]) >> 3) & 0x1f;
-            uint32_t validDFbits = 0x017F0831;   // One bit per 32 possible DF's. Set bits 0,4,5,11,16.17.18.19,20,21,22,24
-            uint32_t thisDFbit   = (1 << thisDF);
-            if (0 == (validDFbits & thisDFbit)) {
-                // The current DF is not ICAO defined, so is probably an errors. 
-                // Toggle the bit we guessed at and see if the resultant DF is more likely
-                theByte  ^= theErrs;
-                thisDF    = (theByte >> 3) & 0x1f;
-                thisDFbit = (1 << thisDF);
-                // if this DF any more likely?
-                if (validDFbits & thisDFbit) {
-                    // Yep, more likely, so update the main message 
-                    msg[0] = theByte;
-                    Modes.stat_DF_Type_Corrected++;
-                    errors--; // decrease the error count so we attempt to use the modified DF.
+                    break;
+                    }
                 }
             }
-        }
 
-        // We measured signal strength over the first 56 bits. Don't forget to add 4 
-        // for the preamble samples, so round up and divide by 60.
-        sigStrength = (sigStrength + 29) / 60;
+            // Ensure msglen is consistent with the DF type
+            i = modesMessageLenByType(msg[0] >> 3);
+            if      (msglen > i) {msglen = i;}
+            else if (msglen < i) {msglen = 0;}
+
+            //
+            // If we guessed at any of the bits in the DF type field, then look to see if our guess was sensible.
+            // Do this by looking to see if the original guess results in the DF type being one of the ICAO defined
+            // message types. If it isn't then toggle the guessed bit and see if this new value is ICAO defined.
+            // if the new value is ICAO defined, then update it in our message.
+            if ((msglen) && (errorsTy == 1) && (theErrs & 0x78)) {
+                // We guessed at one (and only one) of the message type bits. See if our guess is "likely" 
+                // to be correct by comparing the DF against a list of known good DF's
+                int      thisDF      = ((theByte = msg[0]) >> 3) & 0x1f;
+                uint32_t validDFbits = 0x017F0831;   // One bit per 32 possible DF's. Set bits 0,4,5,11,16.17.18.19,20,21,22,24
+                uint32_t thisDFbit   = (1 << thisDF);
+                if (0 == (validDFbits & thisDFbit)) {
+                    // The current DF is not ICAO defined, so is probably an errors. 
+                    // Toggle the bit we guessed at and see if the resultant DF is more likely
+                    theByte  ^= theErrs;
+                    thisDF    = (theByte >> 3) & 0x1f;
+                    thisDFbit = (1 << thisDF);
+                    // if this DF any more likely?
+                    if (validDFbits & thisDFbit) {
+                        // Yep, more likely, so update the main message 
+                        msg[0] = theByte;
+                        Modes.stat_DF_Type_Corrected++;
+                        errors--; // decrease the error count so we attempt to use the modified DF.
+                    }
+                }
+            }
 
-        // When we reach this point, if error is small, and the signal strength is large enough
-        // we may have a Mode S message on our hands. It may still be broken and the CRC may not 
-        // be correct, but this can be handled by the next layer.
-        if ( (msglen) 
-          && (sigStrength >  MODES_MSG_SQUELCH_LEVEL) 
-          && (errors      <= MODES_MSG_ENCODER_ERRS) ) {
+            // We measured signal strength over the first 56 bits. Don't forget to add 4 
+            // for the preamble samples, so round up and divide by 60.
+            sigStrength = (sigStrength + 29) / 60;
 
-            // Set initial mm structure details
-            mm.timestampMsg = Modes.timestampBlk + (j*6);
-            sigStrength    = (sigStrength + 0x7F) >> 8;
-            mm.signalLevel = ((sigStrength < 255) ? sigStrength : 255);
-            mm.phase_corrected = use_correction;
+            // When we reach this point, if error is small, and the signal strength is large enough
+            // we may have a Mode S message on our hands. It may still be broken and the CRC may not 
+            // be correct, but this can be handled by the next layer.
+            if ( (msglen) 
+              && (sigStrength >  MODES_MSG_SQUELCH_LEVEL) 
+              && (errors      <= MODES_MSG_ENCODER_ERRS) ) {
 
-            // Decode the received message
-            decodeModesMessage(&mm, msg);
+                // Set initial mm structure details
+                mm.timestampMsg = rx->timestampBlk + (j*6);
+                sigStrength    = (sigStrength + 0x7F) >> 8;
+                mm.signalLevel = ((sigStrength < 255) ? sigStrength : 255);
+                mm.phase_corrected = use_correction;
+                mm.confidence  = confidence;
+                mm.rx          = rx->index;
 
-            // Update statistics
-            if (Modes.stats) {
-                if (mm.crcok || use_correction || mm.correctedbits) {
-
-                    if (use_correction) {
-                        switch (errors) {
-                            case 0: {Modes.stat_ph_demodulated0++; break;}
-                            case 1: {Modes.stat_ph_demodulated1++; break;}
-                            case 2: {Modes.stat_ph_demodulated2++; break;}
-                            default:{Modes.stat_ph_demodulated3++; break;}
-                        }
-                    } else {
-                        switch (errors) {
-                            case 0: {Modes.stat_demodulated0++; break;}
-                            case 1: {Modes.stat_demodulated1++; break;}
-                            case 2: {Modes.stat_demodulated2++; break;}
-                            default:{Modes.stat_demodulated3++; break;}
-                        }
-                    }
+                pthread_mutex_lock(&Modes.data_mutex);
+
+                // Decode the received message
+                decodeModesMessage(&mm, msg);
+
+                // Update statistics
+                if (Modes.stats) {
+                    if (mm.crcok || use_correction || mm.correctedbits) {
 
-                    if (mm.correctedbits == 0) {
                         if (use_correction) {
-                            if (mm.crcok) {Modes.stat_ph_goodcrc++;}
-                            else          {Modes.stat_ph_badcrc++;}
+                            switch (errors) {
+                                case 0: {Modes.stat_ph_demodulated0++; break;}
+                                case 1: {Modes.stat_ph_demodulated1++; break;}
+                                case 2: {Modes.stat_ph_demodulated2++; break;}
+                                default:{Modes.stat_ph_demodulated3++; break;}
+                            }
                         } else {
-                            if (mm.crcok) {Modes.stat_goodcrc++;}
-                            else          {Modes.stat_badcrc++;}
+                            switch (errors) {
+                                case 0: {Modes.stat_demodulated0++; break;}
+                                case 1: {Modes.stat_demodulated1++; break;}
+                                case 2: {Modes.stat_demodulated2++; break;}
+                                default:{Modes.stat_demodulated3++; break;}
+                            }
                         }
 
-                    } else if (use_correction) {
-                        Modes.stat_ph_badcrc++;
-                        Modes.stat_ph_fixed++;
-                        if ( (mm.correctedbits) 
-                          && (mm.correctedbits <= MODES_MAX_BITERRORS) ) {
-                            Modes.stat_ph_bit_fix[mm.correctedbits-1] += 1;
-                        }
+                        if (mm.correctedbits == 0) {
+                            if (use_correction) {
+                                if (mm.crcok) {Modes.stat_ph_goodcrc++;}
+                                else          {Modes.stat_ph_badcrc++;}
+                            } else {
+                                if (mm.crcok) {Modes.stat_goodcrc++;}
+                                else          {Modes.stat_badcrc++;}
+                            }
+
+                        } else if (use_correction) {
+                            Modes.stat_ph_badcrc++;
+                            Modes.stat_ph_fixed++;
+                            if ( (mm.correctedbits) 
+                              && (mm.correctedbits <= MODES_MAX_BITERRORS) ) {
+                                Modes.stat_ph_bit_fix[mm.correctedbits-1] += 1;
+                            }
 
-                    } else {
-                        Modes.stat_badcrc++;
-                        Modes.stat_fixed++;
-                        if ( (mm.correctedbits) 
-                          && (mm.correctedbits <= MODES_MAX_BITERRORS) ) {
-                            Modes.stat_bit_fix[mm.correctedbits-1] += 1;
+                        } else {
+                            Modes.stat_badcrc++;
+                            Modes.stat_fixed++;
+                            if ( (mm.correctedbits) 
+                              && (mm.correctedbits <= MODES_MAX_BITERRORS) ) {
+                                Modes.stat_bit_fix[mm.correctedbits-1] += 1;
+                            }
                         }
                     }
                 }
-            }
 
-            // Output debug mode info if needed
-            if (use_correction) {
-                if (Modes.debug & MODES_DEBUG_DEMOD)
-                    dumpRawMessage("Demodulated with 0 errors", msg, m, j);
-                else if (Modes.debug & MODES_DEBUG_BADCRC &&
-                         mm.msgtype == 17 &&
-                         (!mm.crcok || mm.correctedbits != 0))
-                    dumpRawMessage("Decoded with bad CRC", msg, m, j);
-                else if (Modes.debug & MODES_DEBUG_GOODCRC && mm.crcok &&
-                         mm.correctedbits == 0)
-                    dumpRawMessage("Decoded with good CRC", msg, m, j);
-            }
+                // Output debug mode info if needed
+                if (use_correction) {
+                    if (Modes.debug & MODES_DEBUG_DEMOD)
+                        dumpRawMessage("Demodulated with 0 errors", msg, m, j);
+                    else if (Modes.debug & MODES_DEBUG_BADCRC &&
+                             mm.msgtype == 17 &&
+                             (!mm.crcok || mm.correctedbits != 0))
+                        dumpRawMessage("Decoded with bad CRC", msg, m, j);
+                    else if (Modes.debug & MODES_DEBUG_GOODCRC && mm.crcok &&
+                             mm.correctedbits == 0)
+                        dumpRawMessage("Decoded with good CRC", msg, m, j);
+                }
 
-            // Skip this message if we are sure it's fine
-            if (mm.crcok) {
-                j += (MODES_PREAMBLE_US+msglen)*2 - 1;
-            }
+                // Skip this message if we are sure it's fine
+                if (mm.crcok) {
+                    j += (MODES_PREAMBLE_US+msglen)*2 - 1;
+                }
 
-            // Pass data to the next layer
-            useModesMessage(&mm);
+                // Pass data to the next layer
+                useReceivedMessage(rx, &mm, j);
 
-        } else {
-            if (Modes.debug & MODES_DEBUG_DEMODERR && use_correction) {
-                printf("The following message has %d demod errors\n", errors);
-                dumpRawMessage("Demodulated with errors", msg, m, j);
+                pthread_mutex_unlock(&Modes.data_mutex);
+
+            } else {
+                if (Modes.debug & MODES_DEBUG_DEMODERR && use_correction) {
+                    printf("The following message has %d demod errors\n", errors);
+                    dumpRawMessage("Demodulated with errors", msg, m, j);
+                }
             }
-        }
 
-        // Retry with phase correction if enabled, necessary and possible.
-        if (Modes.phase_enhance && !mm.crcok && !mm.correctedbits && !use_correction && j && detectOutOfPhase(pPreamble)) {
-            use_correction = 1; j--;
-        } else {
-            use_correction = 0; 
+            if ((!phase) || (use_correction) || (mm.crcok) || (mm.correctedbits)) {break;}
         }
     }
 
-    //Send any remaining partial raw buffers now
-    if (Modes.rawOutUsed || Modes.beastOutUsed)
-      {
-      Modes.net_output_raw_rate_count++;
-      if (Modes.net_output_raw_rate_count > Modes.net_output_raw_rate)
-        {
-        if (Modes.rawOutUsed) {
-            modesSendAllClients(Modes.ros, Modes.rawOut, Modes.rawOutUsed);
-            Modes.rawOutUsed = 0;
-        }
-        if (Modes.beastOutUsed) {
-            modesSendAllClients(Modes.bos, Modes.beastOut, Modes.beastOutUsed);
-            Modes.beastOutUsed = 0;
-        }
-        Modes.net_output_raw_rate_count = 0;
-        }
-      }
-    else if ( (Modes.net) 
-           && (Modes.net_heartbeat_rate) 
-           && ((++Modes.net_heartbeat_count) > Modes.net_heartbeat_rate) ) {
-      //
-      // We haven't received any Mode A/C/S messages for some time. To try and keep any TCP
-      // links alive, send a null frame. This will help stop any routers discarding our TCP 
-      // link which will cause an un-recoverable link error if/when a real frame arrives.   
-      //
-      // Fudge up a null message
-      memset(&mm, 0, sizeof(mm));
-      mm.msgbits      = MODES_SHORT_MSG_BITS;
-      mm.timestampMsg = Modes.timestampBlk;
-
-      // Feed output clients
-      modesQueueOutput(&mm);
-
-      // Reset the heartbeat counter
-      Modes.net_heartbeat_count = 0;
-      }
+    modesEndOfBlock(rx);
 }
 //
 //=========================================================================
@@ -1936,16 +2603,22 @@ void useModesMessage(struct modesMessage *mm) {
     if ((Modes.check_crc == 0) || (mm->crcok) || (mm->correctedbits)) { // not checking, ok or fixed
 
         // Always track aircraft
-        interactiveReceiveData(mm);
+        struct aircraft *a = interactiveReceiveData(mm);
+
+        // and keep the frame, if there's an archive
+        archiveMessage(mm);
 
         // In non-interactive non-quiet mode, display messages on standard output
-        if (!Modes.interactive && !Modes.quiet) {
+        if (!Modes.interactive && !Modes.quiet && (Modes.shed_level < MODES_SHED_DISPLAY)) {
             displayModesMessage(mm);
         }
 
         // Feed output clients
         if (Modes.net) {modesQueueOutput(mm);}
 
+        // and the library caller, if there is one
+        if (Modes.message_handler) {Modes.message_handler(mm, a, Modes.message_arg);}
+
         // Heartbeat not required whilst we're seeing real messages
         Modes.net_heartbeat_count = 0;
     }
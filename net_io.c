@@ -51,20 +51,28 @@ struct service {
 	int *socket;
 	int port;
 	int enabled;
+	char **filter_spec;          // Filter for its clients (--net-xx-filter), or NULL
+	struct netFilter *filter;    // Compiled
 };
 
+// Which clients modesSendClients() sends to
+#define MODES_SEND_UNFILTERED 1  // Those taking every message
+#define MODES_SEND_FILTERED   2  // Those with a filter the message passes
+#define MODES_SEND_ALL        (MODES_SEND_UNFILTERED | MODES_SEND_FILTERED)
+
 struct service services[MODES_NET_SERVICES_NUM];
 
 void modesInitNet(void) {
     int j;
 
 	struct service svc[MODES_NET_SERVICES_NUM] = {
-		{"Raw TCP output", &Modes.ros, Modes.net_output_raw_port, 1},
-		{"Raw TCP input", &Modes.ris, Modes.net_input_raw_port, 1},
-		{"Beast TCP output", &Modes.bos, Modes.net_output_beast_port, 1},
-		{"Beast TCP input", &Modes.bis, Modes.net_input_beast_port, 1},
-		{"HTTP server", &Modes.https, Modes.net_http_port, 1},
-		{"Basestation TCP output", &Modes.sbsos, Modes.net_output_sbs_port, 1}
+		{"Raw TCP output", &Modes.ros, Modes.net_output_raw_port, 1, &Modes.net_output_raw_filter, NULL},
+		{"Raw TCP input", &Modes.ris, Modes.net_input_raw_port, 1, NULL, NULL},
+		{"Beast TCP output", &Modes.bos, Modes.net_output_beast_port, 1, &Modes.net_output_beast_filter, NULL},
+		{"Beast TCP input", &Modes.bis, Modes.net_input_beast_port, 1, NULL, NULL},
+		{"HTTP server", &Modes.https, Modes.net_http_port, 1, NULL, NULL},
+		{"Basestation TCP output", &Modes.sbsos, Modes.net_output_sbs_port, 1, &Modes.net_output_sbs_filter, NULL},
+		{"Record TCP output", &Modes.recos, Modes.net_output_rec_port, 1, &Modes.net_output_rec_filter, NULL}
 	};
 
 	memcpy(&services, &svc, sizeof(svc));//services = svc;
@@ -93,6 +101,14 @@ void modesInitNet(void) {
 			}
 			anetNonBlock(Modes.aneterr, s);
 			*services[j].socket = s;
+
+			if ((services[j].filter_spec) && (*services[j].filter_spec)) {
+				char err[128];
+				if (filterCompile(*services[j].filter_spec, &services[j].filter, err, sizeof(err))) {
+					fprintf(stderr, "%s filter: %s\n", services[j].descr, err);
+					exit(1);
+				}
+			}
 		} else {
 			if (Modes.debug & MODES_DEBUG_NET) printf("%s port is disabled\n", services[j].descr);
 		}
@@ -105,6 +121,84 @@ void modesInitNet(void) {
 //
 //=========================================================================
 //
+// Whether clients of service are sent messages, and may send a filter
+//
+static int modesIsOutputService(int service) {
+    return ((service == Modes.ros) || (service == Modes.bos) ||
+            (service == Modes.sbsos) || (service == Modes.recos));
+}
+//
+//=========================================================================
+//
+// Allocate a client for fd, with a read buffer of bufsize bytes (and room
+// for a terminating 0) in the same block, just after it. It isn't added to
+// Modes.clients.
+//
+struct client *modesCreateClient(int fd, int service, int bufsize) {
+    struct client *c = (struct client *) malloc(sizeof(*c) + bufsize + 1);
+
+    if (c == NULL) {
+        fprintf(stderr, "Out of memory allocating client.\n");
+        exit(1);
+    }
+    c->next    = NULL;
+    c->fd      = fd;
+    c->service = service;
+    c->buflen  = 0;
+    c->bufsize = bufsize;
+    c->buf     = (char *) (c + 1);
+    c->wbuf    = NULL;
+    c->wlen    = c->wpos = 0;
+    c->noread  = 0;
+    c->filter  = NULL;
+    c->sbs_epoch = 0;
+    c->sbs_slot  = -1;
+    return (c);
+}
+//
+//=========================================================================
+//
+// Change the filter of client c to f, which may be NULL. The caller has taken
+// a reference to f for it. A filter left with no raw or Beast clients drops
+// what it had batched for them.
+//
+static void modesSetClientFilter(struct client *c, struct netFilter *f) {
+    if (c->filter) {
+        if ((c->service == Modes.ros) && (--c->filter->rawClients == 0))
+            {c->filter->rawOutUsed = 0;}
+        if ((c->service == Modes.bos) && (--c->filter->beastClients == 0))
+            {c->filter->beastOutUsed = 0;}
+        filterRelease(c->filter);
+        Modes.filtered_clients--;
+    }
+    if ((c->filter = f) != NULL) {
+        if (c->service == Modes.ros) {f->rawClients++;}
+        if (c->service == Modes.bos) {f->beastClients++;}
+        Modes.filtered_clients++;
+    }
+}
+//
+//=========================================================================
+//
+// Give a new SBS client the next epoch and a free slot, for the AIR records
+// (see modesSendSBSAircraft()). There are MODES_SBS_SLOTS slots, and clients
+// beyond that many aren't sent AIR records.
+//
+static void modesTakeSBSSlot(struct client *c) {
+    int k;
+
+    c->sbs_epoch = ++Modes.sbs_epoch;
+    for (k = 0; k < MODES_SBS_SLOTS; k++) {
+        if (!(Modes.sbs_slots & (((uint64_t) 1) << k))) {
+            Modes.sbs_slots |= ((uint64_t) 1) << k;
+            c->sbs_slot = k;
+            return;
+        }
+    }
+}
+//
+//=========================================================================
+//
 // This function gets called from time to time when the decoding thread is
 // awakened by new data arriving. This usually happens a few times every second
 //
@@ -119,17 +213,23 @@ struct client * modesAcceptClients(void) {
 			if (fd == -1) continue;
 
 			anetNonBlock(Modes.aneterr, fd);
-			c = (struct client *) malloc(sizeof(*c));
-			c->service    = *services[j].socket;
+			c = modesCreateClient(fd, *services[j].socket, MODES_CLIENT_BUF_SIZE);
 			c->next       = Modes.clients;
-			c->fd         = fd;
-			c->buflen     = 0;
 			Modes.clients = c;
 			anetSetSendBuffer(Modes.aneterr,fd, (MODES_NET_SNDBUF_SIZE << Modes.net_sndbuf_size));
 
-			if (*services[j].socket == Modes.sbsos) Modes.stat_sbs_connections++;
+			if (services[j].filter) {
+				services[j].filter->refs++;
+				modesSetClientFilter(c, services[j].filter);
+			}
+
+			if (*services[j].socket == Modes.sbsos) {
+				Modes.stat_sbs_connections++;
+				modesTakeSBSSlot(c);
+			}
 			if (*services[j].socket == Modes.ros)   Modes.stat_raw_connections++;
 			if (*services[j].socket == Modes.bos)   Modes.stat_beast_connections++;
+			if (*services[j].socket == Modes.recos) Modes.stat_rec_connections++;
 
 			j--; // Try again with the same listening port
 
@@ -161,6 +261,9 @@ void modesFreeClient(struct client *c) {
         }
     }
 
+    modesSetClientFilter(c, NULL);
+    if (c->sbs_slot >= 0) {Modes.sbs_slots &= ~(((uint64_t) 1) << c->sbs_slot);}
+    free(c->wbuf);
     free(c);
 }
 //
@@ -176,6 +279,8 @@ void modesCloseClient(struct client *c) {
         if (Modes.stat_raw_connections) Modes.stat_raw_connections--;
     } else if (c->service == Modes.bos) {
         if (Modes.stat_beast_connections) Modes.stat_beast_connections--;
+    } else if (c->service == Modes.recos) {
+        if (Modes.stat_rec_connections) Modes.stat_rec_connections--;
     }
 
     if (Modes.debug & MODES_DEBUG_NET)
@@ -186,9 +291,26 @@ void modesCloseClient(struct client *c) {
 //
 //=========================================================================
 //
-// Send the specified message to all clients listening for a given service
+// Write msg to client c, closing it if it can't all be sent
 //
-void modesSendAllClients(int service, void *msg, int len) {
+static void modesWriteClient(struct client *c, void *msg, int len) {
+#ifndef _WIN32
+    int nwritten = write(c->fd, msg, len);
+#else
+    int nwritten = send(c->fd, msg, len, 0 );
+#endif
+    if (nwritten != len) {
+        modesCloseClient(c);
+    }
+}
+//
+//=========================================================================
+//
+// Send msg, which is mm formatted for the service, to the clients of the
+// service picked by who (MODES_SEND_xxx). A client with a filter only gets
+// it if mm passes the filter.
+//
+static void modesSendClients(int service, struct modesMessage *mm, int who, void *msg, int len) {
     struct client *c = Modes.clients;
 
     while (c) {
@@ -196,15 +318,10 @@ void modesSendAllClients(int service, void *msg, int len) {
         struct client *next = c->next;
 
         if (c->fd != -1) {
-            if (c->service == service) {
-#ifndef _WIN32
-                int nwritten = write(c->fd, msg, len);
-#else
-                int nwritten = send(c->fd, msg, len, 0 );
-#endif
-                if (nwritten != len) {
-                    modesCloseClient(c);
-                }
+            if ((c->service == service) &&
+                ((c->filter) ? ((who & MODES_SEND_FILTERED) && (filterMatch(c->filter, mm)))
+                             :  (who & MODES_SEND_UNFILTERED))) {
+                modesWriteClient(c, msg, len);
             }
         } else {
             modesFreeClient(c);
@@ -215,10 +332,83 @@ void modesSendAllClients(int service, void *msg, int len) {
 //
 //=========================================================================
 //
+// Send the batched raw or Beast output in msg to the clients of service that
+// take every message. The ones with a filter get their filter's batch.
+//
+void modesSendAllClients(int service, void *msg, int len) {
+    modesSendClients(service, NULL, MODES_SEND_UNFILTERED, msg, len);
+}
+//
+//=========================================================================
+//
+// Send the batched raw or Beast output in msg to the clients of service that
+// use filter f. Closed clients are left for modesReadFromClients() to free,
+// as freeing one here could free a filter the caller is still looking at.
+//
+static void modesSendFilterClients(int service, struct netFilter *f, void *msg, int len) {
+    struct client *c;
+
+    for (c = Modes.clients; c; c = c->next) {
+        if ((c->fd != -1) && (c->service == service) && (c->filter == f)) {
+            modesWriteClient(c, msg, len);
+        }
+    }
+}
+//
+//=========================================================================
+//
+// Add msg, which is mm formatted for service (raw or Beast), to the batch of
+// each filter that has clients of service and that mm passes. Like the
+// unfiltered batch, a batch is sent once it's net_output_raw_size long.
+//
+static void modesBatchFiltered(int service, struct modesMessage *mm, char *msg, int len) {
+    struct netFilter *f;
+
+    for (f = Modes.filters; f; f = f->next) {
+        int    raw  = (service == Modes.ros);
+        char **out  = raw ? &f->rawOut     : &f->beastOut;
+        int   *used = raw ? &f->rawOutUsed : &f->beastOutUsed;
+
+        if ((raw ? f->rawClients : f->beastClients) == 0) {continue;}
+        if (!filterMatch(f, mm)) {continue;}
+
+        if ((*out == NULL) && ((*out = (char *) malloc(MODES_RAWOUT_BUF_SIZE)) == NULL)) {continue;}
+        memcpy(*out + *used, msg, len);
+        *used += len;
+        if (*used >= Modes.net_output_raw_size) {
+            modesSendFilterClients(service, f, *out, *used);
+            *used = 0;
+        }
+    }
+}
+//
+//=========================================================================
+//
+// Send whatever the filters have batched. Called from modesEndOfBlock() every
+// net_output_raw_rate blocks, as the unfiltered batches are.
+//
+void modesFlushFilteredOutput(void) {
+    struct netFilter *f;
+
+    for (f = Modes.filters; f; f = f->next) {
+        if (f->rawOutUsed) {
+            modesSendFilterClients(Modes.ros, f, f->rawOut, f->rawOutUsed);
+            f->rawOutUsed = 0;
+        }
+        if (f->beastOutUsed) {
+            modesSendFilterClients(Modes.bos, f, f->beastOut, f->beastOutUsed);
+            f->beastOutUsed = 0;
+        }
+    }
+}
+//
+//=========================================================================
+//
 // Write raw output in Beast Binary format with Timestamp to TCP clients
 //
 void modesSendBeastOutput(struct modesMessage *mm) {
-    char *p = &Modes.beastOut[Modes.beastOutUsed];
+    char *start = &Modes.beastOut[Modes.beastOutUsed];
+    char *p = start;
     int  msgLen = mm->msgbits / 8;
     char * pTimeStamp;
     char ch;
@@ -249,6 +439,8 @@ void modesSendBeastOutput(struct modesMessage *mm) {
         if (0x1A == ch) {*p++ = ch; iOutLen++;} 
     }
 
+    if (Modes.filtered_clients) {modesBatchFiltered(Modes.bos, mm, start, iOutLen);}
+
     Modes.beastOutUsed +=  iOutLen;
     if (Modes.beastOutUsed >= Modes.net_output_raw_size)
       {
@@ -263,7 +455,8 @@ void modesSendBeastOutput(struct modesMessage *mm) {
 // Write raw output to TCP clients
 //
 void modesSendRawOutput(struct modesMessage *mm) {
-    char *p = &Modes.rawOut[Modes.rawOutUsed];
+    char *start = &Modes.rawOut[Modes.rawOutUsed];
+    char *p = start;
     int  msgLen = mm->msgbits / 8;
     int j;
     unsigned char * pTimeStamp;
@@ -287,6 +480,8 @@ void modesSendRawOutput(struct modesMessage *mm) {
     *p++ = ';';
     *p++ = '\n';
 
+    if (Modes.filtered_clients) {modesBatchFiltered(Modes.ros, mm, start, p - start);}
+
     Modes.rawOutUsed += ((msgLen*2) + 3);
     if (Modes.rawOutUsed >= Modes.net_output_raw_size)
       {
@@ -353,8 +548,9 @@ void modesSendSBSOutput(struct modesMessage *mm) {
 
     // Find message reception time
     if (mm->timestampMsg && !mm->remote) {                        // Make sure the records' timestamp is valid before using it
-        epocTime_receive = Modes.stSystemTimeBlk;                 // This is the time of the start of the Block we're processing
-        offset   = (int) (mm->timestampMsg - Modes.timestampBlk); // This is the time (in 12Mhz ticks) into the Block
+        struct receiver *rx = &Modes.receivers[mm->rx];
+        epocTime_receive = rx->stSystemTimeBlk;                 // This is the time of the start of the Block we're processing
+        offset   = (int) (mm->timestampMsg - rx->timestampBlk); // This is the time (in 12Mhz ticks) into the Block
         offset   = offset / 12000;                                // convert to milliseconds
         epocTime_receive.millitm += offset;                       // add on the offset time to the Block start time
         if (epocTime_receive.millitm > 999) {                     // if we've caused an overflow into the next second...
@@ -459,15 +655,95 @@ void modesSendSBSOutput(struct modesMessage *mm) {
     }
 
     p += sprintf(p, "\r\n");
-    modesSendAllClients(Modes.sbsos, msg, p-msg);
+    modesSendClients(Modes.sbsos, mm, MODES_SEND_ALL, msg, p-msg);
+}
+//
+//=========================================================================
+//
+// The first time an aircraft the registry knows is sent to an SBS client,
+// precede it with an AIR (new aircraft) record carrying its registration,
+// manufacturer and type in fields 11 to 13. Commas would split the fields,
+// so they become spaces.
+//
+// Each SBS client has a slot, a bit in the aircraft's sbs_sent mask, which is
+// set once it has been sent the record. A slot is reused after its client
+// goes, so the aircraft also remembers the Modes.sbs_epoch its mask was last
+// brought up to date at. Clients that connected since then clear their bit.
+//
+static void modesSendSBSAircraft(struct modesMessage *mm) {
+    char msg[256], *p = msg;
+    struct aircraft *a = interactiveFindAircraft(mm->addr);
+    struct client *cl;
+    struct timeval tv;
+    struct tm    stTime_now;
+    time_t       now;
+    uint64_t     want = 0;
+    int          ms;
+    char *c;
+
+    if ((a == NULL) || (a->registration[0] == 0)) return;
+    if ((a->sbs_epoch == Modes.sbs_epoch) && ((Modes.sbs_slots & ~a->sbs_sent) == 0)) return;
+
+    // Find the clients still waiting for the record. One whose filter doesn't
+    // pass this message gets it with a later one
+    for (cl = Modes.clients; cl; cl = cl->next) {
+        uint64_t bit;
+
+        if ((cl->fd == -1) || (cl->service != Modes.sbsos) || (cl->sbs_slot < 0)) {continue;}
+        bit = ((uint64_t) 1) << cl->sbs_slot;
+        if (cl->sbs_epoch > a->sbs_epoch) {a->sbs_sent &= ~bit;}
+        if ((a->sbs_sent & bit) || ((cl->filter) && (!filterMatch(cl->filter, mm)))) {continue;}
+        want |= bit;
+    }
+    a->sbs_epoch = Modes.sbs_epoch;
+    if (want == 0) return;
+
+    gettimeofday(&tv, NULL);
+    now        = tv.tv_sec;
+    ms         = (int) (tv.tv_usec / 1000);
+    stTime_now = *localtime(&now);
+
+    p += sprintf(p, "AIR,,111,11111,%06X,111111,", mm->addr);
+    p += sprintf(p, "%04d/%02d/%02d,", (stTime_now.tm_year+1900),(stTime_now.tm_mon+1), stTime_now.tm_mday);
+    p += sprintf(p, "%02d:%02d:%02d.%03d,", stTime_now.tm_hour, stTime_now.tm_min, stTime_now.tm_sec, ms);
+    p += sprintf(p, "%04d/%02d/%02d,", (stTime_now.tm_year+1900),(stTime_now.tm_mon+1), stTime_now.tm_mday);
+    p += sprintf(p, "%02d:%02d:%02d.%03d,", stTime_now.tm_hour, stTime_now.tm_min, stTime_now.tm_sec, ms);
+    c  = p;
+    p += sprintf(p, "%s\001%s\001%s", a->registration, a->manufacturer, a->model);
+    for (; c < p; c++) {
+        if      (*c == ',')    {*c = ' ';}
+        else if (*c == '\001') {*c = ',';}
+    }
+    p += sprintf(p, "\r\n");
+
+    for (cl = Modes.clients; cl; cl = cl->next) {
+        if ((cl->fd != -1) && (cl->service == Modes.sbsos) && (cl->sbs_slot >= 0) &&
+            (want & (((uint64_t) 1) << cl->sbs_slot))) {
+            modesWriteClient(cl, msg, p-msg);
+        }
+    }
+    a->sbs_sent |= want;
+}
+//
+//=========================================================================
+//
+// Write the message as a record (see record.c) to TCP clients
+//
+static void modesSendRecordOutput(struct modesMessage *mm) {
+    char msg[MODES_RECORD_MAX];
+
+    modesSendClients(Modes.recos, mm, MODES_SEND_ALL, msg, modesRecord(mm, Modes.net_rec_format, msg));
 }
 //
 //=========================================================================
 //
 void modesQueueOutput(struct modesMessage *mm) {
-    if (Modes.stat_sbs_connections)   {modesSendSBSOutput(mm);}
+    Modes.net_msg_seq++; // Filters test each message once, see filterMatch()
+
+    if (Modes.stat_sbs_connections)   {modesSendSBSAircraft(mm); modesSendSBSOutput(mm);}
     if (Modes.stat_beast_connections) {modesSendBeastOutput(mm);}
     if (Modes.stat_raw_connections)   {modesSendRawOutput(mm);}
+    if (Modes.stat_rec_connections)   {modesSendRecordOutput(mm);}
 }
 //
 //=========================================================================
@@ -633,13 +909,32 @@ int decodeHexMessage(struct client *c, char *hex) {
 //
 //=========================================================================
 //
-// Return a description of planes in json. No metric conversion
+// Copy src to dst (of size dstlen), escaping it for a JSON string
+//
+static void jsonEscape(char *dst, int dstlen, const char *src) {
+    char *end = dst + dstlen - 2; // Room for an escape and the terminator
+
+    while ((*src) && (dst < end)) {
+        if ((*src == '"') || (*src == '\\')) {*dst++ = '\\';}
+        *dst++ = *src++;
+    }
+    *dst = 0;
+}
+//
+//=========================================================================
+//
+// Return a description of planes in json. No metric conversion. This works
+// from the latest aircraft snapshot, so needn't hold Modes.data_mutex.
 //
 char *aircraftsToJson(int *len) {
     time_t now = time(NULL);
-    struct aircraft *a = Modes.aircrafts;
+    struct aircraftSnapshot *snap = interactiveGetSnapshot();
+    struct aircraft *a = (snap) ? snap->aircrafts : NULL;
     int buflen = 1024; // The initial buffer is incremented as needed
     char *buf = (char *) malloc(buflen), *p = buf;
+    char registration[2*sizeof(a->registration)];
+    char manufacturer[2*sizeof(a->manufacturer)];
+    char model[2*sizeof(a->model)];
     int l;
 
     l = snprintf(p,buflen,"[\n");
@@ -661,17 +956,24 @@ char *aircraftsToJson(int *len) {
             track = 1;
         }
         
+        // The registry names may have quotes in them
+        jsonEscape(registration, sizeof(registration), a->registration);
+        jsonEscape(manufacturer, sizeof(manufacturer), a->manufacturer);
+        jsonEscape(model,        sizeof(model),        a->model);
+
         // No metric conversion
         l = snprintf(p,buflen,
             "{\"hex\":\"%06x\", \"squawk\":\"%04x\", \"flight\":\"%s\", \"lat\":%f, "
             "\"lon\":%f, \"validposition\":%d, \"altitude\":%d,  \"vert_rate\":%d,\"track\":%d, \"validtrack\":%d,"
-            "\"speed\":%d, \"messages\":%ld, \"seen\":%d},\n",
+            "\"speed\":%d, \"messages\":%ld, \"seen\":%d, "
+            "\"registration\":\"%s\", \"manufacturer\":\"%s\", \"type\":\"%s\"},\n",
             a->addr, a->modeA, a->flight, a->lat, a->lon, position, a->altitude, a->vert_rate, a->track, track,
-            a->speed, a->messages, (int)(now - a->seen));
+            a->speed, a->messages, (int)(now - a->seen),
+            registration, manufacturer, model);
         p += l; buflen -= l;
         
         //Resize if needed
-        if (buflen < 256) {
+        if (buflen < 512) {
             int used = p-buf;
             buflen += 1024; // Our increment.
             buf = (char *) realloc(buf,used+buflen);
@@ -691,20 +993,117 @@ char *aircraftsToJson(int *len) {
     l = snprintf(p,buflen,"]\n");
     p += l; buflen -= l;
 
+    interactiveReleaseSnapshot(snap);
     *len = p-buf;
     return buf;
 }
 //
 //=========================================================================
 //
+// Return the trails of the aircraft in json, or just the one with ICAO
+// address addr if it isn't 0. Each is sent as its first point, followed by
+// the differences between one point and the next: the time in tenths of a
+// second, the latitude and longitude in units of 1e-5 degrees and the
+// altitude in feet. The trails belong to the live aircraft, so this must
+// be called with Modes.data_mutex held.
+//
+char *historyToJson(int *len, uint32_t addr) {
+    struct aircraft *a;
+    struct trailPoint pt, prev;
+    int buflen = 1024; // The initial buffer is incremented as needed
+    char *buf = (char *) malloc(buflen), *p = buf;
+    int l, pos, n = 0;
+
+    if (buf == NULL) return NULL;
+
+    l = snprintf(p,buflen,"{\"now\":%llu,\"aircraft\":[\n", (unsigned long long) time(NULL) * 1000);
+    p += l; buflen -= l;
+    for (a = Modes.aircrafts; a; a = a->next) {
+        if ((a->trail == NULL) || ((addr) && (a->addr != addr))) continue;
+
+        pos = -1;
+        trailNext(a->trail, &pos, &pt);
+        l = snprintf(p,buflen,
+            "%s{\"hex\":\"%06x\",\"points\":%d,\"time\":%llu,\"lat\":%d,\"lon\":%d,\"altitude\":%d,\"deltas\":[",
+            (n++) ? ",\n" : "", a->addr, a->trail->count,
+            (unsigned long long) pt.time * 100, pt.lat, pt.lon, pt.alt);
+        p += l; buflen -= l;
+
+        for (prev = pt; trailNext(a->trail, &pos, &pt); prev = pt) {
+            l = snprintf(p,buflen,"%d,%d,%d,%d,",
+                (int) (pt.time - prev.time), pt.lat - prev.lat, pt.lon - prev.lon, pt.alt - prev.alt);
+            p += l; buflen -= l;
+
+            //Resize if needed
+            if (buflen < 512) {
+                int used = p-buf;
+                buflen += 65536; // Our increment, the trails can be big
+                buf = (char *) realloc(buf,used+buflen);
+                p = buf+used;
+            }
+        }
+
+        //Remove the final comma if any, and close the deltas
+        if (*(p-1) == ',') {
+            p--;
+            buflen++;
+        }
+        l = snprintf(p,buflen,"]}");
+        p += l; buflen -= l;
+
+        if (buflen < 512) {
+            int used = p-buf;
+            buflen += 65536;
+            buf = (char *) realloc(buf,used+buflen);
+            p = buf+used;
+        }
+    }
+
+    l = snprintf(p,buflen,"\n]}\n");
+    p += l; buflen -= l;
+
+    *len = p-buf;
+    return buf;
+}
+//
+//=========================================================================
+//
+// Send more of the HTTP reply in c->wbuf, as much as the socket will take.
+// Returns 1 once it has all been sent (and wbuf is freed), 0 if there is
+// more to send, or -1 on error.
+//
+static int modesFlushClient(struct client *c) {
+    int n;
+
+    while (c->wpos < c->wlen) {
+#ifndef _WIN32
+        n = write(c->fd, c->wbuf + c->wpos, c->wlen - c->wpos);
+        if (n < 0) {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) return 0;
+#else
+        n = send(c->fd, c->wbuf + c->wpos, c->wlen - c->wpos, 0);
+        if (n < 0) {
+            if (WSAGetLastError() == WSAEWOULDBLOCK) return 0;
+#endif
+            return -1;
+        }
+        c->wpos += n;
+    }
+    free(c->wbuf);
+    c->wbuf = NULL;
+    return 1;
+}
+//
+//=========================================================================
+//
 #define MODES_CONTENT_TYPE_HTML "text/html;charset=utf-8"
 #define MODES_CONTENT_TYPE_CSS  "text/css;charset=utf-8"
 #define MODES_CONTENT_TYPE_JSON "application/json;charset=utf-8"
 #define MODES_CONTENT_TYPE_JS   "application/javascript;charset=utf-8"
 //
 // Get an HTTP request header and write the response to the client.
-// gain here we assume that the socket buffer is enough without doing
-// any kind of userspace buffering.
+// Here we assume that the socket buffer is enough for the header, the
+// content is sent by modesFlushClient() if it doesn't all fit.
 //
 // Returns 1 on error to signal the caller the client connection should
 // be closed.
@@ -722,6 +1121,9 @@ int handleHTTPRequest(struct client *c, char *p) {
     if (Modes.debug & MODES_DEBUG_NET)
         printf("\nHTTP request: %s\n", c->buf);
 
+    // Still sending the last reply. The connection closes after it anyway
+    if (c->wbuf) return 0;
+
     // Minimally parse the request.
     httpver = (strstr(p, "HTTP/1.1") != NULL) ? 11 : 10;
     if (httpver == 10) {
@@ -752,13 +1154,34 @@ int handleHTTPRequest(struct client *c, char *p) {
         snprintf(getFile, sizeof getFile, "%s/%s", HTMLPATH, url);
     }
 
-    // Select the content to send, we have just two so far:
+    // Select the content to send:
     // "/" -> Our google map application.
     // "/data.json" -> Our ajax request to update planes.
     if (strstr(url, "/data.json")) {
         statuscode = 200;
         content = aircraftsToJson(&clen);
         //snprintf(ctype, sizeof ctype, MODES_CONTENT_TYPE_JSON);
+    } else if ((ext = strstr(url, "/history.json")) != NULL) {
+        // "/history.json" -> The aircrafts' trails, "/history.json?icao=xxxxxx" -> one of them
+        char *icao = strstr(ext, "icao=");
+        uint32_t addr = (icao) ? (uint32_t) strtoul(icao + 5, NULL, 16) : 0;
+
+        statuscode = 200;
+        content = historyToJson(&clen, addr);
+        if (content == NULL) return 1;
+    } else if (strstr(url, "/reload-db.json")) {
+        // "/reload-db.json" -> Load the registry files again, if allowed.
+        // The reload happens in the background, so just say it's underway.
+        content = (char *) malloc(64);
+        if (content == NULL) return 1;
+        if (Modes.db_http_reload) {
+            registryRequestReload();
+            statuscode = 202;
+            clen = snprintf(content, 64, "{\"reload\":\"requested\"}\n");
+        } else {
+            statuscode = 403;
+            clen = snprintf(content, 64, "{\"reload\":\"disabled\"}\n");
+        }
     } else {
         struct stat sbuf;
         int fd = -1;
@@ -825,20 +1248,22 @@ int handleHTTPRequest(struct client *c, char *p) {
         printf("HTTP Reply header:\n%s", hdr);
     }
 
-    // Send header and content.
+    // Send header and content. Whatever of the content doesn't fit in the
+    // socket buffer is sent by modesFlushClient() as the client takes it.
 #ifndef _WIN32
-    if ( (write(c->fd, hdr, hdrlen) != hdrlen) 
-      || (write(c->fd, content, clen) != clen) ) {
+    if (write(c->fd, hdr, hdrlen) != hdrlen) {
 #else
-    if ( (send(c->fd, hdr, hdrlen, 0) != hdrlen) 
-      || (send(c->fd, content, clen, 0) != clen) ) {
+    if (send(c->fd, hdr, hdrlen, 0) != hdrlen) {
 #endif
         free(content);
         return 1;
     }
-    free(content);
     Modes.stat_http_requests++;
-    return !keepalive;
+    c->wbuf = content;
+    c->wlen = clen;
+    c->wpos = 0;
+    if (modesFlushClient(c) < 0) return 1;
+    return (c->wbuf) ? 0 : !keepalive;
 }
 //
 //=========================================================================
@@ -866,11 +1291,11 @@ void modesReadFromClient(struct client *c, char *sep,
     while(bContinue) {
 
         fullmsg = 0;
-        left = MODES_CLIENT_BUF_SIZE - c->buflen;
+        left = c->bufsize - c->buflen;
         // If our buffer is full discard it, this is some badly formatted shit
         if (left <= 0) {
             c->buflen = 0;
-            left = MODES_CLIENT_BUF_SIZE;
+            left = c->bufsize;
             // If there is garbage, read more to discard it ASAP
         }
 #ifndef _WIN32
@@ -880,6 +1305,10 @@ void modesReadFromClient(struct client *c, char *sep,
         if (nread < 0) {errno = WSAGetLastError();}
 #endif
         if (nread == 0) {
+            if (modesIsOutputService(c->service)) {
+                c->noread = 1; // It's done talking, but still listening
+                return;
+            }
 			modesCloseClient(c);
 			return;
 		}
@@ -976,6 +1405,29 @@ void modesReadFromClient(struct client *c, char *sep,
 //
 //=========================================================================
 //
+// A line from a client of an output port. "FILTER <terms>" replaces the
+// client's filter (see filter.c), and anything else is ignored. A filter
+// that can't be understood closes the connection, rather than leaving the
+// client to be sent what it didn't ask for.
+//
+static int handleFilterRequest(struct client *c, char *line) {
+    struct netFilter *f;
+    char err[128];
+
+    if (strncmp(line, "FILTER", 6) || ((line[6]) && (line[6] != ' ') && (line[6] != '\r'))) {return (0);}
+
+    if (filterCompile(line + 6, &f, err, sizeof(err))) {
+        if (Modes.debug & MODES_DEBUG_NET)
+            printf("Client %d: %s\n", c->fd, err);
+        return (1);
+    }
+
+    modesSetClientFilter(c, f);
+    return (0);
+}
+//
+//=========================================================================
+//
 // Read data from clients. This function actually delegates a lower-level
 // function that depends on the kind of service (raw, http, ...).
 //
@@ -993,7 +1445,13 @@ void modesReadFromClients(void) {
             } else if (c->service == Modes.bis) {
                 modesReadFromClient(c,"",decodeBinMessage);
             } else if (c->service == Modes.https) {
-                modesReadFromClient(c,"\r\n\r\n",handleHTTPRequest);
+                if (c->wbuf == NULL) {
+                    modesReadFromClient(c,"\r\n\r\n",handleHTTPRequest);
+                } else if (modesFlushClient(c)) {
+                    modesCloseClient(c); // Sent, or failed. We don't keep-alive
+                }
+            } else if ((modesIsOutputService(c->service)) && (!c->noread)) {
+                modesReadFromClient(c,"\n",handleFilterRequest);
             }
         } else {
             modesFreeClient(c);
@@ -0,0 +1,285 @@
+// dump1090, a Mode S messages decoder for RTLSDR devices.
+//
+// Copyright (C) 2012 by Salvatore Sanfilippo <antirez@gmail.com>
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//  *  Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//  *  Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include "dump1090.h"
+#include <stdarg.h>
+//
+// ============================= Buffered output ============================
+//
+// displayModesMessage() writes a lot of small pieces for each message, and
+// --raw used to flush stdout after every frame. Fed into a pipe, that made
+// the decoder wait on a write() for each message. Instead, once
+// outputInit() has been called, the text goes into one of two large
+// buffers, and a writer thread writes the other one out:
+//
+//  *  when the buffer holds MODES_OUT_FLUSH_BYTES, the decoder hands it to
+//     the writer (if the writer is still busy with the last one, the
+//     decoder carries on filling it, and only waits once it is full),
+//
+//  *  and the writer takes whatever there is once it has waited
+//     MODES_OUT_FLUSH_MS, so a quiet receiver's output isn't held up.
+//
+// The bytes are the same as printf() would have written, in the same order.
+// A message is added to the buffer in one go, between outputBegin() and
+// outputEnd(), so messages from different threads are never mixed.
+//
+// Without outputInit() (query1090, or a program using libmodes) the output
+// goes straight to stdio as before.
+//
+//=========================================================================
+//
+// Give the filled buffer to the writer thread, waiting for it to finish
+// with the last one first. Called with Modes.out_mutex held.
+//
+static void outputHandOver(void) {
+    char *buf;
+
+    while (Modes.out_wlen) {
+        pthread_cond_wait(&Modes.out_cond, &Modes.out_mutex);
+    }
+    buf = Modes.out_buf[1];
+    Modes.out_buf[1] = Modes.out_buf[0];
+    Modes.out_buf[0] = buf;
+    Modes.out_wlen = Modes.out_len;
+    Modes.out_len  = 0;
+    pthread_cond_broadcast(&Modes.out_cond);
+}
+//
+//=========================================================================
+//
+static void *outputWriterEntryPoint(void *arg) {
+    struct timespec ts;
+    uint64_t due;
+    int done, n;
+
+    modesUseContext((struct modes *) arg);
+
+    pthread_mutex_lock(&Modes.out_mutex);
+    while (1) {
+        if ((Modes.out_wlen == 0) && (Modes.out_len)) {
+            // Take what there is if it has waited long enough, or we're stopping
+            due = Modes.out_since + MODES_OUT_FLUSH_MS;
+            if ((Modes.out_stop) || (mstime() >= due)) {
+                outputHandOver();
+            } else {
+                ts.tv_sec  = (time_t) (due / 1000);
+                ts.tv_nsec = (long) (due % 1000) * 1000000;
+                pthread_cond_timedwait(&Modes.out_cond, &Modes.out_mutex, &ts);
+                continue;
+            }
+        }
+        if (Modes.out_wlen == 0) {
+            if (Modes.out_stop) break;
+            pthread_cond_wait(&Modes.out_cond, &Modes.out_mutex);
+            continue;
+        }
+
+        // Write it without the lock, so the decoder can fill the other buffer
+        pthread_mutex_unlock(&Modes.out_mutex);
+        for (done = 0; (done < Modes.out_wlen) && (!Modes.out_error); done += n) {
+            n = write(STDOUT_FILENO, Modes.out_buf[1] + done, Modes.out_wlen - done);
+            if (n < 0) {
+                if (errno == EINTR) {n = 0; continue;}
+                Modes.out_error = 1; // Like stdio, carry on without the output
+            }
+        }
+        pthread_mutex_lock(&Modes.out_mutex);
+        Modes.out_wlen = 0;
+        pthread_cond_broadcast(&Modes.out_cond);
+    }
+    pthread_mutex_unlock(&Modes.out_mutex);
+    return (NULL);
+}
+//
+//=========================================================================
+//
+// Start buffering standard output, and the thread that writes it
+//
+void outputInit(void) {
+    if ( ((Modes.out_buf[0] = (char *) malloc(MODES_OUT_BUF_SIZE)) == NULL) ||
+         ((Modes.out_buf[1] = (char *) malloc(MODES_OUT_BUF_SIZE)) == NULL) ) {
+        fprintf(stderr, "Out of memory allocating output buffers.\n");
+        exit(1);
+    }
+    Modes.out_len = Modes.out_wlen = 0;
+    Modes.out_stop = Modes.out_error = 0;
+
+    fflush(stdout); // Anything already printed goes first
+    if (pthread_create(&Modes.out_thread, NULL, outputWriterEntryPoint, modesContext) == 0) {
+        Modes.out_thread_running = 1;
+    }
+}
+//
+//=========================================================================
+//
+// Write out everything buffered so far, and wait until it has been. Used
+// before printing to stdout any other way.
+//
+void outputFlush(void) {
+    if (!Modes.out_thread_running) {
+        fflush(stdout);
+        return;
+    }
+    pthread_mutex_lock(&Modes.out_mutex);
+    if (Modes.out_len) {outputHandOver();}
+    while (Modes.out_wlen) {
+        pthread_cond_wait(&Modes.out_cond, &Modes.out_mutex);
+    }
+    pthread_mutex_unlock(&Modes.out_mutex);
+}
+//
+//=========================================================================
+//
+// Write out what's left, and stop the writer thread
+//
+void outputExit(void) {
+    if (Modes.out_thread_running) {
+        pthread_mutex_lock(&Modes.out_mutex);
+        Modes.out_stop = 1;
+        pthread_cond_broadcast(&Modes.out_cond);
+        pthread_mutex_unlock(&Modes.out_mutex);
+        pthread_join(Modes.out_thread, NULL);
+        Modes.out_thread_running = 0;
+    }
+    free(Modes.out_buf[0]);
+    free(Modes.out_buf[1]);
+    Modes.out_buf[0] = Modes.out_buf[1] = NULL;
+}
+//
+//=========================================================================
+//
+// Start adding a message. Everything up to outputEnd() goes out together.
+//
+void outputBegin(void) {
+    if (Modes.out_thread_running) {
+        pthread_mutex_lock(&Modes.out_mutex);
+    }
+}
+//
+//=========================================================================
+//
+// Finish a message. If urgent and we aren't buffering, flush stdout now.
+//
+void outputEnd(int urgent) {
+    if (!Modes.out_thread_running) {
+        if (urgent) {fflush(stdout);}
+        return;
+    }
+    if ((Modes.out_len >= MODES_OUT_FLUSH_BYTES) && (Modes.out_wlen == 0)) {
+        outputHandOver();
+    }
+    pthread_mutex_unlock(&Modes.out_mutex);
+}
+//
+//=========================================================================
+//
+// Make room for len more bytes, and return where they go. Called between
+// outputBegin() and outputEnd(). len must be less than MODES_OUT_BUF_SIZE.
+//
+static char *outputSpace(int len) {
+    if ((Modes.out_len + len) > MODES_OUT_BUF_SIZE) {
+        outputHandOver();
+    }
+    if (Modes.out_len == 0) {
+        // Start the writer's clock
+        Modes.out_since = mstime();
+        pthread_cond_broadcast(&Modes.out_cond);
+    }
+    return (Modes.out_buf[0] + Modes.out_len);
+}
+//
+//=========================================================================
+//
+void outputWrite(const char *p, int len) {
+    if (!Modes.out_thread_running) {
+        fwrite(p, 1, len, stdout);
+        return;
+    }
+    memcpy(outputSpace(len), p, len);
+    Modes.out_len += len;
+}
+//
+//=========================================================================
+//
+// Add len bytes of msg as lower case hex, as printf("%02x") would
+//
+void outputHex(const unsigned char *msg, int len) {
+    static const char hex[] = "0123456789abcdef";
+    char *p;
+    int j;
+
+    if (!Modes.out_thread_running) {
+        for (j = 0; j < len; j++) printf("%02x", msg[j]);
+        return;
+    }
+    p = outputSpace(len * 2);
+    for (j = 0; j < len; j++) {
+        *p++ = hex[msg[j] >> 4];
+        *p++ = hex[msg[j] & 15];
+    }
+    Modes.out_len += len * 2;
+}
+//
+//=========================================================================
+//
+void outputPrintf(const char *fmt, ...) {
+    va_list ap;
+    char *p;
+    int room, n;
+
+    va_start(ap, fmt);
+    if (!Modes.out_thread_running) {
+        vprintf(fmt, ap);
+        va_end(ap);
+        return;
+    }
+
+    // Our lines are short, so print straight into the buffer if there's
+    // a reasonable amount of room, and start the next one if it didn't fit
+    p = outputSpace(MODES_OUT_LINE_MAX);
+    room = MODES_OUT_BUF_SIZE - Modes.out_len;
+    n = vsnprintf(p, room, fmt, ap);
+    va_end(ap);
+    if (n >= room) {
+        char *line = (char *) malloc(n + 1);
+        if (line == NULL) return;
+        va_start(ap, fmt);
+        vsnprintf(line, n + 1, fmt, ap);
+        va_end(ap);
+        outputHandOver();
+        outputWrite(line, n);
+        free(line);
+        return;
+    }
+    if (n > 0) {Modes.out_len += n;}
+}
+//
+//=========================================================================
+//
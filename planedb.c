@@ -3,15 +3,17 @@
  * Simple tool to read plane registration and type information
  * from various databases
  *
- * Currently, we are just reading the FAA database files.
+ * Each kind of source is read by a provider.  The FAA provider reads the
+ * fixed-width MASTER.txt and ACFTREF.txt files, which cover US registrations.
  * @see http://www.faa.gov/licenses_certificates/aircraft_certification/aircraft_registry/releasable_aircraft_download/
+ * The CSV provider reads one comma separated file of ICAO address, registration,
+ * manufacturer, model and registrant, such as the OpenSky Network aircraft
+ * database, for everything else.  Any number of sources may be used at once.
  *
- * Copy the MASTER.txt and ACFTREF.txt files into the runtime directory for this to work.
+ * By default the FAA files are read from the runtime directory.
  * If they are not found, then the lookup will simply be skipped, and will return a NULL record.  It
  * should not affect operation of the client application.
  *
- * Add more later.
- *
  * The MIT License (MIT)
  * Copyright (c) 2019 Bob Jamison
  *
@@ -37,9 +39,29 @@
 #include <string.h>
 #include <ctype.h>
 #include <stdarg.h>
+#include <pthread.h>
+#include <sys/stat.h>
 
 #include "planedb.h"
 
+/**
+ * The FAA files are shipped gzipped.  zlib reads them directly, and reads
+ * uncompressed files as they are.  Without zlib (Windows) only the
+ * uncompressed files can be used.
+ */
+#ifndef _WIN32
+#include <zlib.h>
+typedef gzFile DbFile;
+#define dbfile_open(name)          gzopen((name), "rb")
+#define dbfile_read(f, buf, len)   gzread((f), (buf), (unsigned) (len))
+#define dbfile_close(f)            gzclose(f)
+#else
+typedef FILE  *DbFile;
+#define dbfile_open(name)          fopen((name), "rb")
+#define dbfile_read(f, buf, len)   ((int) fread((buf), 1, (len), (f)))
+#define dbfile_close(f)            fclose(f)
+#endif
+
 #ifndef TRUE
 #define TRUE  1
 #endif
@@ -66,19 +88,13 @@ static void err(const char *fmt, ...)
     fprintf(stderr, "\n");
 }
 
-/**
- * Non-allocated buffer for reading strings
- */
-#define INSIZE 1024
-static char inbuf[INSIZE];
-
 /**
  * Parse up to 8 hex characters into an int.
  * @param str the string to read
  * @param offset the position in the string to start reading
  * @return the int value represented by the hex pattern
  */
-static int parse_hex(char *str, int offset)
+static int parse_hex(const char *str, int offset)
 {
     int val = 0;
     int i;
@@ -103,7 +119,7 @@ static int parse_hex(char *str, int offset)
  * @param offset the position in the string to start reading
  * @return the int value represented by the digits
  */
-static int parse_int(char *str, int offset)
+static int parse_int(const char *str, int offset)
 {
     int val = 0;
     int i;
@@ -120,423 +136,1767 @@ static int parse_int(char *str, int offset)
 
 
 /**
- * Read some characters from a string, delimited by a starting and
+ * Find some characters in a string, delimited by a starting and
  * ending position.  Training white space will be trimmed.
  * @param str the string to read
  * @p0 the starting position for reading
  * @p1 the end position for reading
- * @return a newly-allocated string containing the desired characters.
- *    This should be free()d eventually.
+ * @param len receives the number of characters, after trimming
+ * @return a pointer to the first character.  It is not terminated.
  */
-static char *pickup(char *str, int p0, int p1)
+static char *pickup(char *str, int p0, int p1, int *len)
 {
     int last = p1-1;
     while(last >= p0)
         {
-        if (!isspace(str[last]))
+        if (!isspace((unsigned char) str[last]))
             break;
         else
             last--;
         }
-    char *word = strndup(&(str[p0]), last-p0+1);
-    if (!word)
-        err("cannot allocate string");
-    return word;
+    *len = last-p0+1;
+    return &(str[p0]);
+}
+
+/**
+ * Copy a string in upper case, as the FAA files are, truncating it to fit
+ */
+static void upper_copy(char *dst, int dstlen, const char *src)
+{
+    int i;
+    for (i = 0 ; src[i] && i < dstlen - 1 ; i++)
+        dst[i] = (char) toupper((unsigned char) src[i]);
+    dst[i] = '\0';
 }
 
 
 //##########################################################################
-//# AIRCRAFT TYPE TABLE
+//# S T R I N G   P O O L
 //##########################################################################
 
 /**
- * A mapping of type numbers to descriptions
+ * Registrant, manufacturer and model names repeat a lot, so each distinct
+ * string is kept once, in one growing block.  Records refer to strings by
+ * their offset in the block.  An open-addressed hash table of offsets finds
+ * strings that are already there.
  */
-static char *typeTable[] = {
-/*0*/ "None",
-/*1*/ "Glider",
-/*2*/ "Balloon",
-/*3*/ "Blimp/Dirigible",
-/*4*/ "Fixed wing single engine",
-/*5*/ "Fixed wing multi engine",
-/*6*/ "Rotorcraft",
-/*7*/ "Weight-shift-control",
-/*8*/ "Powered Parachute",
-/*9*/ "Gyroplane"
-};
-
+typedef struct
+{
+    char         *data;
+    size_t        len;
+    size_t        cap;
+    unsigned int *slots;     // Offsets of the strings, 0 for an empty slot
+    unsigned int  nrslots;   // Always a power of 2
+    unsigned int  count;
+    int           failed;    // Set if we ran out of memory
+} StringPool;
 
 /**
- * Create a TypeInfo object.
- * @return a pointer to a newly-allocated typeinfo structure if
- *    successful else NULL
+ * FNV-1a hash of len characters
  */
-static TypeInfo *typeInfoCreate()
+static unsigned int pool_hash(const char *str, int len)
 {
-    TypeInfo *ti = (TypeInfo *)malloc(sizeof(TypeInfo));
-    if (!ti)
-        return NULL;
-    ti->id           = 0;
-    ti->manufacturer = NULL;
-    ti->model        = NULL;
-    ti->type         = 0;
-    ti->nrseats      = 0;
-    return ti;
+    unsigned int h = 2166136261u;
+    int i;
+    for (i = 0 ; i < len ; i++)
+        h = (h ^ (unsigned char) str[i]) * 16777619u;
+    return h;
 }
 
 /**
- * Delete a TypeInfo object, and deallocate any strings it might have.
- * @return TRUE always
+ * Set up an empty pool.   Offset 0 is the empty string.
+ * @return TRUE if successful, else FALSE
  */
-static int typeInfoDelete(TypeInfo *ti)
+static int pool_init(StringPool *pool)
 {
-    if (!ti)
-        return TRUE;
-    if (ti->manufacturer) free(ti->manufacturer);
-    if (ti->model)        free(ti->model);
-    free(ti);
+    pool->cap     = 1024 * 1024;
+    pool->len     = 1;
+    pool->nrslots = 64 * 1024;
+    pool->count   = 0;
+    pool->failed  = FALSE;
+    pool->data    = (char *) malloc(pool->cap);
+    pool->slots   = (unsigned int *) calloc(pool->nrslots, sizeof(unsigned int));
+    if (!pool->data || !pool->slots)
+        {
+        err("cannot allocate string pool");
+        pool->failed = TRUE;
+        return FALSE;
+        }
+    pool->data[0] = '\0';
     return TRUE;
 }
 
 /**
- * Print a TypeInfo object.
- * @return TRUE always
+ * Free the pool's memory
  */
-static int typeInfoPrint(TypeInfo *ti)
+static void pool_free(StringPool *pool)
 {
-    if (!ti)
-        printf("None\n");
-	printf("  ## Type\n");
-    if (ti->manufacturer)  printf("    Manufacturer   : %s\n", ti->manufacturer);
-    if (ti->model)         printf("    Model name     : %s\n", ti->model);
-                           printf("    Type           : %d - %s\n", ti->type, typeTable[ti->type]);
-                           printf("    Seats          : %d\n", ti->nrseats);
-
-    return TRUE;
+    free(pool->data);
+    free(pool->slots);
+    pool->data  = NULL;
+    pool->slots = NULL;
 }
 
-
 /**
- * Look up a TypeInfo record by its model number.  Use caching.
- * @param db this
- * @param id the model number to look for.
- * @return a TypeInfo object if the model is found, else NULL.
+ * Double the hash table, when it gets half full
+ * @return TRUE if successful, else FALSE
  */
-static TypeInfo *type_lookup(PlaneDb *db, int id)
+static int pool_rehash(StringPool *pool)
 {
-    TypeInfo *rec = db->types;
-    if (id == db->last_model)
-        return db->last_ti;
-    while (rec)
+    unsigned int nrslots = pool->nrslots * 2;
+    unsigned int *slots = (unsigned int *) calloc(nrslots, sizeof(unsigned int));
+    unsigned int i;
+    if (!slots)
+        return FALSE;
+    for (i = 0 ; i < pool->nrslots ; i++)
         {
-        if (rec->id == id)
-            {
-            db->last_model = id;
-            db->last_ti = rec;
-            return rec;
-            }
-        rec = rec->next;
+        unsigned int off = pool->slots[i];
+        if (!off)
+            continue;
+        char *str = pool->data + off;
+        unsigned int h = pool_hash(str, (int) strlen(str)) & (nrslots - 1);
+        while (slots[h])
+            h = (h + 1) & (nrslots - 1);
+        slots[h] = off;
         }
-    return NULL;
+    free(pool->slots);
+    pool->slots   = slots;
+    pool->nrslots = nrslots;
+    return TRUE;
 }
 
 /**
- * Load TypeInfo data from a file.  This is currently coded for the FAA
- * ACRFTREF.txt file
- * @param db this
- * @return TRUE if successful, else FALSE
+ * Find or add a string of len characters
+ * @return its offset in the pool.  0 if it is empty, or if out of memory,
+ *    in which case pool->failed is set.
  */
-static int load_types(PlaneDb *db)
+static unsigned int pool_intern(StringPool *pool, const char *str, int len)
 {
-	char *fname = "ACFTREF.txt";
-    FILE *f = fopen(fname, "r");
-    if (!f)
+    if (len <= 0 || pool->failed)
+        return 0;
+    unsigned int mask = pool->nrslots - 1;
+    unsigned int h = pool_hash(str, len) & mask;
+    unsigned int off;
+    while ((off = pool->slots[h]) != 0)
         {
-        err("cannot open file '%s'", fname);
-        return FALSE;
+        char *s = pool->data + off;
+        if (!strncmp(s, str, len) && s[len] == '\0')
+            return off;
+        h = (h + 1) & mask;
         }
-    TypeInfo *prev = NULL;
-    while (!feof(f))
+
+    if (pool->len + len + 1 > pool->cap)
         {
-        char *str = fgets(inbuf, INSIZE, f);
-        if (!str)
-            continue;
-        if (strlen(str) < 68)
-            continue;
-        TypeInfo *ti = typeInfoCreate();
-        if (!ti)
+        size_t cap = pool->cap * 2;
+        char *data = (char *) realloc(pool->data, cap);
+        if (!data)
             {
-            err("cannot allocate TypeInfo");
-            fclose(f);
-            return FALSE;
+            err("cannot grow string pool");
+            pool->failed = TRUE;
+            return 0;
             }
-        ti->id = parse_int(str, 0);
-        ti->manufacturer = pickup(str, 8, 38);
-        if (!ti->manufacturer)
-            return FALSE;
-        ti->model = pickup(str, 39, 59);
-        if (!ti->model)
-            return FALSE;
-        ti->type = parse_int(str, 60);
-        ti->nrseats = parse_int(str, 72);
-        if (prev)
-            prev->next = ti;
-        else
-            db->types = ti;
-        prev = ti;
+        pool->data = data;
+        pool->cap  = cap;
         }
-    fclose(f);
-    return TRUE;
+    off = (unsigned int) pool->len;
+    memcpy(pool->data + off, str, len);
+    pool->data[off + len] = '\0';
+    pool->len += len + 1;
+    pool->slots[h] = off;
+    if (++pool->count * 2 > pool->nrslots && !pool_rehash(pool))
+        {
+        err("cannot grow string pool");
+        pool->failed = TRUE;
+        }
+    return off;
 }
 
+
 //##########################################################################
-//# REGISTRATION DB
+//# R E C O R D   L O A D E R
 //##########################################################################
 
+/**
+ * Decompressed bytes handed to the parser threads at a time, and the number
+ * of threads that share each chunk.
+ */
+#define LOAD_CHUNK   (4 * 1024 * 1024)
+#define LOAD_THREADS 4
+#define LOAD_PAD     128     // Zeroes after a chunk, so parsers can't run off its end
 
 /**
- * Create a PlaneInfo object.
- * @return a pointer to a newly-allocated PlaneInfo object if
- *    successful else NULL
+ * A growing array of TypeInfo or PlaneInfo records, in file order
  */
-static PlaneInfo *planeInfoCreate()
+typedef struct
 {
-    PlaneInfo *pi = (PlaneInfo *)malloc(sizeof(PlaneInfo));
-    if (!pi)
-        return NULL;
-    pi->id         = 0;
-    pi->nnum       = NULL;
-    pi->model      = 0;
-    pi->registrant = NULL;
-    return pi;
-}
+    char   *data;
+    size_t  recsize;
+    int     count;
+    int     cap;
+} RecordArray;
 
 /**
- * Delete a PlaneInfo object, and deallocate any strings it might have.
- * @return TRUE always
+ * A made-up model number, for a manufacturer and model name pair
  */
-static int planeInfoDelete(PlaneInfo *pi)
+typedef struct
 {
-    if (!pi)
-        return TRUE;
-    if (pi->nnum)       free(pi->nnum);
-    if (pi->registrant) free(pi->registrant);
-    free(pi);
-    return TRUE;
-}
+    unsigned int manufacturer;
+    unsigned int model;
+    int          id;         // 0 for an empty slot
+} LocalModel;
 
 /**
- * Print a PlaneInfo object.
- * @param db "this".   Supplied so that the model number can be looked up.
- * @param pi the PlaneInfo to print.
- * @return TRUE always
+ * Everything read so far.  The sources are loaded one after the other,
+ * in priority order, so the records of each come after those of the
+ * sources before it.  The FAA type and plane files are loaded at the
+ * same time, into the same string pool.
  */
-int planeInfoPrint(PlaneDb *db, PlaneInfo *pi)
+struct PlaneDbBuilderDef
 {
-    if (!pi)
-        printf("None\n");
-	printf("  ## Registration\n");
-    if (pi->nnum)       printf("    N-Number       : %s\n", pi->nnum);
-    if (pi->registrant) printf("    Registrant     : %s\n", pi->registrant);
-    if (pi->model)      printf("    Model          : %d\n", pi->model);
-    TypeInfo *ti = type_lookup(db, pi->model);
-    if (!ti)
-        printf("No model info\n");
-    else
-        typeInfoPrint(ti);
-    return TRUE;
-}
+    StringPool      pool;
+    pthread_mutex_t pool_lock;
+    RecordArray     types;
+    RecordArray     planes;
+    int             source;      // The source being loaded
+    LocalModel     *models;      // Hash table of the made-up model numbers
+    unsigned int    nrmodels;    // Its size, always a power of 2
+    unsigned int    modelcount;
+};
+typedef PlaneDbBuilder Builder;
+
+/**
+ * The fields of one line, as found by a parser thread.   The strings
+ * are still in the chunk, and are added to the string pool afterwards,
+ * one chunk at a time, so the parser threads don't have to share it.
+ */
+typedef struct
+{
+    int   n[3];      // Numeric fields
+    char *s[2];      // Text fields
+    int   slen[2];
+} RawRecord;
 
+/**
+ * Finds the fields of one line, at least the loader's minimum length.
+ */
+typedef void (*RecordParser)(char *line, RawRecord *raw);
 
 /**
- * Load PlaneInfo data from a file.  This is currently coded for the FAA
- * MASTER.txt file
- * @param db this
+ * Adds one line's fields to the Builder.
  * @return TRUE if successful, else FALSE
  */
-static int load_planes(PlaneDb *db)
+typedef int (*RecordStore)(Builder *b, RawRecord *raw);
+
+/**
+ * The lines of a chunk that one parser thread is working on, and the
+ * fields it found in them.  The raw array is kept from chunk to chunk.
+ */
+typedef struct
 {
-	char *fname = "MASTER.txt";
-    FILE *f = fopen(fname, "r");
-    if (!f)
-         {
-         err("cannot open file '%s'", fname);
-         return FALSE;
-         }
-    PlaneInfo *prev = NULL;
-    while (!feof(f))
-        {
-        char *str = fgets(inbuf, INSIZE, f);
-        if (!str)
-            continue;
-        if (strlen(str) < 610)
-            continue;
-        PlaneInfo *pi = planeInfoCreate();
-        if (!pi)
+    RecordParser parse;
+    int          minlen;     // Shorter lines are skipped
+    char        *start;      // First line
+    char        *end;        // End of the last line
+    RawRecord   *raw;
+    int          count;
+    int          cap;
+    int          ok;
+} ParseJob;
+
+/**
+ * Make room for one more record at the end of an array
+ * @return the new record, or NULL if out of memory
+ */
+static void *array_add(RecordArray *arr)
+{
+    if (arr->count == arr->cap)
+        {
+        int cap = arr->cap ? arr->cap * 2 : 4096;
+        char *data = (char *) realloc(arr->data, cap * arr->recsize);
+        if (!data)
             {
-            err("cannot allocate PlaneInfo");
-            fclose(f);
-            return FALSE;
+            err("cannot allocate records");
+            return NULL;
             }
-        pi->id = parse_hex(str, 601);
-        pi->nnum = pickup(str, 0, 5);
-        if (!pi->nnum)
-            return FALSE;
-        pi->model = parse_int(str, 37);
-        pi->registrant = pickup(str, 58, 107);
-        if (!pi->registrant)
-            return FALSE;
-        if (prev)
-            prev->next = pi;
-        else
-            db->planes = pi;
-        prev = pi;
+        arr->data = data;
+        arr->cap  = cap;
         }
-    fclose(f);
-    return TRUE;
+    return arr->data + (arr->count++ * arr->recsize);
 }
 
-
-//##########################################################################
-//# MAIN DATABASE
-//##########################################################################
-
-
-
-
-
 /**
- * Create and initialize a PlaneDb context.
- * @return a newly-allocated PlaneDb object if successful, else NULL.  This
- *   value should be passed to planedb_close() when procesing is completed.
+ * Parse the lines from job->start to job->end.  Lines are found with
+ * memchr() in the chunk, and fields are read at their fixed positions.
  */
-PlaneDb *planedb_init()
+static void *parse_range(void *arg)
 {
-    PlaneDb *db = (PlaneDb *) malloc(sizeof(PlaneDb));
-    if (!db)
-        return NULL;
-    db->types  = (TypeInfo *)0;
-    db->planes = (PlaneInfo *)0;
-    if (!load_types(db))
-        {
-        planedb_close(db);
-        return NULL;
-        }
-    if (!load_planes(db))
+    ParseJob *job = (ParseJob *) arg;
+    char *p = job->start;
+    job->count = 0;
+    job->ok    = TRUE;
+    while (p < job->end)
         {
-        planedb_close(db);
-        return NULL;
+        char *eol = (char *) memchr(p, '\n', job->end - p);
+        if (!eol)
+            eol = job->end;
+        if ((eol - p) >= job->minlen)
+            {
+            if (job->count == job->cap)
+                {
+                int cap = job->cap ? job->cap * 2 : 1024;
+                RawRecord *raw = (RawRecord *) realloc(job->raw, cap * sizeof(RawRecord));
+                if (!raw)
+                    {
+                    job->ok = FALSE;
+                    break;
+                    }
+                job->raw = raw;
+                job->cap = cap;
+                }
+            job->parse(p, &job->raw[job->count++]);
+            }
+        p = eol + 1;
         }
-    return db;
+    return NULL;
 }
 
-
 /**
- * Search the registration database for a PlaneInfo record with
- * given ICAO id.
- * @param db the PlaneDb context.
- * @param icao the ICAO hex string to look for.
- * @return the PlaneInfo object associated with the given ICAO
- *   if successful, else NULL.
+ * Split len bytes of whole lines at buf between the parser threads, and
+ * start them.
  */
-PlaneInfo *planedb_lookup(PlaneDb *db, char *icao)
+static void start_jobs(ParseJob *jobs, pthread_t *threads, char *buf, int len)
 {
-    if (!db || !icao)
-        return NULL;
-    int id = parse_hex(icao, 0);
-    if (id == db->last_icao)
-        return db->last_pi;
-    PlaneInfo *rec = db->planes;
-    while (rec)
+    char *p = buf;
+    char *end = buf + len;
+    int i;
+    for (i = 0 ; i < LOAD_THREADS ; i++)
         {
-        if (rec->id == id)
+        char *q = (i == LOAD_THREADS - 1) ? end : buf + ((long) len * (i + 1)) / LOAD_THREADS;
+        if (q < p)
+            q = p;
+        while (q < end && q[-1] != '\n')   // Finish the line we're in
+            q++;
+        jobs[i].start  = p;
+        jobs[i].end    = q;
+        if (pthread_create(&threads[i], NULL, parse_range, &jobs[i]))
             {
-            db->last_icao = id;
-            db->last_pi = rec;
-            return rec;
+            parse_range(&jobs[i]);        // No thread, do it ourselves
+            threads[i] = pthread_self();
             }
-        rec = rec->next;
+        p = q;
         }
-    return NULL;
 }
 
 /**
- * Delete the PlaneDb object, and any allocated resources it might have
- * @param db the PlaneDb context to delete.
- * @return TRUE always
+ * Wait for the parser threads, and store what they found, in file order.
+ * The chunk they worked on must still be there.
+ * @return TRUE if successful, else FALSE
  */
-int planedb_close(PlaneDb *db)
+static int finish_jobs(Builder *b, ParseJob *jobs, pthread_t *threads, RecordStore store)
 {
-    if (!db)
+    int ok = TRUE;
+    int i, j;
+    for (i = 0 ; i < LOAD_THREADS ; i++)
+        {
+        if (!pthread_equal(threads[i], pthread_self()))
+            pthread_join(threads[i], NULL);
+        if (!jobs[i].ok)
+            ok = FALSE;
+        }
+    if (!ok)
+        {
+        err("cannot allocate parser buffers");
         return FALSE;
-    TypeInfo *tnext;
-    TypeInfo *trec;
-    for (trec = db->types ; trec ; trec = tnext)
+        }
+    pthread_mutex_lock(&b->pool_lock);
+    for (i = 0 ; i < LOAD_THREADS && ok ; i++)
+        for (j = 0 ; j < jobs[i].count && ok ; j++)
+            ok = store(b, &jobs[i].raw[j]);
+    if (b->pool.failed)
+        ok = FALSE;
+    pthread_mutex_unlock(&b->pool_lock);
+    return ok;
+}
+
+/**
+ * Load the records of a file into the Builder.  The gzipped file,
+ * fname with ".gz" added, is preferred.  Otherwise fname itself is read.
+ *
+ * The file is streamed a chunk at a time.  While the parser threads work on
+ * one chunk, the next one is decompressed into the other buffer.  A line
+ * that straddles two chunks is carried over to the start of the second.
+ * @return TRUE if successful, else FALSE
+ */
+static int load_records(Builder *b, char *fname, int minlen,
+                        RecordParser parse, RecordStore store)
+{
+    char gzname[256];
+    snprintf(gzname, sizeof(gzname), "%s.gz", fname);
+    DbFile f = dbfile_open(gzname);
+    if (!f)
+        f = dbfile_open(fname);
+    if (!f)
         {
-        tnext = trec->next;
-        typeInfoDelete(trec);
+        err("cannot open file '%s'", fname);
+        return FALSE;
         }
-    PlaneInfo *pnext;
-    PlaneInfo *prec;
-    for (prec = db->planes ; prec ; prec = pnext)
+
+    char *bufs[2];
+    bufs[0] = (char *) malloc(LOAD_CHUNK + LOAD_PAD);
+    bufs[1] = (char *) malloc(LOAD_CHUNK + LOAD_PAD);
+    if (!bufs[0] || !bufs[1])
         {
-        pnext = prec->next;
-        planeInfoDelete(prec);
+        err("cannot allocate load buffers");
+        free(bufs[0]);
+        free(bufs[1]);
+        dbfile_close(f);
+        return FALSE;
         }
-    free(db);
-    return TRUE;
+
+    ParseJob  jobs[LOAD_THREADS];
+    pthread_t threads[LOAD_THREADS];
+    int       running = FALSE;
+    int       ok      = TRUE;
+    int       carry   = 0;
+    int       cur     = 0;
+    int       i;
+    memset(jobs, 0, sizeof(jobs));
+    for (i = 0 ; i < LOAD_THREADS ; i++)
+        {
+        jobs[i].parse  = parse;
+        jobs[i].minlen = minlen;
+        }
+    while (ok)
+        {
+        char *buf = bufs[cur];
+        int n = dbfile_read(f, buf + carry, LOAD_CHUNK - carry);
+        if (n < 0)
+            {
+            err("error reading '%s'", fname);
+            ok = FALSE;
+            break;
+            }
+        int len = carry + n;
+        if (len == 0)
+            break;
+
+        // Hand over everything up to the last newline, or the lot at the end of the file
+        int cut = len;
+        if (n > 0)
+            {
+            while (cut > 0 && buf[cut - 1] != '\n')
+                cut--;
+            if (cut == 0)         // A line longer than a chunk, that's not our file
+                cut = len;
+            }
+        memset(buf + len, 0, LOAD_PAD);
+
+        if (running && !finish_jobs(b, jobs, threads, store))
+            {
+            running = FALSE;
+            ok = FALSE;
+            break;
+            }
+        start_jobs(jobs, threads, buf, cut);
+        running = TRUE;
+
+        carry = len - cut;
+        memcpy(bufs[cur ^ 1], buf + cut, carry);
+        cur ^= 1;
+        if (n == 0)
+            break;
+        }
+    if (running && !finish_jobs(b, jobs, threads, store))
+        ok = FALSE;
+
+    for (i = 0 ; i < LOAD_THREADS ; i++)
+        free(jobs[i].raw);
+    free(bufs[0]);
+    free(bufs[1]);
+    dbfile_close(f);
+    return ok;
 }
 
 
+//##########################################################################
+//# AIRCRAFT TYPE TABLE
+//##########################################################################
+
 /**
- * Compile with -DSTANDALONE to create a standalone tool.
-*/
-#ifdef STANDALONE
+ * A mapping of type numbers to descriptions
+ */
+static char *typeTable[] = {
+/*0*/ "None",
+/*1*/ "Glider",
+/*2*/ "Balloon",
+/*3*/ "Blimp/Dirigible",
+/*4*/ "Fixed wing single engine",
+/*5*/ "Fixed wing multi engine",
+/*6*/ "Rotorcraft",
+/*7*/ "Weight-shift-control",
+/*8*/ "Powered Parachute",
+/*9*/ "Gyroplane"
+};
+
 
 /**
- * Show proper command-line invocation of this app
+ * Print a TypeInfo object.
+ * @return TRUE always
  */
-static void usage()
+static int typeInfoPrint(PlaneDb *db, TypeInfo *ti)
 {
-    printf("Usage:  planedb <icao code>\n");
+    if (!ti) {
+        printf("None\n");
+        return TRUE;
+    }
+    printf("  ## Type\n");
+    printf("    Manufacturer   : %s\n", planedb_string(db, ti->manufacturer));
+    printf("    Model name     : %s\n", planedb_string(db, ti->model));
+    printf("    Type           : %d - %s\n", ti->type, typeTable[ti->type]);
+    printf("    Seats          : %d\n", ti->nrseats);
+
+    return TRUE;
 }
 
 
 /**
- * Perform a DB lookup of the given ICAO string.
- * Print if found
- * @param icao the ICAO string for the search
- * @return the PlaneInfo associated with the ICAO string
- *    if successful, else NULL.
+ * Look up a TypeInfo record by its model number.
+ * The records are sorted by model number, so this is a binary search.
+ * @param db this
+ * @param id the model number to look for.
+ * @return a TypeInfo object if the model is found, else NULL.
  */
-int lookup(char *icao)
+TypeInfo *planedb_type(PlaneDb *db, int id)
 {
-    printf("%s\n", icao);
-    PlaneDb *db = planedb_init();
     if (!db)
+        return NULL;
+    int lo = 0;
+    int hi = db->nrtypes - 1;
+    while (lo <= hi)
         {
-        printf("Could not initialize plane database\n");
-        return FALSE;
+        int mid = (lo + hi) / 2;
+        TypeInfo *rec = &db->types[mid];
+        if (rec->id < id)
+            lo = mid + 1;
+        else if (rec->id > id)
+            hi = mid - 1;
+        else
+            return rec;
         }
-    PlaneInfo *pi = planedb_lookup(db, icao);
-    if (!pi)
-        printf("Plane not found\n");
-    else
-        planeInfoPrint(db, pi);
-    planedb_close(db);
+    return NULL;
 }
 
+/**
+ * Find the fields of one fixed-width line of the FAA ACFTREF.txt file
+ */
+static void parse_type(char *str, RawRecord *raw)
+{
+    raw->n[0] = parse_int(str, 0);
+    raw->s[0] = pickup(str, 8, 38, &raw->slen[0]);
+    raw->s[1] = pickup(str, 39, 59, &raw->slen[1]);
+    raw->n[1] = parse_int(str, 60);
+    raw->n[2] = parse_int(str, 72);
+}
 
 /**
- * Good old main() function.  O how that takes me back.
+ * Add a TypeInfo to the Builder
+ * @return TRUE if successful, else FALSE
  */
-int main(int argc, char **argv)
+static int store_type(Builder *b, RawRecord *raw)
 {
-    if (argc == 2)
-        lookup(argv[1]);
-    else
-        usage();
-    return 0;
+    TypeInfo *ti = (TypeInfo *) array_add(&b->types);
+    if (!ti)
+        return FALSE;
+    ti->id           = raw->n[0];
+    ti->manufacturer = pool_intern(&b->pool, raw->s[0], raw->slen[0]);
+    ti->model        = pool_intern(&b->pool, raw->s[1], raw->slen[1]);
+    ti->type         = raw->n[1];
+    ti->nrseats      = raw->n[2];
+    return TRUE;
+}
+
+/**
+ * Load TypeInfo data from the FAA ACRFTREF.txt file
+ * @param b the Builder
+ * @param fname the file's name, including its directory
+ * @return TRUE if successful, else FALSE
+ */
+static int load_types(Builder *b, char *fname)
+{
+    // Lines shorter than this (with their CR) don't have all the fields
+    return load_records(b, fname, 67, parse_type, store_type);
+}
+
+//##########################################################################
+//# REGISTRATION DB
+//##########################################################################
+
+
+/**
+ * Print a PlaneInfo object.
+ * @param db "this".   Supplied so that the model number can be looked up.
+ * @param pi the PlaneInfo to print.
+ * @return TRUE always
+ */
+int planeInfoPrint(PlaneDb *db, PlaneInfo *pi)
+{
+    if (!pi) {
+        printf("None\n");
+        return TRUE;
+    }
+    printf("  ## Registration\n");
+    printf("    Registration   : %s\n", planedb_string(db, pi->registration));
+    printf("    Registrant     : %s\n", planedb_string(db, pi->registrant));
+    printf("    Source         : %d\n", pi->source);
+    if (pi->model && pi->model < PLANEDB_LOCAL_MODELS)
+        printf("    Model          : %d\n", pi->model);
+    TypeInfo *ti = planedb_type(db, pi->model);
+    if (!ti)
+        printf("No model info\n");
+    else
+        typeInfoPrint(db, ti);
+    return TRUE;
+}
+
+
+/**
+ * Find the fields of one fixed-width line of the FAA MASTER.txt file
+ */
+static void parse_plane(char *str, RawRecord *raw)
+{
+    raw->n[0] = parse_hex(str, 601);
+    raw->s[0] = pickup(str, 0, 5, &raw->slen[0]);
+    raw->n[1] = parse_int(str, 37);
+    raw->s[1] = pickup(str, 58, 107, &raw->slen[1]);
+}
+
+/**
+ * Add a PlaneInfo to the Builder.  The file has the N-Number without its
+ * "N", which is put back so it is stored like any other registration.
+ * @return TRUE if successful, else FALSE
+ */
+static int store_plane(Builder *b, RawRecord *raw)
+{
+    char reg[8];
+    PlaneInfo *pi = (PlaneInfo *) array_add(&b->planes);
+    if (!pi)
+        return FALSE;
+    reg[0] = 'N';
+    memcpy(reg + 1, raw->s[0], raw->slen[0]);   // At most 5 characters
+    pi->id           = raw->n[0];
+    pi->registration = raw->slen[0] ? pool_intern(&b->pool, reg, raw->slen[0] + 1) : 0;
+    pi->model        = raw->n[1];
+    pi->registrant   = pool_intern(&b->pool, raw->s[1], raw->slen[1]);
+    pi->source       = b->source;
+    return TRUE;
+}
+
+/**
+ * Load PlaneInfo data from the FAA MASTER.txt file
+ * @param b the Builder
+ * @param fname the file's name, including its directory
+ * @return TRUE if successful, else FALSE
+ */
+static int load_planes(Builder *b, char *fname)
+{
+    // Lines shorter than this (with their CR) don't have all the fields
+    return load_records(b, fname, 609, parse_plane, store_plane);
+}
+
+
+//##########################################################################
+//# P R O V I D E R S
+//##########################################################################
+
+/**
+ * Put a directory and a file name together
+ */
+static void join_path(char *buf, size_t len, const char *dir, const char *name)
+{
+    if (!dir || !*dir)
+        snprintf(buf, len, "%s", name);
+    else
+        snprintf(buf, len, "%s/%s", dir, name);
+}
+
+/**
+ * Get the modification time of a file that load_records() would read
+ * @return the time, or 0 if neither form of the file is there
+ */
+static time_t file_mtime(const char *fname)
+{
+    char gzname[256];
+    struct stat st;
+    snprintf(gzname, sizeof(gzname), "%s.gz", fname);
+    if (stat(gzname, &st) == 0 || stat(fname, &st) == 0)
+        return st.st_mtime;
+    return 0;
+}
+
+/**
+ * What load_types_thread() is to load
+ */
+typedef struct
+{
+    Builder *b;
+    char    *fname;
+} TypesJob;
+
+/**
+ * Thread wrapper for load_types()
+ * @return the job if successful, else NULL
+ */
+static void *load_types_thread(void *arg)
+{
+    TypesJob *job = (TypesJob *) arg;
+    return load_types(job->b, job->fname) ? job : NULL;
+}
+
+/**
+ * The FAA provider.   path is the directory holding MASTER.txt and
+ * ACFTREF.txt, or their gzipped forms.
+ * @return TRUE if successful, else FALSE
+ */
+static int faa_load(Builder *b, const char *path)
+{
+    char types[256];
+    char planes[256];
+    TypesJob job;
+    join_path(types, sizeof(types), path, "ACFTREF.txt");
+    join_path(planes, sizeof(planes), path, "MASTER.txt");
+    job.b     = b;
+    job.fname = types;
+
+    // The two files are independent, so load the types alongside the planes
+    pthread_t types_thread;
+    int types_ok;
+    int threaded = (pthread_create(&types_thread, NULL, load_types_thread, &job) == 0);
+    int planes_ok = load_planes(b, planes);
+    if (threaded)
+        {
+        void *res;
+        pthread_join(types_thread, &res);
+        types_ok = (res != NULL);
+        }
+    else
+        types_ok = load_types(b, types);
+    return types_ok && planes_ok;
+}
+
+/**
+ * The newest modification time of the FAA files in directory path
+ */
+static time_t faa_mtime(const char *path)
+{
+    char fname[256];
+    join_path(fname, sizeof(fname), path, "ACFTREF.txt");
+    time_t types = file_mtime(fname);
+    join_path(fname, sizeof(fname), path, "MASTER.txt");
+    time_t planes = file_mtime(fname);
+    return (types > planes) ? types : planes;
+}
+
+static const PlaneDbProvider faaProvider = { "faa", faa_load, faa_mtime };
+
+
+/**
+ * Double the made-up model table, when it gets half full
+ * @return TRUE if successful, else FALSE
+ */
+static int models_rehash(Builder *b)
+{
+    unsigned int nrmodels = b->nrmodels ? b->nrmodels * 2 : 4096;
+    LocalModel *models = (LocalModel *) calloc(nrmodels, sizeof(LocalModel));
+    unsigned int i;
+    if (!models)
+        return FALSE;
+    for (i = 0 ; i < b->nrmodels ; i++)
+        {
+        LocalModel *lm = &b->models[i];
+        if (!lm->id)
+            continue;
+        unsigned int h = (lm->manufacturer * 2654435761u + lm->model) * 2246822519u;
+        h = (h ^ (h >> 15)) & (nrmodels - 1);
+        while (models[h].id)
+            h = (h + 1) & (nrmodels - 1);
+        models[h] = *lm;
+        }
+    free(b->models);
+    b->models   = models;
+    b->nrmodels = nrmodels;
+    return TRUE;
+}
+
+/**
+ * Find the model number made up for a manufacturer and model name pair,
+ * or make one up, with a TypeInfo for it.   Must be called with the pool
+ * locked.
+ * @return the model number, 0 if both names are empty, or -1 if out of memory
+ */
+static int local_model(Builder *b, unsigned int manufacturer, unsigned int model)
+{
+    if (!manufacturer && !model)
+        return 0;
+    if (!b->models && !models_rehash(b))
+        return -1;
+    unsigned int mask = b->nrmodels - 1;
+    unsigned int h = (manufacturer * 2654435761u + model) * 2246822519u;
+    h = (h ^ (h >> 15)) & mask;
+    LocalModel *lm;
+    while ((lm = &b->models[h])->id)
+        {
+        if (lm->manufacturer == manufacturer && lm->model == model)
+            return lm->id;
+        h = (h + 1) & mask;
+        }
+
+    TypeInfo *ti = (TypeInfo *) array_add(&b->types);
+    if (!ti)
+        return -1;
+    int id = PLANEDB_LOCAL_MODELS + (int) b->modelcount;
+    lm->manufacturer = manufacturer;
+    lm->model        = model;
+    lm->id           = id;
+    ti->id           = id;
+    ti->manufacturer = manufacturer;
+    ti->model        = model;
+    ti->type         = 0;
+    ti->nrseats      = 0;
+    if (++b->modelcount * 2 > b->nrmodels && !models_rehash(b))
+        return -1;
+    return id;
+}
+
+/**
+ * Add a plane to the builder, for providers whose sources name the
+ * manufacturer and model.   Those are given a made-up model number.
+ * Registrations and registrants are kept in upper case, as the FAA's are.
+ * Any string may be NULL or "".
+ * @return TRUE if successful, else FALSE if out of memory.
+ */
+int planedb_add(PlaneDbBuilder *b, int icao, const char *registration,
+                const char *registrant, const char *manufacturer, const char *model)
+{
+    char reg[16];
+    char owner[128];
+    int ok = FALSE;
+    upper_copy(reg, sizeof(reg), registration ? registration : "");
+    upper_copy(owner, sizeof(owner), registrant ? registrant : "");
+    if (!manufacturer)
+        manufacturer = "";
+    if (!model)
+        model = "";
+
+    pthread_mutex_lock(&b->pool_lock);
+    PlaneInfo *pi = (PlaneInfo *) array_add(&b->planes);
+    if (pi)
+        {
+        pi->id           = icao;
+        pi->registration = pool_intern(&b->pool, reg, (int) strlen(reg));
+        pi->registrant   = pool_intern(&b->pool, owner, (int) strlen(owner));
+        pi->source       = b->source;
+        pi->model        = local_model(b,
+                               pool_intern(&b->pool, manufacturer, (int) strlen(manufacturer)),
+                               pool_intern(&b->pool, model, (int) strlen(model)));
+        ok = (pi->model >= 0 && !b->pool.failed);
+        }
+    pthread_mutex_unlock(&b->pool_lock);
+    return ok;
+}
+
+
+/**
+ * The fields the CSV provider reads, and the names of the columns they may
+ * be in, best first, for files that start with a header line.  Files
+ * without one have the fields in this order.
+ */
+enum { CSV_ICAO, CSV_REGISTRATION, CSV_MANUFACTURER, CSV_MODEL, CSV_REGISTRANT, CSV_NRFIELDS };
+
+static const char *csvNames[CSV_NRFIELDS][4] = {
+    { "icao24", "icao", "hex", NULL },
+    { "registration", "reg", NULL, NULL },
+    { "manufacturername", "manufacturer", NULL, NULL },
+    { "model", "type", NULL, NULL },
+    { "registrant", "owner", "operator", NULL }
+};
+
+#define CSV_MAXCOLS 64
+#define CSV_BUF     (256 * 1024)
+
+/**
+ * Split a CSV line into its columns, in place.  A field may be quoted
+ * with " or ', with the quote doubled inside it.  Spaces around fields
+ * are trimmed.
+ * @return the number of columns
+ */
+static int csv_split(char *line, char **cols, int max)
+{
+    char *p = line;
+    int n = 0;
+    while (n < max)
+        {
+        while (*p == ' ' || *p == '\t')
+            p++;
+        char *start = p;
+        char *out   = p;
+        if (*p == '"' || *p == '\'')
+            {
+            char quote = *p++;
+            while (*p)
+                {
+                if (*p == quote && p[1] != quote)
+                    {
+                    p++;
+                    break;
+                    }
+                if (*p == quote)
+                    p++;
+                *out++ = *p++;
+                }
+            while (*p && *p != ',')
+                p++;
+            }
+        else
+            {
+            while (*p && *p != ',')
+                p++;
+            out = p;
+            }
+        char sep = *p;
+        while (out > start && isspace((unsigned char) out[-1]))
+            out--;
+        *out = '\0';
+        while (isspace((unsigned char) *start))
+            start++;
+        cols[n++] = start;
+        if (sep != ',')
+            break;
+        p++;
+        }
+    return n;
+}
+
+/**
+ * If cols are a header line, find the columns of the fields in it.
+ * @return TRUE if they are, else FALSE, leaving map as it was
+ */
+static int csv_header(char **cols, int n, int *map)
+{
+    char name[32];
+    int found[CSV_NRFIELDS];
+    int f, i, c;
+    for (f = 0 ; f < CSV_NRFIELDS ; f++)
+        {
+        found[f] = -1;
+        for (i = 0 ; csvNames[f][i] && found[f] < 0 ; i++)
+            for (c = 0 ; c < n ; c++)
+                {
+                int k;
+                for (k = 0 ; cols[c][k] && k < (int) sizeof(name) - 1 ; k++)
+                    name[k] = (char) tolower((unsigned char) cols[c][k]);
+                name[k] = '\0';
+                if (!strcmp(name, csvNames[f][i]))
+                    {
+                    found[f] = c;
+                    break;
+                    }
+                }
+        }
+    if (found[CSV_ICAO] < 0)
+        return FALSE;
+    memcpy(map, found, sizeof(found));
+    return TRUE;
+}
+
+/**
+ * Add the plane on one line of a CSV file.  Lines without a 6 digit hex
+ * ICAO address, such as blank ones, are skipped.
+ * @return TRUE if successful, else FALSE
+ */
+static int csv_line(Builder *b, char *line, int *map, int *first)
+{
+    char *cols[CSV_MAXCOLS];
+    const char *field[CSV_NRFIELDS];
+    int n = csv_split(line, cols, CSV_MAXCOLS);
+    int f;
+    if (*first)
+        {
+        *first = FALSE;
+        if (csv_header(cols, n, map))
+            return TRUE;
+        }
+    for (f = 0 ; f < CSV_NRFIELDS ; f++)
+        field[f] = (map[f] >= 0 && map[f] < n) ? cols[map[f]] : "";
+    const char *icao = field[CSV_ICAO];
+    if (strlen(icao) != 6 || strspn(icao, "0123456789abcdefABCDEF") != 6)
+        return TRUE;
+    return planedb_add(b, parse_hex(icao, 0), field[CSV_REGISTRATION],
+                       field[CSV_REGISTRANT], field[CSV_MANUFACTURER], field[CSV_MODEL]);
+}
+
+/**
+ * The CSV provider.   path is the file, which may be gzipped.  Its fields are
+ * comma separated, one plane to a line.  The columns are found by name if
+ * the first line is a header, else they are icao,registration,manufacturer,
+ * model,registrant.
+ * @return TRUE if successful, else FALSE
+ */
+static int csv_load(Builder *b, const char *path)
+{
+    DbFile f = dbfile_open(path);
+    if (!f)
+        {
+        err("cannot open file '%s'", path);
+        return FALSE;
+        }
+    char *buf = (char *) malloc(CSV_BUF + 1);
+    if (!buf)
+        {
+        err("cannot allocate load buffer");
+        dbfile_close(f);
+        return FALSE;
+        }
+    int map[CSV_NRFIELDS] = { 0, 1, 2, 3, 4 };
+    int first = TRUE;
+    int ok    = TRUE;
+    int len   = 0;
+    while (ok)
+        {
+        int n = dbfile_read(f, buf + len, CSV_BUF - len);
+        if (n < 0)
+            {
+            err("error reading '%s'", path);
+            ok = FALSE;
+            break;
+            }
+        len += n;
+        int start = 0;
+        while (ok && start < len)
+            {
+            char *eol = (char *) memchr(buf + start, '\n', len - start);
+            if (!eol)
+                {
+                if (n > 0)
+                    break;
+                eol = buf + len;      // The last line, without a newline
+                }
+            *eol = '\0';
+            if (eol > buf + start && eol[-1] == '\r')
+                eol[-1] = '\0';
+            ok = csv_line(b, buf + start, map, &first);
+            start = (int) (eol - buf) + 1;
+            }
+        if (n == 0)
+            break;
+        len = (start < len) ? len - start : 0;
+        memmove(buf, buf + start, len);
+        if (len == CSV_BUF)
+            {
+            err("line too long in '%s'", path);
+            ok = FALSE;
+            }
+        }
+    free(buf);
+    dbfile_close(f);
+    return ok;
+}
+
+/**
+ * The modification time of a CSV file
+ */
+static time_t csv_mtime(const char *path)
+{
+    struct stat st;
+    if (stat(path, &st) == 0)
+        return st.st_mtime;
+    return 0;
+}
+
+static const PlaneDbProvider csvProvider = { "csv", csv_load, csv_mtime };
+
+
+/**
+ * The providers planedb_source() knows
+ */
+#define MAX_PROVIDERS 16
+static const PlaneDbProvider *providers[MAX_PROVIDERS] = { &faaProvider, &csvProvider };
+static int nrproviders = 2;
+
+/**
+ * Make a provider available to planedb_source(), in addition to the
+ * built-in "faa" and "csv" providers.  Must be done before any sources
+ * are opened.
+ * @return TRUE if successful, else FALSE if there are too many providers.
+ */
+int planedb_add_provider(const PlaneDbProvider *provider)
+{
+    if (nrproviders == MAX_PROVIDERS)
+        return FALSE;
+    providers[nrproviders++] = provider;
+    return TRUE;
+}
+
+/**
+ * Set up a source from a spec of the form provider:path, such as
+ * "faa:/var/lib/faa" (the directory holding the FAA files) or
+ * "csv:aircraft.csv.gz".
+ * @return TRUE if successful, else FALSE if the provider isn't known.
+ */
+int planedb_source(PlaneDbSource *src, const char *spec)
+{
+    const char *colon = strchr(spec, ':');
+    int i;
+    if (!colon)
+        return FALSE;
+    for (i = 0 ; i < nrproviders ; i++)
+        {
+        const char *name = providers[i]->name;
+        if (strlen(name) == (size_t) (colon - spec) && !strncmp(name, spec, colon - spec))
+            {
+            src->provider = providers[i];
+            snprintf(src->path, sizeof(src->path), "%s", colon + 1);
+            return TRUE;
+            }
+        }
+    return FALSE;
+}
+
+
+//##########################################################################
+//# MAIN DATABASE
+//##########################################################################
+
+/**
+ * A record's id and its place in the file, for sorting
+ */
+typedef struct
+{
+    int id;
+    int index;
+} SortKey;
+
+/**
+ * Sort by id, then by place in the file
+ */
+static int sortkey_compare(const void *a, const void *b)
+{
+    const SortKey *ka = (const SortKey *) a;
+    const SortKey *kb = (const SortKey *) b;
+    if (ka->id != kb->id)
+        return (ka->id < kb->id) ? -1 : 1;
+    return (ka->index < kb->index) ? -1 : (ka->index > kb->index);
+}
+
+/**
+ * Copy the records of an array to dest, sorted by id.  Where several
+ * have the same id only the first in the file is kept, as that is the
+ * one a search of the file would have found.  Records start with their id.
+ * @return the number of records copied, or -1 if out of memory
+ */
+static int sort_records(RecordArray *arr, char *dest)
+{
+    SortKey *keys = (SortKey *) malloc((arr->count + 1) * sizeof(SortKey));
+    int i;
+    int n = 0;
+    if (!keys)
+        return -1;
+    for (i = 0 ; i < arr->count ; i++)
+        {
+        keys[i].id    = *(int *) (arr->data + i * arr->recsize);
+        keys[i].index = i;
+        }
+    qsort(keys, arr->count, sizeof(SortKey), sortkey_compare);
+    for (i = 0 ; i < arr->count ; i++)
+        {
+        if (i > 0 && keys[i].id == keys[i - 1].id)
+            continue;
+        if (dest)
+            memcpy(dest + n * arr->recsize, arr->data + keys[i].index * arr->recsize, arr->recsize);
+        n++;
+        }
+    free(keys);
+    return n;
+}
+
+/**
+ * Count the records of an array that sort_records() would keep
+ * @return the count, or -1 if out of memory
+ */
+static int count_records(RecordArray *arr)
+{
+    return sort_records(arr, NULL);
+}
+
+/**
+ * A plane's string field and its place in db->planes, for sorting
+ */
+typedef struct
+{
+    const char *str;
+    int         index;
+} StringKey;
+
+/**
+ * Sort by string, then by place
+ */
+static int stringkey_compare(const void *a, const void *b)
+{
+    const StringKey *ka = (const StringKey *) a;
+    const StringKey *kb = (const StringKey *) b;
+    int cmp = strcmp(ka->str, kb->str);
+    if (cmp)
+        return cmp;
+    return (ka->index < kb->index) ? -1 : (ka->index > kb->index);
+}
+
+/**
+ * Fill one of the secondary indexes with the places of the planes in
+ * db->planes, sorted on the string at field (offsetof a PlaneInfo member)
+ * @return TRUE if successful, else FALSE
+ */
+static int build_string_index(PlaneDb *db, int *index, size_t field)
+{
+    StringKey *keys = (StringKey *) malloc((db->nrplanes + 1) * sizeof(StringKey));
+    int i;
+    if (!keys)
+        return FALSE;
+    for (i = 0 ; i < db->nrplanes ; i++)
+        {
+        unsigned int off = *(unsigned int *) ((char *) &db->planes[i] + field);
+        keys[i].str   = db->strings + off;
+        keys[i].index = i;
+        }
+    qsort(keys, db->nrplanes, sizeof(StringKey), stringkey_compare);
+    for (i = 0 ; i < db->nrplanes ; i++)
+        index[i] = keys[i].index;
+    free(keys);
+    return TRUE;
+}
+
+/**
+ * Fill the model index with the places of the planes in db->planes,
+ * sorted by model number, and by ICAO address within a model.
+ * @return TRUE if successful, else FALSE
+ */
+static int build_model_index(PlaneDb *db, int *index)
+{
+    SortKey *keys = (SortKey *) malloc((db->nrplanes + 1) * sizeof(SortKey));
+    int i;
+    if (!keys)
+        return FALSE;
+    for (i = 0 ; i < db->nrplanes ; i++)
+        {
+        keys[i].id    = db->planes[i].model;
+        keys[i].index = i;
+        }
+    qsort(keys, db->nrplanes, sizeof(SortKey), sortkey_compare);
+    for (i = 0 ; i < db->nrplanes ; i++)
+        index[i] = keys[i].index;
+    free(keys);
+    return TRUE;
+}
+
+/**
+ * Spread ICAO addresses over the slots of db->by_icao
+ */
+static unsigned int icao_hash(int id)
+{
+    unsigned int h = (unsigned int) id * 2654435761u;
+    return h ^ (h >> 15);
+}
+
+/**
+ * Fill the ICAO hash table with the places of the planes in db->planes.
+ * There is one plane to an address, and always an empty slot, so a probe
+ * ends at the plane or at an empty slot.
+ */
+static void build_icao_index(PlaneDb *db)
+{
+    int i;
+    memset(db->by_icao, 0xff, (db->icao_mask + 1) * sizeof(int));
+    for (i = 0 ; i < db->nrplanes ; i++)
+        {
+        unsigned int h = icao_hash(db->planes[i].id) & db->icao_mask;
+        while (db->by_icao[h] >= 0)
+            h = (h + 1) & db->icao_mask;
+        db->by_icao[h] = i;
+        }
+}
+
+/**
+ * Move everything in the Builder into one block, with the PlaneDb at its
+ * start, then the sorted records, the ICAO hash table, the secondary
+ * indexes and the string pool.
+ * @return the new PlaneDb if successful, else NULL
+ */
+static PlaneDb *build_db(Builder *b)
+{
+    int nrtypes  = count_records(&b->types);
+    int nrplanes = count_records(&b->planes);
+    if (nrtypes < 0 || nrplanes < 0)
+        {
+        err("cannot sort records");
+        return NULL;
+        }
+    // At most two thirds full, so probes stay short
+    unsigned int nrslots = 1;
+    while (nrslots < (unsigned int) (nrplanes + nrplanes / 2 + 1))
+        nrslots <<= 1;
+    size_t size = sizeof(PlaneDb)
+                + nrtypes * sizeof(TypeInfo)
+                + nrplanes * sizeof(PlaneInfo)
+                + nrslots * sizeof(int)
+                + 3 * nrplanes * sizeof(int)
+                + b->pool.len;
+    char *block = (char *) malloc(size);
+    if (!block)
+        {
+        err("cannot allocate plane database");
+        return NULL;
+        }
+    PlaneDb *db = (PlaneDb *) block;
+    db->types      = (TypeInfo *) (block + sizeof(PlaneDb));
+    db->planes     = (PlaneInfo *) (db->types + nrtypes);
+    db->by_icao       = (int *) (db->planes + nrplanes);
+    db->icao_mask     = nrslots - 1;
+    db->by_registration = db->by_icao + nrslots;
+    db->by_registrant = db->by_registration + nrplanes;
+    db->by_model      = db->by_registrant + nrplanes;
+    db->strings    = (char *) (db->by_model + nrplanes);
+    db->nrtypes    = nrtypes;
+    db->nrplanes   = nrplanes;
+    db->size       = size;
+    db->mtime      = 0;
+    db->has_faa    = FALSE;
+    db->refs       = 0;
+    if (sort_records(&b->types, (char *) db->types) < 0 ||
+        sort_records(&b->planes, (char *) db->planes) < 0)
+        {
+        err("cannot sort records");
+        free(block);
+        return NULL;
+        }
+    memcpy(db->strings, b->pool.data, b->pool.len);
+    build_icao_index(db);
+    if (!build_string_index(db, db->by_registration, offsetof(PlaneInfo, registration)) ||
+        !build_string_index(db, db->by_registrant, offsetof(PlaneInfo, registrant)) ||
+        !build_model_index(db, db->by_model))
+        {
+        err("cannot build indexes");
+        free(block);
+        return NULL;
+        }
+    return db;
+}
+
+/**
+ * The source planedb_init() loads: the FAA files in the runtime directory
+ */
+static const PlaneDbSource defaultSource = { &faaProvider, "" };
+
+/**
+ * Load sources into a new PlaneDb context.  They are loaded one after the
+ * other, in priority order, and where several have a plane, sort_records()
+ * keeps the first one's record.  So the sources are merged once, here,
+ * and a lookup is a single probe of one table however many there are.
+ * @param sources the sources.  The FAA files in the runtime directory if
+ *   count is 0.
+ * @param count the number of sources.
+ * @return a newly-allocated PlaneDb object if successful, else NULL.  This
+ *   value should be passed to planedb_close() when procesing is completed.
+ */
+PlaneDb *planedb_open(const PlaneDbSource *sources, int count)
+{
+    Builder b;
+    PlaneDb *db = NULL;
+    int i;
+    if (count <= 0)
+        {
+        sources = &defaultSource;
+        count   = 1;
+        }
+    time_t mtime = planedb_sources_mtime(sources, count);   // Before reading, so a change while we do isn't missed
+    memset(&b, 0, sizeof(b));
+    b.types.recsize  = sizeof(TypeInfo);
+    b.planes.recsize = sizeof(PlaneInfo);
+    pthread_mutex_init(&b.pool_lock, NULL);
+    int ok = pool_init(&b.pool);
+    for (i = 0 ; ok && i < count ; i++)
+        {
+        b.source = i;
+        ok = sources[i].provider->load(&b, sources[i].path);
+        }
+    if (ok)
+        db = build_db(&b);
+    if (db)
+        {
+        db->mtime = mtime;
+        for (i = 0 ; i < count ; i++)
+            if (sources[i].provider == &faaProvider)
+                db->has_faa = TRUE;
+        }
+    pool_free(&b.pool);
+    pthread_mutex_destroy(&b.pool_lock);
+    free(b.types.data);
+    free(b.planes.data);
+    free(b.models);
+    return db;
+}
+
+
+/**
+ * Create and initialize a PlaneDb context from the FAA files in the
+ * runtime directory.
+ * @return a newly-allocated PlaneDb object if successful, else NULL.  This
+ *   value should be passed to planedb_close() when procesing is completed.
+ */
+PlaneDb *planedb_init()
+{
+    return planedb_open(NULL, 0);
+}
+
+
+/**
+ * Get the modification time of the newest of the files planedb_open()
+ * would load, so the caller can tell when they have been replaced.
+ * @param sources the sources, as given to planedb_open().
+ * @param count the number of sources.
+ * @return the time, or 0 if there are no files.
+ */
+time_t planedb_sources_mtime(const PlaneDbSource *sources, int count)
+{
+    time_t newest = 0;
+    int i;
+    if (count <= 0)
+        {
+        sources = &defaultSource;
+        count   = 1;
+        }
+    for (i = 0 ; i < count ; i++)
+        {
+        time_t t = sources[i].provider->mtime(sources[i].path);
+        if (t > newest)
+            newest = t;
+        }
+    return newest;
+}
+
+
+/**
+ * Get the modification time of the newest of the files planedb_init()
+ * would load, so the caller can tell when they have been replaced.
+ * @return the time, or 0 if there are no files.
+ */
+time_t planedb_mtime()
+{
+    return planedb_sources_mtime(NULL, 0);
+}
+
+
+/**
+ * Get a string from the PlaneDb string pool.
+ * @param db the PlaneDb context.
+ * @param offset the offset of the string, from a TypeInfo or PlaneInfo field.
+ * @return the string.   It lasts as long as the PlaneDb context.
+ */
+const char *planedb_string(PlaneDb *db, unsigned int offset)
+{
+    return db->strings + offset;
+}
+
+
+/**
+ * Search the registration database for a PlaneInfo record with
+ * given ICAO id.
+ * @param db the PlaneDb context.
+ * @param icao the ICAO hex string to look for.
+ * @return the PlaneInfo object associated with the given ICAO
+ *   if successful, else NULL.
+ */
+PlaneInfo *planedb_lookup(PlaneDb *db, char *icao)
+{
+    if (!db || !icao)
+        return NULL;
+    return planedb_lookup_id(db, parse_hex(icao, 0));
+}
+
+/**
+ * Search the registration database for a PlaneInfo record with
+ * given ICAO address.  This probes the ICAO hash table, whichever
+ * source the plane came from.
+ * @param db the PlaneDb context.
+ * @param id the ICAO address.
+ * @return the PlaneInfo object associated with the address
+ *   if successful, else NULL.
+ */
+PlaneInfo *planedb_lookup_id(PlaneDb *db, int id)
+{
+    if (!db)
+        return NULL;
+    unsigned int h = icao_hash(id) & db->icao_mask;
+    int i;
+    while ((i = db->by_icao[h]) >= 0)
+        {
+        if (db->planes[i].id == id)
+            return &db->planes[i];
+        h = (h + 1) & db->icao_mask;
+        }
+    return NULL;
+}
+
+/**
+ * Find the planes whose string at field starts with prefix, using an
+ * index sorted on that field.  Two binary searches find the first plane
+ * that doesn't sort before the prefix, and the first that sorts after
+ * everything starting with it.
+ * @return the number of planes found; up to max are put in results
+ */
+static int find_prefix(PlaneDb *db, int *index, size_t field, const char *prefix,
+                       PlaneInfo **results, int max)
+{
+    int len = (int) strlen(prefix);
+    int bounds[2];
+    int pass, i;
+    for (pass = 0 ; pass < 2 ; pass++)
+        {
+        int lo = 0;
+        int hi = db->nrplanes;
+        while (lo < hi)
+            {
+            int mid = (lo + hi) / 2;
+            unsigned int off = *(unsigned int *) ((char *) &db->planes[index[mid]] + field);
+            int cmp = strncmp(db->strings + off, prefix, len);
+            if (cmp < 0 || (pass == 1 && cmp == 0))
+                lo = mid + 1;
+            else
+                hi = mid;
+            }
+        bounds[pass] = lo;
+        }
+    for (i = bounds[0] ; results && i < bounds[1] && i - bounds[0] < max ; i++)
+        results[i - bounds[0]] = &db->planes[index[i]];
+    return bounds[1] - bounds[0];
+}
+
+
+/**
+ * Find the planes whose registration starts with prefix.  If an FAA
+ * source was loaded, a prefix starting with a digit also finds the US
+ * N-Numbers that are "N" followed by it.  They come after the planes
+ * found with the prefix as given, since digits sort before "N".
+ * @param db the PlaneDb context.
+ * @param prefix the start of the registration.  Case doesn't matter.
+ * @param results receives up to max of the planes, in registration order.
+ *   May be NULL if only the count is wanted.
+ * @param max the size of results.
+ * @return the number of planes found, which may be more than max.
+ */
+int planedb_find_registration(PlaneDb *db, const char *prefix, PlaneInfo **results, int max)
+{
+    char key[16];
+    int count, used;
+    if (!db || !prefix)
+        return 0;
+    key[0] = 'N';
+    upper_copy(key + 1, sizeof(key) - 1, prefix);
+    count = find_prefix(db, db->by_registration, offsetof(PlaneInfo, registration), key + 1, results, max);
+    if (!db->has_faa || !isdigit((unsigned char) key[1]))
+        return count;
+    used = (count < max) ? count : max;
+    return count + find_prefix(db, db->by_registration, offsetof(PlaneInfo, registration), key,
+                               results ? results + used : NULL, max - used);
+}
+
+
+/**
+ * Find the planes whose registrant's name starts with prefix.
+ * @param db the PlaneDb context.
+ * @param prefix the start of the name.  Case doesn't matter.
+ * @param results receives up to max of the planes, in registrant order.
+ * @param max the size of results.
+ * @return the number of planes found, which may be more than max.
+ */
+int planedb_find_registrant(PlaneDb *db, const char *prefix, PlaneInfo **results, int max)
+{
+    char key[64];
+    if (!db || !prefix)
+        return 0;
+    upper_copy(key, sizeof(key), prefix);
+    return find_prefix(db, db->by_registrant, offsetof(PlaneInfo, registrant), key, results, max);
+}
+
+
+/**
+ * Find the planes of a model, as in PlaneInfo.model
+ * @param db the PlaneDb context.
+ * @param model the model number.
+ * @param results receives up to max of the planes, in ICAO order.
+ * @param max the size of results.
+ * @return the number of planes found, which may be more than max.
+ */
+int planedb_find_model(PlaneDb *db, int model, PlaneInfo **results, int max)
+{
+    int bounds[2];
+    int pass, i;
+    if (!db)
+        return 0;
+    for (pass = 0 ; pass < 2 ; pass++)
+        {
+        int lo = 0;
+        int hi = db->nrplanes;
+        while (lo < hi)
+            {
+            int mid = (lo + hi) / 2;
+            int m = db->planes[db->by_model[mid]].model;
+            if (m < model || (pass == 1 && m == model))
+                lo = mid + 1;
+            else
+                hi = mid;
+            }
+        bounds[pass] = lo;
+        }
+    for (i = bounds[0] ; results && i < bounds[1] && i - bounds[0] < max ; i++)
+        results[i - bounds[0]] = &db->planes[db->by_model[i]];
+    return bounds[1] - bounds[0];
+}
+
+/**
+ * Delete the PlaneDb object, and any allocated resources it might have.
+ * The whole database is one block, so this is a single free().
+ * @param db the PlaneDb context to delete.
+ * @return TRUE always
+ */
+int planedb_close(PlaneDb *db)
+{
+    if (!db)
+        return FALSE;
+    free(db);
+    return TRUE;
+}
+
+
+/**
+ * Compile with -DSTANDALONE to create a standalone tool.
+*/
+#ifdef STANDALONE
+
+/**
+ * Show proper command-line invocation of this app
+ */
+static void usage()
+{
+    printf("Usage:  planedb [-s <source>]... <icao code>\n");
+    printf("        planedb [-s <source>]... -n <registration>  planes whose registration starts with this\n");
+    printf("        planedb [-s <source>]... -r <registrant>    planes whose registrant starts with this\n");
+    printf("        planedb [-s <source>]... -m <model code>    planes of this model\n");
+    printf("A source is faa:<directory> or csv:<file>, in priority order.  The default\n");
+    printf("is the FAA files in the current directory.\n");
+}
+
+
+/**
+ * Microseconds, for timing the searches
+ */
+static double usecs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+
+/**
+ * Perform a DB lookup of the given ICAO string.
+ * Print if found
+ * @param icao the ICAO string for the search
+ * @return TRUE if found, else FALSE
+ */
+static int lookup(PlaneDb *db, char *icao)
+{
+    printf("%s\n", icao);
+    PlaneInfo *pi = planedb_lookup(db, icao);
+    if (!pi)
+        {
+        printf("Plane not found\n");
+        return FALSE;
+        }
+    planeInfoPrint(db, pi);
+    return TRUE;
+}
+
+
+/**
+ * Run one of the planedb_find_xxx() searches, and list the planes found
+ * one to a line.
+ * @param what the option letter: n, r or m
+ * @param key what to search for
+ * @return TRUE if any were found, else FALSE
+ */
+#define SEARCH_MAX 1000
+static int search(PlaneDb *db, char what, char *key)
+{
+    static PlaneInfo *results[SEARCH_MAX];
+    double start = usecs();
+    int count;
+    if (what == 'n')
+        count = planedb_find_registration(db, key, results, SEARCH_MAX);
+    else if (what == 'r')
+        count = planedb_find_registrant(db, key, results, SEARCH_MAX);
+    else
+        count = planedb_find_model(db, atoi(key), results, SEARCH_MAX);
+    double elapsed = usecs() - start;
+
+    int i;
+    for (i = 0 ; i < count && i < SEARCH_MAX ; i++)
+        {
+        PlaneInfo *pi = results[i];
+        TypeInfo  *ti = planedb_type(db, pi->model);
+        printf("%06X  %-8s %-50s %s %s\n", pi->id,
+            planedb_string(db, pi->registration), planedb_string(db, pi->registrant),
+            ti ? planedb_string(db, ti->manufacturer) : "",
+            ti ? planedb_string(db, ti->model) : "");
+        }
+    if (count > SEARCH_MAX)
+        printf("... and %d more\n", count - SEARCH_MAX);
+    printf("%d found in %.1f microseconds\n", count, elapsed);
+    return count > 0;
+}
+
+
+/**
+ * Good old main() function.  O how that takes me back.
+ */
+#define MAX_SOURCES 8
+int main(int argc, char **argv)
+{
+    PlaneDbSource sources[MAX_SOURCES];
+    int nrsources = 0;
+    while (argc >= 3 && !strcmp(argv[1], "-s"))
+        {
+        if (nrsources == MAX_SOURCES || !planedb_source(&sources[nrsources], argv[2]))
+            {
+            printf("Bad or too many sources: %s\n", argv[2]);
+            return 1;
+            }
+        nrsources++;
+        argc -= 2;
+        argv += 2;
+        }
+    if (!(argc == 2 && argv[1][0] != '-') &&
+        !(argc == 3 && argv[1][0] == '-' && strchr("nrm", argv[1][1]) && argv[1][1] && !argv[1][2]))
+        {
+        usage();
+        return 1;
+        }
+    PlaneDb *db = planedb_open(sources, nrsources);
+    if (!db)
+        {
+        printf("Could not initialize plane database\n");
+        return 1;
+        }
+    int found = (argc == 2) ? lookup(db, argv[1]) : search(db, argv[1][1], argv[2]);
+    planedb_close(db);
+    return found ? 0 : 1;
 }
 
 #endif
@@ -6,15 +6,17 @@
  * Simple tool to read plane registration and type information
  * from various databases
  *
- * Currently, we are just reading the FAA database files.  
+ * Each kind of source is read by a provider.  The FAA provider reads the
+ * fixed-width MASTER.txt and ACFTREF.txt files, which cover US registrations.
  * @see http://www.faa.gov/licenses_certificates/aircraft_certification/aircraft_registry/releasable_aircraft_download/
- * 
- * Copy the MASTER.txt and ACFTREF.txt files into the runtime directory for this to work.
+ * The CSV provider reads one comma separated file of ICAO address, registration,
+ * manufacturer, model and registrant, such as the OpenSky Network aircraft
+ * database, for everything else.  Any number of sources may be used at once.
+ *
+ * By default the FAA files are read from the runtime directory.
  * If they are not found, then the lookup will simply be skipped, and will return a NULL record.  It
  * should not affect operation of the client application.
  *
- * Add more later.
- *
  * The MIT License (MIT)
  * Copyright (c) 2019 Bob Jamison
  * 
@@ -34,55 +36,148 @@
  * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#include <stddef.h>
+#include <time.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 /**
- *
+ * TypeInfo data record.  The strings are offsets into the PlaneDb string
+ * pool; use planedb_string() to read them.
  */
-typedef struct TypeInfoDef TypeInfo;    
+typedef struct TypeInfoDef TypeInfo;
 struct TypeInfoDef
 {
-    struct TypeInfoDef *next;
     int id;        //the manufacturer, model, and series code as an int
-    char *manufacturer;  // Manufacturer name
-    char *model;         // Model name
+    unsigned int manufacturer;  // Manufacturer name
+    unsigned int model;         // Model name
     int type;            // Integer type
     int nrseats;         // Max number of seats
 };
 
 /**
- *  PlaneInfo data record
+ *  PlaneInfo data record.  The strings are offsets into the PlaneDb
+ *  string pool.
  */
 typedef struct PlaneInfoDef PlaneInfo;
 struct PlaneInfoDef
 {
-    struct PlaneInfoDef *next;
     int  id;        //the icao code in int form
-    char *nnum;     // The N-Number string
-    int  model;     // The model name
-    char *registrant; // Name of the registrant
+    unsigned int registration;  // The registration mark, e.g. N12345 or G-ABCD
+    int  model;     // The model number, as in TypeInfo.id
+    unsigned int registrant; // Name of the registrant
+    int  source;    // Which source it came from, 0 for the first
 };
 
 /**
- *  The PlaneDb context.   Created by planedb_init(), used with planedb_liikup(),
+ * Model numbers from here up are made up by the loader, for sources that
+ * name the manufacturer and model rather than giving an FAA code.
+ */
+#define PLANEDB_LOCAL_MODELS 0x40000000
+
+/**
+ *  The PlaneDb context.   Created by planedb_open(), used with planedb_lookup(),
  *  and destroyed by planedb_close()
+ *
+ *  The context, the records and the strings they refer to are all in one
+ *  block of memory, with the context at its start.  This is the same
+ *  whichever sources it was built from.  The records are sorted
+ *  by id, and each distinct string is stored once.  A hash table finds
+ *  a plane by its ICAO address in one probe or so, however many sources
+ *  there are.  The planes are also
+ *  indexed by registration, registrant and model, for the planedb_find_xxx()
+ *  searches.  Nothing in it changes
+ *  after planedb_open(), so any number of threads may search it at once.
  */
 typedef struct
 {
     TypeInfo    *types;
-    int     last_model;
-    TypeInfo  *last_ti;
+    int      nrtypes;
     PlaneInfo  *planes;
-    int      last_icao;
-    PlaneInfo *last_pi;
+    int      nrplanes;
+    int       *by_icao;       // Hash table of indexes into planes, -1 for an empty slot
+    unsigned int icao_mask;   // Its size - 1.  The size is a power of 2
+    int       *by_registration; // Indexes into planes, in registration order
+    int       *by_registrant; // Indexes into planes, in registrant order
+    int       *by_model;      // Indexes into planes, in model number order
+    char      *strings;   // The string pool.  Offset 0 is always ""
+    size_t     size;      // Size of the whole block
+    time_t     mtime;     // Modification time of the newest file, when loaded
+    int        has_faa;   // TRUE if one of the sources was the FAA's
+    int        refs;      // Free for the owner's use, e.g. to count readers
 } PlaneDb;
 
 
 /**
- * Create and initialize a PlaneDb context.
+ * The loader state that a provider adds its records to.
+ */
+typedef struct PlaneDbBuilderDef PlaneDbBuilder;
+
+/**
+ * A provider reads one kind of source.  Its load function adds the
+ * records of the source at path to the builder, with planedb_add(), and
+ * its mtime function says when the source was last changed.
+ */
+typedef struct PlaneDbProviderDef PlaneDbProvider;
+struct PlaneDbProviderDef
+{
+    const char *name;                                   // As in a source spec, e.g. "faa"
+    int       (*load)(PlaneDbBuilder *b, const char *path); // TRUE if successful
+    time_t    (*mtime)(const char *path);               // 0 if the source isn't there
+};
+
+/**
+ * One source of registrations: a provider, and where its files are.
+ */
+typedef struct PlaneDbSourceDef PlaneDbSource;
+struct PlaneDbSourceDef
+{
+    const PlaneDbProvider *provider;
+    char                   path[256];
+};
+
+/**
+ * Make a provider available to planedb_source(), in addition to the
+ * built-in "faa" and "csv" providers.  Must be done before any sources
+ * are opened.
+ * @return TRUE if successful, else FALSE if there are too many providers.
+ */
+int planedb_add_provider(const PlaneDbProvider *provider);
+
+/**
+ * Set up a source from a spec of the form provider:path, such as
+ * "faa:/var/lib/faa" (the directory holding the FAA files) or
+ * "csv:aircraft.csv.gz".
+ * @return TRUE if successful, else FALSE if the provider isn't known.
+ */
+int planedb_source(PlaneDbSource *src, const char *spec);
+
+/**
+ * Add a plane to the builder, for providers whose sources name the
+ * manufacturer and model.   Those are given a made-up model number.
+ * Registrations and registrants are kept in upper case, as the FAA's are.
+ * Any string may be NULL or "".
+ * @return TRUE if successful, else FALSE if out of memory.
+ */
+int planedb_add(PlaneDbBuilder *b, int icao, const char *registration,
+                const char *registrant, const char *manufacturer, const char *model);
+
+/**
+ * Load sources into a new PlaneDb context.  They are given in priority
+ * order: where several have a plane, the first one's record is used.
+ * @param sources the sources.  The FAA files in the runtime directory if
+ *   count is 0.
+ * @param count the number of sources.
+ * @return a newly-allocated PlaneDb object if successful, else NULL.  This
+ *   value should be passed to planedb_close() when procesing is completed.
+ */
+PlaneDb *planedb_open(const PlaneDbSource *sources, int count);
+
+/**
+ * Create and initialize a PlaneDb context from the FAA files in the
+ * runtime directory.
  * @return a newly-allocated PlaneDb object if successful, else NULL.  This
  *   value should be passed to planedb_close() when procesing is completed.
  */
@@ -98,6 +193,81 @@ PlaneDb *planedb_init();
  */
 PlaneInfo *planedb_lookup(PlaneDb *db, char *icao);
 
+/**
+ * Search the registration database for a PlaneInfo record with
+ * given ICAO address.
+ * @param db the PlaneDb context.
+ * @param icao the ICAO address.
+ * @return the PlaneInfo object associated with the address
+ *   if successful, else NULL.
+ */
+PlaneInfo *planedb_lookup_id(PlaneDb *db, int icao);
+
+/**
+ * Look up a TypeInfo record by its model number, as in PlaneInfo.model
+ * @param db the PlaneDb context.
+ * @param id the model number to look for.
+ * @return a TypeInfo object if the model is found, else NULL.
+ */
+TypeInfo *planedb_type(PlaneDb *db, int id);
+
+/**
+ * Find the planes whose registration starts with prefix.  If an FAA
+ * source was loaded, a prefix starting with a digit also finds the US
+ * N-Numbers that are "N" followed by it.
+ * @param db the PlaneDb context.
+ * @param prefix the start of the registration.  Case doesn't matter.
+ * @param results receives up to max of the planes, in registration order.
+ *   May be NULL if only the count is wanted.
+ * @param max the size of results.
+ * @return the number of planes found, which may be more than max.
+ */
+int planedb_find_registration(PlaneDb *db, const char *prefix, PlaneInfo **results, int max);
+
+/**
+ * Find the planes whose registrant's name starts with prefix.
+ * @param db the PlaneDb context.
+ * @param prefix the start of the name.  Case doesn't matter.
+ * @param results receives up to max of the planes, in registrant order.
+ * @param max the size of results.
+ * @return the number of planes found, which may be more than max.
+ */
+int planedb_find_registrant(PlaneDb *db, const char *prefix, PlaneInfo **results, int max);
+
+/**
+ * Find the planes of a model, as in PlaneInfo.model
+ * @param db the PlaneDb context.
+ * @param model the model number.
+ * @param results receives up to max of the planes, in ICAO order.
+ * @param max the size of results.
+ * @return the number of planes found, which may be more than max.
+ */
+int planedb_find_model(PlaneDb *db, int model, PlaneInfo **results, int max);
+
+/**
+ * Get the modification time of the newest of the files planedb_open()
+ * would load, so the caller can tell when they have been replaced.
+ * @param sources the sources, as given to planedb_open().
+ * @param count the number of sources.
+ * @return the time, or 0 if there are no files.
+ */
+time_t planedb_sources_mtime(const PlaneDbSource *sources, int count);
+
+/**
+ * Get the modification time of the newest of the files planedb_init()
+ * would load, so the caller can tell when they have been replaced.
+ * @return the time, or 0 if there are no files.
+ */
+time_t planedb_mtime();
+
+/**
+ * Get a string from the PlaneDb string pool.
+ * @param db the PlaneDb context.
+ * @param offset the offset of the string, from a TypeInfo or PlaneInfo field.
+ * @return the string.   It lasts as long as the PlaneDb context.
+ */
+const char *planedb_string(PlaneDb *db, unsigned int offset);
+
 /**
  * Delete the PlaneDb object, and any allocated resources it might have
  * @param db the PlaneDb context to delete.
@@ -74,6 +74,7 @@ void ppup1090Init(void) {
 
     pthread_mutex_init(&Modes.pDF_mutex,NULL);
     pthread_mutex_init(&Modes.data_mutex,NULL);
+    pthread_mutex_init(&Modes.snapshot_mutex,NULL);
     pthread_cond_init(&Modes.data_cond,NULL);
 
     // Allocate the various buffers used by Modes
@@ -230,11 +231,7 @@ int main(int argc, char **argv) {
     // allocates a handle greater than 1024, then dump1090 won't like it. On my test machine,
     // the first Windows handle is usually in the 0x54 (84 decimal) region.
 
-    c = (struct client *) malloc(sizeof(*c));
-    c->next    = NULL;
-    c->buflen  = 0;
-    c->fd      =
-    c->service =
+    c = modesCreateClient(fd, fd, MODES_CLIENT_BUF_SIZE);
     Modes.bis  = fd;
     Modes.clients = c;
 
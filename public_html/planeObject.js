@@ -43,6 +43,28 @@ var planeObject = {
 			this.trackline.push(new google.maps.LatLng(this.latitude, this.longitude));
 		},
 
+	// Replaces the track with the trail dump1090 has kept for the plane, from
+	// /history.json, so a reloaded page still shows where it has been.
+	// The points after the first are sent as differences from the one before:
+	// tenths of a second, 1e-5 degrees of latitude and longitude, and feet.
+	funcLoadHistory	: function(hist){
+			var lat = hist.lat, lon = hist.lon, alt = hist.altitude;
+			var d = hist.deltas;
+
+			this.trackdata = [[lat / 100000, lon / 100000, alt, null, null]];
+			this.trackline = [new google.maps.LatLng(lat / 100000, lon / 100000)];
+			for (var i = 0; i + 3 < d.length; i += 4) {
+				lat += d[i+1];
+				lon += d[i+2];
+				alt += d[i+3];
+				this.trackdata.push([lat / 100000, lon / 100000, alt, null, null]);
+				this.trackline.push(new google.maps.LatLng(lat / 100000, lon / 100000));
+			}
+			if (this.line) {
+				this.line.setPath(this.trackline);
+			}
+		},
+
 	// This is to remove the line from the screen if we deselect the plane
 	funcClearLine	: function() {
 			if (this.line) {
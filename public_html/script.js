@@ -6,6 +6,7 @@ var PlanesOnTable = 0;
 var PlanesToReap  = 0;
 var SelectedPlane = null;
 var SpecialSquawk = false;
+var History       = {}; // Trails from history.json for planes we haven't seen yet
 
 var iSortCol=-1;
 var bSortASC=true;
@@ -30,6 +31,10 @@ function fetchData() {
 				var plane = Planes[data[j].hex];
 			} else {
 				var plane = jQuery.extend(true, {}, planeObject);
+				if (History[data[j].hex]) {
+					plane.funcLoadHistory(History[data[j].hex]);
+					delete History[data[j].hex];
+				}
 			}
 			
 			/* For special squawk tests
@@ -53,6 +58,21 @@ function fetchData() {
 	});
 }
 
+// Fetches the trails dump1090 has kept, once when the page loads, so they
+// don't have to be built up again from polling.
+function fetchHistory() {
+	$.getJSON('/dump1090/history.json', function(data) {
+		for (var j=0; j < data.aircraft.length; j++) {
+			var hist = data.aircraft[j];
+			if (Planes[hist.hex]) {
+				Planes[hist.hex].funcLoadHistory(hist);
+			} else {
+				History[hist.hex] = hist;
+			}
+		}
+	});
+}
+
 // Initalizes the map and starts up our timers to call various functions
 function initialize() {
 	// Make a list of all the available map IDs
@@ -202,6 +222,9 @@ function initialize() {
 	// Did our crafty user need some setup?
 	extendedInitalize();
 	
+	// Get the trails so far
+	fetchHistory();
+
 	// Setup our timer to poll from the server.
 	window.setInterval(function() {
 		fetchData();
@@ -0,0 +1,320 @@
+// query1090, search the frame archive written by dump1090 --archive
+//
+// Copyright (C) 2012 by Salvatore Sanfilippo <antirez@gmail.com>
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//  *  Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//  *  Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#include "dump1090.h"
+#ifndef _WIN32
+    #include <dirent.h>
+#endif
+//
+// query1090 prints the frames in an archive directory that match an ICAO
+// address and/or a time range. Segments whose times don't overlap the range,
+// or whose bloom filter says they have nothing from the aircraft, are passed
+// over after reading their header. In the rest the time index says where to
+// start, and the scan stops at the end of the range, so a query only reads
+// the records that could match. Those are read straight from the mapped
+// files: the scan runs at the speed memory (or the disk) can deliver them.
+//
+#define QUERY1090_MAX_SEGMENTS 65536
+
+static struct {
+    char    *dir;                      // The archive directory
+    uint32_t addr;                     // Only frames from this aircraft,
+    int      have_addr;                // if set
+    uint64_t from, to;                 // Wall clock range, ms, inclusive
+    int      avr;                      // Print as AVR raw, to feed back to dump1090
+    int      decode;                   // Print dump1090's decode of each frame
+    int      count;                    // Only count the matches
+    int      stats;                    // Report what was read on stderr
+
+    uint64_t matches;
+    uint64_t scanned;                  // Records looked at
+    int      segments, skipped;
+} Query1090;
+//
+// ============================= Utility functions ==========================
+//
+// Parse a local time: "YYYY-MM-DD HH:MM[:SS]" (or with a T), "HH:MM[:SS]"
+// for today, or seconds since 1970. Returns ms since 1970, or 0 if it
+// can't be parsed.
+//
+static uint64_t parseTime(const char *s) {
+    struct tm tm;
+    time_t now = time(NULL), t;
+    char sep;
+
+    memset(&tm, 0, sizeof(tm));
+    if (sscanf(s, "%d-%d-%d%c%d:%d:%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &sep,
+               &tm.tm_hour, &tm.tm_min, &tm.tm_sec) >= 6) {
+        tm.tm_year -= 1900;
+        tm.tm_mon  -= 1;
+    } else if (sscanf(s, "%d:%d:%d", &tm.tm_hour, &tm.tm_min, &tm.tm_sec) >= 2) {
+        struct tm today = *localtime(&now);
+        tm.tm_year = today.tm_year;
+        tm.tm_mon  = today.tm_mon;
+        tm.tm_mday = today.tm_mday;
+    } else {
+        char *end;
+        unsigned long long secs = strtoull(s, &end, 10);
+        return ((*s && !*end) ? (secs * 1000) : 0);
+    }
+    tm.tm_isdst = -1;
+    if ((t = mktime(&tm)) == (time_t) -1) {return (0);}
+    return ((uint64_t) t * 1000);
+}
+//
+//=========================================================================
+//
+// Show one frame
+//
+static void showRecord(struct archiveRecord *r) {
+    time_t secs = (time_t) (r->time / 1000);
+    char when[32];
+    int j;
+
+    if (Query1090.avr) {
+        printf("@%012llX", (unsigned long long) (r->timestamp & 0xFFFFFFFFFFFFULL));
+        for (j = 0; j < r->len; j++) {printf("%02X", r->msg[j]);}
+        printf(";\n");
+        return;
+    }
+
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&secs));
+    printf("%s.%03d %06X sig %3d rx %d%s%s *", when, (int) (r->time % 1000), r->addr,
+           r->signal, r->rx, (r->flags & ARCHIVE_CORRECTED) ? " fixed" : "",
+           (r->flags & ARCHIVE_REMOTE) ? " remote" : "");
+    for (j = 0; j < r->len; j++) {printf("%02X", r->msg[j]);}
+    printf(";\n");
+
+    if ((Query1090.decode) && (r->len != MODEAC_MSG_BYTES)) {
+        struct modesMessage mm;
+
+        // Frames that only carry their address in the parity need it to
+        // have been seen, as it was when they were received
+        memset(&mm, 0, sizeof(mm));
+        addRecentlySeenICAOAddr(r->addr);
+        decodeModesMessage(&mm, r->msg);
+        mm.timestampMsg = r->timestamp;
+        mm.signalLevel  = r->signal;
+        mm.rx           = r->rx;
+        displayModesMessage(&mm);
+    }
+}
+//
+//=========================================================================
+//
+// Search one segment
+//
+static void querySegment(const char *path) {
+    struct archiveSegment seg;
+    struct archiveRecord *r, *first, *end;
+    struct archiveHeader *hdr;
+
+    if (archiveOpenSegment(&seg, path) < 0) {
+        fprintf(stderr, "Skipping %s: not an archive segment\n", path);
+        return;
+    }
+    hdr = seg.hdr;
+    Query1090.segments++;
+
+    if ( (seg.nrecords == 0)
+      || (hdr->last_time < Query1090.from) || (hdr->first_time > Query1090.to)
+      || ((Query1090.have_addr) && (!archiveBloomMayHave(hdr, Query1090.addr))) ) {
+        Query1090.skipped++;
+        archiveCloseSegment(&seg);
+        return;
+    }
+
+    first = r = &seg.records[archiveSeek(&seg, Query1090.from)];
+    end   = &seg.records[seg.nrecords];
+    while ((r < end) && (r->time < Query1090.from)) {r++;}
+
+    if (Query1090.have_addr) {
+        uint32_t addr = Query1090.addr;
+        uint64_t to   = Query1090.to;
+        for (; (r < end) && (r->time <= to); r++) {
+            if (r->addr != addr) continue;
+            Query1090.matches++;
+            if (!Query1090.count) {showRecord(r);}
+        }
+    } else {
+        for (; (r < end) && (r->time <= Query1090.to); r++) {
+            Query1090.matches++;
+            if (!Query1090.count) {showRecord(r);}
+        }
+    }
+    Query1090.scanned += (uint64_t) (r - first);
+    archiveCloseSegment(&seg);
+}
+//
+//=========================================================================
+//
+static int compareNames(const void *a, const void *b) {
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+// Search the segments in the archive directory, oldest first
+static void queryArchive(void) {
+#ifndef _WIN32
+    static char *names[QUERY1090_MAX_SEGMENTS];
+    char path[1024];
+    struct dirent *de;
+    DIR *d;
+    int n = 0, j;
+
+    if ((d = opendir(Query1090.dir)) == NULL) {
+        fprintf(stderr, "Can't open archive %s: %s\n", Query1090.dir, strerror(errno));
+        exit(1);
+    }
+    while ((de = readdir(d)) != NULL) {
+        size_t l = strlen(de->d_name);
+        if ((strncmp(de->d_name, "frames-", 7)) || (l < 4) || (strcmp(de->d_name + l - 4, ".seg"))) continue;
+        if (n == QUERY1090_MAX_SEGMENTS) {
+            fprintf(stderr, "Too many segments in %s, only searching %d\n", Query1090.dir, n);
+            break;
+        }
+        names[n++] = strdup(de->d_name);
+    }
+    closedir(d);
+    qsort(names, n, sizeof(names[0]), compareNames);
+
+    for (j = 0; j < n; j++) {
+        snprintf(path, sizeof(path), "%s/%s", Query1090.dir, names[j]);
+        querySegment(path);
+        free(names[j]);
+    }
+#else
+    fprintf(stderr, "The frame archive isn't available on Windows\n");
+    exit(1);
+#endif
+}
+//
+// ================================ Main ====================================
+//
+void showHelp(void) {
+    printf(
+"-----------------------------------------------------------------------------\n"
+"|                query1090 dump1090 Archive Search       Ver : "MODES_DUMP1090_VERSION " |\n"
+"-----------------------------------------------------------------------------\n"
+  "--archive <directory>    The archive, as given to dump1090 (default: archive)\n"
+  "--icao <hex>             Only frames from this ICAO address\n"
+  "--from <time>            Only frames received at or after <time>\n"
+  "--to <time>              Only frames received at or before <time>\n"
+  "                         Times are local: YYYY-MM-DD HH:MM[:SS], HH:MM[:SS]\n"
+  "                         for today, or seconds since 1970\n"
+  "--avr                    Print the frames as AVR raw with their 12MHz\n"
+  "                         timestamps, as dump1090 --mlat --raw would\n"
+  "--decode                 Print each frame decoded, as dump1090 does\n"
+  "--count                  Only print the number of frames found\n"
+  "--stats                  Show how much of the archive was read on stderr\n"
+  "--help                   Show this help\n"
+    );
+}
+//
+//=========================================================================
+//
+int main(int argc, char **argv) {
+    uint64_t start;
+    int j;
+
+    memset(&Query1090, 0, sizeof(Query1090));
+    Query1090.dir = "archive";
+    Query1090.to  = UINT64_MAX;
+
+    for (j = 1; j < argc; j++) {
+        int more = ((j + 1) < argc); // There are more arguments
+
+        if        (!strcmp(argv[j],"--archive") && more) {
+            Query1090.dir = argv[++j];
+        } else if (!strcmp(argv[j],"--icao") && more) {
+            char *end;
+            Query1090.addr = (uint32_t) strtoul(argv[++j], &end, 16);
+            if ((*end) || (Query1090.addr > 0xFFFFFF)) {
+                fprintf(stderr, "Bad ICAO address: %s\n", argv[j]);
+                exit(1);
+            }
+            Query1090.have_addr = 1;
+        } else if ((!strcmp(argv[j],"--from") || !strcmp(argv[j],"--to")) && more) {
+            uint64_t t = parseTime(argv[j+1]);
+            if (t == 0) {
+                fprintf(stderr, "Bad time: %s\n", argv[j+1]);
+                exit(1);
+            }
+            // Times are to the second, so --to takes in all of its second
+            if (!strcmp(argv[j++],"--from")) {Query1090.from = t;}
+            else                             {Query1090.to   = t + 999;}
+        } else if (!strcmp(argv[j],"--avr")) {
+            Query1090.avr = 1;
+        } else if (!strcmp(argv[j],"--decode")) {
+            Query1090.decode = 1;
+        } else if (!strcmp(argv[j],"--count")) {
+            Query1090.count = 1;
+        } else if (!strcmp(argv[j],"--stats")) {
+            Query1090.stats = 1;
+        } else if (!strcmp(argv[j],"--help")) {
+            showHelp();
+            exit(0);
+        } else {
+            fprintf(stderr, "Unknown or not enough arguments for option '%s'.\n\n", argv[j]);
+            showHelp();
+            exit(1);
+        }
+    }
+
+    // The decoder needs a context of its own
+    if (Query1090.decode) {
+        struct modes *ctx = modesNewContext();
+        if ((ctx == NULL) || (modesInitContext(ctx) < 0)) {
+            fprintf(stderr, "Out of memory allocating data buffer.\n");
+            exit(1);
+        }
+        modesUseContext(ctx);
+    }
+
+    start = mstime();
+    queryArchive();
+
+    if (Query1090.count) {
+        printf("%llu\n", (unsigned long long) Query1090.matches);
+    }
+    fflush(stdout);
+    if (Query1090.stats) {
+        uint64_t ms = mstime() - start;
+        double mb = (Query1090.scanned * sizeof(struct archiveRecord)) / (1024.0 * 1024.0);
+
+        fprintf(stderr, "%d segments, %d skipped, %llu records scanned (%.1f MB) in %llu ms",
+                Query1090.segments, Query1090.skipped, (unsigned long long) Query1090.scanned,
+                mb, (unsigned long long) ms);
+        if (ms) {fprintf(stderr, ", %.0f MB/s", (mb * 1000.0) / ms);}
+        fprintf(stderr, ", %llu frames found\n", (unsigned long long) Query1090.matches);
+    }
+    return (0);
+}
+//
+//=========================================================================
+//
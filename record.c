@@ -0,0 +1,286 @@
+// dump1090, a Mode S messages decoder for RTLSDR devices.
+//
+// Copyright (C) 2012 by Salvatore Sanfilippo <antirez@gmail.com>
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//  *  Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//  *  Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include "dump1090.h"
+//
+// ============================= Message records ============================
+//
+// A compact, machine readable record of each decoded message, for programs
+// rather than people. --records prints them on stdout in place of the text,
+// and they're sent to clients of the record output port (--net-rec-port).
+// The fields that depend on the message type are only present when the
+// message set the matching MODES_ACFLAGS_ bit, so a reader never has to
+// guess whether a zero is a value.
+//
+// JSON: one object per line,
+//
+//   {"df":17,"icao":"40621d","now":1700000000123,"ts":1234567,"sig":52,
+//    "crc":1,"raw":"8d40621d58c382d690c8ac2863a7","alt":38000,
+//    "cpr":"even","cpr_lat":93000,"cpr_lon":51372,"ground":0}
+//
+// Binary: a record is a 16 bit length (of the rest of the record) followed
+// by that many bytes. Numbers are little endian whatever the machine.
+//
+//   u8  version (MODES_RECORD_VERSION)   u8  DF
+//   u32 bFlags                           u64 wall clock time, ms since 1970
+//   u48 12MHz timestamp                  u8  signal level
+//   u8  bit 0: CRC ok, bit 1: remote     u8  bits corrected
+//   u24 ICAO address                     u8  message length, then the message
+//
+// and then, in this order, only the fields whose flag is set in bFlags:
+//
+//   LATLON_VALID     i32 latitude, i32 longitude, in 1e-7 degrees
+//   ALTITUDE_VALID   i32 altitude, u8 unit (0 feet, 1 metres)
+//   HEADING_VALID    i16 heading
+//   SPEED_VALID      i16 speed
+//   VERTRATE_VALID   i16 vertical rate
+//   SQUAWK_VALID     u16 squawk, as its four octal digits in hex
+//   CALLSIGN_VALID   8 bytes callsign
+//   EWSPEED_VALID    i16 east-west velocity
+//   NSSPEED_VALID    i16 north-south velocity
+//   LLEVEN or LLODD  u32 CPR latitude, u32 CPR longitude (odd if LLODD)
+//   FS_VALID         u8 flight status
+//
+// AOG_VALID and AOG need no field. New fields will only ever be added at the
+// end, with a flag of their own.
+//
+// Both are written a byte at a time rather than with printf, as the records
+// are meant for the busiest outputs.
+//
+static char *recordString(char *p, const char *s) {
+    while (*s) {*p++ = *s++;}
+    return (p);
+}
+
+static char *recordInt(char *p, int64_t v) {
+    char tmp[24];
+    uint64_t u = (v < 0) ? (uint64_t) -v : (uint64_t) v;
+    int n = 0;
+
+    if (v < 0) {*p++ = '-';}
+    do {
+        tmp[n++] = (char) ('0' + (u % 10));
+        u /= 10;
+    } while (u);
+    while (n) {*p++ = tmp[--n];}
+    return (p);
+}
+
+// A latitude or longitude, to 6 decimal places
+static char *recordDegrees(char *p, double v) {
+    int64_t micro = (int64_t) floor(v * 1000000.0 + 0.5);
+    int64_t frac;
+    int j;
+
+    if (micro < 0) {*p++ = '-'; micro = -micro;}
+    p = recordInt(p, micro / 1000000);
+    *p++ = '.';
+    frac = micro % 1000000;
+    for (j = 5; j >= 0; j--) {
+        p[j] = (char) ('0' + (frac % 10));
+        frac /= 10;
+    }
+    return (p + 6);
+}
+
+static char *recordHex(char *p, const unsigned char *msg, int len) {
+    static const char hex[] = "0123456789abcdef";
+    int j;
+
+    for (j = 0; j < len; j++) {
+        *p++ = hex[msg[j] >> 4];
+        *p++ = hex[msg[j] & 15];
+    }
+    return (p);
+}
+
+static char *recordField(char *p, const char *name, int64_t v) {
+    p = recordString(p, name);
+    return (recordInt(p, v));
+}
+//
+//=========================================================================
+//
+// Write mm as a line of JSON. buf must have room for MODES_RECORD_MAX bytes.
+// Returns the length.
+//
+static int modesJsonRecord(struct modesMessage *mm, char *buf) {
+    unsigned char addr[3], squawk[2];
+    char *p = buf;
+    int flags = mm->bFlags;
+
+    p = recordField(p, "{\"df\":", mm->msgtype);
+    if (mm->msgtype < 32) {
+        addr[0] = (unsigned char) (mm->addr >> 16);
+        addr[1] = (unsigned char) (mm->addr >>  8);
+        addr[2] = (unsigned char)  mm->addr;
+        p = recordString(p, ",\"icao\":\"");
+        p = recordHex(p, addr, 3);
+        *p++ = '"';
+    }
+    p = recordField(p, ",\"now\":", (int64_t) mstime());
+    if (mm->timestampMsg) {p = recordField(p, ",\"ts\":", (int64_t) mm->timestampMsg);}
+    p = recordField(p, ",\"sig\":", mm->signalLevel);
+    p = recordField(p, ",\"crc\":", (mm->crcok) ? 1 : 0);
+    if (mm->correctedbits) {p = recordField(p, ",\"fixed\":", mm->correctedbits);}
+    if (mm->remote)        {p = recordString(p, ",\"remote\":1");}
+    p = recordString(p, ",\"raw\":\"");
+    p = recordHex(p, mm->msg, mm->msgbits / 8);
+    *p++ = '"';
+
+    if (flags & MODES_ACFLAGS_LATLON_VALID) {
+        p = recordString(p, ",\"lat\":");
+        p = recordDegrees(p, mm->fLat);
+        p = recordString(p, ",\"lon\":");
+        p = recordDegrees(p, mm->fLon);
+    }
+    if (flags & MODES_ACFLAGS_ALTITUDE_VALID) {
+        p = recordField(p, ",\"alt\":", mm->altitude);
+        if (mm->unit == MODES_UNIT_METERS) {p = recordString(p, ",\"alt_unit\":\"m\"");}
+    }
+    if (flags & MODES_ACFLAGS_HEADING_VALID)  {p = recordField(p, ",\"hdg\":",   mm->heading);}
+    if (flags & MODES_ACFLAGS_SPEED_VALID)    {p = recordField(p, ",\"spd\":",   mm->velocity);}
+    if (flags & MODES_ACFLAGS_VERTRATE_VALID) {p = recordField(p, ",\"vrate\":", mm->vert_rate);}
+    if (flags & MODES_ACFLAGS_SQUAWK_VALID) {
+        squawk[0] = (unsigned char) (mm->modeA >> 8);
+        squawk[1] = (unsigned char)  mm->modeA;
+        p = recordString(p, ",\"squawk\":\"");
+        p = recordHex(p, squawk, 2);
+        *p++ = '"';
+    }
+    if (flags & MODES_ACFLAGS_CALLSIGN_VALID) {
+        char *f = mm->flight;
+        int j;
+
+        // The callsign alphabet has nothing that needs escaping
+        p = recordString(p, ",\"flight\":\"");
+        for (j = 0; (j < 8) && (f[j]); j++) {*p++ = f[j];}
+        *p++ = '"';
+    }
+    if (flags & MODES_ACFLAGS_EWSPEED_VALID) {p = recordField(p, ",\"ew\":", mm->ew_velocity);}
+    if (flags & MODES_ACFLAGS_NSSPEED_VALID) {p = recordField(p, ",\"ns\":", mm->ns_velocity);}
+    if (flags & MODES_ACFLAGS_LLEITHER_VALID) {
+        p = recordString(p, (flags & MODES_ACFLAGS_LLODD_VALID) ? ",\"cpr\":\"odd\"" : ",\"cpr\":\"even\"");
+        p = recordField(p, ",\"cpr_lat\":", mm->raw_latitude);
+        p = recordField(p, ",\"cpr_lon\":", mm->raw_longitude);
+    }
+    if (flags & MODES_ACFLAGS_AOG_VALID) {p = recordField(p, ",\"ground\":", (flags & MODES_ACFLAGS_AOG) ? 1 : 0);}
+    if (flags & MODES_ACFLAGS_FS_VALID)  {p = recordField(p, ",\"fs\":", mm->fs);}
+
+    *p++ = '}';
+    *p++ = '\n';
+    return (int) (p - buf);
+}
+//
+//=========================================================================
+//
+static unsigned char *recordPut(unsigned char *p, uint64_t v, int bytes) {
+    while (bytes--) {
+        *p++ = (unsigned char) v;
+        v >>= 8;
+    }
+    return (p);
+}
+//
+//=========================================================================
+//
+// Write mm as a binary record. buf must have room for MODES_RECORD_MAX
+// bytes. Returns the length.
+//
+static int modesBinaryRecord(struct modesMessage *mm, unsigned char *buf) {
+    unsigned char *p = buf + 2; // The length goes first, once we know it
+    int flags = mm->bFlags;
+    int len = mm->msgbits / 8;
+
+    p = recordPut(p, MODES_RECORD_VERSION, 1);
+    p = recordPut(p, mm->msgtype, 1);
+    p = recordPut(p, (uint32_t) flags, 4);
+    p = recordPut(p, mstime(), 8);
+    p = recordPut(p, mm->timestampMsg, 6);
+    p = recordPut(p, mm->signalLevel, 1);
+    p = recordPut(p, ((mm->crcok) ? 1 : 0) | ((mm->remote) ? 2 : 0), 1);
+    p = recordPut(p, mm->correctedbits, 1);
+    p = recordPut(p, mm->addr, 3);
+    p = recordPut(p, len, 1);
+    memcpy(p, mm->msg, len);
+    p += len;
+
+    if (flags & MODES_ACFLAGS_LATLON_VALID) {
+        p = recordPut(p, (uint32_t) (int32_t) floor(mm->fLat * 10000000.0 + 0.5), 4);
+        p = recordPut(p, (uint32_t) (int32_t) floor(mm->fLon * 10000000.0 + 0.5), 4);
+    }
+    if (flags & MODES_ACFLAGS_ALTITUDE_VALID) {
+        p = recordPut(p, (uint32_t) mm->altitude, 4);
+        p = recordPut(p, (mm->unit == MODES_UNIT_METERS) ? 1 : 0, 1);
+    }
+    if (flags & MODES_ACFLAGS_HEADING_VALID)  {p = recordPut(p, (uint16_t) mm->heading,   2);}
+    if (flags & MODES_ACFLAGS_SPEED_VALID)    {p = recordPut(p, (uint16_t) mm->velocity,  2);}
+    if (flags & MODES_ACFLAGS_VERTRATE_VALID) {p = recordPut(p, (uint16_t) mm->vert_rate, 2);}
+    if (flags & MODES_ACFLAGS_SQUAWK_VALID)   {p = recordPut(p, (uint16_t) mm->modeA,     2);}
+    if (flags & MODES_ACFLAGS_CALLSIGN_VALID) {
+        memcpy(p, mm->flight, 8);
+        p += 8;
+    }
+    if (flags & MODES_ACFLAGS_EWSPEED_VALID)  {p = recordPut(p, (uint16_t) mm->ew_velocity, 2);}
+    if (flags & MODES_ACFLAGS_NSSPEED_VALID)  {p = recordPut(p, (uint16_t) mm->ns_velocity, 2);}
+    if (flags & MODES_ACFLAGS_LLEITHER_VALID) {
+        p = recordPut(p, (uint32_t) mm->raw_latitude,  4);
+        p = recordPut(p, (uint32_t) mm->raw_longitude, 4);
+    }
+    if (flags & MODES_ACFLAGS_FS_VALID)       {p = recordPut(p, mm->fs, 1);}
+
+    recordPut(buf, (p - buf) - 2, 2);
+    return (int) (p - buf);
+}
+//
+//=========================================================================
+//
+// Write mm as a record in format (MODES_RECORD_JSON or MODES_RECORD_BINARY)
+// to buf, which must have room for MODES_RECORD_MAX bytes. Returns the length.
+//
+int modesRecord(struct modesMessage *mm, int format, char *buf) {
+    if (format == MODES_RECORD_BINARY) {
+        return (modesBinaryRecord(mm, (unsigned char *) buf));
+    }
+    return (modesJsonRecord(mm, buf));
+}
+//
+//=========================================================================
+//
+// The MODES_RECORD_xxx format called name, or 0 if there's no such format
+//
+int modesRecordFormat(const char *name) {
+    if (!strcmp(name, "json"))   return (MODES_RECORD_JSON);
+    if (!strcmp(name, "binary")) return (MODES_RECORD_BINARY);
+    return (0);
+}
+//
+//=========================================================================
+//
@@ -0,0 +1,227 @@
+// dump1090, a Mode S messages decoder for RTLSDR devices.
+//
+// Copyright (C) 2012 by Salvatore Sanfilippo <antirez@gmail.com>
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//  *  Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//  *  Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include "dump1090.h"
+//
+// ========================= Aircraft registry ==============================
+//
+// Modes.db is the registry (see planedb.c) that messages and aircraft are
+// looked up in. It's loaded from Modes.db_sources, merged into one table by
+// planedb_open(), so a lookup costs the same however many sources there
+// are. It can be replaced while dump1090 runs, so that a new copy of the
+// files is picked up without a restart: a reloader thread loads the new
+// files in the background, then swaps Modes.db over to them.
+//
+// Readers take a reference with registryGet() and drop it again with
+// registryRelease(). Modes.db_mutex is only held to swap the pointer and to
+// count references, so neither side waits for the other's work. The old
+// registry is freed by whoever drops the last reference to it, as with the
+// aircraft snapshots.
+//
+//=========================================================================
+//
+// Return the current registry, which stays valid until it's given to
+// registryRelease(). NULL if none is loaded.
+//
+PlaneDb *registryGet(void) {
+    PlaneDb *db;
+
+    pthread_mutex_lock(&Modes.db_mutex);
+    if ((db = Modes.db) != NULL) {db->refs++;}
+    pthread_mutex_unlock(&Modes.db_mutex);
+    return (db);
+}
+//
+//=========================================================================
+//
+void registryRelease(PlaneDb *db) {
+    int last;
+
+    if (db == NULL) {return;}
+
+    pthread_mutex_lock(&Modes.db_mutex);
+    last = (--db->refs == 0);
+    pthread_mutex_unlock(&Modes.db_mutex);
+
+    if (last) {planedb_close(db);}
+}
+//
+//=========================================================================
+//
+// Copy what the registry knows about aircraft a into it. This is done once,
+// when the aircraft is created, so the displays and network outputs never
+// have to search the registry themselves. The strings are copied, rather
+// than pointed to, so they outlive a reload and go along into snapshots.
+//
+void registryFillAircraft(struct aircraft *a) {
+    PlaneDb   *db = registryGet();
+    PlaneInfo *pi;
+    TypeInfo  *ti;
+
+    if (db == NULL) return;
+
+    if ((pi = planedb_lookup_id(db, (int) a->addr)) != NULL) {
+        snprintf(a->registration, sizeof(a->registration), "%s", planedb_string(db, pi->registration));
+        if ((ti = planedb_type(db, pi->model)) != NULL) {
+            snprintf(a->manufacturer, sizeof(a->manufacturer), "%s", planedb_string(db, ti->manufacturer));
+            snprintf(a->model,        sizeof(a->model),        "%s", planedb_string(db, ti->model));
+        }
+    }
+    registryRelease(db);
+}
+//
+//=========================================================================
+//
+// Make db the current registry. Readers still using the old one keep it
+// until they release it.
+//
+static void registryPublish(PlaneDb *db) {
+    PlaneDb *old;
+
+    db->refs = 1; // Held by Modes.db
+
+    pthread_mutex_lock(&Modes.db_mutex);
+    old = Modes.db;
+    Modes.db = db;
+    pthread_mutex_unlock(&Modes.db_mutex);
+
+    registryRelease(old);
+}
+//
+//=========================================================================
+//
+// The reloader thread. It sleeps until a reload is asked for, and loads the
+// files without holding any lock, so the decoder carries on meanwhile. If
+// loading fails the current registry is kept.
+//
+static void *registryReloaderEntryPoint(void *arg) {
+    PlaneDb *db;
+
+    modesUseContext((struct modes *) arg);
+
+    pthread_mutex_lock(&Modes.db_mutex);
+    while (1) {
+        while ((!Modes.db_reload) && (!Modes.db_stop)) {
+            pthread_cond_wait(&Modes.db_cond, &Modes.db_mutex);
+        }
+        if (Modes.db_stop) break;
+        Modes.db_reload = 0;
+        pthread_mutex_unlock(&Modes.db_mutex);
+
+        db = planedb_open(Modes.db_sources, Modes.db_nsources);
+        if (db) {
+            registryPublish(db);
+            Modes.stat_db_reloads++;
+        } else {
+            Modes.stat_db_reload_failures++;
+        }
+
+        pthread_mutex_lock(&Modes.db_mutex);
+    }
+    pthread_mutex_unlock(&Modes.db_mutex);
+    return (NULL);
+}
+//
+//=========================================================================
+//
+// Load the registry, and start the reloader thread
+//
+void registryInit(void) {
+    PlaneDb *db = planedb_open(Modes.db_sources, Modes.db_nsources);
+
+    Modes.db_mtime = planedb_sources_mtime(Modes.db_sources, Modes.db_nsources);
+    Modes.db_next_check = time(NULL) + Modes.db_check_interval;
+    if (db) {registryPublish(db);}
+
+    if (pthread_create(&Modes.db_thread, NULL, registryReloaderEntryPoint, modesContext) == 0) {
+        Modes.db_thread_running = 1;
+    }
+}
+//
+//=========================================================================
+//
+// Ask the reloader thread to load the files again. Requests made while it's
+// already loading are merged into a single reload afterwards.
+//
+void registryRequestReload(void) {
+    pthread_mutex_lock(&Modes.db_mutex);
+    Modes.db_reload = 1;
+    pthread_cond_signal(&Modes.db_cond);
+    pthread_mutex_unlock(&Modes.db_mutex);
+}
+//
+//=========================================================================
+//
+// Called from backgroundTasks(). Every Modes.db_check_interval seconds see
+// if the files have been replaced, and reload them if they have. A file
+// that is still being written will just be reloaded again when it changes
+// next.
+//
+void registryCheckFiles(void) {
+    time_t now, mtime;
+
+    if (Modes.db_check_interval <= 0) return;
+
+    now = time(NULL);
+    if (now < Modes.db_next_check) return;
+    Modes.db_next_check = now + Modes.db_check_interval;
+
+    mtime = planedb_sources_mtime(Modes.db_sources, Modes.db_nsources);
+    if ((mtime != 0) && (mtime != Modes.db_mtime)) {
+        Modes.db_mtime = mtime;
+        registryRequestReload();
+    }
+}
+//
+//=========================================================================
+//
+// Stop the reloader thread, and drop our reference to the registry
+//
+void registryExit(void) {
+    PlaneDb *db;
+
+    if (Modes.db_thread_running) {
+        pthread_mutex_lock(&Modes.db_mutex);
+        Modes.db_stop = 1;
+        pthread_cond_signal(&Modes.db_cond);
+        pthread_mutex_unlock(&Modes.db_mutex);
+        pthread_join(Modes.db_thread, NULL);
+        Modes.db_thread_running = 0;
+    }
+
+    pthread_mutex_lock(&Modes.db_mutex);
+    db = Modes.db;
+    Modes.db = NULL;
+    pthread_mutex_unlock(&Modes.db_mutex);
+    registryRelease(db);
+}
+//
+//=========================================================================
+//
@@ -0,0 +1,197 @@
+// dump1090, a Mode S messages decoder for RTLSDR devices.
+//
+// Copyright (C) 2012 by Salvatore Sanfilippo <antirez@gmail.com>
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//  *  Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//
+//  *  Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include "dump1090.h"
+//
+// ============================= Position trails ============================
+//
+// Each aircraft with a position keeps a trail of where it has been, for the
+// map to draw. A point is added at most every MODES_TRAIL_INTERVAL ms, when
+// interactiveReceiveData() decodes a new position.
+//
+// The points are stored as the difference from the one before, as varints:
+// the time in tenths of a second, the latitude and longitude in units of
+// 1e-5 degrees (about a metre) and the altitude in feet, the signed ones
+// zigzag encoded. An aircraft at cruise moves a few hundred units between
+// points, so a point takes 6 or 7 bytes rather than the 24 it would as
+// numbers. The oldest point is kept in absolute form in struct
+// aircraftTrail, and the newest too, so a point can be added without
+// decoding the rest.
+//
+// The buffer starts small, doubles as it fills, and once it has reached
+// MODES_TRAIL_BYTES the oldest quarter of it is dropped to make room. So an
+// aircraft never takes more than MODES_TRAIL_BYTES, and a few hundred of
+// them fit in a few MB.
+//
+#define TRAIL_INITIAL_BYTES  256
+#define TRAIL_MAX_POINT_BYTES 20        // Four varints of up to 5 bytes
+
+static int trailPutVarint(unsigned char *p, uint32_t v) {
+    int n = 0;
+
+    while (v >= 0x80) {
+        p[n++] = (unsigned char) (v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (unsigned char) v;
+    return (n);
+}
+
+static int trailGetVarint(const unsigned char *p, uint32_t *v) {
+    uint32_t val = 0;
+    int n = 0, shift = 0;
+
+    do {
+        val |= (uint32_t) (p[n] & 0x7F) << shift;
+        shift += 7;
+    } while (p[n++] & 0x80);
+    *v = val;
+    return (n);
+}
+
+static uint32_t trailZigzag(int32_t v)   {return ((uint32_t) v << 1) ^ (uint32_t) (v >> 31);}
+static int32_t  trailUnzigzag(uint32_t v) {return (int32_t) (v >> 1) ^ -(int32_t) (v & 1);}
+//
+//=========================================================================
+//
+// Decode the point at p, adding it to *pt. Returns its length in bytes.
+//
+static int trailDecodePoint(const unsigned char *p, struct trailPoint *pt) {
+    uint32_t v;
+    int n;
+
+    n  = trailGetVarint(p,     &v); pt->time += v;
+    n += trailGetVarint(p + n, &v); pt->lat  += trailUnzigzag(v);
+    n += trailGetVarint(p + n, &v); pt->lon  += trailUnzigzag(v);
+    n += trailGetVarint(p + n, &v); pt->alt  += trailUnzigzag(v);
+    return (n);
+}
+//
+//=========================================================================
+//
+// Make room for another point, growing the buffer or dropping the oldest
+// points. Returns 0, or -1 if there's no memory for it.
+//
+static int trailMakeRoom(struct aircraftTrail *t) {
+    if ((t->end + TRAIL_MAX_POINT_BYTES) <= t->size) {return (0);}
+
+    if (t->size < MODES_TRAIL_BYTES) {
+        int size = (t->size) ? (t->size * 2) : TRAIL_INITIAL_BYTES;
+        unsigned char *data;
+
+        if (size > MODES_TRAIL_BYTES) {size = MODES_TRAIL_BYTES;}
+        if ((data = (unsigned char *) realloc(t->data, size)) == NULL) {return (-1);}
+        t->data = data;
+        t->size = size;
+    } else {
+        // The oldest point moves on to the next one each time one is dropped
+        while ((t->start < (t->size / 4)) && (t->start < t->end)) {
+            t->start += trailDecodePoint(t->data + t->start, &t->first);
+            t->count--;
+        }
+    }
+
+    if (t->start) {
+        memmove(t->data, t->data + t->start, t->end - t->start);
+        t->end  -= t->start;
+        t->start = 0;
+    }
+    return (0);
+}
+//
+//=========================================================================
+//
+// Add the aircraft's current position to its trail. now is the wall clock
+// time in ms.
+//
+void trailAdd(struct aircraft *a, uint64_t now) {
+    struct aircraftTrail *t = a->trail;
+    struct trailPoint pt;
+    unsigned char *p;
+
+    pt.time = now / 100;
+    pt.lat  = (int32_t) floor(a->lat * 100000.0 + 0.5);
+    pt.lon  = (int32_t) floor(a->lon * 100000.0 + 0.5);
+    pt.alt  = a->altitude;
+
+    if (t == NULL) {
+        if ((t = (struct aircraftTrail *) calloc(1, sizeof(*t))) == NULL) {return;}
+        t->first = t->last = pt;
+        t->count = 1;
+        a->trail = t;
+        return;
+    }
+
+    if ((pt.time < t->last.time) // The clock went back
+     || (((pt.time - t->last.time) * 100) < MODES_TRAIL_INTERVAL)) {return;}
+    if (trailMakeRoom(t)) {return;}
+
+    p = t->data + t->end;
+    p += trailPutVarint(p, (uint32_t) (pt.time - t->last.time));
+    p += trailPutVarint(p, trailZigzag(pt.lat - t->last.lat));
+    p += trailPutVarint(p, trailZigzag(pt.lon - t->last.lon));
+    p += trailPutVarint(p, trailZigzag(pt.alt - t->last.alt));
+    t->end  = p - t->data;
+    t->last = pt;
+    t->count++;
+}
+//
+//=========================================================================
+//
+// Step through a trail, oldest point first. *pos should start at -1, and is
+// updated on each call. Returns 1 with the next point in *pt, or 0 once
+// there are no more. *pt must be left as it was between calls.
+//
+int trailNext(const struct aircraftTrail *t, int *pos, struct trailPoint *pt) {
+    if (t == NULL) {return (0);}
+
+    if (*pos < 0) {
+        *pt  = t->first;
+        *pos = t->start;
+        return (1);
+    }
+    if (*pos >= t->end) {return (0);}
+
+    *pos += trailDecodePoint(t->data + *pos, pt);
+    return (1);
+}
+//
+//=========================================================================
+//
+void trailFree(struct aircraft *a) {
+    if (a->trail) {
+        free(a->trail->data);
+        free(a->trail);
+        a->trail = NULL;
+    }
+}
+//
+//=========================================================================
+//
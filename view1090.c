@@ -48,15 +48,25 @@ int getTermRows() {
     return (w.ws_row); 
 } 
 
+// And the number of columns, or 0 if it isn't known
+int getTermCols() { 
+    struct winsize w; 
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &w) < 0) {return (0);}
+    return (w.ws_col); 
+} 
+
 // Handle resizing terminal
 void sigWinchCallback() {
     signal(SIGWINCH, SIG_IGN);
     Modes.interactive_rows = getTermRows();
-    interactiveShowData();
+    Modes.interactive_cols = getTermCols();
+    Modes.screen_repaint   = 1; // Redrawn from scratch at the next refresh, which is now
+    Modes.interactive_last_update = 0;
     signal(SIGWINCH, sigWinchCallback); 
 }
 #else 
 int getTermRows() { return MODES_INTERACTIVE_ROWS;}
+int getTermCols() { return 0;}
 #endif
 //
 // =============================== Initialization ===========================
@@ -70,7 +80,10 @@ void view1090InitConfig(void) {
     Modes.check_crc               = 1;
     strcpy(View1090.net_input_beast_ipaddr,VIEW1090_NET_OUTPUT_IP_ADDRESS); 
     Modes.net_input_beast_port    = MODES_NET_OUTPUT_BEAST_PORT;
+    Modes.bis                     = VIEW1090_BEAST_SERVICE; // So modesReadFromClient() parses Beast
+    View1090.dedup_window         = VIEW1090_DEDUP_WINDOW;
     Modes.interactive_rows        = getTermRows();
+    Modes.interactive_cols        = getTermCols();
     Modes.interactive_delete_ttl  = MODES_INTERACTIVE_DELETE_TTL;
     Modes.interactive_display_ttl = MODES_INTERACTIVE_DISPLAY_TTL;
     Modes.fUserLat                = MODES_USER_LATITUDE_DFLT;
@@ -85,6 +98,7 @@ void view1090Init(void) {
 
     pthread_mutex_init(&Modes.pDF_mutex,NULL);
     pthread_mutex_init(&Modes.data_mutex,NULL);
+    pthread_mutex_init(&Modes.snapshot_mutex,NULL);
     pthread_cond_init(&Modes.data_cond,NULL);
 
 #ifdef _WIN32
@@ -131,13 +145,50 @@ void view1090Init(void) {
     modesInitErrorInfo();
 }
 
-// Set up data connection
-int setupConnection(struct client *c) {
+//
+// ============================== Connection ================================
+//
+// Each source is connected to without blocking, so the display carries on
+// while connections are being made. If one fails or drops it's made again,
+// after a wait that doubles each time up to VIEW1090_RECONNECT_MAX, and goes
+// back to VIEW1090_RECONNECT_MIN once data arrives.
+//
+// Add a source given as [beast:|raw:]host[:port]
+static void view1090AddSource(char *spec) {
+    struct view1090Source *s;
+    char *colon;
+
+    if (View1090.nsources == VIEW1090_MAX_SOURCES) {
+        fprintf(stderr, "Too many sources, the most is %d\n", VIEW1090_MAX_SOURCES);
+        exit(1);
+    }
+    s = &View1090.sources[View1090.nsources++];
+    memset(s, 0, sizeof(*s));
+    s->port = MODES_NET_OUTPUT_BEAST_PORT;
+    if        (!strncmp(spec, "raw:", 4)) {
+        s->raw  = 1;
+        s->port = MODES_NET_OUTPUT_RAW_PORT;
+        spec += 4;
+    } else if (!strncmp(spec, "beast:", 6)) {
+        spec += 6;
+    }
+    snprintf(s->host, sizeof(s->host), "%s", spec);
+    if ((colon = strchr(s->host, ':')) != NULL) {
+        *colon  = '\0';
+        s->port = atoi(colon + 1);
+    }
+    if ((s->host[0] == '\0') || (s->port <= 0)) {
+        fprintf(stderr, "Bad source '%s'\n", spec);
+        exit(1);
+    }
+}
+
+// Start connecting to a source. Returns the socket, or ANET_ERR
+int setupConnection(struct view1090Source *s) {
+    struct client *c = s->c;
     int fd;
 
-    // Try to connect to the selected ip address and port. We only support *ONE* input connection which we initiate.here.
-    if ((fd = anetTcpConnect(Modes.aneterr, View1090.net_input_beast_ipaddr, Modes.net_input_beast_port)) != ANET_ERR) {
-		anetNonBlock(Modes.aneterr, fd);
+    if ((fd = anetTcpNonBlockConnect(Modes.aneterr, s->host, s->port)) != ANET_ERR) {
 		//
 		// Setup a service callback client structure for a beast binary input (from dump1090)
 		// This is a bit dodgy under Windows. The fd parameter is a handle to the internet
@@ -149,15 +200,242 @@ int setupConnection(struct client *c) {
 		// allocates a handle greater than 1024, then dump1090 won't like it. On my test machine, 
 		// the first Windows handle is usually in the 0x54 (84 decimal) region.
 
-		c->next    = NULL;
 		c->buflen  = 0;
-		c->fd      = 
-		c->service =
-		Modes.bis  = fd;
-		Modes.clients = c;
+		c->fd      = fd;
+		s->connecting = 1;
     }
     return fd;
 }
+
+// Drop a source's connection, if there is one, and schedule the next attempt
+static void view1090Reconnect(struct view1090Source *s, uint64_t now) {
+    if (s->c->fd >= 0) {modesCloseClient(s->c);}
+    s->connecting   = 0;
+    s->next_connect = now + s->backoff;
+    s->backoff     *= 2;
+    if (s->backoff > VIEW1090_RECONNECT_MAX) {s->backoff = VIEW1090_RECONNECT_MAX;}
+}
+//
+// ============================ De-duplication ==============================
+//
+// Several receivers in range of an aircraft all hear its replies, so the
+// same frame arrives from each of them, a little apart. Each frame is
+// remembered for View1090.dedup_window milliseconds, in a small hash table
+// keyed on its bytes, and is dropped if another source sends it meanwhile.
+// A receiver that sends the same frame twice has heard it twice (e.g. DF11
+// all-call replies, which don't change) so that isn't a duplicate.
+//
+// Returns 1 if msg is a duplicate, else remembers it and returns 0.
+static int view1090Duplicate(unsigned char *msg, int len) {
+    struct view1090Source *s = View1090.reading;
+    struct view1090Seen *e, *victim = NULL;
+    int source = (int) (s - View1090.sources);
+    uint64_t now = View1090.now;
+    uint64_t oldest = 0;
+    uint32_t h = 2166136261u;
+    int j;
+
+    s->frames++;
+    if (View1090.dedup_window <= 0) {return (0);}
+
+    for (j = 0; j < len; j++) {h = (h ^ msg[j]) * 16777619u;}
+
+    // Look in the slots the frame may be in, and make a note of the oldest
+    for (j = 0; j < VIEW1090_DEDUP_PROBE; j++) {
+        uint64_t age;
+
+        e   = &View1090.seen[(h + j) & (VIEW1090_DEDUP_SLOTS - 1)];
+        age = (e->time == 0) ? UINT64_MAX : ((now > e->time) ? (now - e->time) : 0);
+        if ((age <= (uint64_t) View1090.dedup_window) && (e->hash == h) &&
+            (e->len == len) && (!memcmp(e->msg, msg, len))) {
+            if (e->source != source) {
+                s->dups++;
+                return (1);
+            }
+            e->time = now;
+            return (0);
+        }
+        if ((victim == NULL) || (age > oldest)) {
+            victim = e;
+            oldest = age;
+        }
+    }
+    victim->time   = now;
+    victim->hash   = h;
+    victim->source = source;
+    victim->len    = len;
+    memcpy(victim->msg, msg, len);
+    return (0);
+}
+
+// Handler for Beast frames. p points after the 0x1a, as for decodeBinMessage()
+static int view1090BeastMessage(struct client *c, char *p) {
+    unsigned char msg[MODES_LONG_MSG_BYTES];
+    char *q = p;
+    int len = 0, j;
+    char ch = *q++;
+
+    if      (ch == '1') {len = MODEAC_MSG_BYTES;}
+    else if (ch == '2') {len = MODES_SHORT_MSG_BYTES;}
+    else if (ch == '3') {len = MODES_LONG_MSG_BYTES;}
+
+    if (len) {
+        for (j = 0; j < 7; j++) { // Skip the timestamp and signal level
+            ch = *q++;
+            if (0x1A == ch) {q++;}
+        }
+        for (j = 0; j < len; j++) {
+            msg[j] = ch = *q++;
+            if (0x1A == ch) {q++;}
+        }
+        if (view1090Duplicate(msg, len)) {return (0);}
+    }
+    return decodeBinMessage(c, p);
+}
+
+// Handler for AVR raw lines. Lines decodeHexMessage() wouldn't accept are
+// passed on to it anyway, to be thrown away there.
+static int view1090RawMessage(struct client *c, char *hex) {
+    unsigned char msg[MODES_LONG_MSG_BYTES];
+    char *p = hex;
+    int l, j, skip;
+
+    while (isspace((unsigned char) *p)) {p++;}
+    l = strlen(p);
+    while (l && isspace((unsigned char) p[l-1])) {l--;}
+    if ((l < 2) || (p[l-1] != ';')) {return decodeHexMessage(c, hex);}
+
+    switch (p[0]) {
+        case '<':           skip = 15; break; // <, timestamp and signal level
+        case '@': case '%': skip = 13; break; // @ or %, and timestamp
+        case '*': case ':': skip = 1;  break;
+        default:            return decodeHexMessage(c, hex);
+    }
+    p += skip;
+    l -= skip + 1;
+    if ((l != (MODEAC_MSG_BYTES * 2)) && (l != (MODES_SHORT_MSG_BYTES * 2)) && (l != (MODES_LONG_MSG_BYTES * 2)))
+        {return decodeHexMessage(c, hex);}
+
+    for (j = 0; j < l; j += 2) {
+        int high = hexDigitVal(p[j]);
+        int low  = hexDigitVal(p[j+1]);
+
+        if ((high == -1) || (low == -1)) {return decodeHexMessage(c, hex);}
+        msg[j/2] = (high << 4) | low;
+    }
+    if (view1090Duplicate(msg, l / 2)) {return (0);}
+    return decodeHexMessage(c, hex);
+}
+//
+// =============================== Event loop ===============================
+//
+// Wait until there's data from a source, or it's time to refresh the
+// display or to connect again, and deal with whatever woke us. Messages are
+// decoded as soon as they arrive, so the tracker never lags the feeds.
+//
+static void view1090Poll(void) {
+    uint64_t now = mstime();
+    struct timeval tv;
+    fd_set rfds, wfds;
+    int wait, maxfd = -1, j;
+
+    wait = MODES_INTERACTIVE_REFRESH_TIME - (int) (now - Modes.interactive_last_update);
+    FD_ZERO(&rfds);
+    FD_ZERO(&wfds);
+    for (j = 0; j < View1090.nsources; j++) {
+        struct view1090Source *s = &View1090.sources[j];
+
+        if ((s->c->fd < 0) && (now >= s->next_connect)) {
+            if (setupConnection(s) == ANET_ERR) {view1090Reconnect(s, now);}
+        }
+        if (s->c->fd < 0) {
+            int until = (s->next_connect > now) ? (int) (s->next_connect - now) : 0;
+            if (until < wait) {wait = until;}
+        } else {
+            FD_SET(s->c->fd, (s->connecting) ? &wfds : &rfds);
+            if (s->c->fd > maxfd) {maxfd = s->c->fd;}
+        }
+    }
+    if (wait < 0) {wait = 0;}
+
+    if (maxfd < 0) { // Nothing to wait for (and Windows' select() needs a socket)
+        usleep(wait * 1000);
+        return;
+    }
+
+    tv.tv_sec  = wait / 1000;
+    tv.tv_usec = (wait % 1000) * 1000;
+    if (select(maxfd + 1, &rfds, &wfds, NULL, &tv) <= 0) {return;} // Timed out, or a signal
+
+    now = View1090.now = mstime();
+    for (j = 0; j < View1090.nsources; j++) {
+        struct view1090Source *s = &View1090.sources[j];
+        struct client *c = s->c;
+
+        if (c->fd < 0) continue;
+
+        if (s->connecting) {
+            int err = 0;
+            socklen_t len = sizeof(err);
+
+            if (!FD_ISSET(c->fd, &wfds)) continue;
+            if ((getsockopt(c->fd, SOL_SOCKET, SO_ERROR, (char *) &err, &len) < 0) || (err)) {
+                view1090Reconnect(s, now);
+            } else {
+                s->connecting = 0;
+            }
+        } else if (FD_ISSET(c->fd, &rfds)) {
+            View1090.reading = s;
+            if (s->raw) {
+                modesReadFromClient(c, "\n", view1090RawMessage);
+            } else {
+                modesReadFromClient(c, "", view1090BeastMessage);
+            }
+            if (c->fd < 0) {
+                view1090Reconnect(s, now); // The source went away
+            } else {
+                s->backoff = VIEW1090_RECONNECT_MIN;
+            }
+        }
+    }
+}
+//
+//=========================================================================
+//
+// Below the aircraft table, a line for each source: whether it's connected,
+// the frames per second it sends, and the share of those another source
+// had already sent. Only shown if there's more than one source, called by
+// interactiveShowData() to add them to the screen.
+//
+static void view1090ShowSources(void) {
+    uint64_t now = mstime();
+    uint64_t elapsed = now - View1090.rate_time;
+    int j;
+
+    if (elapsed >= 1000) {
+        for (j = 0; j < View1090.nsources; j++) {
+            struct view1090Source *s = &View1090.sources[j];
+            uint64_t frames = s->frames - s->last_frames;
+
+            s->rate        = (frames * 1000.0) / elapsed;
+            s->dup_ratio   = (frames) ? ((double) (s->dups - s->last_dups) / frames) : 0.0;
+            s->last_frames = s->frames;
+            s->last_dups   = s->dups;
+        }
+        View1090.rate_time = now;
+    }
+
+    interactivePrintf("");
+    interactivePrintf("Source                            State       Msg/s   Dup%%");
+    for (j = 0; j < View1090.nsources; j++) {
+        struct view1090Source *s = &View1090.sources[j];
+        char name[80];
+        char *state = (s->c->fd < 0) ? "down" : (s->connecting) ? "connecting" : "up";
+
+        snprintf(name, sizeof(name), "%s%s:%d", (s->raw) ? "raw:" : "", s->host, s->port);
+        interactivePrintf("%-33.33s %-10s %7.0f  %5.1f", name, state, s->rate, s->dup_ratio * 100.0);
+    }
+}
 //
 // ================================ Main ====================================
 //
@@ -173,6 +451,10 @@ void showHelp(void) {
   "--modeac                 Enable decoding of SSR modes 3/A & 3/C\n"
   "--net-bo-ipaddr <IPv4>   TCP Beast output listen IPv4 (default: 127.0.0.1)\n"
   "--net-bo-port <port>     TCP Beast output listen port (default: 30005)\n"
+  "--source <[raw:]host[:port]> Take frames from this receiver (Beast, or AVR raw\n"
+  "                         with raw:). Repeat for more, instead of --net-bo-*\n"
+  "--dedup-window <ms>      Drop frames another source sent this recently\n"
+  "                         (default: 500; 0 to keep them)\n"
   "--lat <latitude>         Reference/receiver latitide for surface posn (opt)\n"
   "--lon <longitude>        Reference/receiver longitude for surface posn (opt)\n"
   "--no-crc-check           Disable messages with broken CRC (discouraged)\n"
@@ -222,9 +504,8 @@ void showCopyright(void) {
 //=========================================================================
 //
 int main(int argc, char **argv) {
-    int j, fd;
-    struct client *c;
-    char pk_buf[8];
+    uint64_t now;
+    int j;
 
     // Set sane defaults
 
@@ -239,6 +520,10 @@ int main(int argc, char **argv) {
             Modes.net_input_beast_port = atoi(argv[++j]);
         } else if (!strcmp(argv[j],"--net-bo-ipaddr") && more) {
             strcpy(View1090.net_input_beast_ipaddr, argv[++j]);
+        } else if (!strcmp(argv[j],"--source") && more) {
+            view1090AddSource(argv[++j]);
+        } else if (!strcmp(argv[j],"--dedup-window") && more) {
+            View1090.dedup_window = atoi(argv[++j]);
         } else if (!strcmp(argv[j],"--modeac")) {
             Modes.mode_ac = 1;
         } else if (!strcmp(argv[j],"--interactive-rows") && more) {
@@ -277,7 +562,6 @@ int main(int argc, char **argv) {
 #ifdef _WIN32
     // Try to comply with the Copyright license conditions for binary distribution
     if (!Modes.quiet) {showCopyright();}
-#define MSG_DONTWAIT 0
 #endif
 
 #ifndef _WIN32
@@ -288,31 +572,56 @@ int main(int argc, char **argv) {
     // Initialization
     view1090Init();
 
-    // Try to connect to the selected ip address and port. We only support *ONE* input connection which we initiate.here.
-    c = (struct client *) malloc(sizeof(*c));
-    if ((fd = setupConnection(c)) == ANET_ERR) {
-        fprintf(stderr, "Failed to connect to %s:%d\n", View1090.net_input_beast_ipaddr, Modes.net_input_beast_port);
-        exit(1);
+    // Without --source, the one source is --net-bo-ipaddr and --net-bo-port
+    if (View1090.nsources == 0) {
+        struct view1090Source *s = &View1090.sources[View1090.nsources++];
+        snprintf(s->host, sizeof(s->host), "%s", View1090.net_input_beast_ipaddr);
+        s->port = Modes.net_input_beast_port;
+    }
+
+    // Try to connect to the sources. One that fails, even straight away (say
+    // its name doesn't resolve), is retried with backoff like one that drops
+    // later, so it can't stop the others being shown.
+    now = mstime();
+    for (j = 0; j < View1090.nsources; j++) {
+        struct view1090Source *s = &View1090.sources[j];
+
+        s->c       = modesCreateClient(-1, (s->raw) ? VIEW1090_RAW_SERVICE : VIEW1090_BEAST_SERVICE,
+                                       VIEW1090_NET_BUF_SIZE);
+        s->backoff = VIEW1090_RECONNECT_MIN;
+        if (setupConnection(s) == ANET_ERR) {
+            fprintf(stderr, "Failed to connect to %s:%d, will keep trying\n", s->host, s->port);
+            view1090Reconnect(s, now);
+        }
+    }
+    View1090.rate_time = now;
+
+    // The sources are listed below the aircraft, as part of each screen
+    if (View1090.nsources > 1) {
+        Modes.interactive_footer      = view1090ShowSources;
+        Modes.interactive_footer_rows = View1090.nsources + 2;
     }
 
     // Keep going till the user does something that stops us
     while (!Modes.exit) {
+        view1090Poll();
         interactiveRemoveStaleAircrafts();
+        interactivePublishSnapshot();
         interactiveShowData();
-        if ((fd == ANET_ERR) || (recv(c->fd, pk_buf, sizeof(pk_buf), MSG_PEEK | MSG_DONTWAIT) == 0)) {
-			free(c);
-			usleep(1000000);
-			c = (struct client *) malloc(sizeof(*c));
-			fd = setupConnection(c);
-			continue;
-        }
-        modesReadFromClient(c,"",decodeBinMessage);
-		usleep(100000);
     }
 
     // The user has stopped us, so close any socket we opened
-    if (fd != ANET_ERR) 
-      {close(fd);}
+    for (j = 0; j < View1090.nsources; j++) {
+        struct view1090Source *s = &View1090.sources[j];
+
+        if (View1090.nsources > 1) {
+            printf("%s%s:%d: %llu frames, %llu duplicates\n", (s->raw) ? "raw:" : "", s->host, s->port,
+                   (unsigned long long) s->frames, (unsigned long long) s->dups);
+        }
+        if (s->c->fd >= 0) 
+          {close(s->c->fd);}
+        free(s->c);
+    }
 
     return (0);
 }
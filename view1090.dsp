@@ -94,10 +94,26 @@ SOURCE=.\anet.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\archive.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\checkpoint.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\filter.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\interactive.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\libmodes.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\mode_ac.c
 # End Source File
 # Begin Source File
@@ -110,6 +126,26 @@ SOURCE=.\net_io.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\output.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\planedb.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\record.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\registry.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\trail.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\view1090.c
 # End Source File
 # End Group
@@ -118,10 +154,18 @@ SOURCE=.\view1090.c
 # PROP Default_Filter "h;hpp;hxx;hm;inl"
 # Begin Source File
 
+SOURCE=.\archive.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\dump1090.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\libmodes.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\view1090.h
 # End Source File
 # Begin Source File
@@ -60,15 +60,59 @@
 // ============================= #defines ===============================
 
 #define VIEW1090_NET_OUTPUT_IP_ADDRESS "127.0.0.1"
+#define VIEW1090_NET_BUF_SIZE     (256*1024) // Read buffer for each source
+#define VIEW1090_RECONNECT_MIN    500        // Milliseconds before trying to connect again
+#define VIEW1090_RECONNECT_MAX    30000      // Longest wait between attempts
+#define VIEW1090_MAX_SOURCES      32
+#define VIEW1090_BEAST_SERVICE    -2         // client->service of Beast sources
+#define VIEW1090_RAW_SERVICE      -3         // client->service of AVR raw sources
+#define VIEW1090_DEDUP_WINDOW     500        // Milliseconds a frame is remembered, for de-duplication
+#define VIEW1090_DEDUP_SLOTS      65536      // Frames remembered, a power of 2
+#define VIEW1090_DEDUP_PROBE      16         // Slots a frame may be in
 
 #define NOTUSED(V) ((void) V)
 
 // ======================== structure declarations ========================
 
+// A receiver we take frames from
+struct view1090Source {
+    char           host[64];
+    int            port;
+    int            raw;          // Sends AVR raw hex rather than Beast binary
+    struct client *c;            // The connection, fd -1 if there isn't one
+    int            connecting;   // A connect is in progress on c->fd
+    int            backoff;      // Milliseconds to wait before the next attempt
+    uint64_t       next_connect; // When to make it
+    uint64_t       frames;       // Frames received
+    uint64_t       dups;         // ... that another source had already sent
+    uint64_t       last_frames;  // frames and dups when the rate was last worked out
+    uint64_t       last_dups;
+    double         rate;         // Frames per second
+    double         dup_ratio;    // Share of them that were duplicates
+};
+
+// A frame received recently
+struct view1090Seen {
+    uint64_t      time;          // When, 0 for an empty slot
+    uint32_t      hash;
+    int           source;        // Which source sent it
+    int           len;
+    unsigned char msg[MODES_LONG_MSG_BYTES];
+};
+
 // Program global state
 struct {                           // Internal state
     // Networking
     char    net_input_beast_ipaddr[32]; // IPv4 address or network name of server/RPi
+    struct view1090Source  sources[VIEW1090_MAX_SOURCES];
+    int                    nsources;
+    struct view1090Source *reading;     // The source whose data is being decoded
+    uint64_t               now;         // When it was read
+
+    // De-duplication of frames heard by several receivers
+    int                    dedup_window; // Milliseconds, 0 to not de-duplicate
+    struct view1090Seen    seen[VIEW1090_DEDUP_SLOTS];
+    uint64_t               rate_time;   // When the source rates were last worked out
 } View1090;
 
 // ======================== function declarations =========================